@@ -698,6 +698,39 @@ CMesh3d::element_at_point(const tCoords& c)
   return NULL;
 }
 
+const CMesh3d::tElement*
+CMesh3d::element_at_point(const tCoords& c, ElementHint& hint) const
+{
+  if ( const ElementProxy* cep = m_poctree->element_at_point(c, hint) )
+    return cep->elt();
+  return NULL;
+}
+
+// same logic as TMesh::dir_img
+CMesh3d::tCoords
+CMesh3d::dir_img(const tCoords& c, ElementHint& hint) const
+{
+  tCoords img;
+  const tElement* pelt = this->element_at_point(c, hint);
+
+  if ( !pelt )
+    img.status() = cOutOfBounds;
+  else if ( pelt->orientation_pb() )
+    img.invalidate();
+  else
+    img = pelt->dir_img(c);
+
+  return img;
+}
+
+void
+CMesh3d::prepare_dir_img() const
+{
+  // all the elements are created by the Constructor, hence Element3d
+  for (unsigned int ui=0, noItems = this->get_no_elts(); ui < noItems; ++ui)
+    static_cast<const Element3d*>( this->get_elt(ui) )->prepare_dir_img();
+}
+
 
 
 const CMesh3d::tNode*
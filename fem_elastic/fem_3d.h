@@ -46,6 +46,13 @@ public:
   // this next function will update coeffs for the shape function
   void  update_coefs() const;
 
+  // computes the (otherwise lazily computed) interpolation coeffs,
+  // after which dir_img does not modify the element anymore
+  void  prepare_dir_img() const
+  {
+    if ( !m_isInterpolUpdated ) update_interpol_coefs();
+  }
+
   virtual void print(std::ostream& os) const;
 
   virtual double shape_fct(int node_id, const tCoords& pt) const;
@@ -169,6 +176,16 @@ public:
   tNode* closest_node(const tCoords& c);
   tElement* element_at_point(const tCoords& c);
 
+  // lookups that start from the element found by the previous call
+  //
+  //      the hint is owned by the caller - use one per thread
+  typedef const ElementProxy* ElementHint;
+  const tElement* element_at_point(const tCoords& c, ElementHint& hint) const;
+  tCoords dir_img(const tCoords& c, ElementHint& hint) const;
+
+  // dir_img is only safe to call concurrently after this
+  void prepare_dir_img() const;
+
   // this function's implementation actually uses an octree
   //
   //      since this is a virtual function, the argument will
@@ -1,5 +1,7 @@
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include <itkLinearInterpolateImageFunction.h>
 #include <itkVectorLinearInterpolateImageFunction.h>
@@ -559,6 +561,32 @@ FemTransform3d::doOwnImg(const tCoords& pt) const
 
 }
 
+FemTransform3d::tCoords
+FemTransform3d::doOwnCursorImg(const tCoords& pt,
+                               TransformCursor& cursor) const
+{
+  const CMesh3d* pmesh = dynamic_cast<const CMesh3d*>(&*m_sharedMesh);
+  if ( !pmesh )
+    return this->doOwnImg(pt);
+
+  const void*& slot = cursor.hint(this);
+  CMesh3d::ElementHint hint = static_cast<CMesh3d::ElementHint>(slot);
+  tCoords img = pmesh->dir_img(pt, hint);
+  slot = hint;
+
+  return img;
+}
+
+void
+FemTransform3d::doOwnPrepareConcurrentImg() const
+{
+  if (!m_sharedMesh)
+    throw std::logic_error("FemTransform3d prepare -> NULL mesh");
+
+  if ( const CMesh3d* pmesh = dynamic_cast<const CMesh3d*>(&*m_sharedMesh) )
+    pmesh->prepare_dir_img();
+}
+
 void
 FemTransform3d::doInput(std::istream& is)
 {
@@ -770,106 +798,126 @@ VolumeMorph::apply_transforms(MRI* input,
                                  MRI_FLOAT, 4 ); // 4 frames - one for each direction + 1 to indicate a valid voxel
   }
 
+  // both matrices are affine - keep the 3x4 part for the per-voxel products
+  double mt[3][4], ms[3][4];
+  for (int r=0; r<3; ++r)
+    for (int c=0; c<4; ++c)
+    {
+      mt[r][c] = *MATRIX_RELT(mat_template, r+1, c+1);
+      ms[r][c] = *MATRIX_RELT(mat_subject, r+1, c+1);
+    }
+  MatrixFree(&mat_template);
+  MatrixFree(&mat_subject);
+
   try
   {
     unsigned int voxInvalid(0), voxValid(0);
-    tCoords pt, img;
-    TransformContainerType::const_iterator cit;
-    double val;
-    float valvect[nframes];
-    
+
     if ( cacheField )
       for (int z=0; z<mriOut->depth; ++z)
         for (int y=0; y<mriOut->height; ++y)
           for (int x=0; x<mriOut->width; ++x)
             MRIsetVoxVal(mriCache, x,y,z, 3, 0);
 
-    VECTOR *vFixed, *vMoving, *vTmp;
-    vFixed  = VectorAlloc(4, MATRIX_REAL);
-    VECTOR_ELT(vFixed, 4) = 1.0;
-    vMoving = VectorAlloc(4, MATRIX_REAL);
-    VECTOR_ELT(vMoving,4) = 1.0;
-    vTmp    = VectorAlloc(4, MATRIX_REAL);
-    VECTOR_ELT(vTmp,4) = 1.0;
+    // lazily computed element coefficients must exist before going parallel
+    for ( TransformContainerType::const_iterator cit = m_transforms.begin();
+          cit != m_transforms.end(); ++cit )
+      (*cit)->prepareConcurrentImg();
 
-    for (int z=0; z<mriOut->depth; ++z)
+    // the output is walked by blocks, the voxels of a block in Morton order,
+    // so that consecutive queries mostly hit the element found last
+    const int blockSize = 8;
+    int mortonOffset[blockSize*blockSize*blockSize][3];
+    for (int m=0; m<blockSize*blockSize*blockSize; ++m)
     {
-      if ( !(z%10) ) std::cout << " z = " << z << std::endl;
-      for (int y=0; y<mriOut->height; ++y)
-        for (int x=0; x<mriOut->width; ++x)
-        {
-          //std::cout << " in the FOR loop " << std::endl;
-          //-------------------------
-          // do RAS conversion
-          VECTOR_ELT(vTmp, 1) = x;
-          VECTOR_ELT(vTmp, 2) = y;
-          VECTOR_ELT(vTmp, 3) = z;
-
-          vFixed = MatrixMultiply( mat_template, vTmp, vFixed );
-          //std::cout << " vFixed computed " << std::endl;
-
-          pt.validate();
-          pt(0) = V3_X( vFixed );
-          pt(1) = V3_Y( vFixed );
-          pt(2) = V3_Z( vFixed );
-          //-------------------------
+      mortonOffset[m][0] = mortonOffset[m][1] = mortonOffset[m][2] = 0;
+      for (int bit=0; (1<<bit) < blockSize; ++bit)
+        for (int dir=0; dir<3; ++dir)
+          if ( m & (1<<(3*bit+dir)) )
+            mortonOffset[m][dir] |= (1<<bit);
+    }
 
-          img = this->image(pt);
-          //std::cout << " img computed " << std::endl;
+    const int nbx = (mriOut->width  + blockSize - 1) / blockSize;
+    const int nby = (mriOut->height + blockSize - 1) / blockSize;
+    const int nbz = (mriOut->depth  + blockSize - 1) / blockSize;
+    const int nblocks = nbx * nby * nbz;
+    std::cout << " applying morph - blocks = " << nblocks << std::endl;
 
-          if ( !img.isValid() )
-          {
-            if (img.status()==cInvalid)
-              ++voxInvalid;
-            continue;
-          }
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic) reduction(+ : voxInvalid, voxValid)
+#endif
+    for (int block=0; block<nblocks; ++block)
+    {
+      const int x0 = (block % nbx) * blockSize;
+      const int y0 = ((block / nbx) % nby) * blockSize;
+      const int z0 = (block / (nbx*nby)) * blockSize;
 
-          //--------------------------
-          // convert RAS on the
-          //     moving side
-          //
+      TransformCursor cursor;
+      tCoords pt, img;
+      double val;
+      std::vector<float> valvect(nframes);
 
-          V3_X(vTmp) = img(0);
-          V3_Y(vTmp) = img(1);
-          V3_Z(vTmp) = img(2);
+      for (int m=0; m<blockSize*blockSize*blockSize; ++m)
+      {
+        const int x = x0 + mortonOffset[m][0];
+        const int y = y0 + mortonOffset[m][1];
+        const int z = z0 + mortonOffset[m][2];
+        if ( x >= mriOut->width || y >= mriOut->height || z >= mriOut->depth )
+          continue;
 
-          vMoving = MatrixMultiply( mat_subject, vTmp, vMoving );
-          //std::cout << " vMoving computed " << std::endl;
+        //-------------------------
+        // do RAS conversion
+        pt.validate();
+        for (int r=0; r<3; ++r)
+          pt(r) = mt[r][0]*x + mt[r][1]*y + mt[r][2]*z + mt[r][3];
+        //-------------------------
 
-          img(0) = V3_X( vMoving);
-          img(1) = V3_Y( vMoving);
-          img(2) = V3_Z( vMoving);
-          //std::cout << " img assigned " << img(0) <<"," << img(1) <<"," <<img(2) << std::endl;
+        img = this->image(pt, cursor);
 
-          //--------------------------
-          // do nothing if out of bounds
-          if ( img(0)<0 || img(0)>input->width-1 ||
-               img(1)<0 || img(1)>input->height-1 ||
-               img(2)<0 || img(2)>input->depth-1 ) continue;
+        if ( !img.isValid() )
+        {
+          if (img.status()==cInvalid)
+            ++voxInvalid;
+          continue;
+        }
 
-          ++voxValid;
-	  if (nframes == 1)
-	    {
-	      MRIsampleVolumeType( input, img(0), img(1), img(2), &val, m_interpolationType);
-	      MRIsetVoxVal( mriOut, x,y,z, 0, val);
-	    }
-	  else
-	    {
-	      MRIsampleSeqVolumeType(  input, img(0), img(1), img(2), valvect, 0, nframes-1, m_interpolationType);
-	      for (int ii = 0; ii < nframes; ii++)
-		MRIsetVoxVal( mriOut, x,y,z,ii, valvect[ii]);
-	    }
+        //--------------------------
+        // convert RAS on the
+        //     moving side
+        //
+        tCoords bufImg(img);
+        for (int r=0; r<3; ++r)
+          img(r) = ms[r][0]*bufImg(0) + ms[r][1]*bufImg(1) + ms[r][2]*bufImg(2) + ms[r][3];
+
+        //--------------------------
+        // do nothing if out of bounds
+        if ( img(0)<0 || img(0)>input->width-1 ||
+             img(1)<0 || img(1)>input->height-1 ||
+             img(2)<0 || img(2)>input->depth-1 ) continue;
+
+        ++voxValid;
+        if (nframes == 1)
+        {
+          MRIsampleVolumeType( input, img(0), img(1), img(2), &val, m_interpolationType);
+          MRIsetVoxVal( mriOut, x,y,z, 0, val);
+        }
+        else
+        {
+          MRIsampleSeqVolumeType( input, img(0), img(1), img(2), &valvect[0], 0, nframes-1, m_interpolationType);
+          for (int ii = 0; ii < nframes; ii++)
+            MRIsetVoxVal( mriOut, x,y,z,ii, valvect[ii]);
+        }
 
-          if ( cacheField )
-          {
-            tCoords bufPt(img);
-            bufPt -= pt;
-            for ( unsigned int dir=0; dir<3; ++dir)
-              MRIsetVoxVal( mriCache, x,y,z, dir, bufPt(dir) );
-            MRIsetVoxVal( mriCache, x,y,z, 3, 1);
-          }
-        } // next x,y,z
-    }
+        if ( cacheField )
+        {
+          tCoords bufPt(img);
+          bufPt -= pt;
+          for ( unsigned int dir=0; dir<3; ++dir)
+            MRIsetVoxVal( mriCache, x,y,z, dir, bufPt(dir) );
+          MRIsetVoxVal( mriCache, x,y,z, 3, 1);
+        }
+      } // next m
+    } // next block
     std::cout << " Invalid voxels = " << voxInvalid << std::endl
     << " Valid = " << voxValid << std::endl;
   }
@@ -1088,17 +1136,68 @@ VolumeMorph::apply_transforms(MRIS* input) const
     // so make sure they are recomputed before being used again!
 
   int const nvertices = input->nvertices;
-  for (int ui = 0; ui < nvertices; ++ui) 
+  if ( !nvertices ) return mris;
+
+  for ( TransformContainerType::const_iterator cit = m_transforms.begin();
+        cit != m_transforms.end(); ++cit )
+    (*cit)->prepareConcurrentImg();
+
+  // visit the vertices in Morton order of their (quantized) position,
+  // so that neighbouring queries share the transform cursor state
+  float xmin(input->vertices[0].x), ymin(input->vertices[0].y), zmin(input->vertices[0].z);
+  float xmax(xmin), ymax(ymin), zmax(zmin);
+  for (int ui = 1; ui < nvertices; ++ui)
   {
-    VERTEX* pvtxIn = &input->vertices[ui];
+    const VERTEX* pvtx = &input->vertices[ui];
+    xmin = std::min(xmin, pvtx->x); xmax = std::max(xmax, pvtx->x);
+    ymin = std::min(ymin, pvtx->y); ymax = std::max(ymax, pvtx->y);
+    zmin = std::min(zmin, pvtx->z); zmax = std::max(zmax, pvtx->z);
+  }
+  const double dscale = 1023.0 / std::max( 1.0e-6f, std::max( xmax-xmin, std::max(ymax-ymin, zmax-zmin) ) );
+
+  std::vector<std::pair<unsigned int, int> > order(nvertices);
+  for (int ui = 0; ui < nvertices; ++ui)
+  {
+    const VERTEX* pvtx = &input->vertices[ui];
+    unsigned int q[3] = { (unsigned int)( (pvtx->x - xmin) * dscale ),
+                          (unsigned int)( (pvtx->y - ymin) * dscale ),
+                          (unsigned int)( (pvtx->z - zmin) * dscale ) };
+    unsigned int code = 0;
+    for (int bit=0; bit<10; ++bit)
+      for (int dir=0; dir<3; ++dir)
+        code |= ( (q[dir] >> bit) & 1u ) << (3*bit+dir);
+    order[ui] = std::make_pair(code, ui);
+  }
+  std::sort( order.begin(), order.end() );
 
-    tDblCoords pt;
-    pt.validate();
-    pt(0) = pvtxIn->x;
-    pt(1) = pvtxIn->y;
-    pt(2) = pvtxIn->z;
+  std::vector<tDblCoords> images(nvertices);
+  const int chunkSize = 1024;
+  const int nchunks = (nvertices + chunkSize - 1) / chunkSize;
 
-    pt = image( pt );
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int chunk = 0; chunk < nchunks; ++chunk)
+  {
+    TransformCursor cursor;
+    for (int k = chunk*chunkSize; k < std::min(nvertices, (chunk+1)*chunkSize); ++k)
+    {
+      const int ui = order[k].second;
+      VERTEX* pvtxIn = &input->vertices[ui];
+
+      tDblCoords pt;
+      pt.validate();
+      pt(0) = pvtxIn->x;
+      pt(1) = pvtxIn->y;
+      pt(2) = pvtxIn->z;
+
+      images[ui] = image( pt, cursor );
+    }
+  }
+
+  for (int ui = 0; ui < nvertices; ++ui)
+  {
+    const tDblCoords& pt = images[ui];
     if ( !pt.isValid() ) continue; // better leave it as it was if it's not working
 
     MRISsetXYZ(mris, ui, pt(0), pt(1), pt(2));
@@ -1126,6 +1225,22 @@ VolumeMorph::image(const tCoords& _pt) const
 
 }
 
+tDblCoords
+VolumeMorph::image(const tCoords& _pt, TransformCursor& cursor) const
+{
+  TransformContainerType::const_iterator cit;
+  tCoords pt(_pt), ret;
+
+  for ( cit = m_transforms.begin();
+        cit != m_transforms.end(); ++cit)
+  {
+    ret = (*cit)->img(pt, cursor);
+    if (!ret.isValid()) break;
+    pt = ret;
+  }
+  return ret;
+}
+
 #if 0
 void
 VolumeMorph::save(const char* fname)
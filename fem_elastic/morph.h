@@ -20,6 +20,8 @@ polymorphic way.
 #include <fstream>
 #include <iostream>
 #include <list>
+#include <utility>
+#include <vector>
 
 // ITK
 #include <itkImage.h>
@@ -57,6 +59,33 @@ namespace gmp
 
 template<int n> class Transform;
 
+/*
+
+Lookup state carried across consecutive calls to Transform::img
+by the batched morph application.
+
+Each thread uses its own cursor, so that the transforms themselves
+stay read-only. Every transform of a chain owns one slot.
+
+*/
+class TransformCursor
+{
+public:
+  const void*& hint(const void* owner)
+  {
+    // chains are short, linear search is fine
+    for ( SlotContainer::iterator it = m_slots.begin();
+          it != m_slots.end(); ++it )
+      if ( it->first == owner ) return it->second;
+
+    m_slots.push_back( std::make_pair(owner, (const void*)NULL) );
+    return m_slots.back().second;
+  }
+private:
+  typedef std::vector<std::pair<const void*, const void*> > SlotContainer;
+  SlotContainer m_slots;
+};
+
 std::shared_ptr<Transform<3> > loadTransform(std::istream& is, unsigned int zlibBufferMultiplier=5);
 void saveTransform(std::ostream& os, std::shared_ptr<Transform<3> > ptransform);
 
@@ -88,6 +117,24 @@ public:
 
     return this->doOwnImg(ptBuf);
   }
+
+  // same as above, with the lookup state kept in the cursor
+  tCoords img(const tCoords& pt, TransformCursor& cursor) const
+  {
+    tCoords ptBuf = m_pInitial ? m_pInitial->img(pt, cursor) : pt;
+    if ( !ptBuf.isValid() ) return ptBuf;
+
+    return this->doOwnCursorImg(ptBuf, cursor);
+  }
+
+  // makes the lazily computed state explicit,
+  // after which img may be called from several threads
+  void prepareConcurrentImg() const
+  {
+    if ( m_pInitial ) m_pInitial->prepareConcurrentImg();
+    this->doOwnPrepareConcurrentImg();
+  }
+
   virtual void invert() = 0;
 
   void performInit()
@@ -134,6 +181,13 @@ protected:
   virtual void doInput(std::istream& is)=0;
   virtual void doOutput(std::ostream& os) const=0;
   virtual tCoords doOwnImg(const tCoords& pt) const=0;
+  virtual tCoords doOwnCursorImg(const tCoords& pt,
+                                 TransformCursor& cursor) const
+  {
+    return this->doOwnImg(pt);
+  }
+  virtual void doOwnPrepareConcurrentImg() const
+  {}
   virtual void doOwnInit()
 {};
 };
@@ -317,6 +371,9 @@ protected:
   void doOwnInit();
 
   virtual tCoords doOwnImg(const tCoords& pt) const;
+  virtual tCoords doOwnCursorImg(const tCoords& pt,
+                                 TransformCursor& cursor) const;
+  virtual void doOwnPrepareConcurrentImg() const;
 };
 
 
@@ -349,6 +406,10 @@ public:
 
   // if true, the following option will cache a volume with
   // the VF of the images
+  //
+  // the output voxels (and the surface vertices below) are processed
+  // in Morton-ordered blocks across threads, each thread with its own
+  // transform cursor
   MRI* apply_transforms(MRI*,
                         bool cacheField=false,
                         const VG* vgOutput=NULL) const;
@@ -386,6 +447,7 @@ public:
 
   // apply the morph to a point
   tCoords image(const tCoords& pt) const;
+  tCoords image(const tCoords& pt, TransformCursor& cursor) const;
 
   //----------
   // vol geom
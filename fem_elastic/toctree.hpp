@@ -448,6 +448,23 @@ public:
     return m_pnode->element_at_point(pt);
   }
 
+  /*
+    same as above, but first tests the element found by the previous call.
+
+    the hint is owned by the caller (one per thread), so the tree itself
+    stays read-only. when queries are spatially coherent (Morton-ordered voxels),
+    most of them are answered without descending the tree.
+  */
+  const ElementProxy* element_at_point(const CoordsType& pt,
+                                       const ElementProxy*& hint) const
+  {
+    if ( hint && hint->contains(pt) ) return hint;
+
+    const ElementProxy* ep = this->element_at_point(pt);
+    if ( ep ) hint = ep;
+    return ep;
+  }
+
   unsigned int getElementCount() const
   {
     return m_pnode->getElementCount();
@@ -406,6 +406,9 @@ void FSLabel::GetStatsRange(double *range)
 
 void FSLabel::EditVoxel(int nx, int ny, int nz, int coords, bool bAdd, int* vertices, int* pnum)
 {
+  // painting a large label is a lot of voxel lookups
+  if (!m_label->index)
+    ::LabelBuildIndex(m_label);
   if (bAdd)
     ::LabelAddVoxel(m_label, nx, ny, nz, coords, vertices, pnum);
   else
@@ -29,3 +29,19 @@ void MRISrigidBodyAlignGlobal_findMinSSE(
     float               max_radians,
     double              ext_sse,
     int                 nangles);
+
+// Same search domain, but the candidate rotations are the peaks of the SO(3) correlation of the
+// spherical harmonic expansions (up to lmax) of the subject and the template.
+// The best npeaks peaks in the domain (or the identity, if there are none) are each refined by
+// MRISrigidBodyAlignGlobal_findMinSSE, searching only a few min_radians cells around them at the finest scale.
+//
+void MRISrigidBodyAlignGlobal_findMinSSE_spharm(
+    double* mina, double* new_minb, double* new_ming, double* new_sse,  // outputs
+    MRI_SURFACE*        mris,
+    INTEGRATION_PARMS*  parms,
+    float               min_radians,
+    float               max_radians,
+    double              ext_sse,
+    int                 nangles,
+    int                 lmax,
+    int                 npeaks);
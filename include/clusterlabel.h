@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+/**
+ * @brief reentrant cluster labeling of surface and volume maps
+ *
+ * sclustMapSurfClusters() keeps its state in the surface (undefval) and
+ * clustGetClusters() allocates every cluster, so neither can be run on
+ * the same surface/volume from several threads. Here the neighborhood is
+ * built once as a CSR graph, the map comes in as a plain value array and
+ * all results go into a caller-owned workspace, so any number of threads
+ * can label maps against the same (read-only) graph, eg
+ *
+ *   CLUSTER_GRAPH *g = clustGraphFromSurf(surf);
+ *   // in each thread
+ *   CLUSTER_WORKSPACE *w = clustWorkspaceAlloc(g);
+ *   std::vector<float> val(g->nnodes);
+ *   clustGraphValues(g, map, 0, &val[0]);
+ *   int nc = clustLabelGraph(g, &val[0], thmin, -1, thsign, 0, w);
+ *   // w->clusterno[node], w->clusters[0..nc-1]
+ *   clustWorkspaceFree(&w);
+ *
+ * Clusters follow the same rules as sclustMapSurfClusters() (vertex
+ * 1-neighbors, group-average area correction) and clustGetClusters()
+ * (6- or 26-connected voxels, voxels with mask=0 excluded), but are
+ * numbered in the order of their first node rather than sorted by max.
+ */
+
+#ifndef CLUSTERLABEL_H
+#define CLUSTERLABEL_H
+
+#include "mri.h"
+#include "mrisurf.h"
+
+typedef struct
+{
+  int nnodes;          // vertices, or voxels inside the mask
+  int *rowptr;         // neighbors of node n are col[rowptr[n]] .. col[rowptr[n+1]-1]
+  int *col;
+  float *size;         // area (mm2) of each vertex or volume (mm3) of each voxel
+  float *x, *y, *z;    // vertex xyz, or voxel col, row, slice
+  int *index;          // node -> c + width*(r + height*s) in the map
+  int width, height, depth; // dimensions of the maps
+}
+CLUSTER_GRAPH;
+
+typedef struct
+{
+  int nmembers;
+  double size;         // area (mm2) or volume (mm3)
+  double weight;       // sum of the values of the members
+  float maxval;        // signed value at maxnode
+  int maxnode;         // node with the largest value after applying thsign
+  double cx, cy, cz;   // centroid, in the coords of the graph
+}
+CLUSTER_STATS;
+
+typedef struct
+{
+  int nnodes;
+  int *clusterno;      // 1..nclusters, or 0 if the node is not in a cluster
+  int *queue;          // scratch
+  int nclusters, maxclusters;
+  CLUSTER_STATS *clusters; // clusters[clusterno-1]; grows, then stays allocated
+}
+CLUSTER_WORKSPACE;
+
+CLUSTER_GRAPH *clustGraphFromSurf(MRI_SURFACE *surf);
+CLUSTER_GRAPH *clustGraphFromVolume(MRI *vol, MRI *mask, int allowdiag);
+int clustGraphFree(CLUSTER_GRAPH **pgraph);
+int clustGraphValues(const CLUSTER_GRAPH *graph, MRI *map, int frame, float *val);
+
+CLUSTER_WORKSPACE *clustWorkspaceAlloc(const CLUSTER_GRAPH *graph);
+int clustWorkspaceFree(CLUSTER_WORKSPACE **pwork);
+
+int clustLabelGraph(const CLUSTER_GRAPH *graph, const float *val, float thmin, float thmax,
+                    int thsign, float minsize, CLUSTER_WORKSPACE *work);
+double clustWorkspaceMaxSize(const CLUSTER_WORKSPACE *work);
+
+#endif
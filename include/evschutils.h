@@ -68,6 +68,12 @@ int EVSmaxId(EVSCH *EvSch);
 EVENT_SCHEDULE *EVSsynth(int nEvTypes, int *nPer, float *tPer,
                          float tRes, float tMax, float tPreScan,
                          int nCB1Search, float tNullMin, float tNullMax);
+// Reentrant versions: random numbers come from the erand48() state
+// xsubi (or from drand48() if xsubi is NULL)
+EVENT_SCHEDULE *EVSsynth_r(int nEvTypes, int *nPer, float *tPer,
+                           float tRes, float tMax, float tPreScan,
+                           int nCB1Search, float tNullMin, float tNullMax,
+                           unsigned short *xsubi);
 
 EVENT_SCHEDULE *RandEvSch(int nevents, int ntypes, float dtmin,
                           float dtnullavg, int randweights);
@@ -88,9 +94,12 @@ MATRIX *EVScb1Matrix(EVSCH *EvSch);
 float   EVScb1Error(EVSCH *EvSch);
 
 EVSCH *EVSRandSequence(int nEvTypes, int *nEvReps);
+EVSCH *EVSRandSequence_r(int nEvTypes, int *nEvReps, unsigned short *xsubi);
 int    EVSRandTiming(EVSCH *EvSch, float *EvDur,
                      float tRes, float tMax, float tPreScan);
 EVSCH *EVScb1Optimize(int nEvTypes, int *nEvReps, int nSearch);
+EVSCH *EVScb1Optimize_r(int nEvTypes, int *nEvReps, int nSearch,
+                        unsigned short *xsubi);
 const char  *EVScostString(int CostId);
 int    EVScostId(const char *CostString);
 
@@ -101,6 +110,10 @@ float EVScost(EVSCH *EvSch, int CostId, float *params);
 int *RandPerm(int N, int *v);
 int  RandPermList(int N, int *v);
 int RandPermListLimit0(int N, int *v, int lim, int nitersmax);
+int *RandPerm_r(int N, int *v, unsigned short *xsubi);
+int  RandPermList_r(int N, int *v, unsigned short *xsubi);
+int RandPermListLimit0_r(int N, int *v, int lim, int nitersmax,
+                         unsigned short *xsubi);
 
 MATRIX *EVSfirXtXIdeal(int nEvTypes, int *nEvReps, float *EvDur,
                        float TR, int Ntp,
@@ -32,6 +32,30 @@ MRI *MRIextractDistanceMap(MRI *mri_src,
                            int mode,
                            MRI *mri_mask);
 
+// same as MRIextractDistanceMap, but exact Euclidean distances computed with a
+// separable O(N) transform that runs in parallel. Falls back to fast marching
+// when mri_mask is given, since distances within a mask are geodesic.
+// The distances differ slightly from the marching front's, so the tools
+// only use it when asked to (-edt)
+MRI *MRIextractDistanceMapEDT(MRI *mri_src,
+                              MRI *mri_dst,
+                              int label,
+                              float max_distance,
+                              int mode,
+                              MRI *mri_mask);
+
+// exact distance maps for nlabels labels at once, frame n for labels[n]. If
+// pmri_nearest is not NULL it also returns (allocating it if *pmri_nearest is
+// NULL) an MRI_INT volume holding the closest of the labels at every voxel,
+// or -1 if none of them is present
+MRI *MRIextractDistanceMaps(MRI *mri_src,
+                            MRI *mri_dst,
+                            const int *labels,
+                            int nlabels,
+                            float max_distance,
+                            int mode,
+                            MRI **pmri_nearest);
+
 void MRISextractOutsideDistanceMap(MRIS *mris,
                                    MRI *mri_src,
                                    int label,
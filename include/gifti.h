@@ -32,6 +32,8 @@
 MRIS* mrisReadGIFTIfile(const char *fname, MRIS *mris, std::vector<OverlayInfoStruct> *poverlayinfo=NULL, int daNum = -1, const COLOR_TABLE *ctab = NULL);
 MRIS* mrisReadGIFTIdanum(const char *fname, MRIS *mris, int daNum, std::vector<OverlayInfoStruct> *poverlayinfo=NULL);
 MRI* MRISreadGiftiAsMRI(const char *fname, int read_volume);
+// reads frames [frame0,frame0+nframes) of vertices [vno0,vno0+nvertices), -1 means to the end
+MRI* MRISreadGiftiFrames(const char *fname, int frame0, int nframes, int vno0 = 0, int nvertices = -1);
 int MRISwriteGIFTI(MRIS* mris, int intent_code, const char *out_fname, const char *curv_fname);
 int mriWriteGifti(MRI* mri, const char *out_fname);
 
@@ -45,6 +45,8 @@ struct LABEL_VERTEX
   float         stat ;     /* statistic (might not be used) */
 };
 
+struct LABEL_INDEX ;   // defined in label.cpp
+
 struct LABEL
 {
   int    max_points ;         /* # of points allocated */
@@ -62,6 +64,7 @@ struct LABEL
   MRI    *mri_template ;
   MHT    *mht ;
   MRIS   *mris ; 
+  LABEL_INDEX *index ;  // optional vno/voxel lookup tables, see LabelBuildIndex()
 };
 
 #define LABEL_COORDS_NONE         FS_COORDS_UNKNOWN
@@ -108,6 +111,14 @@ LABEL  *LabelRemoveAlmostDuplicates(LABEL *area, double dist, LABEL *ldst);
 LABEL   *LabelCompact(LABEL *lsrc, LABEL *ldst) ;
 int     LabelRemoveDuplicates(LABEL *area) ;
 int     LabelHasVertex(int vtxno, LABEL *lb);
+
+// optional index that makes LabelHasVertex, LabelAddVoxel, LabelDeleteVoxel
+// etc O(1) instead of a scan of lv. Points appended to lv are indexed the next
+// time it is used; after changing vno or coords of existing points directly,
+// call LabelIndexInvalidate(). Freed by LabelFree
+int     LabelBuildIndex(LABEL *area) ;
+int     LabelFreeIndex(LABEL *area) ;
+int     LabelIndexInvalidate(LABEL *area) ;
 LABEL   *LabelAlloc(int max_points, const char *subject_name, const char *label_name) ;
 LABEL   *LabelRealloc(LABEL *lb, int max_points);
 int     LabelCurvFill(LABEL *area, int *vertex_list, int nvertices,
@@ -1629,6 +1629,7 @@ MRI *MRIreadEx(const char *fname, int nthframe);
 MRI *MRIreadType(const char *fname, int type);
 MRI *MRIreadInfo(const char *fname);
 MRI *MRIreadHeader(const char *fname, int type);
+MRI *MRIreadOverlayFrames(const char *fname, int frame0, int nframes, int vno0 = 0, int nvertices = -1);
 int GetSPMStartFrame(void);
 int MRIwrite(MRI *mri,const  char *fname, std::vector<MRI*> *mriVector=NULL);
 int MRIwriteFrame(MRI *mri,const  char *fname, int frame) ;
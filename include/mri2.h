@@ -119,6 +119,39 @@ MRI *MRIvol2surfVSM( const MRI *SrcVol,
                      const MRI *vsm, int InterpMethod, MRI *SrcHitVol,
                      float ProjFrac, int ProjType, int nskip, 
 		     MRI *TrgVol, int pedir=2);
+
+// Sparse form of the MRIvol2surfVSM() sampling (projection, registration,
+// vsm shift and interpolation weights), one row per vertex for each
+// projection fraction ("layer"). Build it once and apply it to all frames.
+typedef struct
+{
+  int nvertices;            // rows per layer
+  int width, height, depth; // source volume geometry
+  int InterpMethod;         // SAMPLE_NEAREST or SAMPLE_TRILINEAR
+  int nlayers;              // number of projection fractions
+  int nnz;                  // number of entries
+  int *rowptr;              // nlayers*nvertices+1, row of vertex v in layer l is l*nvertices+v
+  int *col;                 // source voxel index c + r*width + s*width*height
+  double *weight;           // interpolation weight of each entry
+  int *hitptr;              // nlayers+1, hits of layer l are hitptr[l]..hitptr[l+1]-1
+  int *hits;                // nearest source voxel sampled by each hit vertex
+  int ProjType;             // projection it was built for, see MRIvol2surfOpMatch()
+  int pedir;
+  float *ProjFrac;          // nlayers
+  unsigned long hash;       // of the registration, source vox2ras, vsm and surface
+} MRI_VOL2SURF_OP;
+
+MRI_VOL2SURF_OP *MRIvol2surfBuildOp(const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                                    const MRI *vsm, int InterpMethod, const float *ProjFrac, int nProjFrac,
+                                    int ProjType, int pedir=2);
+MRI *MRIvol2surfOp(const MRI_VOL2SURF_OP *op, const MRI *SrcVol, int GetMax, MRI *TrgVol);
+int MRIvol2surfOpHits(const MRI_VOL2SURF_OP *op, int layer, MRI *SrcHitVol);
+int MRIvol2surfOpMatch(const MRI_VOL2SURF_OP *op, const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                       const MRI *vsm, int InterpMethod, const float *ProjFrac, int nProjFrac,
+                       int ProjType, int pedir=2);
+int MRIvol2surfOpWrite(const MRI_VOL2SURF_OP *op, const char *fname);
+MRI_VOL2SURF_OP *MRIvol2surfOpRead(const char *fname);
+int MRIvol2surfOpFree(MRI_VOL2SURF_OP **pop);
 MRI *MRImaskAndUpsample(MRI *src, MRI *mask, int UpsampleFactor, int nPad, int DoConserve, LTA **src2out);
 MRI *MRIsegBoundary(MRI *seg);
 MRI *MRIsliceNo(MRI *in, MRI *out);
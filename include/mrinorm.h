@@ -118,6 +118,15 @@ MRI *MRI3dGentleNormalize(MRI *mri_src, MRI *mri_bias, float wm_target,
                           float intensity_below, int only_file, float bias_sigma, MRI *mri_not_control);
 MRI *MRIbuildVoronoiDiagram(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst);
 MRI *MRIsoapBubble(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst,int niter, float min_change);
+
+// solver used by MRIsoapBubble. The multigrid solver iterates to a residual
+// tolerance (relative to the range of the control point values) instead of a
+// fixed niter. It can also be selected with setenv FS_SOAP_BUBBLE_MULTIGRID 1,
+// and the tolerance set with FS_SOAP_BUBBLE_TOL
+#define SOAP_BUBBLE_JACOBI     0
+#define SOAP_BUBBLE_MULTIGRID  1
+int MRIsetSoapBubbleSolver(int solver, float tol) ;
+MRI *MRIsoapBubbleMultigrid(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst, float tol) ;
 MRI *MRIsoapBubbleExpand(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst,int niter);
 int MRI3dUseFileControlPoints(MRI *mri,const char *fname) ;
 int MRI3dUseLabelControlPoints(MRI *mri, LABEL *area) ;
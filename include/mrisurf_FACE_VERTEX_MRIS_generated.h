@@ -259,6 +259,7 @@ struct MRIS {
     PMRI                          mri_sras2vox             ;  //  volume that the above matrix is for
     p_void                        mht                      ;
     p_void                        temps                    ;
+    p_void                        incrementalMP            ;  //  dirty vertex tracking for MRIScomputeMetricProperties
 };		// MRIS
 
 #define LIST_OF_FACE_ELTS \
@@ -529,6 +530,7 @@ struct MRIS {
     ELTP(MRI,mri_sras2vox)  SEP \
     ELTX(p_void,mht)  SEP \
     ELTX(p_void,temps)  SEP \
+    ELTX(p_void,incrementalMP)  SEP \
 // end of macro
 
 #define LIST_OF_MRIS_ELTS \
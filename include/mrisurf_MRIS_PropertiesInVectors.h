@@ -246,5 +246,6 @@ struct MRISPV {
     PMRI                          mri_sras2vox             ;  //  volume that the above matrix is for
     p_void                        mht                      ;
     p_void                        temps                    ;
+    p_void                        incrementalMP            ;  //  dirty vertex tracking for MRIScomputeMetricProperties
 };		// MRISPV
 
@@ -405,6 +405,7 @@
         inline PMRI                  mri_sras2vox             (                               ) const ;  //  volume that the above matrix is for
         inline p_void                mht                      (                               ) const ;
         inline p_void                temps                    (                               ) const ;
+        inline p_void                incrementalMP            (                               ) const ;  //  dirty vertex tracking for MRIScomputeMetricProperties
         
         inline void                  set_strips               ( size_t i,            STRIP to       ) ;
         inline void                  set_xctr                 (                      float to       ) ;
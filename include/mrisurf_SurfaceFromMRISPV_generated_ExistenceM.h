@@ -75,6 +75,7 @@
         inline PMRI                mri_sras2vox             (                          ) const ;  //  volume that the above matrix is for
         inline p_void              mht                      (                          ) const ;
         inline p_void              temps                    (                          ) const ;
+        inline p_void              incrementalMP            (                          ) const ;  //  dirty vertex tracking for MRIScomputeMetricProperties
         
         inline void                set_fname                (          MRIS_fname_t to       ) ;  //  file it was originally loaded from
         inline void                set_status               (           MRIS_Status to       ) ;  //  type of surface (e.g. sphere, plane)
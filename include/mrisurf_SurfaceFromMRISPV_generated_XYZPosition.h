@@ -157,6 +157,7 @@
         inline PMRI                  mri_sras2vox             (                    ) const ;  //  volume that the above matrix is for
         inline p_void                mht                      (                    ) const ;
         inline p_void                temps                    (                    ) const ;
+        inline p_void                incrementalMP            (                    ) const ;  //  dirty vertex tracking for MRIScomputeMetricProperties
         
         inline void                  set_vp                   (          p_void to       ) ;  //  for misc. use
         inline void                  set_alpha                (           float to       ) ;  //  rotation around z-axis
@@ -205,6 +205,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
 
 
     } // namespace Existence
@@ -497,6 +500,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
 
 
     } // namespace Topology
@@ -858,6 +864,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_vp(p_void to) {  //  for misc. use
         repr->vp = to;
@@ -1371,6 +1380,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -2552,6 +2564,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -3727,6 +3742,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -4002,6 +4020,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_fname(MRIS_fname_t to) {  //  file it was originally loaded from
         repr->fname = to;
@@ -4313,6 +4334,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
 
 
     } // namespace TopologyM
@@ -4665,6 +4689,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_vp(p_void to) {  //  for misc. use
         repr->vp = to;
@@ -5181,6 +5208,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -6371,6 +6401,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -7546,6 +7579,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -8772,6 +8808,9 @@ namespace SurfaceFromMRISPV {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
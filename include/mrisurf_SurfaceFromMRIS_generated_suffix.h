@@ -192,6 +192,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
 
 
     } // namespace Existence
@@ -471,6 +474,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
 
 
     } // namespace Topology
@@ -816,6 +822,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_vp(p_void to) {  //  for misc. use
         repr->vp = to;
@@ -1321,6 +1330,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -2495,6 +2507,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -3663,6 +3678,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -3934,6 +3952,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_fname(MRIS_fname_t to) {  //  file it was originally loaded from
         repr->fname = to;
@@ -4232,6 +4253,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
 
 
     } // namespace TopologyM
@@ -4568,6 +4592,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_vp(p_void to) {  //  for misc. use
         repr->vp = to;
@@ -5076,6 +5103,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -6259,6 +6289,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -7427,6 +7460,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -8646,6 +8682,9 @@ namespace SurfaceFromMRIS {
     p_void Surface::temps() const {
         return repr->temps;
     }
+    p_void Surface::incrementalMP() const {  //  dirty vertex tracking for MRIScomputeMetricProperties
+        return repr->incrementalMP;
+    }
     
     void Surface::set_strips(size_t i, STRIP to) {
         repr->strips[i] = to;
@@ -332,6 +332,7 @@ extern       double nsigmas;
 
 float* mrisStealDistStore(MRIS* mris, int vno, int newCapacity);
 void   mrisSetDist(MRIS* mris, int vno, float* dist, int newCapacity);
+bool   mrisReattachDist(MRIS* mris, int vno, float const * expected, int capacity);
 
 bool MRISreallocVertices            (MRIS* mris, int max_vertices, int nvertices);
 void MRISgrowNVertices              (MRIS* mris, int nvertices);
@@ -169,3 +169,8 @@ static void constructComputeDefectContext(ComputeDefectContext* computeDefectCon
 
 void MRIScomputeMetricProperties(MRIS_MP* mris);
 void MRIScomputeMetricPropertiesFaster(MRIS *mris);
+
+// see mrisurf_metricProperties_incremental.cpp
+bool mrisComputeMetricPropertiesIncrementally(MRIS *mris);
+void mrisNoteFullMetricProperties(MRIS *mris);
+void mrisInvalidateIncrementalMetricProperties(MRIS *mris);
@@ -104,6 +104,30 @@ MRI *vol2surf_linear(MRI *SrcVol,
 
 MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs,
 		  int ReverseMapFlag, int DoJac, int UseHash);
+
+// Sparse (CSR) form of the MRISapplyReg() mapping, one row per target vertex.
+// Build it once and apply it to any number of inputs/frames.
+typedef struct
+{
+  int nsrc, ntrg;     // number of source and target vertices
+  int nnz;            // number of entries
+  int ReverseMapFlag; // settings it was built with
+  int DoJac;
+  int *rowptr;        // ntrg+1, entries of row t are rowptr[t]..rowptr[t+1]-1
+  int *col;           // source vertex of each entry
+  float *div;         // each entry contributes src[col]/div
+  float *rowdiv;      // row sum is divided by rowdiv (when > 1)
+  unsigned long hash; // of the registration surfaces, see MRISapplyRegOpMatch()
+} MRIS_APPLYREG_OP;
+
+MRIS_APPLYREG_OP *MRISapplyRegBuildOp(MRI_SURFACE **SurfReg, int nsurfs,
+                                      int ReverseMapFlag, int DoJac, int UseHash);
+MRI *MRISapplyRegOp(MRIS_APPLYREG_OP *op, MRI *SrcSurfVals, MRI *TrgSurfVals);
+int MRISapplyRegOpMatch(MRIS_APPLYREG_OP *op, MRI_SURFACE **SurfReg, int nsurfs,
+                        int ReverseMapFlag, int DoJac);
+int MRISapplyRegOpWrite(MRIS_APPLYREG_OP *op, const char *fname);
+MRIS_APPLYREG_OP *MRISapplyRegOpRead(const char *fname);
+int MRISapplyRegOpFree(MRIS_APPLYREG_OP **pop);
 MRI *surf2surf_nnfr(MRI *SrcSurfVals, MRI_SURFACE *SrcSurfReg,
                     MRI_SURFACE *TrgSurfReg, MRI **SrcHits,
                     MRI **SrcDist, MRI **TrgHits, MRI **TrgDist,
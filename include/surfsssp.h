@@ -0,0 +1,71 @@
+/*
+ *
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+/**
+ * @brief multi-threaded shortest paths over a surface edge graph
+ *
+ * The graph is built once as CSR with a cost on each directed edge,
+ * either the edge length or a caller's cost function (eg the mris_pmake
+ * weightings), so it can be searched any number of times:
+ *
+ *   SSSP_GRAPH *g = SSSPgraphFromSurf(surf, NULL, NULL);
+ *   // cost from the nearest of several sources, by delta-stepping
+ *   SSSPsolve(g, sources, nsources, maxcost, dist, pred);
+ *   // or a separate search from each source, several at a time
+ *   SSSPsolveEach(g, sources, nsources, maxcost, visit, parms);
+ *   SSSPgraphFree(&g);
+ *
+ * SSSPsolve() relaxes the edges of each bucket of the frontier in
+ * parallel, which suits one search over a whole surface.
+ * SSSPsolveEach() runs one serial search per source in each thread,
+ * which suits many searches bounded by maxcost, eg geodesic
+ * neighborhoods. Both give the same costs as Dijkstra. Where several
+ * predecessors give the same cost the lowest numbered is chosen, so
+ * the paths do not depend on the number of threads.
+ */
+
+#ifndef SURFSSSP_H
+#define SURFSSSP_H
+
+#include <float.h>
+
+#include "mrisurf.h"
+
+#define SSSP_UNREACHED FLT_MAX
+
+typedef struct
+{
+  int nnodes;
+  int *rowptr;         // edges of node n are col[rowptr[n]] .. col[rowptr[n+1]-1]
+  int *col;
+  float *cost;         // non-negative cost of each edge
+}
+SSSP_GRAPH;
+
+// cost of the edge from vno to its neighbor vno_nbr
+typedef float (*SSSP_EDGE_COST)(int vno, int vno_nbr, void *parms);
+
+// called once per source by SSSPsolveEach(), from any thread, with the
+// reached nodes in order of cost (the source first)
+typedef void (*SSSP_VISIT)(int nth, int source, int nreached, const int *node, const float *cost, void *parms);
+
+SSSP_GRAPH *SSSPgraphAlloc(int nnodes, int nedges);
+SSSP_GRAPH *SSSPgraphFromSurf(MRI_SURFACE *surf, SSSP_EDGE_COST costfunc, void *parms);
+int SSSPgraphFree(SSSP_GRAPH **pgraph);
+
+int SSSPsolve(const SSSP_GRAPH *graph, const int *sources, int nsources, float maxcost, float *dist, int *pred);
+int SSSPsolveEach(const SSSP_GRAPH *graph, const int *sources, int nsources, float maxcost,
+                  SSSP_VISIT visit, void *parms);
+
+#endif
@@ -48,9 +48,12 @@ public:
   int thsign = 0; // 0=abs, +1=pos, -1=neg
   double E=0.5,H=2; // TFCE parameters; these vals are suggested by Smith and Nichols
   int debug=0, vnodebug=0;
+  int unionfind=1; // compute with a single union-find sweep instead of reclustering
   int hlistUniform(void);
   int hlistAuto(MRI *map);
   MRI *compute(MRI *map); // compute the TFCE map
+  MRI *computeUnionFind(MRI *map);
+  MRI *computeRecluster(MRI *map);
   // Below are useful functions unrelated to TFCE
   std::vector<double> maxstatsim(MRI *temp, int niters);
   int write_vector_double(char *fname,  std::vector<double> vlist);
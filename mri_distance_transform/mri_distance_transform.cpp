@@ -54,6 +54,7 @@ static float posterior_dist = -1 ;
 
 static float binarize = 0.0 ;
 static int percent = 0;
+static int use_edt = 0 ;
 
 static int ndilations = 0 ;
 MRI *MRIthresholdPosterior(MRI *mri_src, MRI *mri_dst, float posterior_dist) ;
@@ -81,6 +82,7 @@ int main(int argc, char *argv[]) {
 
   fprintf(stderr,"mri_distance_transform <input volume> <label> <max_distance> <mode[=1]> <output volume>\n");
   fprintf(stderr,"mode : 1 = outside , mode : 2 = inside , mode : 3 = both, mode : 4 = both unsigned \n");
+  fprintf(stderr,"-edt : exact euclidean distances instead of fast marching (which -wm and -wsurf still use)\n");
 
   if (argc < 5)
     exit(0) ;
@@ -197,7 +199,10 @@ int main(int argc, char *argv[]) {
         MRIwrite(mri_aseg, "a.mgz") ;
     }
 
-  mri_distance=MRIextractDistanceMap(mri,mri_distance,label, max_distance, mode, mri_white);
+  if (use_edt)
+    mri_distance=MRIextractDistanceMapEDT(mri,mri_distance,label, max_distance, mode, mri_white);
+  else
+    mri_distance=MRIextractDistanceMap(mri,mri_distance,label, max_distance, mode, mri_white);
 
   if (mri_aseg)
     {
@@ -381,6 +386,11 @@ get_option(int argc, char *argv[]) {
       percent=1;
       printf("scaling distances to be percent of max\n");
     }
+  else if (!stricmp(option, "edt"))
+    {
+      use_edt=1;
+      printf("computing exact euclidean distances\n");
+    }
   return(nargs) ;
 }
 
@@ -15,6 +15,9 @@
  */
 
 #include "graphcut.h"
+#include "romp_support.h"
+
+#include <algorithm>
 
 #define TERMINAL ( (arc *) 1 )  /* to terminal */
 #define ORPHAN   ( (arc *) 2 )  /* orphan */
@@ -33,6 +36,9 @@ struct edgeW
   int bsw;
 };
 
+// build the graph explicitly and use Graph instead of GridGraph
+static int gcut_explicit_graph = 0;
+
 //no include
 extern bool matrix_alloc(int ****pointer, int z, int y, int x);
 extern bool matrix_free(int ***pointer, int z, int y, int x);
@@ -574,6 +580,501 @@ void Graph::set_tweights(node_id i, captype cap_source, captype cap_sink)
 }
 
 
+/***********************************************************************/
+/* GridGraph */
+
+GridGraph::GridGraph(int xdim, int ydim, int zdim)
+{
+  int x, y, z, i;
+
+  this->xdim = xdim;
+  this->ydim = ydim;
+  this->zdim = zdim;
+  nnodes = xdim*ydim*zdim;
+  offset[0] = -1;
+  offset[1] = +1;
+  offset[2] = -xdim;
+  offset[3] = +xdim;
+  offset[4] = -xdim*ydim;
+  offset[5] = +xdim*ydim;
+
+  nodes = new node[nnodes];
+  memset(nodes, 0, nnodes*sizeof(node));
+  for (z = 0, i = 0; z < zdim; z++)
+    for (y = 0; y < ydim; y++)
+      for (x = 0; x < xdim; x++, i++)
+        nodes[i].nbrs = (x > 0) | ((x < xdim-1) << 1) |
+                        ((y > 0) << 2) | ((y < ydim-1) << 3) |
+                        ((z > 0) << 4) | ((z < zdim-1) << 5);
+}
+
+GridGraph::~GridGraph()
+{
+  delete[] nodes;
+}
+
+void GridGraph::set_tweights(int i, captype cap_source, captype cap_sink)
+{
+  nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+void GridGraph::set_edge(int i, int dir, captype cap, captype rev_cap)
+{
+  nodes[i].rc[dir] = cap;
+  nodes[i + offset[dir]].rc[dir^1] = rev_cap;
+}
+
+inline void GridGraph::set_active(run_t &r, int i)
+{
+  if (nodes[i].next < 0)
+  {
+    /* it's not in the list yet */
+    if (r.queue_last[1] >= 0) nodes[r.queue_last[1]].next = i;
+    else                      r.queue_first[1]            = i;
+    r.queue_last[1] = i;
+    nodes[i].next = i;
+  }
+}
+
+inline int GridGraph::next_active(run_t &r)
+{
+  int i;
+
+  while ( 1 )
+  {
+    if ((i=r.queue_first[0]) < 0)
+    {
+      r.queue_first[0] = i = r.queue_first[1];
+      r.queue_last[0]  = r.queue_last[1];
+      r.queue_first[1] = -1;
+      r.queue_last[1]  = -1;
+      if (i < 0) return -1;
+    }
+
+    /* remove it from the active list */
+    if (nodes[i].next == i) r.queue_first[0] = r.queue_last[0] = -1;
+    else                    r.queue_first[0] = nodes[i].next;
+    nodes[i].next = -1;
+
+    /* a node in the list is active iff it has a parent */
+    if (nodes[i].parent != P_NONE) return i;
+  }
+}
+
+inline void GridGraph::add_orphan_front(run_t &r, int i)
+{
+  nodes[i].parent = P_ORPHAN;
+  r.orphans.push_front(i);
+}
+
+void GridGraph::maxflow_init(run_t &r)
+{
+  int i;
+
+  r.queue_first[0] = r.queue_last[0] = -1;
+  r.queue_first[1] = r.queue_last[1] = -1;
+  r.orphans.clear();
+  r.flow = 0;
+
+  for (i = r.lo; i < r.hi; i++)
+  {
+    node *n = &nodes[i];
+    n -> next = -1;
+    n -> mark_count = 0;
+    n -> is_sink = 0;
+    if (n->tr_cap > 0)
+    {
+      /* i is connected to the source */
+      n -> parent = P_TERMINAL;
+      set_active(r, i);
+      n -> mark_count = 1;
+      n -> mark_d = 1;
+    }
+    else if (n->tr_cap < 0)
+    {
+      /* i is connected to the sink */
+      n -> is_sink = 1;
+      n -> parent = P_TERMINAL;
+      set_active(r, i);
+      n -> mark_count = 1;
+      n -> mark_d = 1;
+    }
+    else
+    {
+      n -> parent = P_NONE;
+    }
+  }
+  r.mark_count = 2;
+}
+
+/* augments along the path through the arc from i (source tree) in
+   direction d (to the sink tree) */
+void GridGraph::augment(run_t &r, int i0, int d0)
+{
+  int i, j, a;
+  captype bottleneck;
+
+  /* 1. Finding bottleneck capacity */
+  /* 1a - the source tree */
+  bottleneck = nodes[i0].rc[d0];
+  for (i = i0; ; i = j)
+  {
+    a = nodes[i].parent;
+    if (a == P_TERMINAL) break;
+    j = i + offset[a];
+    if (bottleneck > nodes[j].rc[a^1]) bottleneck = nodes[j].rc[a^1];
+  }
+  if (bottleneck > nodes[i].tr_cap) bottleneck = nodes[i].tr_cap;
+  /* 1b - the sink tree */
+  for (i = i0 + offset[d0]; ; i = j)
+  {
+    a = nodes[i].parent;
+    if (a == P_TERMINAL) break;
+    j = i + offset[a];
+    if (bottleneck > nodes[i].rc[a]) bottleneck = nodes[i].rc[a];
+  }
+  if (bottleneck > - nodes[i].tr_cap) bottleneck = - nodes[i].tr_cap;
+
+  /* 2. Augmenting */
+  /* 2a - the source tree */
+  nodes[i0 + offset[d0]].rc[d0^1] += bottleneck;
+  nodes[i0].rc[d0] -= bottleneck;
+  for (i = i0; ; i = j)
+  {
+    a = nodes[i].parent;
+    if (a == P_TERMINAL) break;
+    j = i + offset[a];
+    nodes[i].rc[a] += bottleneck;
+    nodes[j].rc[a^1] -= bottleneck;
+    if (!nodes[j].rc[a^1]) add_orphan_front(r, i);
+  }
+  nodes[i].tr_cap -= bottleneck;
+  if (!nodes[i].tr_cap) add_orphan_front(r, i);
+  /* 2b - the sink tree */
+  for (i = i0 + offset[d0]; ; i = j)
+  {
+    a = nodes[i].parent;
+    if (a == P_TERMINAL) break;
+    j = i + offset[a];
+    nodes[j].rc[a^1] += bottleneck;
+    nodes[i].rc[a] -= bottleneck;
+    if (!nodes[i].rc[a]) add_orphan_front(r, i);
+  }
+  nodes[i].tr_cap += bottleneck;
+  if (!nodes[i].tr_cap) add_orphan_front(r, i);
+
+  r.flow += bottleneck;
+}
+
+void GridGraph::process_source_orphan(run_t &r, int i)
+{
+  int d0, d0_min = P_NONE, j, a, d, d_min = INFINITE_D;
+
+  /* trying to find a new parent */
+  for (d0 = 0; d0 < 6; d0++)
+    if (arc_ok(r, i, d0, j) && nodes[j].rc[d0^1])
+    {
+      if (!nodes[j].is_sink && (a=nodes[j].parent) != P_NONE)
+      {
+        /* checking the origin of j */
+        d = 0;
+        while ( 1 )
+        {
+          if (nodes[j].mark_count == r.mark_count)
+          {
+            d += nodes[j].mark_d;
+            break;
+          }
+          a = nodes[j].parent;
+          d ++;
+          if (a==P_TERMINAL)
+          {
+            nodes[j].mark_count = r.mark_count;
+            nodes[j].mark_d = 1;
+            break;
+          }
+          if (a==P_ORPHAN)
+          {
+            d = INFINITE_D;
+            break;
+          }
+          j += offset[a];
+        }
+        if (d<INFINITE_D) /* j originates from the source - done */
+        {
+          if (d<d_min)
+          {
+            d0_min = d0;
+            d_min = d;
+          }
+          /* set marks along the path */
+          for (j = i + offset[d0]; nodes[j].mark_count != r.mark_count;
+               j += offset[(int)nodes[j].parent])
+          {
+            nodes[j].mark_count = r.mark_count;
+            nodes[j].mark_d = d --;
+          }
+        }
+      }
+    }
+
+  if ((nodes[i].parent = d0_min) != P_NONE)
+  {
+    nodes[i].mark_count = r.mark_count;
+    nodes[i].mark_d = d_min + 1;
+  }
+  else
+  {
+    /* no parent is found */
+    nodes[i].mark_count = 0;
+
+    /* process neighbors */
+    for (d0 = 0; d0 < 6; d0++)
+      if (arc_ok(r, i, d0, j))
+      {
+        if (!nodes[j].is_sink && (a=nodes[j].parent) != P_NONE)
+        {
+          if (nodes[j].rc[d0^1]) set_active(r, j);
+          if (a!=P_TERMINAL && a!=P_ORPHAN && j + offset[a] == i)
+          {
+            /* add j to the adoption list */
+            nodes[j].parent = P_ORPHAN;
+            r.orphans.push_back(j);
+          }
+        }
+      }
+  }
+}
+
+void GridGraph::process_sink_orphan(run_t &r, int i)
+{
+  int d0, d0_min = P_NONE, j, a, d, d_min = INFINITE_D;
+
+  /* trying to find a new parent */
+  for (d0 = 0; d0 < 6; d0++)
+    if (arc_ok(r, i, d0, j) && nodes[i].rc[d0])
+    {
+      if (nodes[j].is_sink && (a=nodes[j].parent) != P_NONE)
+      {
+        /* checking the origin of j */
+        d = 0;
+        while ( 1 )
+        {
+          if (nodes[j].mark_count == r.mark_count)
+          {
+            d += nodes[j].mark_d;
+            break;
+          }
+          a = nodes[j].parent;
+          d ++;
+          if (a==P_TERMINAL)
+          {
+            nodes[j].mark_count = r.mark_count;
+            nodes[j].mark_d = 1;
+            break;
+          }
+          if (a==P_ORPHAN)
+          {
+            d = INFINITE_D;
+            break;
+          }
+          j += offset[a];
+        }
+        if (d<INFINITE_D) /* j originates from the sink - done */
+        {
+          if (d<d_min)
+          {
+            d0_min = d0;
+            d_min = d;
+          }
+          /* set marks along the path */
+          for (j = i + offset[d0]; nodes[j].mark_count != r.mark_count;
+               j += offset[(int)nodes[j].parent])
+          {
+            nodes[j].mark_count = r.mark_count;
+            nodes[j].mark_d = d --;
+          }
+        }
+      }
+    }
+
+  if ((nodes[i].parent = d0_min) != P_NONE)
+  {
+    nodes[i].mark_count = r.mark_count;
+    nodes[i].mark_d = d_min + 1;
+  }
+  else
+  {
+    /* no parent is found */
+    nodes[i].mark_count = 0;
+
+    /* process neighbors */
+    for (d0 = 0; d0 < 6; d0++)
+      if (arc_ok(r, i, d0, j))
+      {
+        if (nodes[j].is_sink && (a=nodes[j].parent) != P_NONE)
+        {
+          if (nodes[i].rc[d0]) set_active(r, j);
+          if (a!=P_TERMINAL && a!=P_ORPHAN && j + offset[a] == i)
+          {
+            /* add j to the adoption list */
+            nodes[j].parent = P_ORPHAN;
+            r.orphans.push_back(j);
+          }
+        }
+      }
+  }
+}
+
+void GridGraph::maxflow_run(run_t &r)
+{
+  int i = -1, j, d = 0, mid = -1, current_node = -1;
+
+  maxflow_init(r);
+
+  while ( 1 )
+  {
+    if ((i=current_node) >= 0)
+    {
+      nodes[i].next = -1; /* remove active flag */
+      if (nodes[i].parent == P_NONE) i = -1;
+    }
+    if (i < 0)
+    {
+      if ((i = next_active(r)) < 0) break;
+    }
+
+    /* growth */
+    mid = -1;
+    if (!nodes[i].is_sink)
+    {
+      /* grow source tree */
+      for (d = 0; d < 6; d++)
+        if (arc_ok(r, i, d, j) && nodes[i].rc[d])
+        {
+          if (nodes[j].parent == P_NONE)
+          {
+            nodes[j].is_sink = 0;
+            nodes[j].parent = d^1;
+            nodes[j].mark_count = nodes[i].mark_count;
+            nodes[j].mark_d = nodes[i].mark_d + 1;
+            set_active(r, j);
+          }
+          else if (nodes[j].is_sink)
+          {
+            mid = i;
+            break;
+          }
+          else if (nodes[j].mark_count &&
+                   nodes[j].mark_count <= nodes[i].mark_count &&
+                   nodes[j].mark_d > nodes[i].mark_d)
+          {
+            /* heuristic - trying to make the distance from
+               j to the source shorter */
+            nodes[j].parent = d^1;
+            nodes[j].mark_count = nodes[i].mark_count;
+            nodes[j].mark_d = nodes[i].mark_d + 1;
+          }
+        }
+    }
+    else
+    {
+      /* grow sink tree */
+      for (d = 0; d < 6; d++)
+        if (arc_ok(r, i, d, j) && nodes[j].rc[d^1])
+        {
+          if (nodes[j].parent == P_NONE)
+          {
+            nodes[j].is_sink = 1;
+            nodes[j].parent = d^1;
+            nodes[j].mark_count = nodes[i].mark_count;
+            nodes[j].mark_d = nodes[i].mark_d + 1;
+            set_active(r, j);
+          }
+          else if (!nodes[j].is_sink)
+          {
+            mid = j;
+            d = d^1;
+            break;
+          }
+          else if (nodes[j].mark_count &&
+                   nodes[j].mark_count <= nodes[i].mark_count &&
+                   nodes[j].mark_d > nodes[i].mark_d)
+          {
+            /* heuristic - trying to make the distance
+               from j to the sink shorter */
+            nodes[j].parent = d^1;
+            nodes[j].mark_count = nodes[i].mark_count;
+            nodes[j].mark_d = nodes[i].mark_d + 1;
+          }
+        }
+    }
+
+    if (mid >= 0)
+    {
+      nodes[i].next = i; /* set active flag */
+      current_node = i;
+
+      /* augmentation */
+      augment(r, mid, d);
+      /* augmentation end */
+
+      /* adoption */
+      while (!r.orphans.empty())
+      {
+        i = r.orphans.front();
+        r.orphans.pop_front();
+        if (nodes[i].is_sink) process_sink_orphan(r, i);
+        else                  process_source_orphan(r, i);
+      }
+      r.mark_count ++;
+      /* adoption end */
+    }
+    else current_node = -1;
+  }
+}
+
+GridGraph::flowtype GridGraph::maxflow(int nslabs)
+{
+  flowtype flow = 0;
+  int nslices;
+  run_t r;
+
+  if (nslabs > zdim) nslabs = zdim;
+  if (nslabs > 1)
+  {
+    /* maxflow within each slab, no flow between slabs */
+    nslices = (zdim + nslabs - 1)/nslabs;
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) reduction(+:flow) schedule(dynamic,1)
+#endif
+    for (int s = 0; s < nslabs; s++)
+    {
+      ROMP_PFLB_begin
+      run_t rs;
+      rs.lo = std::min(s*nslices, zdim)*xdim*ydim;
+      rs.hi = std::min((s+1)*nslices, zdim)*xdim*ydim;
+      if (rs.lo < rs.hi)
+      {
+        maxflow_run(rs);
+        flow += rs.flow;
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+  }
+
+  /* maxflow over the whole grid from what is left */
+  r.lo = 0;
+  r.hi = nnodes;
+  maxflow_run(r);
+  flow += r.flow;
+
+  return flow;
+}
+
+
 void Test_Pointer(void * p, char * _or)
 {
   if (p == NULL)
@@ -835,6 +1336,111 @@ void mincut(int ***im_gcut, edgeW *hor, edgeW *ver, edgeW *tra,
   delete[] nodes;
 }
 
+/* n-link weight between two neighboring voxels from their city block
+   distances to the background and their intensities */
+static inline int edge_weight(int cb1, int cb2, 
+                              unsigned char v1, unsigned char v2, 
+                              double k, double threshold)
+{
+  int weight = cb1 > cb2 ? cb1 : cb2;
+  weight = weight * weight;
+  if (weight > 1 && weight < 6)
+    weight = 6;
+  if (weight != 1 && weight != 6 && weight != 0)
+  {
+    unsigned char value = v1 > v2 ? v2 : v1;
+    weight = (int)fabs(weight * (exp(k * (value - threshold)) - 1));
+  }
+  if (weight > 1 && weight < 6)
+    weight = 6;
+  if (weight > 0 && weight < 1)
+    weight = 1;
+  if (weight == 0)
+    weight = 1000;
+  return weight;
+}
+
+/* mincut() on a GridGraph. The graph is built straight from the
+   distance map, image and seeds instead of from edge lists. Gives the
+   same cut as mincut() (except where mincut() overflows its 16 bit
+   capacities) whatever the number of threads. */
+void mincut_grid(int ***im_gcut, unsigned char ***image, int ***cityblock, 
+                 int ***foreSW, int ***backSW, double k, double threshold, 
+                 int x_start, int y_start, int z_start, 
+                 int x_end, int y_end, int z_end)
+{
+  int xdim = x_end - x_start + 1;
+  int ydim = y_end - y_start + 1;
+  int zdim = z_end - z_start + 1;
+  int nslabs = 1;
+
+  GridGraph *g = new GridGraph(xdim, ydim, zdim);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int z = 0; z < zdim; z++)
+  {
+    ROMP_PFLB_begin
+    for (int y = 0; y < ydim; y++)
+    {
+      for (int x = 0; x < xdim; x++)
+      {
+        int i = g->node_id(x, y, z);
+        int xa = x + x_start, ya = y + y_start, za = z + z_start;
+        int w;
+
+        // mincut() gives each node the seed weights of the first edge
+        // that reaches it, which for the first node of a row is the
+        // second node of the row
+        int xs = xa, ys = ya, zs = za;
+        if (xdim > 1) { if (x == 0) xs++; }
+        else if (ydim > 1) { if (y == 0) ys++; }
+        if (i == 0)
+          g -> set_tweights(i, 400, 0);
+        else
+          g -> set_tweights(i, backSW[zs][ys][xs], foreSW[zs][ys][xs]);
+
+        if (x+1 < xdim)
+        {
+          w = edge_weight(cityblock[za][ya][xa], cityblock[za][ya][xa+1],
+                          image[za][ya][xa], image[za][ya][xa+1], k, threshold);
+          g -> set_edge(i, 1, w, w);
+        }
+        if (y+1 < ydim)
+        {
+          w = edge_weight(cityblock[za][ya][xa], cityblock[za][ya+1][xa],
+                          image[za][ya][xa], image[za][ya+1][xa], k, threshold);
+          g -> set_edge(i, 3, w, w);
+        }
+        if (z+1 < zdim)
+        {
+          w = edge_weight(cityblock[za][ya][xa], cityblock[za+1][ya][xa],
+                          image[za][ya][xa], image[za+1][ya][xa], k, threshold);
+          g -> set_edge(i, 5, w, w);
+        }
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+#ifdef HAVE_OPENMP
+  nslabs = omp_get_max_threads();
+#endif
+  printf("now doing maxflow (%d threads)...\n", nslabs);
+  g -> maxflow(nslabs);
+
+  for (int z = 0; z < zdim; z++)
+    for (int y = 0; y < ydim; y++)
+      for (int x = 0; x < xdim; x++)
+        im_gcut[z+z_start][y+y_start][x+x_start] = 
+          g->what_segment(g->node_id(x, y, z));
+
+  delete g;
+}
+
 void decide_bound(unsigned char ***image, double threshold, 
                   int xVol, int yVol, int zVol, 
                   int & x_start, int & x_end, 
@@ -996,6 +1602,17 @@ double graphcut(unsigned char ***image, unsigned char ***label,
   //printf("x_new=%d, y_new=%d, z_new=%d", xVol_new, yVol_new, zVol_new);
 
   double k = kval / (whitemean - threshold);
+  if (!gcut_explicit_graph)
+  {
+    printf("doing mincut...\n");
+    mincut_grid(im_gcut, image, cityblock, foreSW, backSW, k, threshold, 
+                x_start, y_start, z_start, x_end, y_end, z_end);
+    matrix_free(cityblock, zVol, yVol, xVol);
+    matrix_free(backSW, zVol, yVol, xVol);
+    matrix_free(foreSW, zVol, yVol, xVol);
+    return 0;
+  }
+
   //assign memory
   int length_h = (xVol_new-1)*yVol_new*zVol_new;
   int length_v = xVol_new*(yVol_new-1)*zVol_new;
@@ -1023,24 +1640,8 @@ double graphcut(unsigned char ***image, unsigned char ***label,
     x += x_start;
     y += y_start;
     z += z_start;
-    hor[i].weight = cityblock[z][y][x] > cityblock[z][y][x+1] ? 
-      cityblock[z][y][x] : cityblock[z][y][x+1];
-    hor[i].weight = hor[i].weight * hor[i].weight;
-    if (hor[i].weight > 1 && hor[i].weight < 6)
-      hor[i].weight = 6;
-    if (hor[i].weight != 1 && hor[i].weight != 6 && hor[i].weight != 0)
-    {
-      unsigned char value = image[z][y][x] > image[z][y][x+1] ? 
-        image[z][y][x+1] : image[z][y][x];
-      hor[i].weight = (int)fabs(hor[i].weight * 
-                                (exp(k * (value - threshold)) - 1));
-    }
-    if (hor[i].weight > 1 && hor[i].weight < 6)
-      hor[i].weight = 6;
-    if (hor[i].weight > 0 && hor[i].weight < 1)
-      hor[i].weight = 1;
-    if (hor[i].weight == 0)
-      hor[i].weight = 1000;
+    hor[i].weight = edge_weight(cityblock[z][y][x], cityblock[z][y][x+1],
+                                image[z][y][x], image[z][y][x+1], k, threshold);
     //foreground seed and background seed
     hor[i].fsw = foreSW[z][y][x+1];
     hor[i].bsw = backSW[z][y][x+1];
@@ -1060,24 +1661,8 @@ double graphcut(unsigned char ***image, unsigned char ***label,
     x += x_start;
     y += y_start;
     z += z_start;
-    ver[i].weight = cityblock[z][y][x] > cityblock[z][y+1][x] ? 
-      cityblock[z][y][x] : cityblock[z][y+1][x];
-    ver[i].weight = ver[i].weight * ver[i].weight;
-    if (ver[i].weight > 1 && ver[i].weight < 6)
-      ver[i].weight = 6;
-    if (ver[i].weight != 1 && ver[i].weight != 6 && ver[i].weight != 0)
-    {
-      unsigned char value = image[z][y][x] > image[z][y+1][x] ? 
-        image[z][y+1][x] : image[z][y][x];
-      ver[i].weight = (int)fabs(ver[i].weight * 
-                                (exp(k * (value - threshold)) - 1));
-    }
-    if (ver[i].weight > 1 && ver[i].weight < 6)
-      ver[i].weight = 6;
-    if (ver[i].weight > 0 && ver[i].weight < 1)
-      ver[i].weight = 1;
-    if (ver[i].weight == 0)
-      ver[i].weight = 1000;
+    ver[i].weight = edge_weight(cityblock[z][y][x], cityblock[z][y+1][x],
+                                image[z][y][x], image[z][y+1][x], k, threshold);
     //foreground seed and background seed
     ver[i].fsw = foreSW[z][y+1][x];
     ver[i].bsw = backSW[z][y+1][x];
@@ -1097,24 +1682,8 @@ double graphcut(unsigned char ***image, unsigned char ***label,
     x += x_start;
     y += y_start;
     z += z_start;
-    tra[i].weight = cityblock[z][y][x] > cityblock[z+1][y][x] ? 
-      cityblock[z][y][x] : cityblock[z+1][y][x];
-    tra[i].weight = tra[i].weight * tra[i].weight;
-    if (tra[i].weight > 1 && tra[i].weight < 6)
-      tra[i].weight = 6;
-    if (tra[i].weight != 1 && tra[i].weight != 6 && tra[i].weight != 0)
-    {
-      unsigned char value = image[z][y][x] > image[z+1][y][x] ? 
-        image[z+1][y][x] : image[z][y][x];
-      tra[i].weight = (int)fabs(tra[i].weight * 
-                                (exp(k * (value - threshold)) - 1));
-    }
-    if (tra[i].weight > 1 && tra[i].weight < 6)
-      tra[i].weight = 6;
-    if (tra[i].weight > 0 && tra[i].weight < 1)
-      tra[i].weight = 1;
-    if (tra[i].weight == 0)
-      tra[i].weight = 1000;
+    tra[i].weight = edge_weight(cityblock[z][y][x], cityblock[z+1][y][x],
+                                image[z][y][x], image[z+1][y][x], k, threshold);
     //foreground seed and background seed
     tra[i].fsw = foreSW[z+1][y][x];
     tra[i].bsw = backSW[z+1][y][x];
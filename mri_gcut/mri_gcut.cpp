@@ -182,6 +182,18 @@ static int parse_commandline(int argc, char **argv)
       strcpy(mask_filename, pargv[0]);
       nargsused = 1;
     }
+    else if (!strcmp(option, "-threads") || !strcmp(option, "--threads"))
+    {
+      int nthreads = atoi(pargv[0]);
+#ifdef HAVE_OPENMP
+      omp_set_num_threads(nthreads);
+#endif
+      nargsused = 1;
+    }
+    else if (!strcmp(option, "-explicit-graph"))
+    {
+      gcut_explicit_graph = 1;
+    }
     else if (!strcmp(option, "-T"))
     {
       _t = atof(pargv[0]);
@@ -669,6 +669,9 @@ int main(int argc, char **argv) {
     if (reversemap) {
       printf("Performing mapping from target back to the source label %d\n",TrgSurf->nvertices);
       nrevhits = 0;
+      // LabelHasVertex is called for every target vertex
+      LabelBuildIndex(trglabel);
+      LabelBuildIndex(srclabel);
       for (trgvtxno = 0; trgvtxno < TrgSurf->nvertices; trgvtxno++) {
 	trgvtx = &TrgSurf->vertices[trgvtxno] ;
 	if(trgvtx->ripflag) continue;
@@ -740,6 +743,8 @@ int main(int argc, char **argv) {
         nrevhits++;
       }
       printf("Number of reverse mapping hits = %d\n",nrevhits);
+      LabelFreeIndex(trglabel);
+      LabelFreeIndex(srclabel);
       if (usehash) MHTfree(&SrcHash);
     }
 
@@ -43,6 +43,11 @@
 #include "tags.h"
 #include "gca.h"
 #include "MC.h"
+#include "romp_support.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #define MAXFACES    3000000
 #define MAXVERTICES 1500000
@@ -790,27 +795,277 @@ void generateMCtesselation(tesselation_parms * parms) {
   fprintf(stderr,"done\n");
 }
 
+/*-------------------------------------------------------------------------
+  Multi-label marching cubes
+
+  All requested labels are tessellated in a single pass over the volume.
+  The volume is cut into slabs of slices that are processed in parallel;
+  each cube looks up the (at most 8) distinct labels at its corners and
+  emits the triangles of every requested one. Triangle corners are stored
+  as edge keys (the lowest voxel of the cube edge and its axis), and the
+  vertices of each label are then welded through a hash on those keys, so
+  the meshes are watertight without any per-slice bookkeeping. The result
+  is independent of the number of threads.
+  -------------------------------------------------------------------------*/
+
+// offset of the lowest voxel and axis (0=x, 1=y, 2=z) of the 12 cube edges,
+// numbered as in the marching cubes tables (see mc_table.gif)
+static const int mc_edge[12][4] = {
+  {0,0,0,0}, {0,0,0,1}, {0,1,0,0}, {1,0,0,1},
+  {0,0,0,2}, {1,0,0,2}, {0,1,0,2}, {1,1,0,2},
+  {0,0,1,0}, {0,0,1,1}, {0,1,1,0}, {1,0,1,1}
+};
+
+static int (*mcTable(int connectivity))[19] {
+  switch (connectivity) {
+  case 1:
+    return MC6p;
+  case 2:
+    return MC18;
+  case 3:
+    return MC6;
+  default:
+    return MC26;
+  }
+}
+
+void generateMCtesselationMulti(MRI *mri, const int *labels, int nlabels,
+                                int connectivity, MRIS **mris_table) {
+  int n, s, nslabs, slot[256];
+  int (*MC)[19] = mcTable(connectivity);
+  const int width=mri->width, height=mri->height, depth=mri->depth;
+
+  for (n=0;n<256;n++) slot[n]=-1;
+  for (n=0;n<nlabels;n++) {
+    if (labels[n] < 0 || labels[n] > 255)
+      ErrorExit(ERROR_BADPARM, "%s: label %d out of range [0 255]",
+                Progname, labels[n]);
+    if (slot[labels[n]] >= 0)
+      ErrorExit(ERROR_BADPARM, "%s: label %d given twice",
+                Progname, labels[n]);
+    slot[labels[n]]=n;
+  }
+
+  /* slab of slices [kmin kmax) -> triangles (3 edge keys) of each label */
+  nslabs = MIN(depth-1, 64);
+  std::vector< std::vector< std::vector<long> > > tris(nslabs);
+
+  fprintf(stderr,"generating %d surfaces in %d slabs...", nlabels, nslabs);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic)
+#endif
+  for (s=0;s<nslabs;s++) {
+    ROMP_PFLB_begin
+    int i,j,k,c,p,ref,vals[8];
+    const int kmin = s*(depth-1)/nslabs, kmax = (s+1)*(depth-1)/nslabs;
+    std::vector< std::vector<long> > &slabtris = tris[s];
+
+    slabtris.resize(nlabels);
+    for (k=kmin;k<kmax;k++)
+      for (j=0;j<height-1;j++) {
+        const unsigned char *p00=&MRIvox(mri,0,j,k), *p10=&MRIvox(mri,0,j+1,k);
+        const unsigned char *p01=&MRIvox(mri,0,j,k+1), *p11=&MRIvox(mri,0,j+1,k+1);
+        for (i=0;i<width-1;i++) {
+          /* corners in the order of the bits of the cube index */
+          vals[0]=p00[i];
+          vals[1]=p00[i+1];
+          vals[2]=p10[i];
+          vals[3]=p10[i+1];
+          vals[4]=p01[i];
+          vals[5]=p01[i+1];
+          vals[6]=p11[i];
+          vals[7]=p11[i+1];
+          for (c=1;c<8;c++) if (vals[c]!=vals[0]) break;
+          if (c==8) continue;  // no surface goes through this cube
+
+          for (c=0;c<8;c++) {
+            const int label=vals[c];
+            /* each distinct requested label once */
+            if (slot[label]<0) continue;
+            for (p=0;p<c;p++) if (vals[p]==label) break;
+            if (p<c) continue;
+
+            for (ref=0,p=c;p<8;p++)
+              if (vals[p]==label) ref |= (1 << p);
+            std::vector<long> &t = slabtris[slot[label]];
+            for (p=0;MC[ref][p]>=0;p++) {
+              const int *e=mc_edge[MC[ref][p]];
+              t.push_back(3*((long)(i+e[0]) + (long)width*((j+e[1]) + (long)height*(k+e[2]))) + e[3]);
+            }
+          }
+        }
+      }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  /* weld the vertices of each label, in the order they are first used */
+  std::vector< std::vector<long> > vertices(nlabels);
+  std::vector< std::vector<int> > faces(nlabels);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic)
+#endif
+  for (n=0;n<nlabels;n++) {
+    ROMP_PFLB_begin
+    size_t ntotal=0;
+    for (int t=0;t<nslabs;t++) ntotal += tris[t][n].size();
+    std::unordered_map<long,int> index(ntotal/2+1);
+    faces[n].reserve(ntotal);
+    for (int t=0;t<nslabs;t++) {
+      for (long key : tris[t][n]) {
+        auto it = index.insert(std::make_pair(key, (int)vertices[n].size()));
+        if (it.second) vertices[n].push_back(key);
+        faces[n].push_back(it.first->second);
+      }
+      std::vector<long>().swap(tris[t][n]);
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+  fprintf(stderr,"done\n");
+
+  /* build the surfaces with the single label code */
+  for (n=0;n<nlabels;n++) {
+    tesselation_parms parms;
+    int vno, fno, nvertices=vertices[n].size(), nfaces=faces[n].size()/3;
+
+    mris_table[n]=NULL;
+    if (nfaces==0) continue;
+
+    memset(&parms, 0, sizeof(parms));
+    parms.mri=mri;
+    parms.mris_table=mris_table;
+    parms.ind=n;
+    parms.vertex_index=nvertices;
+    parms.face_index=nfaces;
+    parms.vertex=(quad_vertex_type *)calloc(nvertices,sizeof(quad_vertex_type));
+    parms.face=(quad_face_type *)calloc(nfaces,sizeof(quad_face_type));
+    if (!parms.vertex || !parms.face)
+      ErrorExit(ERROR_NOMEMORY,"%s: could not allocate surface of label %d",
+                Progname,labels[n]);
+    for (vno=0;vno<nvertices;vno++) {
+      const long key=vertices[n][vno], vox=key/3;
+      const int axis=key%3;
+      /* vertices sit in the middle of their edge */
+      parms.vertex[vno].i = vox%width + (axis==0 ? 0.5 : 0);
+      parms.vertex[vno].j = (vox/width)%height + (axis==1 ? 0.5 : 0);
+      parms.vertex[vno].imnr = vox/((long)width*height) + (axis==2 ? 0.5 : 0);
+    }
+    for (fno=0;fno<nfaces;fno++) {
+      parms.face[fno].v[0]=faces[n][3*fno];
+      parms.face[fno].v[1]=faces[n][3*fno+1];
+      parms.face[fno].v[2]=faces[n][3*fno+2];
+    }
+    std::vector<long>().swap(vertices[n]);
+    std::vector<int>().swap(faces[n]);
+
+    fprintf(stderr,"constructing surface of label %d...",labels[n]);
+    saveTesselation2(&parms);
+    fprintf(stderr,"done\n");
+    free(parms.vertex);
+    free(parms.face);
+  }
+}
+
+/* reverses the orientation of the faces and keeps the main component */
+static MRIS *correctTesselation(MRIS *mris, MRI *mri_orig, const char *fname) {
+  MRIS *mris_corrected;
+
+  {
+    float dist,max_e=0.0;
+    int n,p,vn0,vn2;
+    fprintf(stderr,"computing the maximum edge length...");
+    for (n = 0 ; n < mris->nvertices ; n++) {
+      VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[n];
+      VERTEX          const * const v  = &mris->vertices         [n];
+      for (p = 0 ; p < vt->vnum ; p++) {
+        VERTEX const * const vp = &mris->vertices[vt->v[p]];
+        dist=SQR(vp->x - v->x)+SQR(vp->y - v->y)+SQR(vp->z - v->z);
+        if (dist>max_e) max_e=dist;
+      }
+    }
+    fprintf(stderr,"%f mm",sqrt(max_e));
+    fprintf(stderr,"\nreversing orientation of faces...");
+    for (n = 0 ; n < mris->nfaces ; n++) {
+      vn0=mris->faces[n].v[0];
+      vn2=mris->faces[n].v[2];
+      /* vertex 0 becomes vertex 2 */
+      { 
+        VERTEX_TOPOLOGY* const v=&mris->vertices_topology[vn0];
+        for (p = 0 ; p < v->num ; p++)
+          if (v->f[p]==n)
+            v->n[p]=2;
+        mris->faces[n].v[2]=vn0;
+      }
+      /* vertex 2 becomes vertex 0 */
+      { 
+        VERTEX_TOPOLOGY* const v=&mris->vertices_topology[vn2];
+        for (p = 0 ; p < v->num ; p++)
+          if (v->f[p]==n)
+            v->n[p]=0;
+        mris->faces[n].v[0]=vn2;
+      }
+    }
+  }
+
+  mrisCheckVertexFaceTopology(mris);
+
+  fprintf(stderr,"\nchecking orientation of surface...");
+  MRISmarkOrientationChanges(mris);
+  mris_corrected=MRISextractMainComponent(mris,0,1,0);
+
+  MRISfree(&mris);
+
+  //MRISaddCommandLine(mris_corrected, cmdline);
+  strcpy(mris_corrected->fname, fname);
+  MRIScopyVolGeomFromMRI(mris_corrected, mri_orig) ;
+  //if (mriConformed(mri_orig) == 0) {
+  //  printf("input volume is not conformed - using useRealRAS=1\n") ;
+  //  mris_corrected->useRealRAS = 1 ;
+  //}   // (mr) maybe bad idea to assume this, e.g. in highres stream volume will not be 256 cube
+  //  getVolGeom(mri, &mris_corrected->vg);
+  return mris_corrected;
+}
+
 int main(int argc, char *argv[]) {
   tesselation_parms *parms;
   MRIS **mris_table, *mris,*mris_corrected;
+  int connectivity;
   MRI *mri, *mri_orig;
 
   std::string cmdline = getAllInfo(argc, argv, "mri_mc");
 
   Progname=argv[0];
 
-  if (argc > 1 && (stricmp(argv[1], "-d") == 0)) {
-    downsample = atoi(argv[2]) ;
-    argc -= 2;
-    argv += 2 ;
-    printf("downsampling input volume %d times\n", downsample) ;
+  for (;;) {
+    if (argc > 2 && (stricmp(argv[1], "-d") == 0)) {
+      downsample = atoi(argv[2]) ;
+      argc -= 2;
+      argv += 2 ;
+      printf("downsampling input volume %d times\n", downsample) ;
+    } else if (argc > 2 && (stricmp(argv[1], "-threads") == 0)) {
+#ifdef HAVE_OPENMP
+      omp_set_num_threads(atoi(argv[2]));
+#endif
+      argc -= 2;
+      argv += 2 ;
+    } else
+      break;
   }
 
   if (argc < 4) {
-    fprintf(stderr,"\n\nUSAGE: mri_mc input_volume "
+    fprintf(stderr,"\n\nUSAGE: mri_mc [-d n] [-threads n] input_volume "
             "label_value output_surface [connectivity]");
     fprintf(stderr,
-            "\noption connectivity: 1=6+,2=18,3=6,4=26 (default=1)\n\n");
+            "\noption connectivity: 1=6+,2=18,3=6,4=26 (default=1)\n");
+    fprintf(stderr,
+            "\nlabel_value can be a comma-separated list of labels, which "
+            "are\nall tessellated in a single parallel pass. output_surface "
+            "must\nthen contain %%d, which is replaced by the label.\n\n");
     exit(-1);
   }
 
@@ -853,19 +1108,63 @@ int main(int argc, char *argv[]) {
     mri = mri_tmp ;
   }
 
+  std::vector<int> labels;
+  {
+    std::string list = argv[2];
+    size_t start = 0, end;
+    do {
+      end = list.find(',', start);
+      labels.push_back(atoi(list.substr(start, end-start).c_str()));
+      start = end+1;
+    } while (end != std::string::npos);
+  }
+  if (argc==5) connectivity=atoi(argv[4]);
+  else connectivity=1;
+
+  if (labels.size() > 1) {
+    char fname[STRLEN];
+    int n;
+
+    if (!strstr(argv[3], "%d"))
+      ErrorExit(ERROR_BADPARM, "%s: output surface %s must contain %%d "
+                "when several labels are given", Progname, argv[3]);
+    mris_table=(MRIS**)calloc(labels.size(),sizeof(MRIS*));
+    if (!mris_table)
+      ErrorExit(ERROR_NOMEMORY, "labels/surfaces tables\n") ;
+    generateMCtesselationMulti(mri, &labels[0], labels.size(), connectivity,
+                               mris_table);
+    for (n = 0 ; n < (int)labels.size() ; n++) {
+      if (!mris_table[n]) {
+        fprintf(stderr,"WARNING: label %d not found, no surface written\n",
+                labels[n]);
+        continue;
+      }
+      mris_corrected=correctTesselation(mris_table[n], mri_orig, argv[1]);
+      sprintf(fname, argv[3], labels[n]);
+      fprintf(stderr,"\nwriting out surface %s...", fname);
+      MRISwrite(mris_corrected,fname);
+      fprintf(stderr,"done\n");
+      MRISfree(&mris_corrected);
+    }
+    free(mris_table);
+    free(parms);
+    MRIfree(&mri);
+    MRIfree(&mri_orig);
+    return 0;
+  }
+
   parms->mri=mri;
 
   parms->number_of_labels=1; //only one single label
   parms->label_values=(int*)malloc(sizeof(int));
-  parms->label_values[0]=atoi(argv[2]);//label;
+  parms->label_values[0]=labels[0];//label;
   parms->ind=0;
   mris_table=(MRIS**)malloc(sizeof(MRIS*)); //final surface information
   parms->mris_table=mris_table;
   if ((!parms->label_values) || (!mris_table))
     ErrorExit(ERROR_NOMEMORY, "labels/surfaces tables\n") ;
 
-  if (argc==5) parms->connectivity=atoi(argv[4]);//connectivity;
-  else parms->connectivity=1;
+  parms->connectivity=connectivity;
 
   initTesselationParms(parms);
 
@@ -876,60 +1175,9 @@ int main(int argc, char *argv[]) {
   free(parms->mris_table);
   freeTesselationParms(&parms);
 
-  {
-    float dist,max_e=0.0;
-    int n,p,vn0,vn2;
-    fprintf(stderr,"computing the maximum edge length...");
-    for (n = 0 ; n < mris->nvertices ; n++) {
-      VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[n];
-      VERTEX          const * const v  = &mris->vertices         [n];
-      for (p = 0 ; p < vt->vnum ; p++) {
-        VERTEX const * const vp = &mris->vertices[vt->v[p]];
-        dist=SQR(vp->x - v->x)+SQR(vp->y - v->y)+SQR(vp->z - v->z);
-        if (dist>max_e) max_e=dist;
-      }
-    }
-    fprintf(stderr,"%f mm",sqrt(max_e));
-    fprintf(stderr,"\nreversing orientation of faces...");
-    for (n = 0 ; n < mris->nfaces ; n++) {
-      vn0=mris->faces[n].v[0];
-      vn2=mris->faces[n].v[2];
-      /* vertex 0 becomes vertex 2 */
-      { 
-        VERTEX_TOPOLOGY* const v=&mris->vertices_topology[vn0];
-        for (p = 0 ; p < v->num ; p++)
-          if (v->f[p]==n)
-            v->n[p]=2;
-        mris->faces[n].v[2]=vn0;
-      }
-      /* vertex 2 becomes vertex 0 */
-      { 
-        VERTEX_TOPOLOGY* const v=&mris->vertices_topology[vn2];
-        for (p = 0 ; p < v->num ; p++)
-          if (v->f[p]==n)
-            v->n[p]=0;
-        mris->faces[n].v[0]=vn2;
-      }
-    }
-  }
-
-  mrisCheckVertexFaceTopology(mris);
-
-  fprintf(stderr,"\nchecking orientation of surface...");
-  MRISmarkOrientationChanges(mris);
-  mris_corrected=MRISextractMainComponent(mris,0,1,0);
-
-  MRISfree(&mris);
+  mris_corrected=correctTesselation(mris, mri_orig, argv[1]);
 
   fprintf(stderr,"\nwriting out surface...");
-  //MRISaddCommandLine(mris_corrected, cmdline);
-  strcpy(mris_corrected->fname, argv[1]);
-  MRIScopyVolGeomFromMRI(mris_corrected, mri_orig) ;
-  //if (mriConformed(mri_orig) == 0) {
-  //  printf("input volume is not conformed - using useRealRAS=1\n") ;
-  //  mris_corrected->useRealRAS = 1 ;
-  //}   // (mr) maybe bad idea to assume this, e.g. in highres stream volume will not be 256 cube
-  //  getVolGeom(mri, &mris_corrected->vg);
   MRISwrite(mris_corrected,argv[3]);
   fprintf(stderr,"done\n");
 
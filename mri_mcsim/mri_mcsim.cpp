@@ -46,8 +46,14 @@ mri_mcsim --o /path/to/mult-comp-cor/fsaverage/lh/superiortemporal --base mc-z
 When running mri_glmfit, make sure to use   --label labeldir/lh.superiortemporal.label
 When running mri_glmfit-sim, add --cache-dir /path/to/mult-comp-cor --cache-label superiortemporal
 
-Example 3: running simulations in parallel (two jobs, 5000 iterations
-each for a total of 10000)
+Example 3: running simulations in parallel
+
+Within one job, add --threads N to run N repetitions at a time. The
+repetitions are seeded from --seed and the repetition number, so the
+tables do not depend on the number of threads.
+
+The simulation can also be split into jobs (two jobs, 5000 iterations
+each for a total of 10000). Give each job a different --seed.
 
 mri_mcsim --o /path/to/mult-comp-cor/fsaverage/lh/superiortemporal --base mc-z.j001 
   --save-iter  --surf fsaverage lh --nreps 5000
@@ -101,6 +107,10 @@ double round(double x);
 #include "volcluster.h"
 #include "surfcluster.h"
 #include "randomfields.h"
+#include "clusterlabel.h"
+#include "romp_support.h"
+
+#include <vector>
 
 static int  parse_commandline(int argc, char **argv);
 static void check_options(void);
@@ -151,26 +161,46 @@ int *nSmoothsList;
 double fwhmmax=30;
 int SaveWeight=0;
 int FixFSALH = 1;
+int nthreads = 1;
+int *maskoutvtxno;
+double avgvtxarea;
+
+/* Nearest-neighbor smoothing on the surface, same as
+   MRISsmoothMRIFastFrame() but without its static cache so that it can
+   run on many maps at once. */
+typedef struct {
+  std::vector<int> rowptr, nbr; // self first, then unmasked unripped neighbors
+  std::vector<char> rip;        // out of mask
+} MCSIM_SMOOTHER;
+
+typedef struct {
+  MRI *z, *zabs, *p, *sig;
+  RFS *rfs;
+  std::vector<float> tmp, val;
+  CLUSTER_WORKSPACE *work;
+} MCSIM_THREAD;
+
+MCSIM_SMOOTHER *smoother;
+CLUSTER_GRAPH *graph;
+MCSIM_THREAD *threads;
+
+static MCSIM_SMOOTHER *mcsimSmootherInit(MRIS *surf, MRI *mask);
+static void mcsimSmooth(const MCSIM_SMOOTHER *sm, MRI *z, std::vector<float> &tmp, int nsteps);
+static unsigned long mcsimRepSeed(int seed, int rep);
+static void mcsimRepetition(int rep, MCSIM_THREAD *t);
 
 /*---------------------------------------------------------------*/
 int main(int argc, char *argv[]) {
-  int nargs, n, err,k, *maskoutvtxno;
+  int nargs, n, err;
   char tmpstr[2000], *SUBJECTS_DIR, fname[2000];
   const char *signstr = NULL; // Is this intended to mask the global?
   //char *OutDir = NULL;
-  RFS *rfs;
-  int nSmoothsPrev, nSmoothsDelta;
-  MRI *z, *zabs=NULL, *sig=NULL, *p=NULL;
   int FreeMask = 0;
   int nthSign, nthFWHM, nthThresh;
-  double sigmax, zmax, threshadj, csize, csizeavg, cweightvtx, searchspace,avgvtxarea;
-  int csizen;
-  int nClusters, cmax,rmax,smax;
-  SURFCLUSTERSUM *SurfClustList;
+  double searchspace;
   Timer mytimer;
   LABEL *clabel;
   FILE *fp, *fpLog=NULL;
-  float **ppVal, **ppSig, **ppVal0, **ppSig0, **ppZ, **ppZ0;
 
   nargs = handleVersionOption(argc, argv, "mri_mcsim");
   if (nargs && argc - nargs == 1) exit (0);
@@ -359,15 +389,27 @@ int main(int argc, char *argv[]) {
     fprintf(fp,"%5.1f %4d\n",FWHMList[nthFWHM],nSmoothsList[nthFWHM]);
   fclose(fp);
 
-  // Alloc the z and sig maps
-  z   = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, 1);
-  sig = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, 1);
-
-  // Set up the random field specification
-  rfs = RFspecInit(SynthSeed,NULL);
-  rfs->name = strcpyalloc("gaussian");
-  rfs->params[0] = 0;
-  rfs->params[1] = 1;
+  // Neighborhoods for smoothing and clustering, shared by all threads
+  smoother = mcsimSmootherInit(surf, mask);
+  graph = clustGraphFromSurf(surf);
+
+  // Per-thread maps, random field and cluster workspace
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  // new, not calloc, so that the vectors are constructed
+  threads = new MCSIM_THREAD[nthreads];
+  for(n=0; n < nthreads; n++){
+    threads[n].z = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, 1);
+    threads[n].zabs = threads[n].p = threads[n].sig = NULL;
+    threads[n].rfs = RFspecInit(SynthSeed,NULL);
+    threads[n].rfs->name = strcpyalloc("gaussian");
+    threads[n].rfs->params[0] = 0;
+    threads[n].rfs->params[1] = 1;
+    threads[n].tmp.resize(surf->nvertices);
+    threads[n].val.resize(surf->nvertices);
+    threads[n].work = clustWorkspaceAlloc(graph);
+  }
 
   printf("Thresholds (%d): ",nThreshList);
   for(n=0; n < nThreshList; n++) printf("%5.2f ",ThreshList[n]);
@@ -379,117 +421,36 @@ int main(int argc, char *argv[]) {
   for(n=0; n < nFWHMList; n++) printf("%5.2f ",FWHMList[n]);
   printf("\n");
 
-  // Set up pointer to the val field
-  ppVal = (float **) calloc(surf->nvertices,sizeof(float *));
-  ppVal0 = ppVal;
-  ppSig = (float **) calloc(surf->nvertices,sizeof(float *));
-  ppSig0 = ppSig;
-  ppZ = (float **) calloc(surf->nvertices,sizeof(float *));
-  ppZ0 = ppZ;
-  for(k=0; k < surf->nvertices; k++){
-    ppVal[k] = &(surf->vertices[k].val);
-    ppSig[k] = &(MRIFseq_vox(sig,k,0,0,0));
-    ppZ[k] = &(MRIFseq_vox(z,k,0,0,0));
-  }
-
-  // Start the simulation loop
-  printf("\n\nStarting Simulation over %d Repetitions\n",nRepetitions);
-  if(fpLog) fprintf(fpLog,"\n\nStarting Simulation over %d Repetitions\n",nRepetitions);
+  // Start the simulation loop. Each batch runs one repetition per
+  // thread; output is saved and the stop file checked between batches.
+  printf("\n\nStarting Simulation over %d Repetitions (%d threads)\n",nRepetitions,nthreads);
+  if(fpLog) fprintf(fpLog,"\n\nStarting Simulation over %d Repetitions (%d threads)\n",nRepetitions,nthreads);
   mytimer.reset() ;
-  for(nthRep = 0; nthRep < nRepetitions; nthRep++){
+  nthRep = 0;
+  while(nthRep < nRepetitions){
+    int nthRepEnd = MIN(nthRep+nthreads,nRepetitions);
     msecTime = mytimer.milliseconds() ;
-    printf("%5d %7.2f ",nthRep,(msecTime/1000.0)/60);
+    printf("%5d %7.2f\n",nthRep,(msecTime/1000.0)/60);
     fflush(stdout);
     if(fpLog) {
-      fprintf(fpLog,"%5d %7.1f ",nthRep,(msecTime/1000.0)/60);
+      fprintf(fpLog,"%5d %7.1f\n",nthRep,(msecTime/1000.0)/60);
       fflush(fpLog);
     }
-    // Synthesize an unsmoothed z map
-    RFsynth(z,rfs,mask); 
-    nSmoothsPrev = 0;
-    
-    // Loop through FWHMs
-    for(nthFWHM=0; nthFWHM < nFWHMList; nthFWHM++){
-      printf("%d ",nthFWHM);
-      fflush(stdout);
-      if(fpLog) {
-	fprintf(fpLog,"%d ",nthFWHM);
-	fflush(fpLog);
-      }
-      nSmoothsDelta = nSmoothsList[nthFWHM] - nSmoothsPrev;
-      nSmoothsPrev = nSmoothsList[nthFWHM];
-      // Incrementally smooth z
-      MRISsmoothMRIFastFrame(surf, z, 0, nSmoothsDelta, mask);
-      // Rescale
-      RFrescale(z,rfs,mask,z);
-      // Slightly tortured way to get the right p-values because
-      //   RFstat2P() computes one-sided, but I handle sidedness
-      //   during thresholding.
-      // First, use zabs to get a two-sided pval bet 0 and 0.5
-      zabs = MRIabs(z,zabs);
-      p = RFstat2P(zabs,rfs,mask,0,p);
-      // Next, mult pvals by 2 to get two-sided bet 0 and 1
-      MRIscalarMul(p,p,2.0);
-      sig = MRIlog10(p,NULL,sig,1); // sig = -log10(p)
-
-      for(nthSign = 0; nthSign < nSignList; nthSign++){
-	csd = csdList[nthFWHM][0][nthSign]; // just need csd->threshsign
-
-	// If test is not ABS then apply the sign
-	if(csd->threshsign != 0) MRIsetSign(sig,z,0);
-
-	// Get the max stats
-	sigmax = MRIframeMax(sig,0,mask,csd->threshsign,
-			     &cmax,&rmax,&smax);
-	zmax = MRIgetVoxVal(z,cmax,rmax,smax,0);
-	if(csd->threshsign == 0){
-	  zmax = fabs(zmax);
-	  sigmax = fabs(sigmax);
-	}
-	// Mask
-	if(mask) {
-	  //MRImask(sig,mask,sig,0.0,0.0); // a little slow
-	  for(k=0; k < nmaskout; k++) MRIsetVoxVal(sig, maskoutvtxno[k],0,0,0, 0.0);
-	}
-
-	// Copy sig to vertexval
-	//MRIScopyMRI(surf, sig, 0, "val"); // MRIScopyMRI() is a little slow
-	ppVal = ppVal0;
-	ppSig = ppSig0;
-	for(k=0; k < surf->nvertices; k++) *(*ppVal++) = *(*ppSig++);
-
-	for(nthThresh = 0; nthThresh < nThreshList; nthThresh++){
-	  csd = csdList[nthFWHM][nthThresh][nthSign];
-
-	  // Surface clustering
-	  // Set the threshold
-	  if(csd->threshsign == 0) threshadj = csd->thresh;
-	  else threshadj = csd->thresh - log10(2.0); // one-sided test
-	  // Compute clusters
-	  SurfClustList = sclustMapSurfClusters(surf,threshadj,-1,csd->threshsign,
-						0,&nClusters,NULL,NULL);
-	  // Actual area of cluster with max area
-	  csize  = sclustMaxClusterArea(SurfClustList, nClusters);
-	  // Number of vertices of cluster with max number of vertices. 
-	  // Note: this may be a different cluster from above!
-	  csizen = sclustMaxClusterCount(SurfClustList, nClusters);
-	  cweightvtx = sclustMaxClusterWeightVtx(SurfClustList, nClusters, csd->threshsign);
-	  // Area of this cluster based on average vertex area. This just scales
-	  // the number of vertices.
-	  csizeavg = csizen * avgvtxarea;
-	  if(UseAvgVtxArea) csize = csizeavg;
-	  // Store results
-	  csd->nClusters[nthRep] = nClusters;
-	  csd->MaxClusterSize[nthRep] = csize;
-	  csd->MaxClusterSizeVtx[nthRep] = csizen;
-	  csd->MaxClusterWeightVtx[nthRep] = cweightvtx;
-	  csd->MaxSig[nthRep] = sigmax;
-	  csd->MaxStat[nthRep] = zmax;
-	} // Sign
-      } // Thresh
-    } // FWHM
-    printf("\n");
-    if(fpLog) fprintf(fpLog,"\n");
+    ROMP_PF_begin
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic,1)
+    #endif
+    for(int rep = nthRep; rep < nthRepEnd; rep++){
+      ROMP_PFLB_begin
+      int tid = 0;
+      #ifdef HAVE_OPENMP
+      tid = omp_get_thread_num();
+      #endif
+      mcsimRepetition(rep, &threads[tid]);
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+    nthRep = nthRepEnd;
     if(SaveEachIter || fio_FileExistsReadable(SaveFile)) SaveOutput();
     if(fio_FileExistsReadable(StopFile)) {
       printf("Found stop file %s\n",StopFile);
@@ -611,6 +572,14 @@ static int parse_commandline(int argc, char **argv) {
       surfname = pargv[0];
       nargsused = 1;
     } 
+    else if (!strcasecmp(option, "--threads") || !strcasecmp(option, "--nthreads")) {
+      if(nargc < 1) CMDargNErr(option,1);
+      sscanf(pargv[0],"%d",&nthreads);
+      #ifdef HAVE_OPENMP
+      omp_set_num_threads(nthreads);
+      #endif
+      nargsused = 1;
+    }
     else if (!strcasecmp(option, "--avgvtxarea"))    UseAvgVtxArea = 1;
     else if (!strcasecmp(option, "--no-avgvtxarea")) UseAvgVtxArea = 0;
     else if (!strcasecmp(option, "--seed")) {
@@ -701,6 +670,7 @@ static void print_usage(void) {
   printf("   \n");
   printf("   --avgvtxarea : report cluster area based on average vtx area\n");
   printf("   --seed randomseed : default is to choose based on ToD\n");
+  printf("   --threads nthreads : run repetitions in parallel (same result for any nthreads)\n");
   printf("   --label labelfile : default is ?h.cortex.label \n");
   printf("   --mask maskfile : instead of label\n");
   printf("   --no-label : do not use a label to mask\n");
@@ -859,6 +829,7 @@ static void dump_options(FILE *fp) {
   fprintf(fp,"SaveFile %s\n",SaveFile);
   fprintf(fp,"StopFile %s\n",StopFile);
   fprintf(fp,"UFSS %s\n",getenv("USE_FAST_SURF_SMOOTHER"));
+  fprintf(fp,"nthreads %d\n",nthreads);
   fflush(fp);
   return;
 }
@@ -906,3 +877,171 @@ int SaveOutput(void)
   return(0);
 }
 
+
+/*---------------------------------------------------------------
+  mcsimSmootherInit() - neighbor lists for mcsimSmooth(). Vertices
+  out of the mask are ripped and stay 0; neighbors that are ripped
+  or out of the mask are not averaged in.
+  ---------------------------------------------------------------*/
+static MCSIM_SMOOTHER *mcsimSmootherInit(MRIS *surf, MRI *mask)
+{
+  MCSIM_SMOOTHER *sm = new MCSIM_SMOOTHER;
+  int vno, nthnbr, nbrvno;
+
+  sm->rip.resize(surf->nvertices);
+  sm->rowptr.resize(surf->nvertices+1);
+  sm->nbr.reserve(7*surf->nvertices);
+  for(vno=0; vno < surf->nvertices; vno++){
+    sm->rowptr[vno] = sm->nbr.size();
+    sm->rip[vno] = (mask && MRIgetVoxVal(mask,vno,0,0,0) < 0.5);
+    if(sm->rip[vno]) continue;
+    sm->nbr.push_back(vno);
+    VERTEX_TOPOLOGY const * const vt = &surf->vertices_topology[vno];
+    for(nthnbr=0; nthnbr < vt->vnum; nthnbr++){
+      nbrvno = vt->v[nthnbr];
+      if(surf->vertices[nbrvno].ripflag) continue;
+      if(mask && MRIgetVoxVal(mask,nbrvno,0,0,0) < 0.5) continue;
+      sm->nbr.push_back(nbrvno);
+    }
+  }
+  sm->rowptr[surf->nvertices] = sm->nbr.size();
+  return(sm);
+}
+
+/*---------------------------------------------------------------
+  mcsimSmooth() - nsteps of nearest-neighbor averaging of frame 0
+  of z, giving the same result as MRISsmoothMRIFastFrame(). tmp must
+  have nvertices elements.
+  ---------------------------------------------------------------*/
+static void mcsimSmooth(const MCSIM_SMOOTHER *sm, MRI *z, std::vector<float> &tmp, int nsteps)
+{
+  int nvertices = sm->rip.size(), vno, k, nthstep;
+  float sumF;
+
+  for(vno=0; vno < nvertices; vno++)
+    if(sm->rip[vno]) MRIFseq_vox(z,vno,0,0,0) = 0;
+
+  for(nthstep=0; nthstep < nsteps; nthstep++){
+    for(vno=0; vno < nvertices; vno++){
+      if(sm->rip[vno]) continue;
+      sumF = 0;
+      for(k = sm->rowptr[vno]; k < sm->rowptr[vno+1]; k++)
+	sumF += MRIFseq_vox(z,sm->nbr[k],0,0,0);
+      tmp[vno] = sumF / (sm->rowptr[vno+1]-sm->rowptr[vno]);
+    }
+    for(vno=0; vno < nvertices; vno++){
+      if(sm->rip[vno]) continue;
+      MRIFseq_vox(z,vno,0,0,0) = tmp[vno];
+    }
+  }
+}
+
+/*---------------------------------------------------------------
+  mcsimRepSeed() - seed of the random stream of a repetition. It
+  depends only on the global seed and the repetition number so the
+  simulation does not depend on the number of threads. Never 0
+  (RFspecSetSeed() would then use the time of day).
+  ---------------------------------------------------------------*/
+static unsigned long mcsimRepSeed(int seed, int rep)
+{
+  unsigned long long x = ((unsigned long long)(unsigned int)seed << 32) + (unsigned int)rep;
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  x = x ^ (x >> 31);
+  x &= 0xFFFFFFFFUL;
+  if(x == 0) x = 1;
+  return((unsigned long)x);
+}
+
+/*---------------------------------------------------------------
+  mcsimRepetition() - run one repetition: synthesize a white z map,
+  then for each FWHM smooth it further and fill in all the signs and
+  thresholds for this rep in the CSDs. Uses only the maps in t, so
+  repetitions can run in parallel; each one writes its own CSD slot.
+  ---------------------------------------------------------------*/
+static void mcsimRepetition(int rep, MCSIM_THREAD *t)
+{
+  int nthFWHM, nthSign, nthThresh, nSmoothsPrev, nClusters, csizen, k;
+  int cmax, rmax, smax, thsign;
+  double sigmax, zmax, threshadj, csize, cweightvtx, w;
+  CSD *csd;
+  CLUSTER_WORKSPACE *work = t->work;
+
+  // Synthesize an unsmoothed z map
+  RFspecSetSeed(t->rfs, mcsimRepSeed(SynthSeed,rep));
+  RFsynth(t->z,t->rfs,mask);
+  nSmoothsPrev = 0;
+
+  // Loop through FWHMs
+  for(nthFWHM=0; nthFWHM < nFWHMList; nthFWHM++){
+    // Incrementally smooth z
+    mcsimSmooth(smoother, t->z, t->tmp, nSmoothsList[nthFWHM] - nSmoothsPrev);
+    nSmoothsPrev = nSmoothsList[nthFWHM];
+    // Rescale
+    RFrescale(t->z,t->rfs,mask,t->z);
+    // Slightly tortured way to get the right p-values because
+    //   RFstat2P() computes one-sided, but I handle sidedness
+    //   during thresholding.
+    // First, use zabs to get a two-sided pval bet 0 and 0.5
+    t->zabs = MRIabs(t->z,t->zabs);
+    t->p = RFstat2P(t->zabs,t->rfs,mask,0,t->p);
+    // Next, mult pvals by 2 to get two-sided bet 0 and 1
+    MRIscalarMul(t->p,t->p,2.0);
+    t->sig = MRIlog10(t->p,NULL,t->sig,1); // sig = -log10(p)
+
+    for(nthSign = 0; nthSign < nSignList; nthSign++){
+      thsign = SignList[nthSign];
+
+      // If test is not ABS then apply the sign
+      if(thsign != 0) MRIsetSign(t->sig,t->z,0);
+
+      // Get the max stats
+      sigmax = MRIframeMax(t->sig,0,mask,thsign,&cmax,&rmax,&smax);
+      zmax = MRIgetVoxVal(t->z,cmax,rmax,smax,0);
+      if(thsign == 0){
+	zmax = fabs(zmax);
+	sigmax = fabs(sigmax);
+      }
+      // Mask
+      if(mask) for(k=0; k < nmaskout; k++) MRIFseq_vox(t->sig,maskoutvtxno[k],0,0,0) = 0.0;
+      for(k=0; k < surf->nvertices; k++) t->val[k] = MRIFseq_vox(t->sig,k,0,0,0);
+
+      for(nthThresh = 0; nthThresh < nThreshList; nthThresh++){
+	csd = csdList[nthFWHM][nthThresh][nthSign];
+
+	// Set the threshold
+	if(thsign == 0) threshadj = csd->thresh;
+	else threshadj = csd->thresh - log10(2.0); // one-sided test
+	// Compute clusters
+	nClusters = clustLabelGraph(graph, &t->val[0], threshadj, -1, thsign, 0, work);
+	// Actual area of cluster with max area
+	csize = clustWorkspaceMaxSize(work);
+	// Number of vertices of cluster with max number of vertices, and
+	// the weight of the cluster with the max weight (same as
+	// sclustMaxClusterCount() and sclustMaxClusterWeightVtx()).
+	// Note: these may be different clusters from above!
+	csizen = 0;
+	if(nClusters == 0 || thsign == 0) cweightvtx = 0;
+	else cweightvtx = -thsign * 10e10;
+	for(k=0; k < nClusters; k++){
+	  csizen = MAX(csizen,work->clusters[k].nmembers);
+	  w = (float)work->clusters[k].weight;
+	  if(thsign == 0 && fabs(cweightvtx) < fabs(w)) cweightvtx = w;
+	  if(thsign == +1 && cweightvtx < w) cweightvtx = w;
+	  if(thsign == -1 && cweightvtx > w) cweightvtx = w;
+	}
+	// Area of this cluster based on average vertex area. This just scales
+	// the number of vertices.
+	if(UseAvgVtxArea) csize = csizen * avgvtxarea;
+	// Store results
+	csd->nClusters[rep] = nClusters;
+	csd->MaxClusterSize[rep] = csize;
+	csd->MaxClusterSizeVtx[rep] = csizen;
+	csd->MaxClusterWeightVtx[rep] = cweightvtx;
+	csd->MaxSig[rep] = sigmax;
+	csd->MaxStat[rep] = zmax;
+      } // Thresh
+    } // Sign
+  } // FWHM
+}
@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+source "$(dirname $0)/../test.sh"
+
+# there is no testdata tarball: the simulation runs on the installed fsaverage5,
+# and the output of one thread is the reference for the output of several
+mkdir -p $FSTEST_TESTDATA_DIR
+export FSTEST_NO_DATA_RESET=1
+
+for nthreads in 1 4; do
+    test_command mri_mcsim --sd ${FREESURFER_HOME}/subjects --surf fsaverage5 lh \
+        --o mcsim.threads${nthreads} --base mc-z --nreps 20 --fwhm 5 10 \
+        --seed 1234 --threads ${nthreads}
+done
+
+# the headers hold the command line, so only the simulation rows are compared
+for csd in $(cd mcsim.threads1 && find . -name mc-z.csd); do
+    diff <(grep -v '^#' mcsim.threads1/${csd}) <(grep -v '^#' mcsim.threads4/${csd}) \
+        || error_exit "${csd} differs between 1 and 4 threads"
+done
@@ -477,6 +477,7 @@ int ConvGaussian = 0;
 int UseDualHemi = 0; // Assume ?h.?h.surfreg file name, source only
 MRI *RegTarg = NULL;
 int UseOldSurf2Surf = 1;
+char *RegOpFile = NULL;
 char *PatchFile=NULL, *SurfTargName=NULL;
 int nPatchDil=0;
 struct utsname uts;
@@ -1034,7 +1035,34 @@ int main(int argc, char **argv)
       MRIS *SurfRegList[2];
       SurfRegList[0] = SrcSurfReg;
       SurfRegList[1] = TrgSurfReg;
-      TrgVals = MRISapplyReg(SrcVals, SurfRegList, 2, ReverseMapFlag,jac,UseHash);
+      if(RegOpFile == NULL)
+	TrgVals = MRISapplyReg(SrcVals, SurfRegList, 2, ReverseMapFlag,jac,UseHash);
+      else {
+	// Reuse the mapping if it has already been saved for this
+	// registration and these settings, otherwise build and save it
+	MRIS_APPLYREG_OP *RegOp = NULL;
+	if(fio_FileExistsReadable(RegOpFile)){
+	  printf("Reading registration operator %s\n",RegOpFile);
+	  RegOp = MRISapplyRegOpRead(RegOpFile);
+	  if(RegOp == NULL){
+	    printf("ERROR: cannot use %s, delete it to rebuild the operator\n",RegOpFile);
+	    exit(1);
+	  }
+	  if(!MRISapplyRegOpMatch(RegOp, SurfRegList, 2, ReverseMapFlag, jac)){
+	    printf("ERROR: operator in %s does not match this registration, delete it to rebuild\n",RegOpFile);
+	    exit(1);
+	  }
+	}
+	if(RegOp == NULL){
+	  RegOp = MRISapplyRegBuildOp(SurfRegList, 2, ReverseMapFlag, jac, UseHash);
+	  if(RegOp == NULL) exit(1);
+	  printf("Saving registration operator to %s\n",RegOpFile);
+	  if(MRISapplyRegOpWrite(RegOp, RegOpFile)) exit(1);
+	}
+	TrgVals = MRISapplyRegOp(RegOp, SrcVals, NULL);
+	MRISapplyRegOpFree(&RegOp);
+      }
+      if(TrgVals == NULL) exit(1);
     }
 
   } else {
@@ -1276,6 +1304,12 @@ static int parse_commandline(int argc, char **argv)
     }
     else if (!strcasecmp(option, "--old"))UseOldSurf2Surf = 1;
     else if (!strcasecmp(option, "--new")) UseOldSurf2Surf = 0;
+    else if (!strcasecmp(option, "--reg-op")){
+      if (nargc < 1) CMDargNErr(option,1);
+      RegOpFile = pargv[0];
+      UseOldSurf2Surf = 0;
+      nargsused = 1;
+    }
     else if (!strcasecmp(option, "--usehash")) {
       UseHash = 1;
     } else if (!strcasecmp(option, "--hash")) {
@@ -1863,6 +1897,9 @@ static void print_usage(void)
   printf("   --srcsurfreg source surface registration (sphere.reg)  \n");
   printf("   --trgsurfreg target surface registration (sphere.reg)  \n");
   printf("   --mapmethod  nnfr or nnf\n");
+  printf("   --reg-op opfile : save the mapping in opfile (eg, next to sphere.reg) and reuse it\n");
+  printf("                     on later runs with the same surfaces (implies --new).\n");
+  printf("                     Exits with an error if opfile was made for other surfaces\n");
   printf("   --frame      save only nth frame (with --trg_type paint)\n");
   printf("   --fwhm-src fwhmsrc: smooth the source to fwhmsrc\n");
   printf("   --fwhm-trg fwhmtrg: smooth the target to fwhmtrg\n");
@@ -42,6 +42,7 @@
 #include <math.h>
 #include <string.h>
 #include <sys/time.h>
+#include <vector>
 
 #include "icosahedron.h"
 #include "MRIio_old.h"
@@ -191,6 +192,7 @@ char *vsmfile = NULL;
 MRI *vsm = NULL;
 int pedir = 2;
 int UseOld = 1;
+char *SampleOpFile = NULL;
 MRI *MRIvol2surf(MRI *SrcVol, MATRIX *Rtk, MRI_SURFACE *TrgSurf, 
 		 MRI *vsm, int InterpMethod, MRI *SrcHitVol, 
 		 float ProjFrac, int ProjType, int nskip);
@@ -494,6 +496,53 @@ int main(int argc, char **argv) {
                                   mri_wm, mri_gm, mri_csf) ;
     MatrixFree(&Qsrc) ; MatrixFree(&QFWDsrc) ;
   }
+  else if (!UseOld && (interpmethod == SAMPLE_NEAREST || interpmethod == SAMPLE_TRILINEAR))
+  {
+    // Compute the sampling once for all projections and frames
+    MRI_VOL2SURF_OP *SampleOp = NULL;
+    std::vector<float> ProjFracList;
+    printf("Projecting %g %g %g\n",ProjFracMin,ProjFracMax,ProjFracDelta);
+    for (ProjFrac=ProjFracMin; 
+         ProjFrac <= ProjFracMax; 
+         ProjFrac += ProjFracDelta) {
+      printf("%2d %g %g %g\n",(int)ProjFracList.size()+1,ProjFrac,ProjFracMin,ProjFracMax);
+      ProjFracList.push_back(ProjFrac);
+    }
+    if(ProjFracList.empty()){
+      printf("ERROR: no projection fractions between %g and %g\n",ProjFracMin,ProjFracMax);
+      exit(1);
+    }
+    if(SampleOpFile && fio_FileExistsReadable(SampleOpFile)){
+      printf("Reading sampling operator %s\n",SampleOpFile);
+      SampleOp = MRIvol2surfOpRead(SampleOpFile);
+      if(SampleOp == NULL) {
+	printf("ERROR: cannot use %s, delete it to rebuild the operator\n",SampleOpFile);
+	exit(1);
+      }
+      if(!MRIvol2surfOpMatch(SampleOp, SrcVol, Dsrc, Surf, vsm, interpmethod, &ProjFracList[0],
+			     ProjFracList.size(), ProjDistFlag, pedir)){
+	printf("ERROR: operator in %s does not match this run, delete it to rebuild\n",SampleOpFile);
+	exit(1);
+      }
+    }
+    if(SampleOp == NULL){
+      SampleOp = MRIvol2surfBuildOp(SrcVol, Dsrc, Surf, vsm, interpmethod, &ProjFracList[0],
+				    ProjFracList.size(), ProjDistFlag, pedir);
+      if(SampleOp == NULL) exit(1);
+      if(SampleOpFile){
+	printf("Saving sampling operator to %s\n",SampleOpFile);
+	if(MRIvol2surfOpWrite(SampleOp, SampleOpFile)) exit(1);
+      }
+    }
+    SurfVals = MRIvol2surfOp(SampleOp, SrcVol, GetProjMax, NULL);
+    if (SurfVals == NULL) {
+      printf("ERROR: mapping volume to source\n");
+      exit(1);
+    }
+    // Hits of the last projection, as when sampling one projection at a time
+    MRIvol2surfOpHits(SampleOp, SampleOp->nlayers-1, SrcHitVol);
+    MRIvol2surfOpFree(&SampleOp);
+  }
   else
   {
     printf("Projecting %g %g %g\n",ProjFracMin,ProjFracMax,ProjFracDelta);
@@ -1050,6 +1099,12 @@ static int parse_commandline(int argc, char **argv) {
     else if (!strcmp(option, "--use-new")) {
       UseOld = 0;
     } 
+    else if (!strcmp(option, "--sample-op")) {
+      if (nargc < 1) argnerr(option,1);
+      SampleOpFile = pargv[0];
+      UseOld = 0;
+      nargsused = 1;
+    } 
     else if (!strcmp(option, "--copy-ctab")) {
       setenv("FS_COPY_HEADER_CTAB","1",1);
     } 
@@ -1373,6 +1428,10 @@ static void print_usage(void) {
   printf("   --version   print out version and exit\n");
   printf("\n");
   printf("   --interp    interpolation method (<nearest> or trilinear)\n");
+  printf("   --sample-op opfile : save the vertex-to-voxel sampling in opfile and reuse it\n");
+  printf("                        on later runs with the same surface, volume geometry,\n");
+  printf("                        registration, vsm and projection (implies --use-new).\n");
+  printf("                        Exits with an error if opfile was made for other inputs\n");
   printf("   --vg-thresh thrshold : threshold for  'ERROR: LTAconcat(): LTAs 0 and 1 do not match'\n");
   printf("\n");
   printf("   --vol2surf vol surf projtype projdist projmap reg vsm interp output\n");
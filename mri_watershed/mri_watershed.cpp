@@ -61,6 +61,7 @@
 #include "stats.h"
 #include "timer.h"
 #include "const.h"
+#include "romp_support.h"
 #include "mrishash.h"
 #include "icosahedron.h"
 #include "tritri.h"
@@ -263,7 +264,13 @@ static void SphereAverageVals(Sphere* sphere, int navgs) {
   int const nvertices = sphere->nvertices;
 
   for (int i = 0; i < navgs; i++) {
+    // Note the neighbor values are read from the MRIS, not from the sphere
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
     for (int vno = 0; vno < nvertices; vno++) {
+      ROMP_PFLB_begin
       
       auto const * const vt = &sphere->mris->vertices_topology[vno];
       auto       * const v  = &sphere->vertices               [vno];
@@ -276,7 +283,9 @@ static void SphereAverageVals(Sphere* sphere, int navgs) {
       }
       
       v->tdx = val / (vt->vnum + 1);
+      ROMP_PFLB_end
     }
+    ROMP_PF_end
 
     for (int vno = 0; vno < nvertices; vno++) {
       auto * const v = &sphere->vertices[vno];
@@ -319,12 +328,12 @@ typedef struct
   Bound *Bound1,*Bound2;
 
   Cell *** Basin;
+  MRI *mri_wmlike;       // 1 where the 3x3x3 neighborhood looks like WM
 
-  Coord** Table[256];
+  Coord* Table[256];     // voxels of each intensity, in raster order
 
   unsigned char intbasin[256];
   unsigned long tabdim[256];
-  unsigned long sqrdim[256];
   unsigned long count[256];
 
   Coord* T1Table;
@@ -377,7 +386,7 @@ BasinCell* CreateBasinCell(int val, unsigned long size,
 int Decision(STRIP_PARMS *parms,  MRI_variables *MRI_var);
 void FindMainWmComponent(MRI_variables *MRI_var);
 int CharSorting(MRI_variables *MRI_var);
-int sqroot(int r);
+void ComputeWmLikeVoxels(MRI_variables *MRI_var);
 int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var);
 Cell* FindBasin(Cell *cell);
 int Lookat(int,int,int,unsigned char,int*,Cell**,int*,Cell* adtab[27],
@@ -639,6 +648,15 @@ get_option(int argc, char *argv[],STRIP_PARMS *parms)
            "and writing it to %s...\n", argv[2], argv[3]) ;
     nargs = 2 ;
   }
+  else if (!strcmp(option, "threads") || !strcmp(option, "nthreads"))
+  {
+    int nthreads = atoi(argv[2]);
+#ifdef HAVE_OPENMP
+    omp_set_num_threads(nthreads);
+#endif
+    nargs = 1 ;
+    fprintf(stdout,"Mode:          %d threads\n", nthreads) ;
+  }
   else if (!strcmp(option, "rusage"))
   {
     // resource usage
@@ -2059,7 +2077,6 @@ void Allocation(MRI_variables *MRI_var)
   for (k=0; k<256; k++)
   {
     MRI_var->tabdim[k]=0;
-    MRI_var->sqrdim[k]=0;
     MRI_var->count[k]=0;
     MRI_var->intbasin[k]=k;
     MRI_var->gmnumber[k]=0;
@@ -3334,7 +3351,6 @@ int Decision(STRIP_PARMS *parms,  MRI_variables *MRI_var)
     for (k=0; k<256; k++)
     {
       MRI_var->tabdim[k]=0;
-      MRI_var->sqrdim[k]=0;
       MRI_var->count[k]=0;
       MRI_var->intbasin[k]=k;
       MRI_var->gmnumber[k]=0;
@@ -3353,78 +3369,139 @@ int Decision(STRIP_PARMS *parms,  MRI_variables *MRI_var)
   ------------------------------------------------------*/
 int CharSorting(MRI_variables *MRI_var)
 {
-  int i,j,k,u,v;
-  int l;
-  ldiv_t ld;
-  BUFTYPE *pb;
-  unsigned char val;
-
-  /*allocating an 256 table of Coord** in order to process the Sorting*/
+  int k,val;
+  int nthreads=1;
 
+  /*allocating a table of Coord per intensity in order to process the Sorting*/
   for (k=1; k<MRI_var->Imax+1; k++)
   {
-    l=sqroot(MRI_var->tabdim[k]); // sqrt of the population at grey=k
-    MRI_var->sqrdim[k]=l;
-    MRI_var->Table[k]=(Coord**)malloc(l*sizeof(Coord*));
-    // each Table is a 2d array of Coord
+    MRI_var->Table[k]=(Coord*)calloc(MAX(1,MRI_var->tabdim[k]),sizeof(Coord));
     if (!MRI_var->Table[k])
     {
-      Error("Allocation first Table Echec");
+      Error("Allocation Table Echec");
     }
-    // array is l x l
-    for (u=0; u<l; u++)
-    {
-      MRI_var->Table[k][u]=(Coord*)calloc(l,sizeof(Coord));
-      if (!MRI_var->Table[k][u])
+  }
+
+  /*Sorting itself*/
+  // Counting sort by grey value: each thread counts the voxels of its
+  // slices, then writes them starting after those of the previous
+  // slices, so each Table[k] is in raster order whatever the number of
+  // threads.
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  int nslabs = MIN(nthreads, MAX(1,MRI_var->depth-4));
+  std::vector< std::vector<unsigned long> > offset(nslabs+1, std::vector<unsigned long>(256,0));
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int s=0; s<nslabs; s++)
+  {
+    ROMP_PFLB_begin
+    int k0=2+(MRI_var->depth-4)*s/nslabs, k1=2+(MRI_var->depth-4)*(s+1)/nslabs;
+    std::vector<unsigned long> &cnt=offset[s+1];
+    for (int k=k0; k<k1; k++)
+      for (int j=2; j<MRI_var->height-2; j++)
       {
-        Error("Allocation second Table Echec");
+        BUFTYPE const *pb=&MRIvox(MRI_var->mri_src,2,j,k);
+        for (int i=2; i<MRI_var->width-2; i++)
+        {
+          cnt[*pb++]++;
+        }
       }
-    }
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
-  /*Sorting itself*/
-  // each Table[k] (k=grey value) is a 2D array.  each element of 2D array has
-  // the coordinate of a voxel.
-  // filling 2d array with quot and rem of count
-  // why 2d array?  Maybe this programmer thought that the length of column is
-  // too big to fit in the linear array.  Unnecessary
-  for (k=2; k<MRI_var->depth-2; k++)
-    for (j=2; j<MRI_var->height-2; j++)
-    {
-      pb=&MRIvox(MRI_var->mri_src,0,j,k);
-      pb+=2;
-      for (i=2; i<MRI_var->width-2; i++)
+  // offset[s][val] = where the voxels of grey val in slab s start
+  for (val=0; val<256; val++)
+    offset[0][val]=MRI_var->count[val];
+  for (int s=1; s<=nslabs; s++)
+    for (val=0; val<256; val++)
+      offset[s][val]+=offset[s-1][val];
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int s=0; s<nslabs; s++)
+  {
+    ROMP_PFLB_begin
+    int k0=2+(MRI_var->depth-4)*s/nslabs, k1=2+(MRI_var->depth-4)*(s+1)/nslabs;
+    std::vector<unsigned long> &l=offset[s];
+    for (int k=k0; k<k1; k++)
+      for (int j=2; j<MRI_var->height-2; j++)
       {
-        val=*pb++;
-        if (val)
+        BUFTYPE const *pb=&MRIvox(MRI_var->mri_src,2,j,k);
+        for (int i=2; i<MRI_var->width-2; i++)
         {
-          l=MRI_var->count[val]++;
-          // count[] is a histogram of non-zero grey values
-          ld=ldiv(l,MRI_var->sqrdim[val]);
-          u=ld.quot;
-          v=ld.rem;
-          MRI_var->Table[val][u][v][0]=i;
-          MRI_var->Table[val][u][v][1]=j;
-          MRI_var->Table[val][u][v][2]=k;
+          unsigned char val=*pb++;
+          if (val)
+          {
+            // each Table[k] (k=grey value) has the coordinates of its voxels
+            Coord *crd=&MRI_var->Table[val][l[val]++];
+            (*crd)[0]=i;
+            (*crd)[1]=j;
+            (*crd)[2]=k;
+          }
         }
       }
-    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // count[] is a histogram of non-zero grey values
+  for (val=1; val<256; val++)
+  {
+    MRI_var->count[val]=offset[nslabs][val];
+  }
+
   return 0;
 }
 
-/*sqrt routine*/
-int sqroot(int r)
+/*-----------------------------------------------------
+  ComputeWmLikeVoxels() - marks the voxels whose 3x3x3
+  neighborhood has a mean within [WM_MIN, WM_MAX] and a
+  variance below WM_VARIANCE (the test Test() does when
+  watershed_analyze is set). The image does not change during
+  the flooding, so this is done once for all voxels in parallel.
+  ------------------------------------------------------*/
+void ComputeWmLikeVoxels(MRI_variables *MRI_var)
 {
-  int i;
-  i=(int)sqrt(r);
-  if (i*i<r)
-  {
-    return (i+1);
-  }
-  else
+  MRI_var->mri_wmlike=MRIalloc(MRI_var->width,MRI_var->height,MRI_var->depth,
+                               MRI_UCHAR);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int k=2; k<MRI_var->depth-2; k++)
   {
-    return i;
+    ROMP_PFLB_begin
+    for (int j=2; j<MRI_var->height-2; j++)
+      for (int i=2; i<MRI_var->width-2; i++)
+      {
+        int mean=0,var=0,tp;
+        for (int a = -1 ; a<2 ; a++)
+          for (int b = -1 ; b<2 ; b++)
+            for (int c = -1 ; c<2 ; c++)
+            {
+              tp=MRIvox(MRI_var->mri_src,i+a,j+b,k+c);
+              mean+=tp;
+              var+=SQR(tp);
+            }
+        mean/=27;
+        var=var/27-SQR(mean);
+        MRIvox(MRI_var->mri_wmlike,i,j,k)=
+          (mean>=MRI_var->WM_MIN &&
+           mean<=MRI_var->WM_MAX &&
+           var<=MRI_var->WM_VARIANCE);
+      }
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 }
 
 /*******************************ANALYZE****************************/
@@ -3433,37 +3510,26 @@ int sqroot(int r)
 int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var)
 {
   int pos;
-  int u,v,n,d;
+  int n,d;
   int l;
-  ldiv_t ld;
   double vol_elt;
 
   MRI_var->basinnumber=0;
   MRI_var->basinsize=0;
 
-  n=MRI_var->sqrdim[MRI_var->Imax]; // the sqrt of the population at Imax
-  for (u=0; u<n; u++)
+  if (parms->watershed_analyze)
   {
-    free(MRI_var->Table[MRI_var->Imax][u]);
+    ComputeWmLikeVoxels(MRI_var);
   }
+
   free(MRI_var->Table[MRI_var->Imax]);
 
   for (pos=MRI_var->Imax-1; pos>0; pos--)
   {
-    l=0;
     d=MRI_var->tabdim[pos];  // the population at pos
-    n=MRI_var->sqrdim[pos];  // the sqrt of the d
-    while (l<d)
+    for (l=0; l<d; l++)
     {
-      ld=ldiv(l,n);
-      u=ld.quot;
-      v=ld.rem;
-      Test(MRI_var->Table[pos][u][v],parms,MRI_var);
-      l++;
-    }
-    for (u=0; u<n; u++)
-    {
-      free(MRI_var->Table[pos][u]);
+      Test(MRI_var->Table[pos][l],parms,MRI_var);
     }
     free(MRI_var->Table[pos]);
 
@@ -3489,6 +3555,11 @@ int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var)
     MRI_var->mri_src->xsize*
     MRI_var->mri_src->ysize*
     MRI_var->mri_src->zsize;
+  if (MRI_var->mri_wmlike)
+  {
+    MRIfree(&MRI_var->mri_wmlike);
+  }
+
   fprintf(stdout,"\n      main basin size=%8ld voxels, voxel volume =%.3f ",
           MRI_var->main_basin_size,(float)vol_elt);
   fprintf(stdout,"\n                     = %.0f mmm3 = %.3f cm3"
@@ -3607,8 +3678,7 @@ int Test(Coord crd,STRIP_PARMS *parms,MRI_variables *MRI_var)
 {
   int n,nb=0,dpt=-1;
   unsigned char val;
-  int mean,var,tp=0;
-  int a,b,c;
+  int tp=0;
 
   int i=crd[0],j=crd[1],k=crd[2];
 
@@ -3625,29 +3695,7 @@ int Test(Coord crd,STRIP_PARMS *parms,MRI_variables *MRI_var)
 
   if (parms->watershed_analyze)
   {
-    mean=0;
-    var=0;
-    for ( a = -1 ; a<2 ; a++)
-      for ( b = -1 ; b<2 ; b++)
-        for ( c = -1 ; c<2 ; c++)
-        {
-          // i > 0, j > 0, k > 0
-          tp=MRIvox(MRI_var->mri_src,i+a,j+b,k+c);
-          mean+=tp;
-          var+=SQR(tp);
-        }
-    mean/=27;
-    var=var/27-SQR(mean);
-    if (mean>=MRI_var->WM_MIN &&
-        mean<=MRI_var->WM_MAX &&
-        var<=MRI_var->WM_VARIANCE)
-    {
-      tp=1;
-    }
-    else
-    {
-      tp=0;
-    }
+    tp=MRIvox(MRI_var->mri_wmlike,i,j,k);
   }
 
   /*creates a new basin*/
@@ -74,6 +74,7 @@ static int nlabels=0;
 static int navgs=0;
 static float fdistance=20.0f;
 static int mode = 1 ;
+static int use_edt = 0 ;
 
 static char subjects_dir[STRLEN] ;
 
@@ -181,9 +182,9 @@ static int findSurfaceReference(int label) {
 
 int main(int argc, char *argv[]) {
   char *subject_fname,*subjects_fname[STRLEN],fname[STRLEN],*cp,*hemi;
-  int  nargs,n , m,surface_reference,nsubjects;
+  int  nargs,n , m,surface_reference,nsubjects, nedt_frame;
   MRI_SURFACE  *mris;
-  MRI *mri,*mri_distance, *mri_orig;
+  MRI *mri,*mri_distance, *mri_orig, *mri_edt=NULL;
 
   int msec, minutes, seconds ;
   Timer start;
@@ -287,11 +288,25 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "allocating distance map\n") ;
     mri_distance=MRIalloc(mri->width,mri->height,mri->depth,MRI_FLOAT);
 
-    for (n=0 ; n < nlabels ; n++) {
+    if (use_edt) { /* all the label maps in one pass, one frame per label */
+      int edt_labels[50], nedt=0 ;
+      for (n=0 ; n < nlabels ; n++)
+        if (labels[n]>=0)
+          edt_labels[nedt++]=labels[n];
+      if (nedt>0) {
+        fprintf(stderr, "generating distance maps for %d labels\n", nedt) ;
+        mri_edt=MRIextractDistanceMaps(mri,NULL,edt_labels,nedt,fdistance,mode,NULL);
+      }
+    }
+
+    for (n=0, nedt_frame=0 ; n < nlabels ; n++) {
 
       if (labels[n]>=0) {
         fprintf(stderr, "generating distance map for label %d\n", labels[n]) ;
-        MRIextractDistanceMap(mri,mri_distance,labels[n],fdistance,mode,NULL);
+        if (use_edt)
+          MRIcopyFrame(mri_edt,mri_distance,nedt_frame++,0);
+        else
+          MRIextractDistanceMap(mri,mri_distance,labels[n],fdistance,mode,NULL);
 
         fprintf(stderr,
                 "extracting distance values for label %d\n", labels[n]) ;
@@ -354,6 +369,8 @@ int main(int argc, char *argv[]) {
     }
 
     MRIfree(&mri_distance);
+    if (mri_edt)
+      MRIfree(&mri_edt);
     MRIfree(&mri);
     MRISfree(&mris);
   }
@@ -403,7 +420,10 @@ get_option(int argc, char *argv[]) {
     print_help() ;
   else if (!stricmp(option, (char*)"-version"))
     print_version() ;
-  else if (!stricmp(option,(char*) "navgs")) {
+  else if (!stricmp(option,(char*) "edt")) {
+    use_edt=1;
+    fprintf(stderr,"computing exact euclidean distance maps\n");
+  } else if (!stricmp(option,(char*) "navgs")) {
     navgs=atoi(argv[2]);
     fprintf(stderr,"smoothing curv for %d iterations\n",navgs);
     nargs=1;
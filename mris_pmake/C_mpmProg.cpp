@@ -26,6 +26,7 @@
 
 #include "C_mpmProg.h"
 #include "dijkstra.h"
+#include "surfsssp.h"
 
 #include "c_surface.h"
 #include "c_label.h"
@@ -867,8 +868,15 @@ int C_mpmProg_autodijk_fast::run()
     // If compiled with OpenCL support, run the OpenCL version of the algorithm
     runDijkstraOpenCL(&graph, &sourceVertices, results, 1);
 #else
-    // If not compiled with OpenCL, run the reference version of the algorithm
-    runDijkstraRef(&graph, &sourceVertices, results, 1);
+    // If not compiled with OpenCL, run the multi-threaded delta-stepping
+    // engine on the same graph.
+    SSSP_GRAPH *pgraph = SSSPgraphAlloc(graph.vertexCount, graph.edgeCount);
+    memcpy(pgraph->rowptr, graph.vertexArray, graph.vertexCount * sizeof(int));
+    pgraph->rowptr[graph.vertexCount] = graph.edgeCount;
+    memcpy(pgraph->col, graph.edgeArray, graph.edgeCount * sizeof(int));
+    memcpy(pgraph->cost, graph.weightArray, graph.edgeCount * sizeof(float));
+    SSSPsolve(pgraph, &sourceVertices, 1, 0, results, NULL);
+    SSSPgraphFree(&pgraph);
 #endif
 
     cout << "Done." << endl;
@@ -1171,7 +1179,6 @@ C_mpmProg_ROI::run() {
     bool         b_origHistoryFlag      = mps_env->b_costHistoryPreserve;
     bool         b_surfaceCostVoid      = false;
     unsigned int i			= 0;
-    int          j                      = 0;
     mps_env->b_costHistoryPreserve      = true;
     MRIS*        pmesh                  = mps_env->pMS_active;
 
@@ -1180,14 +1187,18 @@ C_mpmProg_ROI::run() {
     if(mb_boundaryOnly) border_mark();
 
     if(!mb_ROIsInSeparateLabels) {
+        // All the ripped vertices are searched from together, so each
+        // vertex within the radius gets the cost from its nearest one.
+        vector<int> v_source;
         for (i=0; i<(unsigned int)pmesh->nvertices; i++) {
             if (pmesh->vertices[i].ripflag == TRUE) {
-                b_surfaceCostVoid       = !j++;
                 mps_env->startVertex    = i;
                 mps_env->endVertex      = i;
-                ret = dijkstra(*mps_env, mf_radius, b_surfaceCostVoid);
+                v_source.push_back(i);
             }
         }
+        ret = dijkstra_sources(*mps_env, v_source.data(), v_source.size(),
+                               mf_radius, !v_source.empty());
         mps_env->b_costHistoryPreserve = b_origHistoryFlag;
         Gsout.str(std::string());
         Gsout << "-r" << mf_radius;
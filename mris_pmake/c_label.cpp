@@ -30,6 +30,7 @@
 #include "asynch.h"
 
 #include <sstream>
+#include <vector>
 
 void
 label_ply_do(
@@ -51,22 +52,24 @@ label_ply_do(
     // Should any cost values remaining in the surface be zeroed? Yes.
 
     bool        b_origHistoryFlag       = ast_env.b_costHistoryPreserve;
-    bool        b_surfaceCostVoid       = false;
     int         i                       = 0;
-    int         j                       = 0;
     float       f_plyDepth              = s_env_plyDepth_get(ast_env);
     ast_env.b_costHistoryPreserve       = true;
 
     //s_env_costFctSet(&ast_env, costFunc_unityReturn, e_unity);
 
+    // The label vertices are searched from together, so each vertex
+    // within the ply depth gets the cost from its nearest one.
+    vector<int> v_source;
     for (i=0; i<ast_env.pMS_active->nvertices; i++) {
         if (ast_env.pMS_active->vertices[i].ripflag == TRUE) {
-        b_surfaceCostVoid  = !j++;
         ast_env.startVertex = i;
         ast_env.endVertex = i;
-        dijkstra(ast_env, f_plyDepth, b_surfaceCostVoid);
+        v_source.push_back(i);
         }
     }
+    dijkstra_sources(ast_env, v_source.data(), v_source.size(),
+                     f_plyDepth, !v_source.empty());
     ast_env.b_costHistoryPreserve = b_origHistoryFlag;
 }
 
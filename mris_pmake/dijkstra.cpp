@@ -23,8 +23,10 @@
 #include <assert.h>
 
 #include "dijkstra.h"
+#include "surfsssp.h"
 
 struct d_node *d_list = NULL;
+static int    dijkstra_calls  = 0;
 
 int addToList(MRIS *surf, int vno) {
 
@@ -124,6 +126,57 @@ mark(MRIS *surf, int vno, int m, bool b_overwrite) {
   return(NO_ERROR);
 } /* end mark() */
 
+static float
+dijkstra_edgeCost(int vno, int vno_nbr, void *parms) {
+  return s_env_edgeCostFind(*(s_env *)parms, vno, vno_nbr);
+}
+
+static int
+dijkstra_engine(
+    s_env&          st_env,
+    const int*      pvno_source,
+    int             sources,
+    float           af_maxAllowedCost,
+    bool            ab_costHistoryPreserve)
+{
+  //
+  // DESC
+  //  Cost from the nearest of the <pvno_source> vertices to every vertex
+  //  within <af_maxAllowedCost>, by the delta-stepping engine. The edge
+  //  costs are found once, serially, since the cost functions keep state
+  //  in the environment. Reached vertices are marked DIJK_DONE and get
+  //  their cost in val and the previous vertex on the path in
+  //  old_undefval; a source is its own previous vertex. With
+  //  <ab_costHistoryPreserve> a val is only lowered, as in dijkstra().
+  //
+  // POSTCONDITIONS
+  //  o The number of vertices reached is returned.
+  //
+  MRIS*         surf    = st_env.pMS_active;
+  int           reached = 0;
+
+  SSSP_GRAPH *graph = SSSPgraphFromSurf(surf, dijkstra_edgeCost, &st_env);
+  float *dist = new float[surf->nvertices];
+  int   *pred = new int[surf->nvertices];
+
+  SSSPsolve(graph, pvno_source, sources, af_maxAllowedCost, dist, pred);
+
+  for (int i = 0; i < surf->nvertices; i++) {
+    if (dist[i] == SSSP_UNREACHED) continue;
+    VERTEX * const v = &surf->vertices[i];
+    reached++;
+    v->marked = DIJK_DONE;
+    if (ab_costHistoryPreserve && v->val != -1 && v->val <= dist[i]) continue;
+    v->val          = dist[i];
+    v->old_undefval = pred[i] < 0 ? i : pred[i];
+  }
+
+  delete [] dist;
+  delete [] pred;
+  SSSPgraphFree(&graph);
+  return reached;
+}
+
 int dijkstra(
     s_env&          st_env,
     float           af_maxAllowedCost,
@@ -143,7 +196,6 @@ int dijkstra(
   // If we aren't going to preserve cost history in the environment, then we
   // will by default always be able to write path costs
   bool              b_canWriteCostVal   = !st_env.b_costHistoryPreserve;
-  static int        calls               = 0;
   int               marked              = 0;
   int               totalLoops          = -1;
 
@@ -169,9 +221,17 @@ int dijkstra(
     // Set all vertex values to -1 - only the very first time
     // that this function is called, or if explicitly
     // specified in the calling parameters.
-    if (!calls || ab_surfaceCostVoid) surf->vertices[i].val = -1;
+    if (!dijkstra_calls || ab_surfaceCostVoid) surf->vertices[i].val = -1;
+  }
+  dijkstra_calls++;
+
+  // A search with no end vertex, eg 'autodijk', visits the whole surface
+  // so it goes to the bucketed engine; a search to an end vertex, or one
+  // that must respect the cost history, keeps to the list.
+  if (vno_i == vno_f && !st_env.b_costHistoryPreserve) {
+    int reached = dijkstra_engine(st_env, &vno_i, 1, af_maxAllowedCost, false);
+    return(reached >= st_env.pMS_primary->nvertices-1 ? TRUE : FALSE);
   }
-  calls++;
 
   surf->vertices[vno_i].val = 0.0;
   surf->vertices[vno_i].old_undefval = vno_f;
@@ -268,4 +328,32 @@ clean:
 
 } /* end dijkstra() */
 
+int dijkstra_sources(
+    s_env&          st_env,
+    const int*      pvno_source,
+    int             sources,
+    float           af_maxAllowedCost,
+    bool            ab_surfaceCostVoid)
+{
+  //
+  // DESC
+  //  Stands in for calling dijkstra() from each of <pvno_source> in
+  //  turn, with start == end and b_costHistoryPreserve set, but in one
+  //  search: each vertex gets the cost from its nearest source, if that
+  //  is within <af_maxAllowedCost> and lower than any cost already
+  //  there. Used to ply a label.
+  //
+  MRIS*         surf    = st_env.pMS_active;
+
+  for (int i = 0; i < surf->nvertices; i++) {
+    surf->vertices[i].marked = DIJK_VIRGIN;
+    if (!dijkstra_calls || ab_surfaceCostVoid) surf->vertices[i].val = -1;
+  }
+  dijkstra_calls++;
+
+  if (!sources) return(TRUE);
+  dijkstra_engine(st_env, pvno_source, sources, af_maxAllowedCost, true);
+  return(TRUE);
+}
+
 /* eof */
@@ -97,6 +97,13 @@ int   dijkstra(  s_env&  st_env,
                  float  af_maxAllowedCost = 0.0,
                  bool  ab_surfaceCostVoid = false);
 
+/*/// \fn int dijkstra_sources */
+int   dijkstra_sources( s_env&  st_env,
+                        const int* pvno_source,
+                        int   sources,
+                        float  af_maxAllowedCost = 0.0,
+                        bool  ab_surfaceCostVoid = false);
+
 
 typedef struct _node s_node;
 typedef struct _node {
@@ -36,6 +36,7 @@
 #include "evschutils.h"
 #include "version.h"
 #include "numerics.h"
+#include "romp_support.h"
 
 /* Things to do:
    1. Automatically compute Ntp such that Null has as much time
@@ -90,6 +91,21 @@ static int CheckIntMult(float val, float res, float tol);
 static MATRIX * ContrastMatrix(float *EVContrast,
                                int nEVs, int nPer, int nNuis, int SumDelays);
 static MATRIX * AR1WhitenMatrix(double rho, int N);
+
+/* Buffers owned by one search thread, reused across iterations */
+typedef struct
+{
+  MATRIX *Xt, *XtX;     /* transpose and Gram matrix of the FIR matrix */
+  MATRIX *XtXIdeal;     /* ideal XtX for EvReps (only with --repvar) */
+  int     EvReps[500];
+}
+OPTSEQ_THREAD;
+
+static void OptseqRandState(long seed, int nthsearched,
+                            unsigned short xsubi[3]);
+static EVSCH *SynthSchedule(int nthsearched, unsigned short *xsubi,
+                            OPTSEQ_THREAD *th, MATRIX *XtXIdealNom,
+                            MATRIX *Xpoly, MATRIX *W);
 int debug = 0;
 
 int   Ntp = -1;
@@ -157,12 +173,16 @@ double ar1rho = 0;
 int penalize = 0;
 double penalpha = 0, penT = 0, pendtmin = 0;
 
+int nthreads = 1;
+/* number of schedules each thread synthesizes between merges */
+#define OPTSEQ_BATCH_PER_THREAD 16
+
 /*-------------------------------------------------------------*/
 int main(int argc, char **argv) {
-  EVSCH *EvSch;
-  MATRIX *Xfir=NULL, *Xpoly=NULL, *X=NULL, *Xt=NULL,
-                                     *XtX=NULL, *XtXIdeal=NULL, *W=NULL;
-  int m,n, nthhit=0;
+  EVSCH *EvSch, **EvSchBatch;
+  MATRIX *Xfir=NULL, *Xpoly=NULL, *X=NULL, *XtXIdeal=NULL, *W=NULL;
+  OPTSEQ_THREAD *threads;
+  int m,n, nthhit=0, nbatch, nthbatch;
   //float eff, cb1err, vrfavg, vrfstd, vrfmin, vrfmax, vrfrange;
   char fname[2000];
   FILE *fpsum, *fplog;
@@ -347,6 +367,16 @@ int main(int argc, char **argv) {
   fprintf(fplog,"\nBeginUpdateLog\n");
 
   /* ------------->>>>>>>----- Search -----<<<<<<<<<---------------------*/
+  /* With one thread, schedules are synthesized one at a time from the
+     global drand48() stream. With more, each pass synthesizes a batch
+     of schedules in parallel, each from its own erand48() stream seeded
+     by (seed, nthsearched), then merges them in search order. The kept
+     schedules thus depend only on the seed, not on thread timing. */
+  threads = (OPTSEQ_THREAD *) calloc(sizeof(OPTSEQ_THREAD),nthreads);
+  for (n=0; n < nthreads; n++)
+    for (m=0; m < nEvTypes; m++) threads[n].EvReps[m] = EvRepsNom[m];
+  EvSchBatch = (EVSCH **) calloc(sizeof(EVSCH*),
+                                 nthreads*OPTSEQ_BATCH_PER_THREAD);
   while (1) {
 
     /* Termination Condition */
@@ -355,117 +385,108 @@ int main(int argc, char **argv) {
     tSearched = (tNow-tStart)/3600.0;
     if ( (tSearch > 0)  && (tSearched >= tSearch) )break;
     if ( (nSearch > 0)  && (nSearched >= nSearch) ) break;
-    nSearched++;
-
-    /* Randomly select Number of Event Repetitions */
-    if (PctVarEvReps > 0.0) {
-      if (!VarEvRepsPerCond) ftmp = 1.0+2*(drand48()-0.5)*PctVarEvReps/100;
-      for (m=0; m < nEvTypes; m++) {
-        if (VarEvRepsPerCond) ftmp = 1.0+2*(drand48()-0.5)*PctVarEvReps/100;
-        EvReps[m] = (int)nint(ftmp*EvRepsNom[m]);
-      }
-      MatrixFree(&XtXIdeal);
-      XtXIdeal = EVSfirXtXIdeal(nEvTypes, EvReps, EvDuration,
-                                TR, Ntp, PSDMin, PSDMax, dPSD);
-    }
 
-    /* Synthesize a Sequence and Schedule */
-    EvSch = EVSsynth(nEvTypes, EvReps, EvDuration, dPSD,
-                     TR*Ntp, TPreScan, nCB1Opt, tNullMin, tNullMax);
-    if (EvSch==NULL) {
-      printf("ERROR: syntheszing schedule\n");
-      exit(1);
-    }
-    EvSch->nthsearched = nSearched;
-    if (penalize) EVSrefractory(EvSch, penalpha, penT, pendtmin);
-
-    /* Construct the FIR Design Matrix */
-    Xfir = EVSfirMtxAll(EvSch, 0, TR, Ntp, PSDMin, PSDMax, dPSD);
-
-    /* Compute XtXIdeal Error */
-    Xt = MatrixTranspose(Xfir,Xt);
-    XtX = MatrixMultiply(Xt,Xfir,XtX);
-
-    EvSch->idealxtxerr = 0;
-    for (m=1; m <= Xfir->cols; m++) {
-      for (n=1; n <= Xfir->cols; n++) {
-        EvSch->idealxtxerr += fabs(XtX->rptr[m][n]-XtXIdeal->rptr[m][n]);
+    /* Synthesize and rate the schedules of this pass */
+    if (nthreads == 1) {
+      nbatch = 1;
+      EvSchBatch[0] = SynthSchedule(nSearched+1, NULL, &threads[0],
+                                    XtXIdeal, Xpoly, W);
+    } else {
+      nbatch = nthreads*OPTSEQ_BATCH_PER_THREAD;
+      if (nSearch > 0 && nbatch > nSearch-nSearched)
+        nbatch = nSearch-nSearched;
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic,1)
+#endif
+      for (int nth=0; nth < nbatch; nth++) {
+        ROMP_PFLB_begin
+        int tid = 0;
+        unsigned short thxsubi[3];
+#ifdef HAVE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        OptseqRandState(seed, nSearched+1+nth, thxsubi);
+        EvSchBatch[nth] = SynthSchedule(nSearched+1+nth, thxsubi,
+                                        &threads[tid], XtXIdeal, Xpoly, W);
+        ROMP_PFLB_end
       }
+      ROMP_PF_end
     }
-    MatrixFree(&Xt);
-    MatrixFree(&XtX);
-
-    Singular = EVSdesignMtxStats(Xfir, Xpoly, EvSch, C, W);
-    MatrixFree(&Xfir);
 
-    if (Singular) continue;
+    /* Merge into the running stats and the kept list, in search order */
+    for (nthbatch=0; nthbatch < nbatch; nthbatch++) {
+      nSearched++;
+      EvSch = EvSchBatch[nthbatch];
+      if (EvSch == NULL) continue; /* singular */
 
-    /* Compute the Cost (to be maximized) */
-    EVScost(EvSch, CostId, &VRFAvgStd_Cost_Ratio);
+      /* Compute the Cost (to be maximized) */
+      EVScost(EvSch, CostId, &VRFAvgStd_Cost_Ratio);
 //  CostSum += EvSch->cost;
-    { // Kahan summation algorithm for correction of sum error accumulation:
-      // http://en.wikipedia.org/wiki/Kahan_summation_algorithm
-      float y = EvSch->cost - SumCorrect;
-      float t = CostSum + y;
-      SumCorrect = (t - CostSum) - y;
-      CostSum = t;
-    }
+      { // Kahan summation algorithm for correction of sum error accumulation:
+        // http://en.wikipedia.org/wiki/Kahan_summation_algorithm
+        float y = EvSch->cost - SumCorrect;
+        float t = CostSum + y;
+        SumCorrect = (t - CostSum) - y;
+        CostSum = t;
+      }
 //  CostSum2 += (EvSch->cost * EvSch->cost);
-    { // Kahan summation algorithm for correction of sum error accumulation:
-      float y = (EvSch->cost * EvSch->cost) - Sum2Correct;
-      float t = CostSum2 + y;
-      Sum2Correct = (t - CostSum2) - y;
-      CostSum2 = t;
-    }
-    if (EffMax < EvSch->eff)       EffMax    = EvSch->eff;
-    if (VRFAvgMax < EvSch->vrfavg) VRFAvgMax = EvSch->vrfavg;
-
-    /* Save data on each iteration to a file */
-    if (SvAllFile != NULL) {
-      fprintf(fpSvAll,"%g  %g  %g  %g  %g  %g  %g %g",
-              EvSch->cost,EvSch->eff,EvSch->cb1err,EvSch->vrfavg,
-              EvSch->vrfstd,EvSch->vrfmin,EvSch->vrfmax,EvSch->idealxtxerr);
-      if (PctVarEvReps > 0.0)
-        for (m=0; m < nEvTypes; m++) fprintf(fpSvAll,"%d ",EvReps[m]);
-      fprintf(fpSvAll,"\n");
-    }
+      { // Kahan summation algorithm for correction of sum error accumulation:
+        float y = (EvSch->cost * EvSch->cost) - Sum2Correct;
+        float t = CostSum2 + y;
+        Sum2Correct = (t - CostSum2) - y;
+        CostSum2 = t;
+      }
+      if (EffMax < EvSch->eff)       EffMax    = EvSch->eff;
+      if (VRFAvgMax < EvSch->vrfavg) VRFAvgMax = EvSch->vrfavg;
+
+      /* Save data on each iteration to a file */
+      if (SvAllFile != NULL) {
+        fprintf(fpSvAll,"%g  %g  %g  %g  %g  %g  %g %g",
+                EvSch->cost,EvSch->eff,EvSch->cb1err,EvSch->vrfavg,
+                EvSch->vrfstd,EvSch->vrfmin,EvSch->vrfmax,EvSch->idealxtxerr);
+        if (PctVarEvReps > 0.0)
+          for (m=0; m < nEvTypes; m++) fprintf(fpSvAll,"%d ",EvSch->nEvReps[m]);
+        fprintf(fpSvAll,"\n");
+      }
 
-    if (nthhit < nKeep && nInFiles == 0) {
-      EvSchList[nthhit] = EvSch;
-      if (nthhit == nKeep-1) EVSsort(EvSchList,nKeep);
-    } else {
-      if (EvSch->cost > EvSchList[nKeep-1]->cost) {
-        /* Print update before and after the list changes */
-        PrintUpdate(fplog,0);
-        PrintUpdate(stdout,0);
+      if (nthhit < nKeep && nInFiles == 0) {
+        EvSchList[nthhit] = EvSch;
+        if (nthhit == nKeep-1) EVSsort(EvSchList,nKeep);
+      } else {
+        if (EvSch->cost > EvSchList[nKeep-1]->cost) {
+          /* Print update before and after the list changes */
+          PrintUpdate(fplog,0);
+          PrintUpdate(stdout,0);
+
+          EVSfree(&EvSchList[nKeep-1]);
+          EvSchList[nKeep-1] = EvSch;
+          EVSsort(EvSchList,nKeep);
+          nSince = 0;
+
+          PrintUpdate(fplog,0);
+          PrintUpdate(stdout,0);
+        } else {
+          EVSfree(&EvSch);
+          nSince++;
+        }
+      }
 
-        EVSfree(&EvSchList[nKeep-1]);
-        EvSchList[nKeep-1] = EvSch;
-        EVSsort(EvSchList,nKeep);
-        nSince = 0;
+      /* Print an update to the terminal */
+      if (nSearch > 0) PctDone = 100*nSearched/nSearch;
+      else            PctDone = 100*tSearched/tSearch;
+      PctDoneSince = PctDone - PctDoneLast;
 
+      if (Update && (PctDoneSince > PctUpdate || UpdateNow ) ) {
         PrintUpdate(fplog,0);
         PrintUpdate(stdout,0);
-      } else {
-        EVSfree(&EvSch);
-        nSince++;
+        PctDoneLast = PctDone;
+        UpdateNow = 0;
       }
-    }
 
-    /* Print an update to the terminal */
-    if (nSearch > 0) PctDone = 100*nSearched/nSearch;
-    else            PctDone = 100*tSearched/tSearch;
-    PctDoneSince = PctDone - PctDoneLast;
+      nthhit ++;
 
-    if (Update && (PctDoneSince > PctUpdate || UpdateNow ) ) {
-      PrintUpdate(fplog,0);
-      PrintUpdate(stdout,0);
-      PctDoneLast = PctDone;
-      UpdateNow = 0;
     }
-
-    nthhit ++;
-
   }/*----------- Done Search Loop ----------------------------*/
   /*-----------------------------------------------------------*/
 
@@ -478,6 +499,13 @@ int main(int argc, char **argv) {
   fclose(fplog);
 
   /*---------------- Clean-up after loop ------------------------*/
+  for (n=0; n < nthreads; n++) {
+    MatrixFree(&threads[n].Xt);
+    MatrixFree(&threads[n].XtX);
+    if (threads[n].XtXIdeal) MatrixFree(&threads[n].XtXIdeal);
+  }
+  free(threads);
+  free(EvSchBatch);
   if (SvAllFile != NULL) fclose(fpSvAll);
 
   printf("INFO: searched %d iterations for %f hours\n",
@@ -659,6 +687,14 @@ static int parse_commandline(int argc, char **argv) {
       if (nargc < 1) argnerr(option,1);
       sscanf(pargv[0],"%ld",&seed);
       nargsused = 1;
+    } else if (stringmatch(option, "--threads")) {
+      if (nargc < 1) argnerr(option,1);
+      sscanf(pargv[0],"%d",&nthreads);
+      if (nthreads < 1) nthreads = 1;
+#ifdef HAVE_OPENMP
+      omp_set_num_threads(nthreads);
+#endif
+      nargsused = 1;
     } else if (stringmatch(option, "--ntp")) {
       if (nargc < 1) argnerr(option,1);
       sscanf(pargv[0],"%d",&Ntp);
@@ -872,6 +908,7 @@ static void print_usage(void) {
   printf("\n");
   printf("  --sumdelays : sum delays when forming contrast matrix\n");
   printf("  --seed seedval : initialize random number generator to seedval\n");
+  printf("  --threads n : search with n threads\n");
 
   printf("\n");
   printf("Output Options\n");
@@ -1082,6 +1119,14 @@ static void print_help(void) {
          "specified, then one will be picked based on the time of day. optseq2 \n"
          "uses drand48(). \n"
          " \n"
+         "--threads nthreads \n"
+         " \n"
+         "Synthesize and rate schedules with nthreads threads (default 1). Each \n"
+         "schedule then gets its own random number stream derived from the seed \n"
+         "and its search number, so a given seed gives the same schedules for \n"
+         "any number of threads > 1 (but not the same as with one thread, which \n"
+         "uses the single drand48() stream). \n"
+         " \n"
          "--pctupdate pct \n"
          " \n"
          "Print an update line to stdout and the log file after completing each \n"
@@ -1519,6 +1564,7 @@ static void dump_options(FILE *fp) {
   fprintf(fp,"PctUpdate  = %f\n",PctUpdate);
   fprintf(fp,"nCB1Opt  = %d\n",nCB1Opt);
   fprintf(fp,"seed     = %ld\n",seed);
+  if (nthreads > 1) fprintf(fp,"nthreads = %d\n",nthreads);
   fprintf(fp,"Ntp  = %d\n",Ntp);
   fprintf(fp,"TR   = %g\n",TR);
   fprintf(fp,"TPreScan   = %g\n",TPreScan);
@@ -1689,3 +1735,85 @@ static MATRIX * AR1WhitenMatrix(double rho, int N) {
 
   return(W);
 }
+/*------------------------------------------------------------------
+  OptseqRandState() - erand48() state for the nthsearched schedule of
+  a multi-threaded search. Depends only on the seed and nthsearched so
+  the schedule does not depend on which thread synthesizes it.
+  ------------------------------------------------------------------*/
+static void OptseqRandState(long seed, int nthsearched,
+                            unsigned short xsubi[3]) {
+  unsigned long long x;
+
+  x = ((unsigned long long)(unsigned long)seed << 32) + (unsigned int)nthsearched;
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  x = x ^ (x >> 31);
+  xsubi[0] = (unsigned short)(x);
+  xsubi[1] = (unsigned short)(x >> 16);
+  xsubi[2] = (unsigned short)(x >> 32);
+  return;
+}
+/*------------------------------------------------------------------
+  SynthSchedule() - synthesize one schedule and compute its ideal-XtX
+  error and design statistics. Random numbers come from xsubi (or
+  drand48() if NULL). Uses only the buffers in th, so several can run
+  at once. Returns NULL if the design is singular.
+  ------------------------------------------------------------------*/
+static EVSCH *SynthSchedule(int nthsearched, unsigned short *xsubi,
+                            OPTSEQ_THREAD *th, MATRIX *XtXIdealNom,
+                            MATRIX *Xpoly, MATRIX *W) {
+  EVSCH *EvSch;
+  MATRIX *Xfir, *XtXIdeal;
+  int m, n, Singular;
+  float ftmp=0;
+
+  /* Randomly select Number of Event Repetitions */
+  XtXIdeal = XtXIdealNom;
+  if (PctVarEvReps > 0.0) {
+    if (!VarEvRepsPerCond)
+      ftmp = 1.0+2*((xsubi ? erand48(xsubi) : drand48())-0.5)*PctVarEvReps/100;
+    for (m=0; m < nEvTypes; m++) {
+      if (VarEvRepsPerCond)
+        ftmp = 1.0+2*((xsubi ? erand48(xsubi) : drand48())-0.5)*PctVarEvReps/100;
+      th->EvReps[m] = (int)nint(ftmp*EvRepsNom[m]);
+    }
+    if (th->XtXIdeal) MatrixFree(&th->XtXIdeal);
+    th->XtXIdeal = EVSfirXtXIdeal(nEvTypes, th->EvReps, EvDuration,
+                                  TR, Ntp, PSDMin, PSDMax, dPSD);
+    XtXIdeal = th->XtXIdeal;
+  }
+
+  /* Synthesize a Sequence and Schedule */
+  EvSch = EVSsynth_r(nEvTypes, th->EvReps, EvDuration, dPSD,
+                     TR*Ntp, TPreScan, nCB1Opt, tNullMin, tNullMax, xsubi);
+  if (EvSch==NULL) {
+    printf("ERROR: syntheszing schedule\n");
+    exit(1);
+  }
+  EvSch->nthsearched = nthsearched;
+  if (penalize) EVSrefractory(EvSch, penalpha, penT, pendtmin);
+
+  /* Construct the FIR Design Matrix */
+  Xfir = EVSfirMtxAll(EvSch, 0, TR, Ntp, PSDMin, PSDMax, dPSD);
+
+  /* Compute XtXIdeal Error */
+  th->Xt = MatrixTranspose(Xfir,th->Xt);
+  th->XtX = MatrixMultiply(th->Xt,Xfir,th->XtX);
+
+  EvSch->idealxtxerr = 0;
+  for (m=1; m <= Xfir->cols; m++) {
+    for (n=1; n <= Xfir->cols; n++) {
+      EvSch->idealxtxerr += fabs(th->XtX->rptr[m][n]-XtXIdeal->rptr[m][n]);
+    }
+  }
+
+  Singular = EVSdesignMtxStats(Xfir, Xpoly, EvSch, C, W);
+  MatrixFree(&Xfir);
+
+  if (Singular) {
+    EVSfree(&EvSch);
+    return(NULL);
+  }
+  return(EvSch);
+}
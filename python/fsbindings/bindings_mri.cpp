@@ -6,35 +6,44 @@
 
 
 /*
-  Build a surfa Overlay, Slice, or Volume object (whichever is appropriate given the dimensionality)
-  from an MRI instance. All data is copied between python and cxx, so any allocated MRI pointers
-  will need to be freed, even after convert to python. However, if `release` is `true`, this function
-  will free the MRI after converting.
+  Numpy dtype that matches the voxel type of an MRI.
 */
-py::object MRItoSurfaArray(MRI* mri, bool release)
+static py::dtype MRItypeToNumpy(int type)
 {
-  // sanity check on the MRI instance
-  if (!mri) throw std::runtime_error("MRItoSurfaArray: cannot convert to surfa - MRI input is null");
-  if (!mri->ischunked) throw std::runtime_error("MRItoSurfaArray: image is too large to fit into contiguous memory");
-
-  // determine numpy dtype from MRI type
-  py::dtype dtype;
-  switch (mri->type) {
+  switch (type) {
   case MRI_UCHAR:
-    dtype = py::dtype::of<unsigned char>(); break;
+    return py::dtype::of<unsigned char>();
   case MRI_SHORT:
-    dtype = py::dtype::of<short>(); break;
+    return py::dtype::of<short>();
   case MRI_INT:
-    dtype = py::dtype::of<int>(); break;
+    return py::dtype::of<int>();
   case MRI_LONG:
-    dtype = py::dtype::of<long>(); break;
+    return py::dtype::of<long>();
   case MRI_FLOAT:
-    dtype = py::dtype::of<float>(); break;
+    return py::dtype::of<float>();
   case MRI_USHRT:
-    dtype = py::dtype::of<unsigned short>(); break;
+    return py::dtype::of<unsigned short>();
   default:
-    throw py::value_error("MRItoSurfaArray: unknown MRI data type ID: " + std::to_string(mri->type));
+    throw py::value_error("MRItoSurfaArray: unknown MRI data type ID: " + std::to_string(type));
   }
+}
+
+
+/*
+  Build a surfa Overlay, Slice, or Volume object (whichever is appropriate given the dimensionality)
+  from an MRI instance. Unless `release` is `true`, the data is copied, so any allocated MRI pointers
+  will need to be freed, even after convert to python. If `release` is `true`, ownership of the MRI
+  is handed to the numpy array, which wraps the MRI chunk without copying and frees the MRI once
+  the array is garbage collected.
+*/
+py::object MRItoSurfaArray(MRI* mri, bool release)
+{
+  // sanity check on the MRI instance
+  if (!mri) throw std::runtime_error("MRItoSurfaArray: cannot convert to surfa - MRI input is null");
+  if (!mri->ischunked) throw std::runtime_error("MRItoSurfaArray: image is too large to fit into contiguous memory");
+
+  // determine numpy dtype from MRI type
+  py::dtype dtype = MRItypeToNumpy(mri->type);
 
   // squeeze the 4D MRI to determine the actual represented shape
   std::vector<ssize_t> shape = {mri->width};
@@ -43,9 +52,18 @@ py::object MRItoSurfaArray(MRI* mri, bool release)
   if (mri->nframes > 1) shape.push_back(mri->nframes);
   std::vector<ssize_t> strides = fstrides(shape, mri->bytes_per_vox);
 
-  // wrap a numpy array around the chunked MRI data, then copy
-  py::capsule capsule(mri->chunk);
-  py::array buffer = py::array(dtype, shape, strides, mri->chunk, capsule).attr("copy")();
+  // wrap a numpy array around the chunked MRI data. If we're releasing the MRI anyway, the capsule
+  // takes ownership of it so the data can be shared, otherwise copy. An MRI that borrows its
+  // buffer from elsewhere is always copied
+  py::array buffer;
+  bool handover = release && mri->owndata;
+  if (handover) {
+    py::capsule owner(mri, [](void *p) { MRI *m = (MRI *)p; MRIfree(&m); });
+    buffer = py::array(dtype, shape, strides, mri->chunk, owner);
+  } else {
+    py::capsule capsule(mri->chunk);
+    buffer = py::array(dtype, shape, strides, mri->chunk, capsule).attr("copy")();
+  }
 
   // extract base dimensions (ignore frames) to determine whether the MRI
   // represents an overlay, image, or volume
@@ -96,7 +114,7 @@ py::object MRItoSurfaArray(MRI* mri, bool release)
     arr.attr("labels") = lookup;
   }
 
-  if (release) MRIfree(&mri);
+  if (release && !handover) MRIfree(&mri);
 
   return arr;
 }
@@ -104,38 +122,43 @@ py::object MRItoSurfaArray(MRI* mri, bool release)
 
 /*
   Convert a surfa FramedArray to an MRI structure of appropriate dimensionality. The returned
-  MRI pointer will need to be freed manually once it's done with.
+  MRI pointer will need to be freed manually once it's done with. If `borrow` is `true` and the
+  array data is a writeable, Fortran-ordered buffer of a supported dtype, the MRI chunk points
+  directly into the numpy buffer (with `owndata` false) instead of holding a copy. In that case
+  the array must outlive the MRI, and any change to the MRI data is visible in python. Otherwise,
+  the data is converted straight into a newly allocated chunk in a single pass.
 */
-MRI* MRIfromSurfaArray(py::object arr)
+MRI* MRIfromSurfaArray(py::object arr, bool borrow)
 {
   // type checking
   py::object arrclass = py::module::import("surfa").attr("core").attr("FramedArray");
   if (!py::isinstance(arr, arrclass)) throw py::value_error("MRIfromSurfaArray: cannot convert to MRI - input is not a surfa FramedArray");
 
-  // make sure buffer is in fortran order and cache the array in case we're converting back to surfa later
   py::module np = py::module::import("numpy");
-  py::array mri_buffer = np.attr("asfortranarray")(arr.attr("data"));
-
-  // convert unsupported data types
-  if (py::isinstance<py::array_t<double>>(mri_buffer)) mri_buffer = py::array_t<float>(mri_buffer);
-  if (py::isinstance<py::array_t<bool>>(mri_buffer)) mri_buffer = py::array_t<uchar>(mri_buffer);
-  if (py::isinstance<py::array_t<char>>(mri_buffer)) mri_buffer = py::array_t<int>(mri_buffer);
-  if (py::isinstance<py::array_t<long>>(mri_buffer)) mri_buffer = py::array_t<int>(mri_buffer);
+  py::array data = np.attr("asarray")(arr.attr("data"));
 
-  // determine valid MRI type from numpy datatype
+  // determine valid MRI type from numpy datatype, noting unsupported data types
+  // that need to be converted
   int dtype;
-  if      (py::isinstance<py::array_t<uchar>>(mri_buffer)) { dtype = MRI_UCHAR; }
-  else if (py::isinstance<py::array_t<int>>  (mri_buffer)) { dtype = MRI_INT; }
-  else if (py::isinstance<py::array_t<short>>(mri_buffer)) { dtype = MRI_SHORT; }
-  else if (py::isinstance<py::array_t<long>> (mri_buffer)) { dtype = MRI_LONG; }
-  else if (py::isinstance<py::array_t<float>>(mri_buffer)) { dtype = MRI_FLOAT; }
-  else if (py::isinstance<py::array_t<unsigned short>>(mri_buffer)) { dtype = MRI_USHRT; }
+  bool convert = true;
+  if      (py::isinstance<py::array_t<double>>(data)) { dtype = MRI_FLOAT; }
+  else if (py::isinstance<py::array_t<bool>>  (data)) { dtype = MRI_UCHAR; }
+  else if (py::isinstance<py::array_t<char>>  (data)) { dtype = MRI_INT; }
+  else if (py::isinstance<py::array_t<long>>  (data)) { dtype = MRI_INT; }
   else {
-    throw py::value_error("MRIfromSurfaArray: unsupported array dtype " + py::str(mri_buffer.attr("dtype")).cast<std::string>());
+    convert = false;
+    if      (py::isinstance<py::array_t<uchar>>(data)) { dtype = MRI_UCHAR; }
+    else if (py::isinstance<py::array_t<int>>  (data)) { dtype = MRI_INT; }
+    else if (py::isinstance<py::array_t<short>>(data)) { dtype = MRI_SHORT; }
+    else if (py::isinstance<py::array_t<float>>(data)) { dtype = MRI_FLOAT; }
+    else if (py::isinstance<py::array_t<unsigned short>>(data)) { dtype = MRI_USHRT; }
+    else {
+      throw py::value_error("MRIfromSurfaArray: unsupported array dtype " + py::str(data.attr("dtype")).cast<std::string>());
+    }
   }
 
   // initialize a header-only MRI structure with the known shape (expanded to 4D)
-  std::vector<int> expanded, shape = mri_buffer.attr("shape").cast<std::vector<int>>();
+  std::vector<int> expanded, shape = data.attr("shape").cast<std::vector<int>>();
   int nframes = arr.attr("nframes").cast<int>();
 
   // get dimensionality
@@ -147,9 +170,23 @@ MRI* MRIfromSurfaArray(py::object arr)
   }
   MRI *mri = new MRI(expanded, dtype, false);
 
-  // copy buffer data into MRI chunk
-  mri->chunk = malloc(mri->bytes_total);
-  memcpy(mri->chunk, mri_buffer.mutable_data(), mri->bytes_total);
+  // the buffer can only be shared if numpy already stores it the way the MRI chunk is laid out
+  bool shareable = borrow && !convert &&
+                   (data.flags() & py::array::f_style) &&
+                   (data.flags() & py::detail::npy_api::NPY_ARRAY_WRITEABLE_);
+
+  if (shareable) {
+    mri->chunk = data.mutable_data();
+    mri->owndata = false;
+  } else {
+    // wrap a (non-owning) fortran-ordered numpy view around a new chunk and let numpy
+    // cast and reorder the data straight into it
+    mri->chunk = malloc(mri->bytes_total);
+    if (!mri->chunk) throw std::bad_alloc();
+    std::vector<ssize_t> vshape(data.shape(), data.shape() + data.ndim());
+    py::array view = py::array(MRItypeToNumpy(dtype), vshape, fstrides(vshape, mri->bytes_per_vox), mri->chunk, py::capsule(mri->chunk));
+    np.attr("copyto")(view, data, py::arg("casting") = "unsafe");
+  }
   mri->ischunked = true;
   mri->initSlices();
   mri->initIndices();
@@ -228,7 +265,7 @@ py::object readMRI(const std::string& filename)
 */
 void writeMRI(py::object arr, const std::string& filename)
 {
-  MRI* mri = MRIfromSurfaArray(arr);
+  MRI* mri = MRIfromSurfaArray(arr, true);
   if (stringEndsWith(filename, ".annot")) {
     writeAnnotationFromSeg(mri, filename);
   } else {
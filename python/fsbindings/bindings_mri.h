@@ -7,7 +7,7 @@
 
 // conversion between MRI cxx objects and surfa FramedArray python objects
 py::object MRItoSurfaArray(MRI* mri, bool release);
-MRI* MRIfromSurfaArray(py::object arr);
+MRI* MRIfromSurfaArray(py::object arr, bool borrow = false);
 
 // wrapped functions
 py::object readMRI(const std::string& filename);
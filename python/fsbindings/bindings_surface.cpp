@@ -9,9 +9,10 @@
 
 
 /*
-  Convert an MRIS structure to a surfa Mesh. All data is copied between python and cxx, so any
-  allocated MRIS pointers will need to be freed, even after convert to python. However, if
-  `release` is `true`, this function will free the MRIS after converting.
+  Convert an MRIS structure to a surfa Mesh. MRIS vertices are not stored as a contiguous array,
+  so the vertex and face data is gathered once into new buffers that are handed over to numpy
+  (no further copy). Any allocated MRIS pointers will need to be freed, even after convert to
+  python. However, if `release` is `true`, this function will free the MRIS after converting.
 */
 py::object MRIStoSurfaMesh(MRIS *mris, bool release)
 {
@@ -33,8 +34,9 @@ py::object MRIStoSurfaMesh(MRIS *mris, bool release)
 
 
 /*
-  Convert a surfa Mesh to an MRIS structure. All data is copied between python and cxx, so the
-  returned MRIS pointer will need to be freed manually once it's done with.
+  Convert a surfa Mesh to an MRIS structure. The vertex and face arrays are read in place when
+  they are already C-ordered float32/int32, otherwise converted first. The data is copied into
+  the MRIS, so the returned MRIS pointer will need to be freed manually once it's done with.
 */
 MRIS* MRISfromSurfaMesh(py::object mesh)
 {
@@ -141,7 +143,7 @@ int countIntersections(py::object surf)
 py::object smoothOverlay(py::object surf, py::object overlay, int steps)
 {
   MRIS *mris = MRISfromSurfaMesh(surf);
-  MRI *mri_overlay = MRIfromSurfaArray(overlay);
+  MRI *mri_overlay = MRIfromSurfaArray(overlay, true);
   MRI *mri_smoothed = MRISsmoothMRIFast(mris, mri_overlay, steps, nullptr, nullptr);
   MRISfree(&mris);
   MRIfree(&mri_overlay);
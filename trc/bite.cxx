@@ -27,43 +27,92 @@ float Bite::mFminPath;
 vector<unsigned int> Bite::mBaselineImages;
 vector<float> Bite::mGradients, Bite::mBvalues;
 
+thread_local bool McmcRandom::mIsLocal = false;
+thread_local unsigned short McmcRandom::mState[3];
+
+//
+// Give the calling thread a random number stream of its own
+//
+void McmcRandom::SetSeed(long Seed) {
+  // Same initialization as srand48()
+  mState[0] = 0x330E;
+  mState[1] = (unsigned short) (Seed & 0xFFFF);
+  mState[2] = (unsigned short) ((Seed >> 16) & 0xFFFF);
+  mIsLocal = true;
+}
+
+//
+// Go back to the global random number sequences for the calling thread
+//
+void McmcRandom::UseGlobal() { mIsLocal = false; }
+
+//
+// Uniform random number in [0, 1)
+//
+double McmcRandom::Uniform() {
+  return mIsLocal ? erand48(mState) : drand48();
+}
+
+//
+// Gaussian random number with zero mean and unit variance
+// (same as PDFgaussian(), but drawing from this thread's stream)
+//
+double McmcRandom::Gaussian() {
+  double v1, v2, r2;
+
+  do {
+    v1 = 2.0 * Uniform() - 1.0;
+    v2 = 2.0 * Uniform() - 1.0;
+    r2 = v1 * v1 + v2 * v2;
+  } while (r2 > 1.0);
+
+  return (v1 * sqrt(-2.0 * log(r2) / r2));
+}
+
+//
+// Random integer in [0, Max), usable as the generator of random_shuffle()
+// (gives the same sequence as its default generator)
+//
+long McmcRandom::Integer(long Max) {
+  return (mIsLocal ? nrand48(mState) : rand()) % Max;
+}
+
 Bite::Bite(MRI *Dwi, MRI **Phi, MRI **Theta, MRI **F,
            MRI **V0, MRI **F0, MRI *D0,
            int CoordX, int CoordY, int CoordZ) :
            mCoordX(CoordX), mCoordY(CoordY), mCoordZ(CoordZ) {
   float fsum, vx, vy, vz;
+  std::shared_ptr<Samples> samples = std::make_shared<Samples>();
 
-  mDwi.clear();
-  mPhiSamples.clear();
-  mThetaSamples.clear();
-  mFSamples.clear();
   mPhi.clear();
   mTheta.clear();
   mF.clear();
 
   // DWI intensity values
   for (int idir = 0; idir < mNumDir; idir++)
-    mDwi.push_back(MRIgetVoxVal(Dwi, mCoordX, mCoordY, mCoordZ, idir));
+    samples->mDwi.push_back(MRIgetVoxVal(Dwi, mCoordX, mCoordY, mCoordZ, idir));
 
   // Initialize s0
   mS0 = 0;
   for (vector<unsigned int>::const_iterator ibase = mBaselineImages.begin();
                                             ibase < mBaselineImages.end();
                                             ibase++)
-      mS0 += mDwi[*ibase];
+      mS0 += samples->mDwi[*ibase];
   mS0 /= mNumB0;
 
   // Samples of phi, theta, f
   for (int isamp = 0; isamp < mNumBedpost; isamp++)
     for (int itract = 0; itract < mNumTract; itract++) {
-      mPhiSamples.push_back(MRIgetVoxVal(Phi[itract],
+      samples->mPhiSamples.push_back(MRIgetVoxVal(Phi[itract],
                                          mCoordX, mCoordY, mCoordZ, isamp));
-      mThetaSamples.push_back(MRIgetVoxVal(Theta[itract],
+      samples->mThetaSamples.push_back(MRIgetVoxVal(Theta[itract],
                                          mCoordX, mCoordY, mCoordZ, isamp));
-      mFSamples.push_back(MRIgetVoxVal(F[itract],
+      samples->mFSamples.push_back(MRIgetVoxVal(F[itract],
                                          mCoordX, mCoordY, mCoordZ, isamp));
     }
 
+  mSamples = samples;
+
   fsum = 0;
   for (int itract = 0; itract < mNumTract; itract++) {
     // Initialize phi, theta
@@ -159,17 +208,17 @@ float Bite::GetLowBvalue() { return mBvalues[mBaselineImages[0]]; }
 // Draw samples from marginal posteriors of diffusion parameters
 //
 void Bite::SampleParameters() {
-  const int isamp = (int) round(drand48() * (mNumBedpost-1))
+  const int isamp = (int) round(McmcRandom::Uniform() * (mNumBedpost-1))
                                             * mNumTract;
   vector<float>::const_iterator samples;
  
-  samples = mPhiSamples.begin() + isamp;
+  samples = mSamples->mPhiSamples.begin() + isamp;
   copy(samples, samples + mNumTract, mPhi.begin());
  
-  samples = mThetaSamples.begin() + isamp;
+  samples = mSamples->mThetaSamples.begin() + isamp;
   copy(samples, samples + mNumTract, mTheta.begin());
  
-  samples = mFSamples.begin() + isamp;
+  samples = mSamples->mFSamples.begin() + isamp;
   copy(samples, samples + mNumTract, mF.begin());
 }
 
@@ -180,7 +229,7 @@ void Bite::ComputeLikelihoodOffPath() {
   double like = 0;
   vector<float>::const_iterator ri = mGradients.begin();
   vector<float>::const_iterator bi = mBvalues.begin();
-  vector<float>::const_iterator sij = mDwi.begin();
+  vector<float>::const_iterator sij = mSamples->mDwi.begin();
 
   for (int idir = mNumDir; idir > 0; idir--) {
     double sbar = 0, fsum = 0;
@@ -221,7 +270,7 @@ void Bite::ComputeLikelihoodOnPath(float PathPhi, float PathTheta) {
   double like = 0;
   vector<float>::const_iterator ri = mGradients.begin();
   vector<float>::const_iterator bi = mBvalues.begin();
-  vector<float>::const_iterator sij = mDwi.begin();
+  vector<float>::const_iterator sij = mSamples->mDwi.begin();
 
   // Choose which anisotropic compartment in voxel corresponds to path
   ChoosePathTractAngle(PathPhi, PathTheta);
@@ -304,7 +353,7 @@ void Bite::ChoosePathTractLike(float PathPhi, float PathTheta) {
       double dlike, like = 0;
       vector<float>::const_iterator ri = mGradients.begin();
       vector<float>::const_iterator bi = mBvalues.begin();
-      vector<float>::const_iterator sij = mDwi.begin();
+      vector<float>::const_iterator sij = mSamples->mDwi.begin();
 
       // Calculate likelihood by replacing the chosen tract orientation from path
       for (int idir = mNumDir; idir > 0; idir--) {
@@ -379,7 +428,7 @@ void Bite::ComputePriorOnPath() {
   mPrior1 = 0;
 }
 
-bool Bite::IsAllFZero() {
+bool Bite::IsAllFZero() const {
   return (*max_element(mF.begin(), mF.end()) < mFminPath);
 }
 
@@ -27,9 +27,26 @@
 #include <fstream>
 #include <limits>
 #include <algorithm>
+#include <memory>
 #include <math.h>
 #include "mri.h"
 
+class McmcRandom {	// Random numbers for the MCMC
+  public:
+    static void SetSeed(long Seed);
+    static void UseGlobal();
+    static double Uniform();
+    static double Gaussian();
+    static long Integer(long Max);
+
+  private:
+    // By default numbers come from the global drand48()/rand() sequences.
+    // A thread that is given a seed draws from a stream of its own instead,
+    // so that chains running in parallel are independent and reproducible.
+    static thread_local bool mIsLocal;
+    static thread_local unsigned short mState[3];
+};
+
 class Bite {
   public:
     Bite(MRI *Dwi, MRI **Phi, MRI **Theta, MRI **F,
@@ -44,12 +61,17 @@ class Bite {
     static std::vector<float> mGradients,	// [3 x mNumDir]
                               mBvalues;		// [mNumDir]
 
+    // Data that do not change during the MCMC, shared by all copies of a voxel
+    struct Samples {
+      std::vector<float> mDwi;			// [mNumDir]
+      std::vector<float> mPhiSamples;		// [mNumTract x mNumBedpost]
+      std::vector<float> mThetaSamples;		// [mNumTract x mNumBedpost]
+      std::vector<float> mFSamples;		// [mNumTract x mNumBedpost]
+    };
+
     int mCoordX, mCoordY, mCoordZ, mPathTract;
     float mS0, mD, mLikelihood0, mLikelihood1, mPrior0, mPrior1;
-    std::vector<float> mDwi;			// [mNumDir]
-    std::vector<float> mPhiSamples;		// [mNumTract x mNumBedpost]
-    std::vector<float> mThetaSamples;		// [mNumTract x mNumBedpost]
-    std::vector<float> mFSamples;		// [mNumTract x mNumBedpost]
+    std::shared_ptr<const Samples> mSamples;
     std::vector<float> mPhi;			// [mNumTract]
     std::vector<float> mTheta;			// [mNumTract]
     std::vector<float> mF;			// [mNumTract]
@@ -71,7 +93,7 @@ class Bite {
     void ChoosePathTractLike(float PathPhi, float PathTheta);
     void ComputePriorOffPath();
     void ComputePriorOnPath();
-    bool IsAllFZero();
+    bool IsAllFZero() const;
     bool IsFZero();
     bool IsThetaZero();
     float GetLikelihoodOffPath();
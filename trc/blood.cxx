@@ -23,7 +23,8 @@
 using namespace std;
 
 const int Blood::mDistThresh = 4,
-          Blood::mEndDilation = 2;
+          Blood::mEndDilation = 2,
+          Blood::mNumRankRef = 1000;
 const unsigned int Blood::mDiffStep = 3;
 const float Blood::mLengthCutoff = 0.05,
             Blood::mLengthRatio = 3.0,
@@ -45,12 +46,13 @@ Blood::Blood(const string TrainListFile, const string TrainTrkFile,
              const string TestBaseMaskFile,
              bool UseTruncated, bool UseAnatomy, bool UseShape,
              vector<int> &NumControls,
-             int NumStrMax, bool Debug) :
+             int NumStrMax, int NumStrRead, bool Debug) :
              mDebug(Debug),
              mUseTruncated(UseTruncated),
              mUseAnatomy(UseAnatomy),
              mUseShape(UseShape),
              mNumStrMax(NumStrMax),
+             mNumStrRead(NumStrRead),
              mMaskLabel(TrainMaskLabel) {
   int dirs[45] = { 0,  0,  0,
                    1,  0,  0,
@@ -197,6 +199,7 @@ Blood::Blood(const string TrainTrkFile,
              mUseAnatomy(false),
              mUseShape(false),
              mNumStrMax(INT_MAX),
+             mNumStrRead(INT_MAX),
              mNx(0), mNy(0), mNz(0) {
   // Allocate space for histograms
   if (!TrainRoi1File.empty() && TrainRoi2File.empty()) {
@@ -387,13 +390,26 @@ void Blood::ReadStreamlines(const string TrainListFile,
   mLengthMaxEnds = 0;
   mLengthAvgEnds = 0;
 
+  // In streaming mode, keep only a random sample of each training subject's
+  // streamlines, so that memory does not grow with the number of subjects
+  const int nstrsubj = (mNumStrRead < INT_MAX) ?
+                       max(1, mNumStrRead / (int) dirlist.size()) : INT_MAX;
+
+  if (nstrsubj < INT_MAX)
+    cout << "INFO: Keeping up to " << nstrsubj
+         << " streamlines per training subject" << endl;
+
   for (vector<string>::const_iterator idir = dirlist.begin();
                                       idir != dirlist.end(); idir++) {
-    int npts, nlines = 0;
+    int npts, nlines = 0, nseen = 0;
     bool ismissing = false;
+    float *properties;
     CTrackReader trkreader;
     TRACK_HEADER trkheader;
     string fname;
+    vector<int> samporder;
+    vector< vector<int> > sampstr;
+    vector< vector<float> > sampprop;
 
     if (!TrainRoi1File.empty()) {
       fname = *idir + TrainRoi1File;
@@ -455,6 +471,8 @@ void Blood::ReadStreamlines(const string TrainListFile,
     else
       mHavePresorted = false;
 
+    properties = new float [trkheader.n_properties];
+
     while (trkreader.GetNextPointCount(&npts)) {
       bool isinmask = true;
       int nptsmask = npts,
@@ -463,8 +481,7 @@ void Blood::ReadStreamlines(const string TrainListFile,
             forwback2 = 0, forw2 = 0;
       vector<int> pts;
       vector<float> dir1(3), dir2(3);
-      float *rawpts = new float[npts*3], *rawptsmask = rawpts, *iraw,
-            *properties = new float [trkheader.n_properties];
+      float *rawpts = new float[npts*3], *rawptsmask = rawpts, *iraw;
 
       // Read a streamline from input file
       trkreader.GetNextTrackData(npts, rawpts, NULL, properties);
@@ -701,32 +718,58 @@ void Blood::ReadStreamlines(const string TrainListFile,
         continue;
       }
 
-      mStreamlines.push_back(pts);
-      mLengths.push_back(pts.size() / 3);
-      nlines++;
-
-      if (mHavePresorted) {
-        if ((int) properties[0] == 1 || (int) properties[0] == 3)
-          mIsInEnd1.push_back(true);
-        else
-          mIsInEnd1.push_back(false);
-        
-        if ((int) properties[0] == 2 || (int) properties[0] == 3)
-          mIsInEnd2.push_back(true);
-        else
-          mIsInEnd2.push_back(false);
+      if (nstrsubj < INT_MAX) {		// Reservoir sampling
+        int isamp = nseen;
 
-        mTruncatedLengths.push_back((int) properties[1]);
+        nseen++;
 
-        if (*(mIsInEnd1.end()-1) && *(mIsInEnd2.end()-1))
-          strorder.push_back(make_pair(properties[2], index));
+        if (isamp >= nstrsubj)
+          isamp = (int) (drand48() * nseen);
 
-        index++;
+        if (isamp < (int) sampstr.size()) {
+          samporder[isamp] = nseen;
+          sampstr[isamp].swap(pts);
+          sampprop[isamp].assign(properties,
+                                 properties + trkheader.n_properties);
+        }
+        else if (isamp < nstrsubj) {
+          samporder.push_back(nseen);
+          sampstr.push_back(pts);
+          sampprop.push_back(vector<float>(properties,
+                                           properties + trkheader.n_properties));
+        }
+      }
+      else {
+        AddStreamline(pts, properties, index, strorder);
+        nlines++;
       }
 
       delete[] rawpts;
     }
 
+    if (!sampstr.empty()) {		// Keep sampled streamlines in file order
+      vector< pair<int,int> > sorted;
+
+      for (vector<int>::const_iterator iord = samporder.begin();
+                                       iord < samporder.end(); iord++)
+        sorted.push_back(make_pair(*iord, iord - samporder.begin()));
+
+      sort(sorted.begin(), sorted.end());
+
+      for (vector< pair<int,int> >::const_iterator isort = sorted.begin();
+                                                   isort < sorted.end();
+                                                   isort++) {
+        AddStreamline(sampstr[isort->second], sampprop[isort->second].data(),
+                      index, strorder);
+        nlines++;
+      }
+
+      cout << "INFO: Kept " << nlines << " of " << nseen
+           << " streamlines" << endl;
+    }
+
+    delete[] properties;
+
     mNumLines.push_back(nlines);
 
     trkreader.Close();
@@ -766,6 +809,34 @@ void Blood::ReadStreamlines(const string TrainListFile,
     ReadExcludedStreamlines(ExcludeFile);
 }
 
+//
+// Append a streamline read from a training subject's .trk file
+//
+void Blood::AddStreamline(const vector<int> &Points, const float *Properties,
+                          int &Index, vector< pair<int,int> > &Order) {
+  mStreamlines.push_back(Points);
+  mLengths.push_back(Points.size() / 3);
+
+  if (mHavePresorted) {
+    if ((int) Properties[0] == 1 || (int) Properties[0] == 3)
+      mIsInEnd1.push_back(true);
+    else
+      mIsInEnd1.push_back(false);
+    
+    if ((int) Properties[0] == 2 || (int) Properties[0] == 3)
+      mIsInEnd2.push_back(true);
+    else
+      mIsInEnd2.push_back(false);
+
+    mTruncatedLengths.push_back((int) Properties[1]);
+
+    if (*(mIsInEnd1.end()-1) && *(mIsInEnd2.end()-1))
+      Order.push_back(make_pair(Properties[2], Index));
+
+    Index++;
+  }
+}
+
 //
 // Read list of streamlines to be excluded from search for center streamline
 //
@@ -1232,19 +1303,30 @@ void Blood::RemoveLengthOutliers() {
       ihisto++;
     }
   
-    // Remove outlier streamlines
-    vector<int>::iterator ilen = mLengths.begin();
+    // Remove outlier streamlines, moving the remaining ones up in one pass
+    vector<int>::iterator ilen = mLengths.begin(), ilenout = ilen;
+    vector< vector<int> >::iterator istr = mStreamlines.begin(),
+                                    istrout = istr;
     for (vector<int>::iterator inum = mNumLines.begin();
                                inum != mNumLines.end(); inum++)
-      for (int k = *inum; k > 0; k--)
+      for (int k = *inum; k > 0; k--) {
         if (*ilen < llow || *ilen > lhigh) {
-          ilen = mLengths.erase(ilen);
-          mStreamlines.erase(mStreamlines.begin() + (ilen - mLengths.begin()));
           (*inum)--;
           nrejlen++;
         }
-        else
-          ilen++;
+        else {
+          *ilenout = *ilen;
+          istrout->swap(*istr);
+          ilenout++;
+          istrout++;
+        }
+
+        ilen++;
+        istr++;
+      }
+
+    mLengths.erase(ilenout, mLengths.end());
+    mStreamlines.erase(istrout, mStreamlines.end());
   }
 
   cout << "INFO: Rejected " << nrejlen
@@ -2138,63 +2220,86 @@ void Blood::FindOutlierStreamlines(bool CheckOverlap, bool CheckDeviation,
 void Blood::RankStreamlineDistance() {
   int index = 0;
   const int lag = max(1, (int) round(mHausStepRatio * mLengthAvgEnds)) * 3;
+  vector<int> strpts, stroffset(1, 0), strlen, strindex, refs;
   vector< pair<double,int> > distance(mNumStrEnds, make_pair(0,0));
   vector<bool>::const_iterator ivalid1 = mIsInEnd1.begin(),
                                ivalid2 = mIsInEnd2.begin();
+  vector<int>::const_iterator ilen = mLengths.begin();
   vector<int>::iterator irank;
-  vector< pair<double,int> >::iterator idout = distance.begin(), id0;
+  vector< pair<double,int> >::iterator idout = distance.begin();
 
   cout << "INFO: Step is " << lag/3 << " voxels" << endl;
 
+  // Copy the points that are compared on each non-truncated streamline
+  // into a single contiguous block
   for (vector< vector<int> >::const_iterator istr = mStreamlines.begin();
                                              istr < mStreamlines.end();
                                              istr++) {
     if (*ivalid1 && *ivalid2) {
-      double hdtot = 0;
-      vector<bool>::const_iterator jvalid1 = mIsInEnd1.begin(),
-                                   jvalid2 = mIsInEnd2.begin();
-      vector<int>::const_iterator jlen = mLengths.begin();
+      for (unsigned int k = 0; k < istr->size(); k += lag)
+        strpts.insert(strpts.end(), istr->begin() + k, istr->begin() + k + 3);
 
-      for (vector< vector<int> >::const_iterator
-           jstr = mStreamlines.begin(); jstr < mStreamlines.end(); jstr++) {
-        double hd = 0;
+      stroffset.push_back(strpts.size());
+      strlen.push_back(*ilen);
+      strindex.push_back(index);
+    }
 
-        if (*jvalid1 && *jvalid2 && (jstr != istr)) {
-          for (vector<int>::const_iterator jpt = jstr->begin();
-                                           jpt < jstr->end(); jpt += lag) {
-            int dmin = 1000000;
+    ivalid1++;
+    ivalid2++;
+    ilen++;
+    index++;
+  }
 
-            for (vector<int>::const_iterator ipt = istr->begin();
-                                             ipt < istr->end(); ipt += lag) {
-              const int dx = ipt[0] - jpt[0],
-                        dy = ipt[1] - jpt[1],
-                        dz = ipt[2] - jpt[2],
-                        dist = dx*dx + dy*dy + dz*dz;
+  // Streamlines that every streamline is compared to
+  refs.resize(strindex.size());
+  iota(refs.begin(), refs.end(), 0);
 
-              if (dist < dmin)
-                dmin = dist;
-            }
+  if (mNumStrRead < INT_MAX && (int) refs.size() > mNumRankRef) {
+    random_shuffle(refs.begin(), refs.end());
+    refs.resize(mNumRankRef);
+    sort(refs.begin(), refs.end());
 
-            hd += sqrt(dmin);
-          }
+    cout << "INFO: Comparing to a random subset of " << mNumRankRef
+         << " streamlines" << endl;
+  }
 
-          hd /= (*jlen);
-        }
+  for (unsigned int istr = 0; istr < strindex.size(); istr++) {
+    double hdtot = 0;
+    const int *ibegin = &strpts[stroffset[istr]],
+              *iend   = &strpts[0] + stroffset[istr+1];
 
-        hdtot += hd;
+    for (vector<int>::const_iterator jref = refs.begin(); jref < refs.end();
+                                                          jref++) {
+      const unsigned int jstr = *jref;
+      double hd = 0;
 
-        jvalid1++;
-        jvalid2++;
-        jlen++;
+      if (jstr == istr)
+        continue;
+
+      for (const int *jpt = &strpts[stroffset[jstr]];
+                      jpt < &strpts[0] + stroffset[jstr+1]; jpt += 3) {
+        int dmin = 1000000;
+
+        for (const int *ipt = ibegin; ipt < iend; ipt += 3) {
+          const int dx = ipt[0] - jpt[0],
+                    dy = ipt[1] - jpt[1],
+                    dz = ipt[2] - jpt[2],
+                    dist = dx*dx + dy*dy + dz*dz;
+
+          if (dist < dmin)
+            dmin = dist;
+        }
+
+        hd += sqrt(dmin);
       }
 
-      *idout = make_pair(hdtot, index);
-      idout++;
+      hd /= strlen[jstr];
+
+      hdtot += hd;
     }
 
-    ivalid1++;
-    ivalid2++;
-    index++;
+    *idout = make_pair(hdtot, strindex[istr]);
+    idout++;
   }
 
   sort(distance.begin(), distance.end());
@@ -53,7 +53,7 @@ class Blood {
           const std::string TestBaseMaskFile,
           bool UseTruncated, bool UseAnatomy, bool UseShape,
           std::vector<int> &NumControls,
-          int NumStrMax=INT_MAX, bool Debug=false);
+          int NumStrMax=INT_MAX, int NumStrRead=INT_MAX, bool Debug=false);
     Blood(const std::string TrainTrkFile,
           const std::string TrainRoi1File, const std::string TrainRoi2File,
           bool Debug=false);
@@ -104,14 +104,14 @@ class Blood {
     int GetLengthCenter();
 
   private:
-    static const int mDistThresh, mEndDilation;
+    static const int mDistThresh, mEndDilation, mNumRankRef;
     static const unsigned int mDiffStep;
     static const float mLengthCutoff, mLengthRatio,
                        mHausStepRatio, mControlStepRatio,
                        mTangentBinSize, mCurvatureBinSize;
 
     const bool mDebug, mUseTruncated, mUseAnatomy, mUseShape;
-    const int mNumStrMax;
+    const int mNumStrMax, mNumStrRead;
     bool mHavePresorted;
     int mNx, mNy, mNz, mNumTrain, mVolume,
         mNumStr, mLengthMin, mLengthMax,
@@ -153,6 +153,8 @@ class Blood {
     MRI *mHistoStr, *mHistoSubj, *mTestBaseMask;
 
     void AllocateHistogram(MRI *RefVol);
+    void AddStreamline(const std::vector<int> &Points, const float *Properties,
+                       int &Index, std::vector< std::pair<int,int> > &Order);
     void ReadExcludedStreamlines(const std::string ExcludeFile);
     void ComputeStats();
     void ComputeStatsEnds();
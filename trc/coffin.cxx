@@ -23,10 +23,10 @@
 using namespace std;
 
 const unsigned int Aeon::mDiffStep = 3;
-int Aeon::mMaxAPosterioriPath;
-unsigned int Aeon::mMaxAPosterioriPath0;
-vector<float> Aeon::mPriorSamples;
-vector< vector<int> > Aeon::mBasePathPointSamples;
+thread_local int Aeon::mMaxAPosterioriPath;
+thread_local unsigned int Aeon::mMaxAPosterioriPath0;
+thread_local vector<float> Aeon::mPriorSamples;
+thread_local vector< vector<int> > Aeon::mBasePathPointSamples;
 MRI *Aeon::mBaseMask;
 
 const unsigned int Coffin::mMaxTryMask = 100,
@@ -187,11 +187,11 @@ void Aeon::ReadData(const string RootDir, const string DwiFile,
     for (int iy = 0; iy < mNy; iy++)
       for (int ix = 0; ix < mNx; ix++)
         if (MRIgetVoxVal(mMask, ix, iy, iz, 0)) {
-          mDataMask.push_back(&mData[mNumVox]);
+          mDataMask.push_back(mNumVox);
           mNumVox++;
         }
         else
-          mDataMask.push_back(0);
+          mDataMask.push_back(-1);
 
   cout << "INFO: Found " << mNumVox << " voxels in brain mask" << endl;
 
@@ -483,13 +483,13 @@ void Aeon::ProposeDiffusionParameters() {
 
   // Sample parameters on proposed path
   for (ipt = mPathPointsNew.begin(); ipt < mPathPointsNew.end(); ipt += 3) {
-    Bite *ivox = mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy];
+    Bite *ivox = &mData[mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy]];
     ivox->SampleParameters();
   }
 
   // Sample parameters on current path
   for (ipt = mPathPoints.begin(); ipt < mPathPoints.end(); ipt += 3) {
-    Bite *ivox = mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy];
+    Bite *ivox = &mData[mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy]];
     ivox->SampleParameters();
   }
 }
@@ -518,7 +518,7 @@ bool Aeon::ComputePathDataFit() {
 
   for (vector<int>::iterator ipt = mPathPointsNew.begin();
                              ipt < mPathPointsNew.end(); ipt += 3) {
-    Bite *ivox = mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy];
+    Bite *ivox = &mData[mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy]];
 
     ivox->ComputeLikelihoodOffPath();
     ivox->ComputeLikelihoodOnPath(*iphi, *itheta);
@@ -570,7 +570,7 @@ bool Aeon::ComputePathDataFit() {
 
   for (vector<int>::iterator ipt = mPathPoints.begin();
                              ipt < mPathPoints.end(); ipt += 3) {
-    Bite *ivox = mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy];
+    Bite *ivox = &mData[mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy]];
 
     ivox->ComputeLikelihoodOffPath();
     ivox->ComputeLikelihoodOnPath(*iphi, *itheta);
@@ -961,7 +961,7 @@ unsigned int Aeon::GetNumFZerosNew() const {
 
   for (vector<int>::const_iterator ipt = mPathPointsNew.begin();
                                    ipt < mPathPointsNew.end(); ipt += 3) {
-    Bite *ivox = mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy];
+    const Bite *ivox = &mData[mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy]];
 
     if (ivox->IsAllFZero())
       nzeros++;
@@ -978,7 +978,7 @@ unsigned int Aeon::GetNumFZeros() const {
 
   for (vector<int>::const_iterator ipt = mPathPoints.begin();
                                    ipt < mPathPoints.end(); ipt += 3) {
-    Bite *ivox = mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy];
+    const Bite *ivox = &mData[mDataMask[ipt[0] + ipt[1]*mNx + ipt[2]*mNxy]];
 
     if (ivox->IsAllFZero())
       nzeros++;
@@ -1075,7 +1075,7 @@ Coffin::Coffin(const string OutDir, vector<string> InDirList,
                const int KeepSampleNth, const int UpdatePropNth,
                const string PropStdFile,
                const bool Debug) :
-               mDebug(Debug),
+               mDebug(Debug), mOwnsData(true),
                mPriorSetLocal(LocalPriorSet), mPriorSetNear(NeighPriorSet),
                mMask(0), mRoi1(0), mRoi2(0),
                mXyzPrior0(0), mXyzPrior1(0) {
@@ -1251,16 +1251,45 @@ exit(1);
                     KeepSampleNth, UpdatePropNth, PropStdFile);
 }
 
+//
+// Make a container that shares the diffusion data, masks, segmentation maps,
+// and registrations of an existing one, so that a different pathway can be
+// reconstructed concurrently. The voxel-wise parameter samples are shared
+// (read-only), only the state of the MCMC is copied. The pathway and MCMC
+// parameters must be set before running.
+//
+Coffin::Coffin(const Coffin &Base) :
+               mDebug(Base.mDebug), mOwnsData(false),
+               mNx(Base.mNx), mNy(Base.mNy), mNz(Base.mNz), mNxy(Base.mNxy),
+               mNumControl(0),
+               mPriorSetLocal(Base.mPriorSetLocal),
+               mPriorSetNear(Base.mPriorSetNear),
+               mInfoGeneral(Base.mInfoGeneral),
+               mResolution(Base.mResolution),
+               mMask(Base.mMask), mRoi1(0), mRoi2(0),
+               mXyzPrior0(0), mXyzPrior1(0),
+               mAffineReg(Base.mAffineReg),
+#ifndef NO_CVS_UP_IN_HERE
+               mNonlinReg(Base.mNonlinReg),
+#endif
+               mAseg(Base.mAseg),
+               mDwi(Base.mDwi) {
+  mSpline.SetMask(mMask);
+  mAtlasCoords.resize(mNxy*mNz);
+}
+
 Coffin::~Coffin() {
-  if (mMask != mDwi[0].GetMask())
-    MRIfree(&mMask);
+  if (mOwnsData) {
+    if (mMask != mDwi[0].GetMask())
+      MRIfree(&mMask);
 
-  for (vector<Aeon>::iterator idwi = mDwi.begin(); idwi < mDwi.end(); idwi++)
-    idwi->FreeMask();
+    for (vector<Aeon>::iterator idwi = mDwi.begin(); idwi < mDwi.end(); idwi++)
+      idwi->FreeMask();
 
-  for (vector<MRI *>::iterator iaseg = mAseg.begin(); iaseg < mAseg.end();
-                                                      iaseg++)
-    MRIfree(&(*iaseg));
+    for (vector<MRI *>::iterator iaseg = mAseg.begin(); iaseg < mAseg.end();
+                                                        iaseg++)
+      MRIfree(&(*iaseg));
+  }
 
   MRIfree(&mRoi1);
   MRIfree(&mRoi2);
@@ -2107,7 +2136,7 @@ bool Coffin::RunMcmcSingle() {
     // Perturb control points in random order
     for (int k = 0; k < mNumControl; k++)
       cptorder[k] = k;
-    random_shuffle(cptorder.begin(), cptorder.end());
+    random_shuffle(cptorder.begin(), cptorder.end(), McmcRandom::Integer);
 
     fill(mRejectControl.begin(), mRejectControl.end(), false);
 
@@ -2159,7 +2188,7 @@ bool Coffin::RunMcmcSingle() {
     // Perturb control points in random order
     for (int k = 0; k < mNumControl; k++)
       cptorder[k] = k;
-    random_shuffle(cptorder.begin(), cptorder.end());
+    random_shuffle(cptorder.begin(), cptorder.end(), McmcRandom::Integer);
 
     fill(mRejectControl.begin(), mRejectControl.end(), false);
 
@@ -2651,7 +2680,7 @@ bool Coffin::ProposePathFull() {
     double norm = 0;
 
     for (int ii = 0; ii < 3; ii++) {
-      *jump = round((*pstd) * PDFgaussian());
+      *jump = round((*pstd) * McmcRandom::Gaussian());
       *newcoord = *coord + (int) *jump;
 
       *jump *= *jump;
@@ -2783,7 +2812,7 @@ bool Coffin::ProposePathSingle(int ControlIndex) {
 
   // Perturb current control point
   for (int ii = 0; ii < 3; ii++) {
-    *jump = round((*pstd) * PDFgaussian());
+    *jump = round((*pstd) * McmcRandom::Gaussian());
     *newcoord = *coord + (int) *jump;
 
     *jump *= *jump;
@@ -2957,7 +2986,7 @@ bool Coffin::AcceptPath(bool UsePriorOnly) {
               + mPosteriorOffPath   - mPosteriorOnPath;
 
   // Accept or reject proposed path based on ratio of posteriors
-  if (drand48() < exp(-neglogratio)) {
+  if (McmcRandom::Uniform() < exp(-neglogratio)) {
     if (mDebug) {
       mLog << "Accept due to posterior (alpha = " << exp(-neglogratio) << ")"
            << endl;
@@ -3607,8 +3636,13 @@ void Coffin::MapPointToAtlas(vector<int>::iterator OutPoint,
 
     mAffineReg.ApplyXfm(point, point.begin());
 #ifndef NO_CVS_UP_IN_HERE
-    if (!mNonlinReg.IsEmpty())
+    if (!mNonlinReg.IsEmpty()) {
+      // The registration is shared by pathways running in parallel
+#ifdef HAVE_OPENMP
+      #pragma omp critical(coffin_nonlin)
+#endif
       mNonlinReg.ApplyXfm(point, point.begin());
+    }
 #endif
 
     for (int k = 0; k < 3; k++)
@@ -99,10 +99,12 @@ class Aeon {		// One point in time
 
   private:
     static const unsigned int mDiffStep;
-    static int mMaxAPosterioriPath;
-    static unsigned int mMaxAPosterioriPath0;
-    static std::vector<float> mPriorSamples;
-    static std::vector< std::vector<int> > mBasePathPointSamples;
+    // Common among time points for the pathway that the calling thread is
+    // working on (pathways may be reconstructed in parallel)
+    static thread_local int mMaxAPosterioriPath;
+    static thread_local unsigned int mMaxAPosterioriPath0;
+    static thread_local std::vector<float> mPriorSamples;
+    static thread_local std::vector< std::vector<int> > mBasePathPointSamples;
     static MRI *mBaseMask;
 
     bool mRejectF, mAcceptF, mRejectTheta, mAcceptTheta;
@@ -120,7 +122,7 @@ class Aeon {		// One point in time
                        mDataFitSamples;
     std::vector< std::vector<int> > mPathPointSamples;
     std::vector<Bite> mData;				// [mNumVox]
-    std::vector<Bite *>mDataMask;			// [mNx x mNy x mNz]
+    std::vector<int> mDataMask;				// [mNx x mNy x mNz]
     AffineReg mBaseReg;
 
     bool IsInMask(std::vector<int>::const_iterator Point);
@@ -156,6 +158,7 @@ class Coffin {		// The main container
            const int KeepSampleNth, const int UpdatePropNth,
            const string PropStdFile,
            const bool Debug=false);
+    Coffin(const Coffin &Base);
     ~Coffin();
     void SetOutputDir(const string OutDir);
     void SetPathway(const string InitFile,
@@ -178,7 +181,7 @@ class Coffin {		// The main container
     static const float mTangentBinSize, mCurvatureBinSize;
     bool mRejectSpline, mRejectPosterior,
          mRejectF, mAcceptF, mRejectTheta, mAcceptTheta;
-    const bool mDebug;
+    const bool mDebug, mOwnsData;
     int mNx, mNy, mNz, mNxy, mNumControl,
         mNxAtlas, mNyAtlas, mNzAtlas, mNumArc,
         mPriorSetLocal, mPriorSetNear,
@@ -63,7 +63,7 @@ int main(int argc, char *argv[]);
 
 const char *Progname = "dmri_paths";
 
-unsigned int nlab1 = 0, nlab2 = 0;
+unsigned int nlab1 = 0, nlab2 = 0, nthreads = 1;
 unsigned int nTract = 1, 
              nBurnIn = 5000, nSample = 5000, nKeepSample = 10, nUpdateProp = 40,
              localPriorSet = 15, neighPriorSet = 14;
@@ -157,6 +157,89 @@ int main(int argc, char **argv) {
   if (islabel1) ilab1++;
   if (islabel2) ilab2++;
 
+  if (nthreads > 1 && outDir.size() > 1) {
+    vector<int> ilab1path(outDir.size(), 0), ilab2path(outDir.size(), 0);
+
+    // Index of the label mesh of each pathway
+    ilab1 = ilab2 = 0;
+    for (unsigned int iout = 0; iout < outDir.size(); iout++) {
+      ilab1path[iout] = ilab1;
+      ilab2path[iout] = ilab2;
+      if (roiFile1[iout].find(".label") != string::npos) ilab1++;
+      if (roiFile2[iout].find(".label") != string::npos) ilab2++;
+    }
+
+    // Reconstruct pathways in parallel. Each thread runs the MCMC on its own
+    // copy of the container, which shares the diffusion data with the others.
+    // Random numbers for each pathway come from a stream seeded by the
+    // pathway index, so results do not depend on the number of threads.
+#ifdef HAVE_OPENMP
+    #pragma omp parallel num_threads(nthreads)
+#endif
+    {
+      Coffin pathcoffin(mycoffin);
+
+#ifdef HAVE_OPENMP
+      #pragma omp for schedule(dynamic, 1)
+#endif
+      for (int iout = 0; iout < (int) outDir.size(); iout++) {
+        const bool islab1 = (roiFile1[iout].find(".label") != string::npos),
+                   islab2 = (roiFile2[iout].find(".label") != string::npos);
+        Timer pathtimer;
+        bool isdone;
+
+        McmcRandom::SetSeed(6875 + iout);
+
+#ifdef HAVE_OPENMP
+        #pragma omp critical(dmri_paths_io)
+#endif
+        {
+          cout << "Processing pathway " << iout+1 << " of " << outDir.size()
+               << "..." << endl;
+
+          pathcoffin.SetOutputDir(outDir[iout]);
+          pathcoffin.SetPathway(initFile[iout],
+                  roiFile1[iout], roiFile2[iout],
+                  islab1 ? roiMeshFile1[ilab1path[iout]] : string(),
+                  islab2 ? roiMeshFile2[ilab2path[iout]] : string(),
+                  islab1 ? roiRefFile1[ilab1path[iout]] : string(),
+                  islab2 ? roiRefFile2[ilab2path[iout]] : string(),
+                  doxyzprior ? xyzPriorFile0[iout] : string(),
+                  doxyzprior ? xyzPriorFile1[iout] : string(),
+                  dotangprior ? tangPriorFile[iout] : string(),
+                  docurvprior ? curvPriorFile[iout] : string(),
+                  doneighprior ? neighPriorFile[iout] : string(),
+                  doneighprior ? neighIdFile[iout] : string(),
+                  dolocalprior ? localPriorFile[iout] : string(),
+                  dolocalprior ? localIdFile[iout] : string());
+          pathcoffin.SetMcmcParameters(nBurnIn, nSample, nKeepSample,
+                  nUpdateProp, dopropinit ? stdPropFile[iout] : string());
+        }
+
+        isdone = pathcoffin.RunMcmcSingle();
+
+#ifdef HAVE_OPENMP
+        #pragma omp critical(dmri_paths_io)
+#endif
+        {
+          if (isdone)
+            pathcoffin.WriteOutputs();
+          else
+            cout << "ERROR: Pathway reconstruction failed for "
+                 << outDir[iout] << endl;
+
+          printf("Pathway %d done in %g sec.\n", iout+1,
+                 pathtimer.milliseconds()/1000.0);
+        }
+      }
+
+      McmcRandom::UseGlobal();
+    }
+
+    printf("dmri_paths done\n");
+    return(0);
+  }
+
   for (unsigned int iout = 0; iout < outDir.size(); iout++) {
     if (iout > 0) {
       islabel1 = (roiFile1[iout].find(".label") != string::npos);
@@ -444,6 +527,11 @@ static int parse_commandline(int argc, char **argv) {
       sscanf(pargv[0],"%u",&nUpdateProp);
       nargsused = 1;
     }
+    else if (!strcmp(option, "--threads")) {
+      if (nargc < 1) CMDargNErr(option,1);
+      sscanf(pargv[0],"%u",&nthreads);
+      nargsused = 1;
+    }
     else {
       fprintf(stderr,"ERROR: Option %s unknown\n",option);
       if (CMDsingleDash(option))
@@ -548,6 +636,11 @@ static void print_usage(void) {
   << "     default SD=1 for all control points and all paths)" << endl
   << endl
   << "Other options" << endl
+  << "   --threads <num>:" << endl
+  << "     Reconstruct up to this many pathways in parallel (default 1)." << endl
+  << "     With more than one thread, each pathway uses its own random" << endl
+  << "     number stream, so results do not depend on the number of" << endl
+  << "     threads but differ from those of a single-threaded run" << endl
   << "   --debug:     turn on debugging" << endl
   << "   --checkopts: don't run anything, just check options and exit" << endl
   << "   --help:      print out information on how to use this program" << endl
@@ -807,6 +900,9 @@ static void dump_options() {
     cout << endl;
   }
 
+  if (nthreads > 1)
+    cout << "Number of threads: " << nthreads << endl;
+
   return;
 }
 
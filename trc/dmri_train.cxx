@@ -64,7 +64,7 @@ int main(int argc, char *argv[]);
 const char *Progname = "dmri_train";
 
 bool useTrunc = false, useAnatomy = false, useShape = false, excludeStr = false;
-int numStrMax = INT_MAX;
+int numStrMax = INT_MAX, numStrRead = INT_MAX;
 vector<float> trainMaskLabel;
 vector< vector<int> > nControl;
 vector<string> outTrkList, outPriorBase,
@@ -139,7 +139,7 @@ int main(int argc, char **argv) {
                 testAffineXfmFile, testNonlinXfmFile, testNonlinRefFile,
                 testBaseXfmList, testBaseMaskFile,
                 useTrunc, useAnatomy, useShape, nControl[0], numStrMax,
-                debug);
+                numStrRead, debug);
 
   for (unsigned int itrk = 0; itrk < trainTrkList.size(); itrk++) {
     if (itrk > 0) {
@@ -337,6 +337,11 @@ static int parse_commandline(int argc, char **argv) {
       sscanf(pargv[0], "%d", &numStrMax);
       nargsused = 1;
     }
+    else if (!strcmp(option, "--stream")) {
+      if (nargc < 1) CMDargNErr(option,1);
+      sscanf(pargv[0], "%d", &numStrRead);
+      nargsused = 1;
+    }
     else if (!strcmp(option, "--trunc"))
       useTrunc = true;
     else if (!strcmp(option, "--aprior"))
@@ -406,6 +411,11 @@ static void print_usage(void) {
   << "     or one for all paths" << endl
   << "   --max <num>:" << endl
   << "     Maximum number of training streamlines to keep per path" << endl
+  << "   --stream <num>:" << endl
+  << "     Maximum number of training streamlines to read into memory per" << endl
+  << "     path, sampled at random from each training subject's .trk file," << endl
+  << "     and rank them by distance to a random subset of streamlines" << endl
+  << "     (Default: read and compare all streamlines)" << endl
   << "   --xstr:" << endl
   << "     Exclude previously chosen center streamline(s) (Default: No)" << endl
   << "   --aprior:" << endl
@@ -488,6 +498,10 @@ static void check_options(void) {
     cout << "ERROR: Must specify location of cortex mask volume" << endl;
     exit(1);
   }
+  if (numStrRead < 1) {
+    cout << "ERROR: Number of streamlines to read must be positive" << endl;
+    exit(1);
+  }
   if (!trainRoi1List.empty() && trainRoi1List.size() != trainTrkList.size()) {
     cout << "ERROR: Numbers of input .trk files and start ROIs must match"
          << endl;
@@ -653,6 +667,10 @@ static void dump_options() {
     cout << "Maximum number of training streamlines per path: "
          << numStrMax << endl;
 
+  if (numStrRead < INT_MAX)
+    cout << "Maximum number of training streamlines read per path: "
+         << numStrRead << endl;
+
   cout << "Exclude previously chosen center streamlines: " << excludeStr << endl
        << "Use truncated streamlines: " << useTrunc << endl
        << "Compute priors on underlying anatomy: " << useAnatomy << endl
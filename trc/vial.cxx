@@ -436,16 +436,11 @@ void NonlinReg::ApplyXfm(vector<float> &OutPoint,
 //
 // Non-linear registration class
 //
-NonlinReg::NonlinReg() : mMorph(0) {}
+NonlinReg::NonlinReg() {}
 
-NonlinReg::~NonlinReg() {
-  if (mMorph != NULL) {
-    GCAfree(&(mMorph->gca));
-    GCAMfree(&mMorph);
-  }
-}
+NonlinReg::~NonlinReg() {}
 
-bool NonlinReg::IsEmpty() { return (mMorph == 0); }
+bool NonlinReg::IsEmpty() { return (!mMorph); }
 
 //
 // Read a non-linear transform from file
@@ -459,12 +454,17 @@ void NonlinReg::ReadXfm(const string XfmFile, MRI *RefVol) {
   xfile.close();
 
   cout << "Loading non-linear registration from " << XfmFile << endl;
-  mMorph = GCAMreadAndInvertNonTal(XfmFile.c_str());
+  GCAM *morph = GCAMreadAndInvertNonTal(XfmFile.c_str());
+
+  if (morph == NULL) exit(1);
 
-  if (mMorph == NULL) exit(1);
+  morph->gca = gcaAllocMax(1, 1, 1, RefVol->width, RefVol->height,
+                                                   RefVol->depth, 0, 0);
 
-  mMorph->gca = gcaAllocMax(1, 1, 1, RefVol->width, RefVol->height,
-                                                    RefVol->depth, 0, 0);
+  mMorph = std::shared_ptr<GCAM>(morph, [](GCAM *m) {
+    GCAfree(&(m->gca));
+    GCAMfree(&m);
+  });
 }
 
 //
@@ -476,7 +476,7 @@ void NonlinReg::ApplyXfm(vector<float> &OutPoint,
 
   copy(InPoint, InPoint+3, inpoint);
 
-  GCAMmorphPlistFromAtlas(1, inpoint, mMorph, &OutPoint[0]);
+  GCAMmorphPlistFromAtlas(1, inpoint, mMorph.get(), &OutPoint[0]);
 }
 
 //
@@ -488,7 +488,7 @@ void NonlinReg::ApplyXfmInv(vector<float> &OutPoint,
 
   copy(InPoint, InPoint+3, inpoint);
 
-  GCAMmorphPlistToSource(1, inpoint, mMorph, &OutPoint[0]);
+  GCAMmorphPlistToSource(1, inpoint, mMorph.get(), &OutPoint[0]);
 }
 #endif
 
@@ -37,6 +37,7 @@
 #endif
 
 #include <vector>
+#include <memory>
 #include <iostream>
 #include <fstream>
 #include "mri.h"
@@ -82,7 +83,7 @@ class NonlinReg {
                      std::vector<float>::const_iterator InPoint);
 
   private:
-    GCAM *mMorph;
+    std::shared_ptr<GCAM> mMorph;	// Copies share the same transform
 };
 #endif
 
@@ -16,6 +16,10 @@
  * Reporting: freesurfer@nmr.mgh.harvard.edu
  *
  */
+#include <algorithm>
+#include <complex>
+#include <vector>
+
 #include "MRISrigidBodyAlignGlobal.h"
 #include "romp_support.h"
 #include "vertexRotator.h"
@@ -540,3 +544,418 @@ void MRISrigidBodyAlignGlobal_findMinSSE(
 }
 
 
+
+
+// Spherical harmonic search
+// -------------------------
+//
+// The subject curvature f and the std-normalized template h are expanded in spherical harmonics up to lmax.
+// The correlation of f rotated by R with h is then
+//
+//      C(R) = sum_l sum_m sum_m' conj(h_lm) D^l_mm'(R) f_lm'
+//
+// With R = Rz(alpha) Ry(beta) Rz(gamma) and D^l_mm' = exp(-i m alpha) d^l_mm'(beta) exp(-i m' gamma)
+// this is, for each beta, a 2D Fourier series in (alpha, gamma) so the whole SO(3) grid is obtained
+// with one Wigner-d sum and one 2D FFT per beta (the SOFT scheme).
+//
+// The best few peaks that lie inside the grid search domain are located to a fraction of a grid cell by
+// fitting parabolas through their neighbours, and each is then refined by one finest-scale local search.
+//
+namespace {
+
+typedef std::complex<double> Complex;
+
+inline int lmIndex(int l, int m) { return l*l + l + m; }
+
+// Orthonormal associated Legendre functions, including the Condon-Shortley phase,
+// so that Y_lm(theta,phi) = P[lmIndex(l,m)] * exp(i m phi) for m >= 0
+//
+void spharmLegendre(double* P, int lmax, double cosTheta)
+{
+  double const sinTheta = sqrt(std::max(0.0, 1.0 - cosTheta*cosTheta));
+
+  double pmm = sqrt(1.0 / (4.0*M_PI));
+  for (int m = 0; m <= lmax; m++) {
+    if (m > 0) pmm *= -sqrt((2.0*m + 1.0) / (2.0*m)) * sinTheta;
+    P[lmIndex(m,m)] = pmm;
+    if (m == lmax) break;
+
+    double pm1 = sqrt(2.0*m + 3.0) * cosTheta * pmm;
+    P[lmIndex(m+1,m)] = pm1;
+
+    double pm2 = pmm;
+    for (int l = m + 2; l <= lmax; l++) {
+      double const a = sqrt((4.0*l*l - 1.0) / (double(l)*l - double(m)*m));
+      double const b = sqrt((double(l-1)*(l-1) - double(m)*m) / (4.0*(l-1)*(l-1) - 1.0));
+      double const pl = a * (cosTheta * pm1 - b * pm2);
+      P[lmIndex(l,m)] = pl;
+      pm2 = pm1;
+      pm1 = pl;
+    }
+  }
+}
+
+// Coefficients of a real function sampled at unit vectors (x,y,z) with quadrature weights w
+// Partitioned so the sum does not depend on the number of threads
+//
+void spharmForward(Complex* coefs, int lmax,
+                   float const* x, float const* y, float const* z, double const* values, double const* weights, size_t n)
+{
+  int const ncoefs = (lmax+1)*(lmax+1);
+  int const numberOfPartitions = 16;
+  int const perPartition = (n + numberOfPartitions - 1) / numberOfPartitions;
+
+  std::vector<Complex> partial(numberOfPartitions*ncoefs, Complex(0.0,0.0));
+
+  ROMP_PF_begin
+  int partition;
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (partition = 0; partition < numberOfPartitions; partition++) {
+    ROMP_PFLB_begin
+    std::vector<double> P(ncoefs);
+    Complex* const acc = &partial[partition*ncoefs];
+
+    size_t const iLo = (size_t)partition*perPartition;
+    size_t const iHi = std::min(n, iLo + perPartition);
+    for (size_t i = iLo; i < iHi; i++) {
+      double const r = sqrt(double(x[i])*x[i] + double(y[i])*y[i] + double(z[i])*z[i]);
+      if (r <= 0.0) continue;
+      spharmLegendre(&P[0], lmax, z[i]/r);
+      double const phi = atan2(y[i], x[i]);
+      double const wv  = weights[i] * values[i];
+      for (int m = 0; m <= lmax; m++) {
+        Complex const e = std::polar(wv, -m*phi);
+        for (int l = m; l <= lmax; l++) acc[lmIndex(l,m)] += P[lmIndex(l,m)] * e;
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  for (int i = 0; i < ncoefs; i++) coefs[i] = 0.0;
+  for (int partition = 0; partition < numberOfPartitions; partition++)
+    for (int l = 0; l <= lmax; l++)
+      for (int m = 0; m <= l; m++) coefs[lmIndex(l,m)] += partial[partition*ncoefs + lmIndex(l,m)];
+
+  // real function, so f_l,-m = (-1)^m conj(f_lm)
+  for (int l = 0; l <= lmax; l++)
+    for (int m = 1; m <= l; m++)
+      coefs[lmIndex(l,-m)] = ((m & 1) ? -1.0 : 1.0) * std::conj(coefs[lmIndex(l,m)]);
+}
+
+// Wigner small-d d^l_mm'(beta) for all |m|,|m'| <= l, stored in d[(l+m)*(2l+1) + (l+m')]
+//
+void wignerSmallD(double* d, int l, double beta, double const* logFactorial)
+{
+  double const c = cos(beta/2), s = sin(beta/2);
+  int const n = 2*l + 1;
+  for (int m = -l; m <= l; m++) {
+    for (int mp = -l; mp <= l; mp++) {
+      double const logNorm = 0.5*(logFactorial[l+m] + logFactorial[l-m] + logFactorial[l+mp] + logFactorial[l-mp]);
+      int const kLo = std::max(0, mp - m);
+      int const kHi = std::min(l - m, l + mp);
+      double sum = 0.0;
+      for (int k = kLo; k <= kHi; k++) {
+        int const cPow = 2*l - 2*k + mp - m;
+        int const sPow = 2*k + m - mp;
+        double const term = exp(logNorm - logFactorial[l+mp-k] - logFactorial[k] - logFactorial[l-m-k] - logFactorial[k+m-mp])
+                          * pow(c, cPow) * pow(s, sPow);
+        sum += ((k + m - mp) & 1) ? -term : term;
+      }
+      d[(l+m)*n + (l+mp)] = sum;
+    }
+  }
+}
+
+// In-place radix-2 FFT, sign -1, n a power of 2
+//
+void fftInPlace(Complex* a, int n)
+{
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(a[i], a[j]);
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    Complex const wlen = std::polar(1.0, -2.0*M_PI/len);
+    for (int i = 0; i < n; i += len) {
+      Complex w(1.0, 0.0);
+      for (int k = 0; k < len/2; k++) {
+        Complex const u = a[i+k], v = a[i+k+len/2] * w;
+        a[i+k]       = u + v;
+        a[i+k+len/2] = u - v;
+        w *= wlen;
+      }
+    }
+  }
+}
+
+// C on the grid alpha_j = 2 pi j/nag, beta_b = pi (b+0.5)/nbeta, gamma_k = 2 pi k/nag,
+// stored in corr[(b*nag + j)*nag + k]
+//
+void so3Correlation(double* corr, int nbeta, int nag, Complex const* f, Complex const* h, int lmax)
+{
+  std::vector<double> logFactorial(2*lmax + 2);
+  logFactorial[0] = 0.0;
+  for (size_t i = 1; i < logFactorial.size(); i++) logFactorial[i] = logFactorial[i-1] + log(double(i));
+
+  ROMP_PF_begin
+  int b;
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (b = 0; b < nbeta; b++) {
+    ROMP_PFLB_begin
+    double const beta = M_PI * (b + 0.5) / nbeta;
+
+    // S[m][m'] = sum_l conj(h_lm) d^l_mm'(beta) f_lm', placed at the fft frequencies
+    std::vector<Complex> S(nag*nag, Complex(0.0,0.0));
+    std::vector<double>  d((2*lmax+1)*(2*lmax+1));
+    for (int l = 0; l <= lmax; l++) {
+      wignerSmallD(&d[0], l, beta, &logFactorial[0]);
+      int const n = 2*l + 1;
+      for (int m = -l; m <= l; m++) {
+        Complex const hc = std::conj(h[lmIndex(l,m)]);
+        for (int mp = -l; mp <= l; mp++)
+          S[((m + nag) % nag)*nag + (mp + nag) % nag] += hc * d[(l+m)*n + (l+mp)] * f[lmIndex(l,mp)];
+      }
+    }
+
+    // the 2D transform, rows (m') then columns (m)
+    std::vector<Complex> column(nag);
+    for (int m = 0; m < nag; m++) fftInPlace(&S[m*nag], nag);
+    for (int k = 0; k < nag; k++) {
+      for (int m = 0; m < nag; m++) column[m] = S[m*nag + k];
+      fftInPlace(&column[0], nag);
+      for (int j = 0; j < nag; j++) corr[(b*nag + j)*nag + k] = column[j].real();
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+typedef double Matrix3[3][3];
+
+void multiply(Matrix3 out, Matrix3 const a, Matrix3 const b)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      out[i][j] = a[i][0]*b[0][j] + a[i][1]*b[1][j] + a[i][2]*b[2][j];
+}
+
+// Rz(alpha) Ry(beta) Rz(gamma)
+//
+void zyzToMatrix(Matrix3 R, double alpha, double beta, double gamma)
+{
+  double const ca = cos(alpha), sa = sin(alpha), cb = cos(beta), sb = sin(beta), cg = cos(gamma), sg = sin(gamma);
+  Matrix3 const Rza = {{ca,-sa,0},{sa,ca,0},{0,0,1}};
+  Matrix3 const Ryb = {{cb,0,sb},{0,1,0},{-sb,0,cb}};
+  Matrix3 const Rzg = {{cg,-sg,0},{sg,cg,0},{0,0,1}};
+  Matrix3 tmp;
+  multiply(tmp, Ryb, Rzg);
+  multiply(R, Rza, tmp);
+}
+
+// The matrix applied by MRISrotate and rotateVertices
+//
+void mrisAnglesToMatrix(Matrix3 R, double alpha, double beta, double gamma)
+{
+  double const sa = sin(alpha), sb = sin(beta), sg = sin(gamma), ca = cos(alpha), cb = cos(beta), cg = cos(gamma);
+  R[0][0] =  ca*cb; R[0][1] = cg*sa - ca*sb*sg; R[0][2] = -ca*cg*sb - sa*sg;
+  R[1][0] = -cb*sa; R[1][1] = ca*cg + sa*sb*sg; R[1][2] =  cg*sa*sb - ca*sg;
+  R[2][0] =  sb;    R[2][1] = cb*sg;            R[2][2] =  cb*cg;
+}
+
+void matrixToMrisAngles(double* alpha, double* beta, double* gamma, Matrix3 const R)
+{
+  *beta  = asin(std::max(-1.0, std::min(1.0, R[2][0])));
+  *gamma = atan2(R[2][1], R[2][2]);
+  *alpha = atan2(-R[1][0], R[0][0]);
+}
+
+// Offset of the vertex of the parabola through (-1,cm), (0,c0), (1,cp), within half a cell
+//
+double parabolaPeakOffset(double cm, double c0, double cp)
+{
+  double const den = cm - 2.0*c0 + cp;
+  if (den >= 0.0) return 0.0;
+  return std::max(-0.5, std::min(0.5, 0.5*(cm - cp)/den));
+}
+
+} // namespace
+
+
+void MRISrigidBodyAlignGlobal_findMinSSE_spharm(
+  double* new_mina, double* new_minb, double* new_ming, double* new_sse,  // outputs
+  MRI_SURFACE*       mris,
+  INTEGRATION_PARMS* parms,
+  float              min_radians,
+  float              max_radians,
+  double             ext_sse,
+  int                nangles,
+  int                lmax,
+  int                npeaks) {
+
+  // The grid sizes in alpha and gamma must be powers of 2 covering -lmax..lmax
+  //
+  int nag = 2;
+  while (nag < 2*lmax + 2) nag *= 2;
+  int const nbeta = nag / 2;
+
+  // Subject: the curvature at the non-ripped vertices, mean removed
+  //
+  std::vector<float>  xv, yv, zv;
+  std::vector<double> subjectValues, subjectWeights;
+  double subjectMean = 0.0;
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const * v = &mris->vertices[vno];
+    if (v->ripflag) continue;
+    xv.push_back(v->x); yv.push_back(v->y); zv.push_back(v->z);
+    subjectValues.push_back(v->curv);
+    subjectMean += v->curv;
+  }
+  size_t const nsubject = xv.size();
+  if (nsubject == 0) {
+    MRISrigidBodyAlignGlobal_findMinSSE(new_mina, new_minb, new_ming, new_sse, mris, parms, min_radians, max_radians, ext_sse, nangles);
+    return;
+  }
+  subjectMean /= nsubject;
+  for (size_t i = 0; i < nsubject; i++) subjectValues[i] -= subjectMean;
+  subjectWeights.assign(nsubject, 4.0*M_PI / nsubject);
+
+  // Template: sampled on a midpoint grid in (theta,phi) with sin(theta) weights,
+  // twice as fine as needed for lmax, each sample divided by its std
+  //
+  int const ntheta = 2*nag, nphi = 2*nag;
+  size_t const ntemplate = (size_t)ntheta*nphi;
+  std::vector<float>  xt(ntemplate), yt(ntemplate), zt(ntemplate);
+  std::vector<double> templateValues(ntemplate), templateWeights(ntemplate);
+
+  ROMP_PF_begin
+  int it;
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (it = 0; it < ntheta; it++) {
+    ROMP_PFLB_begin
+    double const theta = M_PI * (it + 0.5) / ntheta;
+    for (int ip = 0; ip < nphi; ip++) {
+      double const phi = 2.0 * M_PI * ip / nphi;
+      size_t const i = (size_t)it*nphi + ip;
+      xt[i] = mris->radius * sin(theta) * cos(phi);
+      yt[i] = mris->radius * sin(theta) * sin(phi);
+      zt[i] = mris->radius * cos(theta);
+
+      float const zero = 0.0f;
+      MRISPfunctionValResultForAlpha targetAndStd;
+      MRISPfunctionVal_radiusR(parms->mrisp_template, &targetAndStd, mris->radius, xt[i], yt[i], zt[i],
+                               parms->frame_no, true, &zero, 1, false);
+
+      double sqrt_std = sqrt(targetAndStd.next);
+      if (FZERO(sqrt_std)) sqrt_std = DEFAULT_STD;
+
+      templateValues[i]  = targetAndStd.curr / sqrt_std;
+      templateWeights[i] = sin(theta) * (M_PI / ntheta) * (2.0 * M_PI / nphi);
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  { double sum = 0.0, weights = 0.0;
+    for (size_t i = 0; i < ntemplate; i++) { sum += templateWeights[i]*templateValues[i]; weights += templateWeights[i]; }
+    for (size_t i = 0; i < ntemplate; i++) templateValues[i] -= sum / weights;
+  }
+
+  int const ncoefs = (lmax+1)*(lmax+1);
+  std::vector<Complex> f(ncoefs), h(ncoefs);
+  spharmForward(&f[0], lmax, &xv[0], &yv[0], &zv[0], &subjectValues[0], &subjectWeights[0], nsubject);
+  spharmForward(&h[0], lmax, &xt[0], &yt[0], &zt[0], &templateValues[0], &templateWeights[0], ntemplate);
+
+  std::vector<double> corr((size_t)nbeta*nag*nag);
+  so3Correlation(&corr[0], nbeta, nag, &f[0], &h[0], lmax);
+
+  // Local maxima over the 26 neighbours, wrapping in alpha and gamma
+  //
+  std::vector<std::pair<double,int> > peaks;
+  for (int b = 0; b < nbeta; b++)
+    for (int j = 0; j < nag; j++)
+      for (int k = 0; k < nag; k++) {
+        double const c = corr[((size_t)b*nag + j)*nag + k];
+        bool isMax = true;
+        for (int db = -1; db <= 1 && isMax; db++) {
+          int const b1 = b + db;
+          if (b1 < 0 || nbeta <= b1) continue;
+          for (int dj = -1; dj <= 1 && isMax; dj++)
+            for (int dk = -1; dk <= 1 && isMax; dk++) {
+              if (!db && !dj && !dk) continue;
+              int const j1 = (j + dj + nag) % nag, k1 = (k + dk + nag) % nag;
+              if (corr[((size_t)b1*nag + j1)*nag + k1] > c) isMax = false;
+            }
+        }
+        if (isMax) peaks.push_back(std::make_pair(-c, (b*nag + j)*nag + k));
+      }
+  std::sort(peaks.begin(), peaks.end());
+
+  // Candidates are the best peaks inside the grid search domain, or the identity if there are none
+  //
+  std::vector<std::vector<double> > candidates;
+  for (size_t p = 0; p < peaks.size() && (int)candidates.size() < npeaks; p++) {
+    int const index = peaks[p].second;
+    int const b = index / (nag*nag), j = (index / nag) % nag, k = index % nag;
+
+    // Sub-cell position of the peak, wrapping in alpha and gamma
+    #define CORR(B,J,K) corr[((size_t)(B)*nag + ((J) + nag) % nag)*nag + ((K) + nag) % nag]
+    double const c0 = CORR(b,j,k);
+    double const db = (0 < b && b < nbeta - 1) ? parabolaPeakOffset(CORR(b-1,j,k), c0, CORR(b+1,j,k)) : 0.0;
+    double const dj = parabolaPeakOffset(CORR(b,j-1,k), c0, CORR(b,j+1,k));
+    double const dk = parabolaPeakOffset(CORR(b,j,k-1), c0, CORR(b,j,k+1));
+    #undef CORR
+
+    Matrix3 R;
+    zyzToMatrix(R, 2.0*M_PI*(j + dj)/nag, M_PI*(b + db + 0.5)/nbeta, 2.0*M_PI*(k + dk)/nag);
+
+    std::vector<double> angles(3);
+    matrixToMrisAngles(&angles[0], &angles[1], &angles[2], R);
+    if (fabs(angles[0]) > max_radians || fabs(angles[1]) > max_radians || fabs(angles[2]) > max_radians) continue;
+    candidates.push_back(angles);
+  }
+  if (candidates.empty()) candidates.push_back(std::vector<double>(3, 0.0));
+
+  // Refine each with a single local search at the finest scale.
+  // A domain of 8 cells searched 4 angles at a time starts at a stride of one cell,
+  // and moves with the minimum until it settles, so no coarser scales are visited.
+  //
+  int   const refine_nangles = 4;
+  float const refine_radians = 8*min_radians;
+
+  bool found = false;
+  MRISsaveVertexPositions(mris, TMP2_VERTICES);
+  for (size_t c = 0; c < candidates.size(); c++) {
+    double const a0 = candidates[c][0], b0 = candidates[c][1], g0 = candidates[c][2];
+
+    MRISrotate(mris, mris, a0, b0, g0);
+
+    double a1, b1, g1, sse;
+    MRISrigidBodyAlignGlobal_findMinSSE(&a1, &b1, &g1, &sse, mris, parms, min_radians, refine_radians, ext_sse, refine_nangles);
+    MRISrestoreVertexPositions(mris, TMP2_VERTICES);
+
+    Matrix3 R0, R1, R;
+    mrisAnglesToMatrix(R0, a0, b0, g0);
+    mrisAnglesToMatrix(R1, a1, b1, g1);
+    multiply(R, R1, R0);
+
+    if (Gdiag & DIAG_SHOW) {
+      fprintf(stdout, "%s:%d candidate %d at (%2.2f, %2.2f, %2.2f) refined sse = %2.2f\n", __FILE__, __LINE__,
+        (int)c, (float)DEGREES(a0), (float)DEGREES(b0), (float)DEGREES(g0), (float)sse);
+    }
+
+    if (!found || sse < *new_sse) {
+      found = true;
+      matrixToMrisAngles(new_mina, new_minb, new_ming, R);
+      *new_sse = sse;
+    }
+  }
+}
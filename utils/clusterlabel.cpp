@@ -0,0 +1,314 @@
+/**
+ * @brief reentrant cluster labeling of surface and volume maps
+ *
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clusterlabel.h"
+#include "error.h"
+#include "volcluster.h"
+
+static CLUSTER_GRAPH *clustGraphAlloc(int nnodes, int nedges)
+{
+  CLUSTER_GRAPH *graph = (CLUSTER_GRAPH *)calloc(1, sizeof(CLUSTER_GRAPH));
+  graph->nnodes = nnodes;
+  graph->rowptr = (int *)calloc(nnodes + 1, sizeof(int));
+  graph->col = (int *)calloc(nedges > 0 ? nedges : 1, sizeof(int));
+  graph->size = (float *)calloc(nnodes, sizeof(float));
+  graph->x = (float *)calloc(nnodes, sizeof(float));
+  graph->y = (float *)calloc(nnodes, sizeof(float));
+  graph->z = (float *)calloc(nnodes, sizeof(float));
+  graph->index = (int *)calloc(nnodes, sizeof(int));
+  if (!graph->rowptr || !graph->col || !graph->size || !graph->x || !graph->y || !graph->z || !graph->index)
+    ErrorExit(ERROR_NOMEMORY, "clustGraphAlloc(): could not alloc graph with %d nodes, %d edges", nnodes, nedges);
+  return (graph);
+}
+
+/*--------------------------------------------------------------------
+  clustGraphFromSurf() - builds the cluster graph of a surface: the
+  nodes are the vertices, the edges the 1-neighbors. Node sizes are
+  the vertex areas (group average areas if loaded), scaled to the group
+  surface area the way sclustSurfaceArea() does, so
+  MRIScomputeMetricProperties() must have been run.
+  --------------------------------------------------------------------*/
+CLUSTER_GRAPH *clustGraphFromSurf(MRI_SURFACE *surf)
+{
+  int vno, n, nedges = 0;
+  double scale = 1;
+
+  for (vno = 0; vno < surf->nvertices; vno++) nedges += surf->vertices_topology[vno].vnum;
+  CLUSTER_GRAPH *graph = clustGraphAlloc(surf->nvertices, nedges);
+  graph->width = surf->nvertices;
+  graph->height = graph->depth = 1;
+
+  if (surf->group_avg_surface_area > 0 && !surf->group_avg_vtxarea_loaded)
+    scale = surf->group_avg_surface_area / surf->total_area;
+
+  for (vno = 0; vno < surf->nvertices; vno++) {
+    VERTEX_TOPOLOGY const *const vt = &surf->vertices_topology[vno];
+    VERTEX const *const v = &surf->vertices[vno];
+    graph->rowptr[vno + 1] = graph->rowptr[vno] + vt->vnum;
+    for (n = 0; n < vt->vnum; n++) graph->col[graph->rowptr[vno] + n] = vt->v[n];
+    graph->size[vno] = (surf->group_avg_vtxarea_loaded ? v->group_avg_area : v->area) * scale;
+    graph->x[vno] = v->x;
+    graph->y[vno] = v->y;
+    graph->z[vno] = v->z;
+    graph->index[vno] = vno;
+  }
+  return (graph);
+}
+
+/*--------------------------------------------------------------------
+  clustGraphFromVolume() - builds the cluster graph of a volume: the
+  nodes are the voxels where the mask is not 0 (all voxels if mask is
+  NULL), the edges connect face neighbors (6-connectivity) or, if
+  allowdiag, all 26 neighbors. Node sizes are the voxel volume.
+  --------------------------------------------------------------------*/
+CLUSTER_GRAPH *clustGraphFromVolume(MRI *vol, MRI *mask, int allowdiag)
+{
+  int c, r, s, dc, dr, ds, n = 0, nnodes;
+  const int width = vol->width, height = vol->height, depth = vol->depth;
+  const long nvox = (long)width * height * depth;
+
+  if (nvox > INT_MAX) ErrorExit(ERROR_BADPARM, "clustGraphFromVolume(): volume too big (%ld voxels)", nvox);
+
+  // node number of each voxel, -1 if outside the mask
+  int *node = (int *)calloc(nvox, sizeof(int));
+  if (!node) ErrorExit(ERROR_NOMEMORY, "clustGraphFromVolume(): could not alloc node map");
+  nnodes = 0;
+  for (s = 0; s < depth; s++)
+    for (r = 0; r < height; r++)
+      for (c = 0; c < width; c++) {
+        long i = c + (long)width * (r + (long)height * s);
+        if (mask && (int)MRIgetVoxVal(mask, c, r, s, 0) == 0)
+          node[i] = -1;
+        else
+          node[i] = nnodes++;
+      }
+
+  // count, then fill the neighbors
+  for (int pass = 0; pass < 2; pass++) {
+    CLUSTER_GRAPH *graph = NULL;
+    if (pass == 1) {
+      graph = clustGraphAlloc(nnodes, n);
+      graph->width = width;
+      graph->height = height;
+      graph->depth = depth;
+    }
+    n = 0;
+    for (s = 0; s < depth; s++)
+      for (r = 0; r < height; r++)
+        for (c = 0; c < width; c++) {
+          long i = c + (long)width * (r + (long)height * s);
+          if (node[i] < 0) continue;
+          for (ds = -1; ds <= 1; ds++) {
+            if (s + ds < 0 || s + ds >= depth) continue;
+            for (dr = -1; dr <= 1; dr++) {
+              if (r + dr < 0 || r + dr >= height) continue;
+              for (dc = -1; dc <= 1; dc++) {
+                if (c + dc < 0 || c + dc >= width) continue;
+                int dsum = abs(dc) + abs(dr) + abs(ds);
+                if (dsum == 0 || (!allowdiag && dsum != 1)) continue;
+                int nbr = node[i + dc + (long)width * (dr + (long)height * ds)];
+                if (nbr < 0) continue;
+                if (graph) graph->col[n] = nbr;
+                n++;
+              }
+            }
+          }
+          if (graph) {
+            int k = node[i];
+            graph->rowptr[k + 1] = n;
+            graph->size[k] = vol->xsize * vol->ysize * vol->zsize;
+            graph->x[k] = c;
+            graph->y[k] = r;
+            graph->z[k] = s;
+            graph->index[k] = i;
+          }
+        }
+    if (graph) {
+      free(node);
+      return (graph);
+    }
+  }
+  return (NULL);
+}
+
+int clustGraphFree(CLUSTER_GRAPH **pgraph)
+{
+  CLUSTER_GRAPH *graph = *pgraph;
+  if (graph == NULL) return (0);
+  free(graph->rowptr);
+  free(graph->col);
+  free(graph->size);
+  free(graph->x);
+  free(graph->y);
+  free(graph->z);
+  free(graph->index);
+  free(graph);
+  *pgraph = NULL;
+  return (0);
+}
+
+/*--------------------------------------------------------------------
+  clustGraphValues() - gets the value of each node of the graph from
+  the given frame of map, which must have the dimensions the graph was
+  built from (nvertices x 1 x 1 for a surface).
+  --------------------------------------------------------------------*/
+int clustGraphValues(const CLUSTER_GRAPH *graph, MRI *map, int frame, float *val)
+{
+  if ((long)map->width * map->height * map->depth != (long)graph->width * graph->height * graph->depth) {
+    printf("ERROR: clustGraphValues(): map dimension mismatch %dx%dx%d, graph %dx%dx%d\n",
+           map->width, map->height, map->depth, graph->width, graph->height, graph->depth);
+    return (1);
+  }
+  for (int n = 0; n < graph->nnodes; n++) {
+    int i = graph->index[n];
+    int c = i % map->width, r = (i / map->width) % map->height, s = i / (map->width * map->height);
+    val[n] = MRIgetVoxVal(map, c, r, s, frame);
+  }
+  return (0);
+}
+
+CLUSTER_WORKSPACE *clustWorkspaceAlloc(const CLUSTER_GRAPH *graph)
+{
+  CLUSTER_WORKSPACE *work = (CLUSTER_WORKSPACE *)calloc(1, sizeof(CLUSTER_WORKSPACE));
+  work->nnodes = graph->nnodes;
+  work->clusterno = (int *)calloc(graph->nnodes > 0 ? graph->nnodes : 1, sizeof(int));
+  work->queue = (int *)calloc(graph->nnodes > 0 ? graph->nnodes : 1, sizeof(int));
+  work->maxclusters = 64;
+  work->clusters = (CLUSTER_STATS *)calloc(work->maxclusters, sizeof(CLUSTER_STATS));
+  if (!work->clusterno || !work->queue || !work->clusters)
+    ErrorExit(ERROR_NOMEMORY, "clustWorkspaceAlloc(): could not alloc workspace for %d nodes", graph->nnodes);
+  return (work);
+}
+
+int clustWorkspaceFree(CLUSTER_WORKSPACE **pwork)
+{
+  CLUSTER_WORKSPACE *work = *pwork;
+  if (work == NULL) return (0);
+  free(work->clusterno);
+  free(work->queue);
+  free(work->clusters);
+  free(work);
+  *pwork = NULL;
+  return (0);
+}
+
+/*--------------------------------------------------------------------
+  clustLabelGraph() - finds the clusters of connected nodes whose value
+  is in range (see clustValueInRange()) and returns their number. The
+  cluster number of each node and the stats of each cluster are left in
+  work. Clusters smaller than minsize (mm2 or mm3) are dropped, and the
+  rest are numbered 1..nclusters in the order of their first node. Only
+  work is written, so this can run concurrently with other workspaces.
+  --------------------------------------------------------------------*/
+int clustLabelGraph(const CLUSTER_GRAPH *graph, const float *val, float thmin, float thmax,
+                    int thsign, float minsize, CLUSTER_WORKSPACE *work)
+{
+  int n, k, seed, nclusters = 0;
+  int *clusterno = work->clusterno, *queue = work->queue;
+
+  if (work->nnodes != graph->nnodes) {
+    printf("ERROR: clustLabelGraph(): workspace has %d nodes, graph %d\n", work->nnodes, graph->nnodes);
+    return (-1);
+  }
+
+  // -1 marks nodes in range that have not been assigned yet
+  for (n = 0; n < graph->nnodes; n++) clusterno[n] = clustValueInRange(val[n], thmin, thmax, thsign) ? -1 : 0;
+
+  for (seed = 0; seed < graph->nnodes; seed++) {
+    if (clusterno[seed] != -1) continue;
+
+    if (nclusters == work->maxclusters) {
+      work->maxclusters *= 2;
+      work->clusters = (CLUSTER_STATS *)realloc(work->clusters, work->maxclusters * sizeof(CLUSTER_STATS));
+      if (!work->clusters)
+        ErrorExit(ERROR_NOMEMORY, "clustLabelGraph(): could not alloc %d clusters", work->maxclusters);
+    }
+    CLUSTER_STATS *cs = &work->clusters[nclusters++];
+    memset(cs, 0, sizeof(CLUSTER_STATS));
+    float maxval = 0;
+
+    // breadth-first growth from the seed
+    int head = 0, tail = 0;
+    clusterno[seed] = nclusters;
+    queue[tail++] = seed;
+    while (head < tail) {
+      n = queue[head++];
+      cs->nmembers++;
+      cs->size += graph->size[n];
+      cs->cx += graph->x[n];
+      cs->cy += graph->y[n];
+      cs->cz += graph->z[n];
+      cs->weight += val[n];
+      float v = val[n];
+      if (thsign == 0) v = fabs(v);
+      if (thsign == -1) v = -v;
+      if (cs->nmembers == 1 || v > maxval) {
+        maxval = v;
+        cs->maxval = val[n];
+        cs->maxnode = n;
+      }
+      for (k = graph->rowptr[n]; k < graph->rowptr[n + 1]; k++) {
+        int nbr = graph->col[k];
+        if (clusterno[nbr] != -1) continue;
+        clusterno[nbr] = nclusters;
+        queue[tail++] = nbr;
+      }
+    }
+    cs->cx /= cs->nmembers;
+    cs->cy /= cs->nmembers;
+    cs->cz /= cs->nmembers;
+  }
+
+  // drop the small clusters and renumber the rest
+  if (minsize > 0) {
+    int nkeep = 0;
+    int *newno = queue;  // queue is free again
+    for (k = 0; k < nclusters; k++) {
+      if (work->clusters[k].size < minsize) {
+        newno[k] = 0;
+        continue;
+      }
+      work->clusters[nkeep] = work->clusters[k];
+      newno[k] = ++nkeep;
+    }
+    if (nkeep < nclusters)
+      for (n = 0; n < graph->nnodes; n++)
+        if (clusterno[n]) clusterno[n] = newno[clusterno[n] - 1];
+    nclusters = nkeep;
+  }
+
+  work->nclusters = nclusters;
+  return (nclusters);
+}
+
+/*--------------------------------------------------------------------
+  clustWorkspaceMaxSize() - size of the largest cluster found by the
+  last clustLabelGraph(), 0 if there were none.
+  --------------------------------------------------------------------*/
+double clustWorkspaceMaxSize(const CLUSTER_WORKSPACE *work)
+{
+  double maxsize = 0;
+  for (int k = 0; k < work->nclusters; k++)
+    if (maxsize < work->clusters[k].size) maxsize = work->clusters[k].size;
+  return (maxsize);
+}
@@ -31,6 +31,14 @@
 #endif
 static int EVScompare(const void *evsch1, const void *evsch2);
 
+/* Uniform [0,1) deviate from the given erand48() state, or from the
+   global drand48() stream if xsubi is NULL. */
+static double EVSdrand48(unsigned short *xsubi)
+{
+  if (xsubi != NULL) return (erand48(xsubi));
+  return (drand48());
+}
+
 /*-------------------------------------------------------------*/
 EVENT_SCHEDULE *EVSAlloc(int nevents, int allocweight)
 {
@@ -267,6 +275,25 @@ EVENT_SCHEDULE *EVSsynth(int nEvTypes,
                          int nCB1Search,
                          float tNullMin,
                          float tNullMax)
+{
+  return (EVSsynth_r(nEvTypes, nPer, tPer, tRes, tMax, tPreScan, nCB1Search, tNullMin, tNullMax, NULL));
+}
+/*-----------------------------------------------------------------
+  EVSsynth_r() - same as EVSsynth() but draws all random numbers
+  from the erand48() state xsubi so that several schedules can be
+  synthesized concurrently, each from its own stream. If xsubi is
+  NULL, the global drand48() stream is used.
+-----------------------------------------------------------------*/
+EVENT_SCHEDULE *EVSsynth_r(int nEvTypes,
+                           int *nPer,
+                           float *tPer,
+                           float tRes,
+                           float tMax,
+                           float tPreScan,
+                           int nCB1Search,
+                           float tNullMin,
+                           float tNullMax,
+                           unsigned short *xsubi)
 {
   int id, m, n, nevents, nSlotsNull, nSlotsTot, *EvSeq, nNullMax;
   float tStimTot, t, tScanTot, tNullTot;
@@ -293,9 +320,9 @@ EVENT_SCHEDULE *EVSsynth(int nEvTypes,
 
   /* Synthesize the sequence */
   if (nCB1Search > 1)
-    EvSch = EVScb1Optimize(nEvTypes, nPer, nCB1Search);
+    EvSch = EVScb1Optimize_r(nEvTypes, nPer, nCB1Search, xsubi);
   else
-    EvSch = EVScb1Optimize(nEvTypes, nPer, 1);
+    EvSch = EVScb1Optimize_r(nEvTypes, nPer, 1, xsubi);
 
   /* The code  below is for synthesizing the timing */
   /* Compute the total amount of null time */
@@ -323,7 +350,7 @@ EVENT_SCHEDULE *EVSsynth(int nEvTypes,
   EvSeq = (int *)calloc(sizeof(int), nSlotsTot);
   for (n = 0; n < nevents; n++) EvSeq[n] = 1;
   /* Randomize the sequence of nulls and non-nulls*/
-  m = RandPermListLimit0(nSlotsTot, EvSeq, nNullMax, 1000000);
+  m = RandPermListLimit0_r(nSlotsTot, EvSeq, nNullMax, 1000000, xsubi);
   if (m < 0) {
     printf("ERROR: could not enforce tNullMax=%g (ntries=1000000)\n", tNullMax);
     printf("You will need to reduce the number of time points\n");
@@ -369,6 +396,10 @@ EVENT_SCHEDULE *EVSsynth(int nEvTypes,
   minimize the first-order counter-balancing error.
 -----------------------------------------------------------*/
 EVSCH *EVScb1Optimize(int nEvTypes, int *nEvReps, int nSearch)
+{
+  return (EVScb1Optimize_r(nEvTypes, nEvReps, nSearch, NULL));
+}
+EVSCH *EVScb1Optimize_r(int nEvTypes, int *nEvReps, int nSearch, unsigned short *xsubi)
 {
   EVSCH *EvSch, *EvSchBest = NULL;
   int n;
@@ -376,7 +407,7 @@ EVSCH *EVScb1Optimize(int nEvTypes, int *nEvReps, int nSearch)
   /* Loop over the number of search iterations */
   for (n = 0; n < nSearch; n++) {
     /* Get a random sequence of events */
-    EvSch = EVSRandSequence(nEvTypes, nEvReps);
+    EvSch = EVSRandSequence_r(nEvTypes, nEvReps, xsubi);
 
     /* Compute the CB1 cost */
     EVScb1Error(EvSch);
@@ -402,6 +433,10 @@ EVSCH *EVScb1Optimize(int nEvTypes, int *nEvReps, int nSearch)
   event.
   -----------------------------------------------------------*/
 EVSCH *EVSRandSequence(int nEvTypes, int *nEvReps)
+{
+  return (EVSRandSequence_r(nEvTypes, nEvReps, NULL));
+}
+EVSCH *EVSRandSequence_r(int nEvTypes, int *nEvReps, unsigned short *xsubi)
 {
   EVSCH *EvSch;
   int nevents, m, n, nthev;
@@ -426,7 +461,7 @@ EVSCH *EVSRandSequence(int nEvTypes, int *nEvReps)
   }
 
   /* Randomly permute the event list to randomize */
-  RandPermList(nevents, EvSch->eventid);
+  RandPermList_r(nevents, EvSch->eventid, xsubi);
 
   return (EvSch);
 }
@@ -502,7 +537,8 @@ EVENT_SCHEDULE *EVSreadPar(char *parfile)
   RandPerm() - returns a list of randomly permuted integers
   between 0 and N-1. Should be the same as matlab's.
   ------------------------------------------------------------*/
-int *RandPerm(int N, int *v)
+int *RandPerm(int N, int *v) { return (RandPerm_r(N, v, NULL)); }
+int *RandPerm_r(int N, int *v, unsigned short *xsubi)
 {
   int tmp, n, n2;
 
@@ -510,7 +546,7 @@ int *RandPerm(int N, int *v)
   for (n = 0; n < N; n++) v[n] = n;
 
   for (n = 0; n < N; n++) {
-    n2 = (int)floor(drand48() * N);
+    n2 = (int)floor(EVSdrand48(xsubi) * N);
     tmp = v[n];
     v[n] = v[n2];
     v[n2] = tmp;
@@ -527,12 +563,16 @@ int *RandPerm(int N, int *v)
  if the maximum number of iterations is exceeded.
  -----------------------------------------------------------------*/
 int RandPermListLimit0(int N, int *v, int lim, int nitersmax)
+{
+  return (RandPermListLimit0_r(N, v, lim, nitersmax, NULL));
+}
+int RandPermListLimit0_r(int N, int *v, int lim, int nitersmax, unsigned short *xsubi)
 {
   int niters, runlenmax, runlen, n;
 
   niters = 0;
   while (1) {
-    RandPermList(N, v);  // permute the list
+    RandPermList_r(N, v, xsubi);  // permute the list
     // Count the max run length of items whose val is 0
     runlenmax = 0;
     runlen = 0;
@@ -557,7 +597,8 @@ int RandPermListLimit0(int N, int *v, int lim, int nitersmax)
 /*---------------------------------------------------------------
   RandPermList() - randomly permutes members of the given list.
   ------------------------------------------------------------*/
-int RandPermList(int N, int *v)
+int RandPermList(int N, int *v) { return (RandPermList_r(N, v, NULL)); }
+int RandPermList_r(int N, int *v, unsigned short *xsubi)
 {
   int *p, *vp, n;
 
@@ -566,7 +607,7 @@ int RandPermList(int N, int *v)
     return (1);
   }
 
-  p = RandPerm(N, NULL);
+  p = RandPerm_r(N, NULL, xsubi);
   vp = (int *)calloc(sizeof(int), N);
   for (n = 0; n < N; n++) vp[n] = v[n];
   for (n = 0; n < N; n++) v[n] = vp[p[n]];
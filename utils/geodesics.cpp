@@ -3,10 +3,10 @@
 //
 
 #include <stdlib.h>
+#include <unistd.h>
 #include <algorithm>  
 #include <iomanip>
 #include <iostream>
-#include <map>
 #include <stack>
 #include <vector>
 
@@ -14,11 +14,9 @@
 
 #include "macros.h"
 #include "mrisurf.h"
-#include "timer.h"
-
-#ifdef _OPENMP
 #include "romp_support.h"
-#endif
+#include "surfsssp.h"
+#include "timer.h"
 
 // Vertex
 struct Vertex
@@ -42,16 +40,42 @@ struct Triangle
   float angle[3];
   int vert[3];
   int neighbor[3];
-  bool inChain;
 };
 
-static int getIndex(int *arr, int vid);
+static int getIndex(const int *arr, int vid);
 static float distanceBetween(int v1, int v2, MRIS *surf);
 static int findNeighbor(int faceidx, int v1, int v2, MRIS *surf);
 static Vertex extendedPoint(Vertex A, Vertex B, float dA, float dB, float dAB);
-static std::pair< int, int > makeKey(int a, int b);
 static void progressBar(float progress);
 
+// collects the result of each search from SSSPsolveEach() in step 2
+struct GeodesicsVisit
+{
+  Geodesics *geo;
+  int overflow;
+};
+
+static void geodesicsVisit(int nth, int source, int nreached, const int *node, const float *cost, void *parms)
+{
+  GeodesicsVisit *visit = (GeodesicsVisit *)parms;
+  Geodesics *g = &visit->geo[source];
+  g->vnum = 0;
+  if (nreached - 1 > MAX_GEODESICS) {
+    // called from the threads of SSSPsolveEach()
+#ifdef HAVE_OPENMP
+    #pragma omp atomic write
+#endif
+    visit->overflow = 1;
+    return;
+  }
+  // the source itself comes first
+  for (int n = 1; n < nreached; n++) {
+    g->v[g->vnum] = node[n];
+    g->dist[g->vnum] = cost[n];
+    g->vnum++;
+  }
+}
+
 Geodesics *computeGeodesics(MRIS *surf, float maxdist)
 {
   int msec;
@@ -75,7 +99,6 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
       triangle->vert[ns] = face->v[ns];
       triangle->angle[ns] = face->angle[ns];
     }
-    triangle->inChain = false;
   }
 
   msec = mytimer.milliseconds();
@@ -84,38 +107,57 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
 
   std::cout << "computing geodesics within distance of " << maxdist << " mm\n";
   fflush(stdout);
-  std::vector< std::vector< int > > nearestverts(surf->nvertices);
   int idxlookup[] = {0, 2, 1, 0};  // fast lookup table to find remaining index
                                    // can be removed... there's an easier way
-  std::map< std::pair< int, int >, float > pathmap;
-  // private vars:
-  std::vector< int > chain;
-  std::stack< StackItem > stack;
-  std::vector< bool > isnearest(surf->nvertices);
-  std::map< std::pair< int, int >, float >::iterator edge;
-  StackItem stackitem;
-  Vertex A, B, C, D;
-  int iA, iB, iC, iD;
-  int current_idx;
-  float min_angle, max_angle, current_angle, distance;
+  // line-of-sight distances found from each vertex
+  std::vector< std::vector< std::pair< int, float > > > los(surf->nvertices);
 
   // ------ STEP 1 ------
-  // compute each geodesic using the LOS algorithm. each geodesics is added
-  // to the pathmap, but this will not account for every path.
-  for (int vertexID = 0; vertexID < surf->nvertices; vertexID++) {
+  // compute each geodesic using the LOS algorithm. the vertices are
+  // independent, so each thread unfolds its own chains and keeps the
+  // triangles in its chain in its own flags rather than in the shared
+  // triangles. this will not account for every path.
+  int nthreads = 1;
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  std::vector< std::vector< char > > inChains(nthreads);
+  int vertexID;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 64)
+#endif
+  for (vertexID = 0; vertexID < surf->nvertices; vertexID++) {
+    ROMP_PFLB_begin
+#ifdef HAVE_OPENMP
+    int const thread = omp_get_thread_num();
+#else
+    int const thread = 0;
+#endif
+    std::vector< char > &inChain = inChains[thread];
+    if (inChain.empty()) inChain.resize(surf->nfaces, 0);
+    std::vector< std::pair< int, float > > &found = los[vertexID];
+    std::vector< int > chain;
+    std::stack< StackItem > stack;
+    StackItem stackitem;
+    Triangle const *triangle;
+    Vertex A, B, C, D;
+    int iA, iB, iC, iD;
+    int current_idx;
+    float min_angle, max_angle, current_angle, distance;
+
     VERTEX_TOPOLOGY const * const basevertex = &surf->vertices_topology[vertexID];
     // begin chain with each face that neighbors the current base vertex:
     for (int i = 0; i < basevertex->num; i++) {
-      // clear triangle chain and surrounding vertices index:
-      for (unsigned int c = 0; c < chain.size(); c++) triangles[chain[c]].inChain = false;
+      // clear triangle chain:
+      for (unsigned int c = 0; c < chain.size(); c++) inChain[chain[c]] = 0;
       chain.clear();
-      for (unsigned int c = 0; c < isnearest.size(); c++) isnearest[c] = false;
       // set up initial triangle in plane:
       current_idx = basevertex->f[i];
       triangle = &triangles[current_idx];
       // formally add to chain:
       chain.push_back(current_idx);
-      triangle->inChain = true;
+      inChain[current_idx] = 1;
       // get vertex indices in relation to their
       // placement in the face's vertex array:
       iC = getIndex(triangle->vert, vertexID);
@@ -136,22 +178,9 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
       C.x = 0.0;
       C.y = 0.0;
       C.id = triangle->vert[iC];
-      // formally consider the distance from C to A as a geodesic:
-      nearestverts[vertexID].push_back(A.id);
-      isnearest[A.id] = true;
-      edge = pathmap.find(makeKey(vertexID, A.id));
-      if (edge != pathmap.end())
-        edge->second = triangle->length[iB];
-      else
-        pathmap.insert(make_pair(makeKey(vertexID, A.id), triangle->length[iB]));
-      // formally consider the distance from C to B as a geodesic:
-      nearestverts[vertexID].push_back(B.id);
-      isnearest[B.id] = true;
-      edge = pathmap.find(makeKey(vertexID, B.id));
-      if (edge != pathmap.end())
-        edge->second = triangle->length[iA];
-      else
-        pathmap.insert(make_pair(makeKey(vertexID, B.id), triangle->length[iA]));
+      // formally consider the distances from C to A and to B as geodesics:
+      found.push_back(std::make_pair(A.id, triangle->length[iB]));
+      found.push_back(std::make_pair(B.id, triangle->length[iA]));
       // chain initialiaztion complete. get next triangle
       // and begin building chain:
       current_idx = triangle->neighbor[iC];
@@ -159,7 +188,7 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
       while (true) {
         // check if the current triangle is valid or if it
         // already exists in the chain:
-        if ((current_idx < 0) || (triangles[current_idx].inChain)) {
+        if ((current_idx < 0) || (inChain[current_idx])) {
           // move on to next base triangle if the stack is empty:
           if (stack.empty()) break;
           // if not, just revert to the last stack item:
@@ -174,7 +203,7 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
             triangle = &triangles[current_idx];
             // trim the chain back to the current triangle:
             while ((chain.back() != current_idx) && (chain.size() > 0)) {
-              triangles[chain.back()].inChain = false;
+              inChain[chain.back()] = 0;
               chain.pop_back();
             }
             stack.pop();
@@ -184,7 +213,7 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
         else {
           triangle = &triangles[current_idx];
           chain.push_back(current_idx);
-          triangle->inChain = true;
+          inChain[current_idx] = 1;
           // find appropriate vertex indices for new triangle:
           iA = getIndex(triangle->vert, A.id);  // this can be optimized
           iB = getIndex(triangle->vert, B.id);
@@ -200,11 +229,6 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
             current_idx = -1;  // this forces the next triangle invalid
             continue;
           }
-          // potentially use the geodesics matrix here...
-          if (!isnearest[D.id]) {
-            nearestverts[vertexID].push_back(D.id);
-            isnearest[D.id] = true;
-          }
           // check if angle is visible within the fov:
           if ((current_angle < min_angle)) {
             C = A;
@@ -215,14 +239,8 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
             B = D;
           }
           else if (((current_angle <= max_angle) && (current_angle >= min_angle))) {
-            // add geodesic to path map if shorter than the previous distance:
-            edge = pathmap.find(makeKey(vertexID, D.id));
-            if (edge != pathmap.end()) {
-              if ((distance < edge->second) || (edge->second < 0.0)) edge->second = distance;
-            }
-            else {
-              pathmap.insert(make_pair(makeKey(vertexID, D.id), distance));
-            }
+            // add geodesic to the line-of-sight distances:
+            found.push_back(std::make_pair(D.id, distance));
             // push triangle to the stack:
             stackitem.a = A;
             stackitem.b = D;
@@ -249,8 +267,18 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
         current_idx = triangle->neighbor[iC];
       }
     }
-    if (vertexID % 1000 == 0) progressBar((float)vertexID / surf->nvertices);
+    for (unsigned int c = 0; c < chain.size(); c++) inChain[chain[c]] = 0;
+    // keep the shortest distance to each vertex seen
+    std::sort(found.begin(), found.end());
+    unsigned int nfound = 0;
+    for (unsigned int d = 0; d < found.size(); d++)
+      if (!nfound || found[d].first != found[nfound - 1].first) found[nfound++] = found[d];
+    found.resize(nfound);
+
+    if (thread == 0 && vertexID % 1000 == 0) progressBar((float)vertexID / surf->nvertices);
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
   progressBar(1.0);
   std::cout << std::endl;
   msec = mytimer.milliseconds();
@@ -259,74 +287,48 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
 
   std::cout << "computing shortest paths and non-geodesics\n";
   fflush(stdout);
-  Geodesics *geo = (Geodesics *)calloc(surf->nvertices, sizeof(Geodesics));
+
   // ------ STEP 2 ------
-  // compute the shortest paths between each vertex (within given limit)
-  int vi, vj;
+  // the line-of-sight distances, taken both ways and keeping the shortest
+  // of each pair, are the edges of a graph whose shortest paths within
+  // the limit give the geodesics that no single chain could see
+  std::vector< int > degree(surf->nvertices, 0);
   for (int k = 0; k < surf->nvertices; k++) {
-    // set up nearest vertices reference:
-    for (unsigned int d = 0; d < nearestverts[k].size(); d++) {
-      isnearest[nearestverts[k][d]] == true;
-    }
-    for (unsigned int i = 0; i < nearestverts[k].size(); i++) {
-      vi = nearestverts[k][i];
-      edge = pathmap.find(makeKey(k, vi));
-      if ((vi == k) || (edge != pathmap.end())) continue;
-
-      for (unsigned int j = 0; j < nearestverts[k].size(); j++) {
-        vj = nearestverts[k][j];
-        if ((vi == vj) || (vj == k)) continue;
-        // retrieve distance from k to i:
-        edge = pathmap.find(makeKey(k, vj));
-        if (edge == pathmap.end()) continue;
-        distance = edge->second;
-        // retrieve distance from j to k:
-        edge = pathmap.find(makeKey(vj, vi));
-        if (edge == pathmap.end()) continue;
-        distance += edge->second;
-        // retrieve distance from i to j:
-        edge = pathmap.find(makeKey(k, vi));
-        if ((edge == pathmap.end()) && (distance < maxdist))
-          pathmap.insert(make_pair(makeKey(k, vi), distance));
-        else if (distance < edge->second)
-          edge->second = distance;
-      }
-      // search for vertices that are within distance limits
-      // but weren't discovered by the triangle chain
-      edge = pathmap.find(makeKey(k, vi));
-      if (edge != pathmap.end()) {
-        for (int side = 0; side < surf->vertices_topology[vi].vnum; side++) {
-          if (!isnearest[surf->vertices_topology[vi].v[side]]) {
-            distance = edge->second + 0.5;
-            if (distance < maxdist) {
-              isnearest[surf->vertices_topology[vi].v[side]] = true;
-              nearestverts[k].push_back(surf->vertices_topology[vi].v[side]);
-            }
-          }
-        }
-      }
+    for (unsigned int d = 0; d < los[k].size(); d++) {
+      if (los[k][d].first == k) continue;
+      degree[k]++;
+      degree[los[k][d].first]++;
     }
-    geo[k].vnum = 0;
-    // geo[k].v = (int*) calloc(nearestverts[k].size(), sizeof(int));
-    // geo[k].dist = (float*) calloc(nearestverts[k].size(), sizeof(float));
-    for (unsigned int d = 0; d < nearestverts[k].size(); d++) {
-      edge = pathmap.find(makeKey(k, nearestverts[k][d]));
-      if (edge != pathmap.end()) {
-        geo[k].v[geo[k].vnum] = nearestverts[k][d];
-        geo[k].dist[geo[k].vnum] = edge->second;
-        geo[k].vnum += 1;
-        if (geo[k].vnum > MAX_GEODESICS) {
-          std::cerr << "error: too many neighbors, try a smaller max distance\n";
-          fflush(stdout);
-          exit(1);
-        }
-      }
-      isnearest[nearestverts[k][d]] == false;
+  }
+  int nedges = 0;
+  for (int k = 0; k < surf->nvertices; k++) nedges += degree[k];
+  SSSP_GRAPH *graph = SSSPgraphAlloc(surf->nvertices, nedges);
+  for (int k = 0; k < surf->nvertices; k++) graph->rowptr[k + 1] = graph->rowptr[k] + degree[k];
+  std::vector< int > fill(graph->rowptr, graph->rowptr + surf->nvertices);
+  for (int k = 0; k < surf->nvertices; k++) {
+    for (unsigned int d = 0; d < los[k].size(); d++) {
+      int const j = los[k][d].first;
+      if (j == k) continue;
+      graph->col[fill[k]] = j;
+      graph->cost[fill[k]++] = los[k][d].second;
+      graph->col[fill[j]] = k;
+      graph->cost[fill[j]++] = los[k][d].second;
     }
+    std::vector< std::pair< int, float > >().swap(los[k]);
+  }
 
-    if (k % 100 == 0) {
-      progressBar((float)k / surf->nvertices);
-    }
+  Geodesics *geo = (Geodesics *)calloc(surf->nvertices, sizeof(Geodesics));
+  std::vector< int > sources(surf->nvertices);
+  for (int k = 0; k < surf->nvertices; k++) sources[k] = k;
+  GeodesicsVisit visit;
+  visit.geo = geo;
+  visit.overflow = 0;
+  SSSPsolveEach(graph, &sources[0], surf->nvertices, maxdist, geodesicsVisit, &visit);
+  SSSPgraphFree(&graph);
+  if (visit.overflow) {
+    std::cerr << "error: too many neighbors, try a smaller max distance\n";
+    fflush(stdout);
+    exit(1);
   }
   progressBar(1.0);
   std::cout << std::endl;
@@ -459,7 +461,7 @@ int geodesicsUniquify(Geodesics *geod)
   return (nunique);
 }
 
-static int getIndex(int *arr, int vid)
+static int getIndex(const int *arr, int vid)
 {
   int idx = std::distance(arr, std::find(arr, arr + 3, vid));
   // this can be removed:
@@ -505,14 +507,6 @@ static Vertex extendedPoint(Vertex A, Vertex B, float dA, float dB, float dAB)
   return D;
 }
 
-static std::pair< int, int > makeKey(int a, int b)
-{
-  if (a < b)
-    return std::pair< int, int >(a, b);
-  else
-    return std::pair< int, int >(b, a);
-}
-
 static void progressBar(float progress)
 {
   if (!isatty(fileno(stdout))) return;
@@ -29,6 +29,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 #include "error.h"  // return codes
 #include "gifti.h"
 #include "nifti1.h"
@@ -1510,6 +1513,226 @@ MRI *MRISreadGiftiAsMRI(const char *fname, int read_volume)
   return (mri);
 } // end of MRISreadGiftiAsMRI()
 
+/*
+ * convert n raw GIFTI values (already in host byte order) to float
+ */
+static int gifti_values_to_float(const void *data, int datatype, long long n, float *out)
+{
+  long long i;
+  switch (datatype) {
+    case NIFTI_TYPE_UINT8:
+      for (i = 0; i < n; i++) out[i] = ((const unsigned char *)data)[i];
+      break;
+    case NIFTI_TYPE_INT8:
+      for (i = 0; i < n; i++) out[i] = ((const signed char *)data)[i];
+      break;
+    case NIFTI_TYPE_INT16:
+      for (i = 0; i < n; i++) out[i] = ((const short *)data)[i];
+      break;
+    case NIFTI_TYPE_UINT16:
+      for (i = 0; i < n; i++) out[i] = ((const unsigned short *)data)[i];
+      break;
+    case NIFTI_TYPE_INT32:
+      for (i = 0; i < n; i++) out[i] = ((const int *)data)[i];
+      break;
+    case NIFTI_TYPE_UINT32:
+      for (i = 0; i < n; i++) out[i] = ((const unsigned int *)data)[i];
+      break;
+    case NIFTI_TYPE_INT64:
+      for (i = 0; i < n; i++) out[i] = ((const long long *)data)[i];
+      break;
+    case NIFTI_TYPE_UINT64:
+      for (i = 0; i < n; i++) out[i] = ((const unsigned long long *)data)[i];
+      break;
+    case NIFTI_TYPE_FLOAT32:
+      memcpy(out, data, n * sizeof(float));
+      break;
+    case NIFTI_TYPE_FLOAT64:
+      for (i = 0; i < n; i++) out[i] = ((const double *)data)[i];
+      break;
+    default:
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * read values [vno0, vno0+nvertices) of an ExternalFileBinary data array
+ * straight from the external file. A relative ExternalFileName that cannot
+ * be opened as-is is looked up next to the .gii file.
+ */
+static int gifti_read_extern_DA_range(const char *fname, giiDataArray *da, long long vno0, long long nvertices, float *out)
+{
+  FILE *fp = fopen(da->ext_fname, "rb");
+  if (fp == NULL && da->ext_fname[0] != '/') {
+    char *fcopy = strcpyalloc(fname);
+    std::string path = std::string(dirname(fcopy)) + "/" + da->ext_fname;
+    free(fcopy);
+    fp = fopen(path.c_str(), "rb");
+  }
+  if (fp == NULL) {
+    fprintf(stderr, "MRISreadGiftiFrames: could not open external file %s\n", da->ext_fname);
+    return 1;
+  }
+
+  std::vector<char> buf(nvertices * da->nbyper);
+  if (fseeko(fp, (off_t)(da->ext_offset + vno0 * da->nbyper), SEEK_SET) ||
+      fread(buf.data(), da->nbyper, nvertices, fp) != (size_t)nvertices) {
+    fprintf(stderr, "MRISreadGiftiFrames: could not read %lld values from %s\n", nvertices, da->ext_fname);
+    fclose(fp);
+    return 1;
+  }
+  fclose(fp);
+
+  if (da->nbyper > 1 && da->endian != gifti_get_this_endian()) gifti_swap_Nbytes(buf.data(), nvertices, da->nbyper);
+
+  if (gifti_values_to_float(buf.data(), da->datatype, nvertices, out)) {
+    fprintf(stderr, "MRISreadGiftiFrames: unsupported data type %d in %s\n", da->datatype, fname);
+    return 1;
+  }
+  return 0;
+}
+
+/*-----------------------------------------------------------
+  MRISreadGiftiFrames() - reads a sub-block of the overlay data in a
+  GIFTI file: frames [frame0, frame0+nframes) restricted to vertices
+  [vno0, vno0+nvertices). A negative count means "up to the end".
+  The data arrays are selected as in MRISreadGiftiAsMRI, and the
+  result is an MRI_FLOAT of size nvertices x 1 x 1 x nframes.
+
+  Only the requested data is read: the XML is first parsed without
+  data, then ExternalFileBinary arrays are read by seeking into the
+  external file, and the remaining (inline) arrays are decoded only
+  for the requested frames.
+  -----------------------------------------------------------*/
+MRI *MRISreadGiftiFrames(const char *fname, int frame0, int nframes, int vno0, int nvertices)
+{
+  gifti_image *image = gifti_read_image(fname, 0);
+  if (NULL == image) {
+    fprintf(stderr, "MRISreadGiftiFrames: gifti_read_image() returned NULL\n");
+    return NULL;
+  }
+
+  // search all DAs for time series, then shape, then none, then normal
+  int intent_code[] = {NIFTI_INTENT_TIME_SERIES, NIFTI_INTENT_SHAPE, NIFTI_INTENT_NONE, NIFTI_INTENT_NORMAL};
+  std::vector<int> frameDA;
+  for (int i = 0; i < (int)(sizeof(intent_code) / sizeof(intent_code[0])) && frameDA.empty(); i++) {
+    for (int da_num = 0; da_num < image->numDA; da_num++) {
+      if (image->darray[da_num] && image->darray[da_num]->intent == intent_code[i]) frameDA.push_back(da_num);
+    }
+  }
+  if (frameDA.empty()) {
+    fprintf(stderr, "MRISreadGiftiFrames: no overlay data found in file %s\n", fname);
+    gifti_free_image(image);
+    return NULL;
+  }
+
+  long long num_vertices = -1;
+  bool multicol = false;
+  for (unsigned int f = 0; f < frameDA.size(); f++) {
+    giiDataArray *da = image->darray[frameDA[f]];
+    long long nrows = 0, ncols = 0;
+    if (da->ind_ord == GIFTI_IND_ORD_ROW_MAJOR)
+      gifti_DA_rows_cols(da, &nrows, &ncols);
+    else
+      gifti_DA_rows_cols(da, &ncols, &nrows);
+    if (ncols != 1) multicol = true;
+    if (num_vertices == -1)
+      num_vertices = nrows;
+    else if (num_vertices != nrows) {
+      fprintf(stderr,
+              "MRISreadGiftiFrames: malformed time-series data array in file "
+              "%s: nvertices=%lld expected num_vertices=%lld\n",
+              fname,
+              nrows,
+              num_vertices);
+      gifti_free_image(image);
+      return NULL;
+    }
+  }
+
+  int frame_count = frameDA.size();
+  if (nframes < 0) nframes = frame_count - frame0;
+  if (nvertices < 0) nvertices = num_vertices - vno0;
+  if (frame0 < 0 || nframes <= 0 || frame0 + nframes > frame_count || vno0 < 0 || nvertices <= 0 ||
+      vno0 + nvertices > num_vertices) {
+    fprintf(stderr,
+            "MRISreadGiftiFrames: requested frames %d-%d, vertices %d-%d out of range "
+            "(%d frames, %lld vertices) in %s\n",
+            frame0,
+            frame0 + nframes - 1,
+            vno0,
+            vno0 + nvertices - 1,
+            frame_count,
+            num_vertices,
+            fname);
+    gifti_free_image(image);
+    return NULL;
+  }
+
+  MRI *mri = NULL;
+  if (multicol) {
+    // only the first column of multi-column arrays is used as overlay,
+    // which cannot be read as a contiguous range
+    gifti_free_image(image);
+    MRI *full = MRISreadGiftiAsMRI(fname, 1);
+    if (full == NULL) return NULL;
+    mri = MRIallocSequence(nvertices, 1, 1, MRI_FLOAT, nframes);
+    mri->tr = full->tr;
+    for (int f = 0; f < nframes; f++)
+      for (int vno = 0; vno < nvertices; vno++)
+        MRIFseq_vox(mri, vno, 0, 0, f) = MRIgetVoxVal(full, vno0 + vno, 0, 0, frame0 + f);
+    MRIfree(&full);
+    return (mri);
+  }
+
+  mri = MRIallocSequence(nvertices, 1, 1, MRI_FLOAT, nframes);
+  // not sure this is the best way to do this (dng, 4/4/17)
+  char *stmp = gifti_get_meta_value(&image->darray[0]->meta, "TimeStep");
+  if (stmp) sscanf(stmp, "%f", &mri->tr);
+
+  // external arrays are read directly, inline ones are decoded in one pass
+  std::vector<int> dalist, dalistFrame;
+  for (int f = 0; f < nframes; f++) {
+    giiDataArray *da = image->darray[frameDA[frame0 + f]];
+    if (da->encoding == GIFTI_ENCODING_EXTBIN && da->ext_fname && *da->ext_fname) {
+      if (gifti_read_extern_DA_range(fname, da, vno0, nvertices, &MRIFseq_vox(mri, 0, 0, 0, f))) {
+        gifti_free_image(image);
+        MRIfree(&mri);
+        return NULL;
+      }
+    }
+    else {
+      dalist.push_back(frameDA[frame0 + f]);
+      dalistFrame.push_back(f);
+    }
+  }
+  gifti_free_image(image);
+  if (dalist.empty()) return (mri);
+
+  gifti_image *data = gifti_read_da_list(fname, 1, dalist.data(), dalist.size());
+  if (data == NULL || data->numDA != (int)dalist.size()) {
+    fprintf(stderr, "MRISreadGiftiFrames: gifti_read_da_list() failed for %s\n", fname);
+    if (data) gifti_free_image(data);
+    MRIfree(&mri);
+    return NULL;
+  }
+  for (unsigned int n = 0; n < dalist.size(); n++) {
+    giiDataArray *da = data->darray[n];
+    if (da->data == NULL ||
+        gifti_values_to_float(
+            (const char *)da->data + vno0 * da->nbyper, da->datatype, nvertices, &MRIFseq_vox(mri, 0, 0, 0, dalistFrame[n]))) {
+      fprintf(stderr, "MRISreadGiftiFrames: could not convert data array %d in %s\n", dalist[n], fname);
+      gifti_free_image(data);
+      MRIfree(&mri);
+      return NULL;
+    }
+  }
+  gifti_free_image(data);
+
+  return (mri);
+} // end of MRISreadGiftiFrames()
+
 /*
  * insert username and current date into meta data
  */
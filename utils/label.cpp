@@ -24,6 +24,8 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unordered_map>
+#include <vector>
 
 #include "mri.h"
 #include "mrisurf.h"
@@ -47,6 +49,9 @@ static int labelGetSurfaceRasCoords(LABEL *area, LABEL_VERTEX *lv, float *px, fl
 static int update_vertex_indices(LABEL *area);
 ;
 static LABEL_VERTEX *labelFindVertexNumber(LABEL *area, int vno);
+static int labelIndexSync(LABEL *area);
+static int labelIndexFindVertex(LABEL *area, int vno);
+static int labelMarkDuplicates(LABEL *area, double tol);
 static Transform *labelLoadTransform(const char *subject_name, const char *sdir, General_transform *transform);
 #define MAX_VERTICES 500000
 /*-----------------------------------------------------
@@ -219,6 +224,7 @@ int LabelFree(LABEL **parea)
   area = *parea;
   *parea = NULL;
   if (area->vertex_label_ind) free(area->vertex_label_ind);
+  LabelFreeIndex(area);
 
   free(area->lv);
   free(area);
@@ -245,6 +251,7 @@ int LabelToCanonical(LABEL *area, MRI_SURFACE *mris)
     area->lv[n].z = v->cz;
   }
   strncpy(area->space, "TkReg coords=canonical", sizeof(area->space));
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -268,6 +275,7 @@ int LabelToCurrent(LABEL *area, MRI_SURFACE *mris)
     area->lv[n].z = v->z;
   }
   strncpy(area->space, "TkReg coords=canonical", sizeof(area->space));
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -333,6 +341,7 @@ int LabelFromCanonical(LABEL *area, MRI_SURFACE *mris)
     lv->z = v->cz;
   }
   MRISPfree(&mrisp);
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -487,6 +496,7 @@ int LabelFromTalairach(LABEL *area, MRI_SURFACE *mris)
     area->lv[n].y = v->origy;
     area->lv[n].z = v->origz;
   }
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 #endif
@@ -529,6 +539,7 @@ int LabelToFlat(LABEL *area, MRI_SURFACE *mris)
     }
   }
   MHTfree(&mht);
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 int LabelWriteInto(LABEL *area, FILE *fp)
@@ -1155,6 +1166,7 @@ int LabelTalairachTransform(LABEL *area, MRI_SURFACE *mris)
     lv->y = yt;
     lv->z = zt;
   }
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -1177,6 +1189,7 @@ int LabelSphericalTransform(LABEL *area, MRI_SURFACE *mris)
     lv->y = v->cy;
     lv->z = v->cz;
   }
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -1266,6 +1279,7 @@ LABEL *LabelCopy(LABEL *asrc, LABEL *adst)
   strcpy(adst->subject_name, asrc->subject_name);
 
   memmove(adst->lv, asrc->lv, asrc->n_points * sizeof(LABEL_VERTEX));
+  LabelIndexInvalidate(adst);
   return (adst);
 }
 /*-----------------------------------------------------
@@ -1275,30 +1289,7 @@ LABEL *LabelCopy(LABEL *asrc, LABEL *adst)
   ------------------------------------------------------*/
 int LabelRemoveDuplicates(LABEL *area)
 {
-  int n1, n2, deleted = 0;
-  LV *lv1, *lv2;
-
-  // loop thru each label point
-  for (n1 = 0; n1 < area->n_points; n1++) {
-    lv1 = &area->lv[n1];
-    if (lv1->deleted) {
-      continue;
-    }
-    // loop thru the remaining looking for duplicates
-    for (n2 = n1 + 1; n2 < area->n_points; n2++) {
-      lv2 = &area->lv[n2];
-      if (lv1->vno >= 0 && lv2->vno >= 0 && lv1->vno == lv2->vno) {
-        deleted++;
-        lv2->deleted = 1;
-      }
-      else if (lv1->vno < 0 && lv2->vno < 0) {
-        if (FEQUAL(lv1->x, lv2->x) && FEQUAL(lv1->y, lv2->y) && FEQUAL(lv1->z, lv2->z)) {
-          deleted++;
-          lv2->deleted = 1;
-        }
-      }
-    }
-  }
+  int deleted = labelMarkDuplicates(area, FLT_EPSILON);
 
   if (Gdiag & DIAG_SHOW) fprintf(stderr, "%d duplicate vertices removed from label %s.\n", deleted, area->name);
   return (NO_ERROR);
@@ -1311,30 +1302,8 @@ int LabelRemoveDuplicates(LABEL *area)
   ------------------------------------------------------*/
 LABEL *LabelRemoveAlmostDuplicates(LABEL *area, double dist, LABEL *ldst)
 {
-  int n1, n2, deleted = 0;
-  LV *lv1, *lv2;
+  int deleted = labelMarkDuplicates(area, dist);
 
-  // loop thru each label point
-  for (n1 = 0; n1 < area->n_points; n1++) {
-    lv1 = &area->lv[n1];
-    if (lv1->deleted) {
-      continue;
-    }
-    // loop thru the remaining looking for duplicates
-    for (n2 = n1 + 1; n2 < area->n_points; n2++) {
-      lv2 = &area->lv[n2];
-      if (lv1->vno >= 0 && lv2->vno >= 0 && lv1->vno == lv2->vno) {
-        deleted++;
-        lv2->deleted = 1;
-      }
-      else if (lv1->vno < 0 && lv2->vno < 0) {
-        if (fabs(lv1->x - lv2->x) < dist && fabs(lv1->y - lv2->y) < dist && fabs(lv1->z - lv2->z) < dist) {
-          deleted++;
-          lv2->deleted = 1;
-        }
-      }
-    }
-  }
   if (Gdiag & DIAG_SHOW) fprintf(stderr, "%d duplicate vertices removed from label %s.\n", deleted, area->name);
   ldst = LabelCompact(area, ldst);
   return (ldst);
@@ -1366,6 +1335,7 @@ LABEL *LabelCompact(LABEL *lsrc, LABEL *ldst)
       n++;
     }
   ldst->n_points = n;
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 
@@ -1639,6 +1609,7 @@ int LabelToOriginal(LABEL *area, MRI_SURFACE *mris)
     area->lv[n].z = v->origz;
   }
   strncpy(area->space, "TkReg coords=orig", sizeof(area->space));
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -1666,6 +1637,7 @@ int LabelToWhite(LABEL *area, MRI_SURFACE *mris)
     area->lv[n].z = v->whitez;
   }
   strncpy(area->space, "TkReg coords=white", sizeof(area->space));
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 /*-----------------------------------------------------
@@ -1946,6 +1918,7 @@ int LabelFillUnassignedVertices(MRI_SURFACE *mris, LABEL *area, int coords)
     fprintf(stderr, "Couldn't assign %d vertices.\n", num_not_found);
   }
 
+  LabelIndexInvalidate(area);
   return (nfilled);
 }
 
@@ -1970,6 +1943,10 @@ LABEL *LabelSphericalCombine(MRI_SURFACE *mris, LABEL *asrc, MRIS_HASH_TABLE *mh
     adst = atmp;
   }
 
+  // labelFindVertexNumber is called for every point, so index adst for the duration
+  int const had_index = (adst->index != NULL);
+  if (!had_index) LabelBuildIndex(adst);
+
   MRISclearMarks(mris_dst);
   for (n = 0; n < asrc->n_points; n++) {
     vno = asrc->lv[n].vno;
@@ -2071,6 +2048,7 @@ LABEL *LabelSphericalCombine(MRI_SURFACE *mris, LABEL *asrc, MRIS_HASH_TABLE *mh
             LabelCopy(adst, atmp);
             LabelFree(&adst);
             adst = atmp;
+            LabelBuildIndex(adst);
           }
 
           vn->marked = 1;
@@ -2101,6 +2079,8 @@ LABEL *LabelSphericalCombine(MRI_SURFACE *mris, LABEL *asrc, MRIS_HASH_TABLE *mh
     }
   } while (nfilled != 0);
 
+  if (!had_index) LabelFreeIndex(adst);
+
   return (adst);
 }
 
@@ -2334,11 +2314,199 @@ int LabelDilate(LABEL *area, MRI_SURFACE *mris, int num_times, int coords)
   return (NO_ERROR);
 }
 
+/*-----------------------------------------------------------------
+  Label index
+
+  Optional lookup tables for labels with many points, so that
+  finding the point of a vertex or voxel doesn't mean scanning lv.
+  vno maps to the first point with that vertex number, and voxel
+  and coordinate keys map to all points in that voxel/cell,
+  regardless of their deleted flag (callers filter on that).
+
+  Points appended to the end of lv are picked up the next time the
+  index is used, and a label that shrank is reindexed. Anything that
+  changes vno or the coordinates of existing points must call
+  LabelIndexInvalidate(); the label functions that do so here
+  already do.
+  -----------------------------------------------------------------*/
+#define LABEL_INDEX_CELL 1e-3  // size of the cells the coordinate hash uses
+
+struct LABEL_INDEX_KEY
+{
+  long long x, y, z;
+  bool operator==(const LABEL_INDEX_KEY &k) const { return (x == k.x && y == k.y && z == k.z); }
+};
+
+struct LABEL_INDEX_KEY_HASH
+{
+  size_t operator()(const LABEL_INDEX_KEY &k) const
+  {
+    return ((size_t)k.x * 73856093u) ^ ((size_t)k.y * 19349663u) ^ ((size_t)k.z * 83492791u);
+  }
+};
+
+typedef std::unordered_map<LABEL_INDEX_KEY, std::vector<int>, LABEL_INDEX_KEY_HASH> LABEL_INDEX_TABLE;
+
+struct LABEL_INDEX
+{
+  int n_indexed;  // lv[0..n_indexed-1] are in the tables
+  bool invalid;
+  std::unordered_map<int, int> vertices;
+  LABEL_INDEX_TABLE voxels;
+  LABEL_INDEX_TABLE cells;
+};
+
+static LABEL_INDEX_KEY labelCellKey(double x, double y, double z, double cell)
+{
+  LABEL_INDEX_KEY k = {(long long)floor(x / cell), (long long)floor(y / cell), (long long)floor(z / cell)};
+  return (k);
+}
+
+int LabelBuildIndex(LABEL *area)
+{
+  if (area->index == NULL) area->index = new LABEL_INDEX;
+  area->index->invalid = true;
+  return (labelIndexSync(area));
+}
+
+int LabelFreeIndex(LABEL *area)
+{
+  delete area->index;
+  area->index = NULL;
+  return (NO_ERROR);
+}
+
+int LabelIndexInvalidate(LABEL *area)
+{
+  if (area->index) area->index->invalid = true;
+  return (NO_ERROR);
+}
+
+static int labelIndexSync(LABEL *area)
+{
+  LABEL_INDEX *index = area->index;
+  int n;
+
+  if (index == NULL) return (NO_ERROR);
+  if (index->invalid || index->n_indexed > area->n_points) {
+    index->vertices.clear();
+    index->voxels.clear();
+    index->cells.clear();
+    index->n_indexed = 0;
+    index->invalid = false;
+  }
+  for (n = index->n_indexed; n < area->n_points; n++) {
+    LV const *lv = &area->lv[n];
+    if (lv->vno >= 0) index->vertices.insert(std::make_pair(lv->vno, n));  // keeps the first one
+    LABEL_INDEX_KEY const kv = {lv->xv, lv->yv, lv->zv};
+    index->voxels[kv].push_back(n);
+    index->cells[labelCellKey(lv->x, lv->y, lv->z, LABEL_INDEX_CELL)].push_back(n);
+  }
+  index->n_indexed = area->n_points;
+  return (NO_ERROR);
+}
+
+// first point with this vertex number or -1, same as a linear search of lv
+static int labelIndexFindVertex(LABEL *area, int vno)
+{
+  if (vno < 0)  // unassigned points aren't in the table
+  {
+    for (int n = 0; n < area->n_points; n++)
+      if (area->lv[n].vno == vno) return (n);
+    return (-1);
+  }
+  labelIndexSync(area);
+  std::unordered_map<int, int>::const_iterator it = area->index->vertices.find(vno);
+  if (it == area->index->vertices.end()) return (-1);
+  if (area->lv[it->second].vno != vno)  // changed behind our back
+  {
+    LabelIndexInvalidate(area);
+    return (labelIndexFindVertex(area, vno));
+  }
+  return (it->second);
+}
+
+// first undeleted point other than nskip, with no vertex and the same coords (FEQUAL) as (x,y,z), or -1
+static int labelIndexFindUnassignedPoint(LABEL *area, float x, float y, float z, int nskip)
+{
+  LABEL_INDEX_KEY const k0 = labelCellKey(x, y, z, LABEL_INDEX_CELL);
+  int found = -1;
+
+  labelIndexSync(area);
+  for (long long dz = -1; dz <= 1; dz++)
+    for (long long dy = -1; dy <= 1; dy++)
+      for (long long dx = -1; dx <= 1; dx++) {
+        LABEL_INDEX_KEY const k = {k0.x + dx, k0.y + dy, k0.z + dz};
+        LABEL_INDEX_TABLE::const_iterator it = area->index->cells.find(k);
+        if (it == area->index->cells.end()) continue;
+        for (size_t i = 0; i < it->second.size(); i++) {
+          int const n = it->second[i];
+          LV const *lv = &area->lv[n];
+          if (n == nskip || lv->vno >= 0 || lv->deleted) continue;
+          if (FEQUAL(lv->x, x) && FEQUAL(lv->y, y) && FEQUAL(lv->z, z) && (found < 0 || n < found)) found = n;
+        }
+      }
+  return (found);
+}
+
+/*
+  Sets the deleted flag of every point that duplicates an earlier,
+  undeleted one: the same vertex, or for points without a vertex,
+  coords within tol. Points are hashed into cells of size >= tol so
+  only the neighboring cells need to be compared. Returns the number
+  of points deleted.
+*/
+static int labelMarkDuplicates(LABEL *area, double tol)
+{
+  double const cell = MAX(tol, LABEL_INDEX_CELL);
+  std::unordered_map<int, int> vertices;
+  LABEL_INDEX_TABLE cells;
+  int n, deleted = 0;
+
+  for (n = 0; n < area->n_points; n++) {
+    LV *lv = &area->lv[n];
+    if (lv->deleted) continue;
+
+    if (lv->vno >= 0) {
+      if (!vertices.insert(std::make_pair(lv->vno, n)).second) {
+        lv->deleted = 1;
+        deleted++;
+      }
+      continue;
+    }
+
+    LABEL_INDEX_KEY const k0 = labelCellKey(lv->x, lv->y, lv->z, cell);
+    bool dup = false;
+    for (long long dz = -1; dz <= 1 && !dup; dz++)
+      for (long long dy = -1; dy <= 1 && !dup; dy++)
+        for (long long dx = -1; dx <= 1 && !dup; dx++) {
+          LABEL_INDEX_KEY const k = {k0.x + dx, k0.y + dy, k0.z + dz};
+          LABEL_INDEX_TABLE::const_iterator it = cells.find(k);
+          if (it == cells.end()) continue;
+          for (size_t i = 0; i < it->second.size() && !dup; i++) {
+            LV const *lv2 = &area->lv[it->second[i]];
+            dup = (fabs(lv->x - lv2->x) < tol && fabs(lv->y - lv2->y) < tol && fabs(lv->z - lv2->z) < tol);
+          }
+        }
+    if (dup) {
+      lv->deleted = 1;
+      deleted++;
+    }
+    else
+      cells[k0].push_back(n);
+  }
+  return (deleted);
+}
+
 static LABEL_VERTEX *labelFindVertexNumber(LABEL *area, int vno)
 {
   int n;
   LABEL_VERTEX *lv;
 
+  if (area->index) {
+    n = labelIndexFindVertex(area, vno);
+    return (n >= 0 ? &area->lv[n] : NULL);
+  }
   for (n = 0; n < area->n_points; n++) {
     lv = &area->lv[n];
     if (lv->vno == vno) {
@@ -2543,6 +2711,7 @@ LABEL *LabelFillHolesWithOrig(LABEL *area_src, MRI_SURFACE *mris)
 int LabelHasVertex(int vtxno, LABEL *lb)
 {
   int n;
+  if (lb->index) return (labelIndexFindVertex(lb, vtxno));
   for (n = 0; n < lb->n_points; n++)
     if (lb->lv[n].vno == vtxno) {
       return (n);
@@ -2830,6 +2999,7 @@ LABEL *LabelTranslate(LABEL *area, LABEL *area_offset, float dx, float dy, float
     area_offset->lv[i].y = area->lv[i].y + dy;
     area_offset->lv[i].z = area->lv[i].z + dz;
   }
+  LabelIndexInvalidate(area_offset);
   return (area_offset);
 }
 
@@ -2840,6 +3010,7 @@ int LabelUnassign(LABEL *area)
   for (i = 0; i < area->n_points; i++) {
     area->lv[i].vno = -1;
   }
+  LabelIndexInvalidate(area);
   return (NO_ERROR);
 }
 
@@ -3141,6 +3312,7 @@ LABEL *LabelToScannerRAS(LABEL *lsrc, MRI *mri, LABEL *ldst)
   VectorFree(&v1);
   VectorFree(&v2);
   MatrixFree(&M_surface_to_RAS);
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 /*
@@ -3188,6 +3360,7 @@ LABEL *LabelToSurfaceRAS(LABEL *lsrc, MRI *mri, LABEL *ldst)
   VectorFree(&v2);
   MatrixFree(&M_surface_to_RAS);
   MatrixFree(&M_surface_from_RAS);
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 
@@ -3232,6 +3405,7 @@ LABEL *LabelToVoxel(LABEL *lsrc, MRI *mri, LABEL *ldst)
   VectorFree(&v1);
   VectorFree(&v2);
   MatrixFree(&M_surface_to_vox);
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 LABEL *LabelClone(LABEL *a)
@@ -3279,6 +3453,7 @@ LABEL *LabelTransform(LABEL *lsrc, TRANSFORM *xform, MRI *mri, LABEL *ldst)
   strncpy(ldst->space, "scanner", sizeof(ldst->space));
   ldst->coords = LABEL_COORDS_SCANNER_RAS ;
 
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 
@@ -3302,6 +3477,7 @@ LABEL *LabelVoxelToSurfaceRAS(LABEL *lsrc, MRI *mri, LABEL *ldst)
 
   ldst->coords = LABEL_COORDS_TKREG_RAS;
   strcpy(ldst->space, "TkReg");
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 
@@ -3579,6 +3755,7 @@ int LabelInit(LABEL *area, MRI *mri_template, MRI_SURFACE *mris, int coords)
       MRIscannerRASToVoxel(mri_template, lv->x, lv->y, lv->z, &xv, &yv, &zv);
       lv->xv = nint(xv);  lv->yv = nint(yv); lv->zv = nint(zv);
     }  // for loop
+    LabelIndexInvalidate(area);
 
     return (NO_ERROR);   // end case where no mris is passed
   }  // mris == NULL
@@ -3678,9 +3855,24 @@ int LabelInit(LABEL *area, MRI *mri_template, MRI_SURFACE *mris, int coords)
       }
     }
   }
+  LabelIndexInvalidate(area);  // vno and voxel coords were rewritten
   return (NO_ERROR);
 }
 
+// an undeleted point other than lv[n] without a vertex at the same coords as lv, or -1
+static int labelFindUnassignedPoint(LABEL *area, LV const *lv, int n)
+{
+  int i;
+
+  if (area->index) return (labelIndexFindUnassignedPoint(area, lv->x, lv->y, lv->z, n));
+  for (i = 0; i < area->n_points; i++) {
+    LV const *lv2 = &area->lv[i];
+    if (i == n || lv2->vno >= 0 || lv2->deleted) continue;
+    if (FEQUAL(lv->x, lv2->x) && FEQUAL(lv->y, lv2->y) && FEQUAL(lv->z, lv2->z)) return (i);
+  }
+  return (-1);
+}
+
 int LabelAddVoxel(LABEL *area, int xv, int yv, int zv, int coords, int *vertices, int *pnvertices)
 {
   int n, min_vno, i, vno;
@@ -3759,35 +3951,13 @@ int LabelAddVoxel(LABEL *area, int xv, int yv, int zv, int coords, int *vertices
       else
       {
         lv->vno = -1;
-        for ( i = 0; i < area->n_points-1; i++)
-        {
-          LV *lv2 = &area->lv[i];
-          if ( lv2->vno < 0 && !lv2->deleted)
-          {
-            if (FEQUAL(lv->x, lv2->x) && FEQUAL(lv->y, lv2->y) && FEQUAL(lv->z, lv2->z))
-            {
-              lv->deleted = 1;
-              break;
-            }
-          }
-        }
+        if (labelFindUnassignedPoint(area, lv, n) >= 0) lv->deleted = 1;
       }
     }
   }
   else
   {
-    for ( i = 0; i < area->n_points-1; i++)
-    {
-      LV *lv2 = &area->lv[i];
-      if ( lv2->vno < 0 && !lv2->deleted)
-      {
-        if (FEQUAL(lv->x, lv2->x) && FEQUAL(lv->y, lv2->y) && FEQUAL(lv->z, lv2->z))
-        {
-          lv->deleted = 1;
-          break;
-        }
-      }
-    }
+    if (labelFindUnassignedPoint(area, lv, n) >= 0) lv->deleted = 1;
     return (NO_ERROR);
   }
   //  else
@@ -3819,7 +3989,7 @@ int LabelAddVoxel(LABEL *area, int xv, int yv, int zv, int coords, int *vertices
 
 int LabelDeleteVoxel(LABEL *area, int xv, int yv, int zv, int *vertices, int *pnvertices)
 {
-  int n, ndeleted;
+  int i, n, ndeleted;
   LV *lv;
 #if 0
   MATRIX *m_vox2ras ;
@@ -3838,7 +4008,19 @@ int LabelDeleteVoxel(LABEL *area, int xv, int yv, int zv, int *vertices, int *pn
     ErrorExit(ERROR_UNSUPPORTED, "LabelDeleteVoxel: label coords tkreg unsupported\n") ;
 #endif
 
-  for (ndeleted = n = 0; n < area->n_points; n++) {
+  // with an index only the points in this voxel need to be looked at
+  static const std::vector<int> no_points;
+  const std::vector<int> *points = NULL;
+  if (area->index) {
+    labelIndexSync(area);
+    LABEL_INDEX_KEY const k = {xv, yv, zv};
+    LABEL_INDEX_TABLE::const_iterator it = area->index->voxels.find(k);
+    points = (it == area->index->voxels.end()) ? &no_points : &it->second;
+  }
+  int const npoints = points ? (int)points->size() : area->n_points;
+
+  for (ndeleted = i = 0; i < npoints; i++) {
+    n = points ? (*points)[i] : i;
     lv = &area->lv[n];
     if (lv->deleted) continue;
     if (lv->xv == xv && lv->yv == yv && lv->zv == zv) {
@@ -3973,6 +4155,7 @@ LABEL *LabelApplyMatrix(LABEL *lsrc, MATRIX *m, LABEL *ldst)
 
   VectorFree(&v1);
   VectorFree(&v2);
+  LabelIndexInvalidate(ldst);
   return (ldst);
 }
 static int labelGetSurfaceRasCoords(LABEL *area, LABEL_VERTEX *lv, float *px, float *py, float *pz)
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <vector>
 
 #include "bfileio.h"
 #include "cma.h"
@@ -768,6 +769,180 @@ MRI *MRIvol2VolLTA::vol2vol(MRI *outvol)
 
 
 
+/*---------------------------------------------------------------
+  mriVol2VolTiled() - the nearest, trilinear and cubic B-spline cases
+  of MRIvol2Vol(). The target is walked in memory order, a tile of
+  VOL2VOL_TILE_ROWS rows of one slice at a time, so the target (and,
+  for the usual near-identity vox2vox, the source) is visited along
+  rows rather than along slices. The source coords of a row are
+  computed together in a loop the compiler can vectorize, and for each
+  voxel the source offsets and weights are found once and applied to
+  all the frames, reading the chunk directly.
+
+  The values are the same as those of the per-voxel loop: the coords
+  are the same float expression with the row-invariant products
+  hoisted (stepping them by adding the column increment would drift
+  and move nearest-neighbor ties), and the sums are done in the order
+  of MRIsampleSeqVolume() and MRIsampleSeqBSpline().
+
+  Returns 0 if done, or 1 if the case is not covered (sinc, unchunked
+  source, or a type MRIsampleSeqVolume() does not handle), leaving the
+  per-voxel loop to do it.
+  ---------------------------------------------------------------*/
+#define VOL2VOL_TILE_ROWS 8
+
+template <class T>
+static void mriVol2VolTiledRow(const MRI *src, const MRI_BSPLINE *bspline, int InterpCode,
+                               const float *fcs, const float *frs, const float *fss,
+                               const int *ics, const int *irs, const int *iss,
+                               const char *inside, int width, float *vals)
+{
+  const T *const base = (const T *)src->chunk;
+  const size_t vpr = src->vox_per_row, vps = src->vox_per_slice, vpv = src->vox_per_vol;
+  const int nframes = src->nframes;
+
+  for (int ct = 0; ct < width; ct++) {
+    if (!inside[ct]) continue;
+    float *const valvect = &vals[(size_t)ct * nframes];
+
+    if (InterpCode == SAMPLE_NEAREST) {
+      const T *const p = base + ics[ct] + irs[ct] * vpr + iss[ct] * vps;
+      for (int f = 0; f < nframes; f++) valvect[f] = (float)p[f * vpv];
+      continue;
+    }
+    if (InterpCode == SAMPLE_CUBIC_BSPLINE) {
+      MRIsampleSeqBSpline(bspline, fcs[ct], frs[ct], fss[ct], valvect, 0, nframes - 1);
+      continue;
+    }
+
+    // trilinear, as in MRIsampleSeqVolume()
+    double x = fcs[ct], y = frs[ct], z = fss[ct];
+    if (MRIindexNotInVolume(src, x, y, z) == 1) {
+      for (int f = 0; f < nframes; f++) valvect[f] = src->outside_val;
+      continue;
+    }
+    if (x >= src->width) x = src->width - 1.0;
+    if (y >= src->height) y = src->height - 1.0;
+    if (z >= src->depth) z = src->depth - 1.0;
+    if (x < 0.0) x = 0.0;
+    if (y < 0.0) y = 0.0;
+    if (z < 0.0) z = 0.0;
+
+    const int xm = MAX((int)x, 0), xp = MIN(src->width - 1, xm + 1);
+    const int ym = MAX((int)y, 0), yp = MIN(src->height - 1, ym + 1);
+    const int zm = MAX((int)z, 0), zp = MIN(src->depth - 1, zm + 1);
+    const double xmd = x - (float)xm, ymd = y - (float)ym, zmd = z - (float)zm;
+    const double xpd = (1.0f - xmd), ypd = (1.0f - ymd), zpd = (1.0f - zmd);
+
+    const double w[8] = {xpd * ypd * zpd, xpd * ypd * zmd, xpd * ymd * zpd, xpd * ymd * zmd,
+                         xmd * ypd * zpd, xmd * ypd * zmd, xmd * ymd * zpd, xmd * ymd * zmd};
+    const T *const p[8] = {base + xm + ym * vpr + zm * vps, base + xm + ym * vpr + zp * vps,
+                           base + xm + yp * vpr + zm * vps, base + xm + yp * vpr + zp * vps,
+                           base + xp + ym * vpr + zm * vps, base + xp + ym * vpr + zp * vps,
+                           base + xp + yp * vpr + zm * vps, base + xp + yp * vpr + zp * vps};
+    for (int f = 0; f < nframes; f++) {
+      const size_t o = f * vpv;
+      valvect[f] = w[0] * (double)p[0][o] + w[1] * (double)p[1][o] + w[2] * (double)p[2][o] +
+                   w[3] * (double)p[3][o] + w[4] * (double)p[4][o] + w[5] * (double)p[5][o] +
+                   w[6] * (double)p[6][o] + w[7] * (double)p[7][o];
+    }
+  }
+}
+
+static int mriVol2VolTiled(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode,
+                           const MRI_BSPLINE *bspline, int (*nintfunc)(double))
+{
+  if (InterpCode != SAMPLE_NEAREST && InterpCode != SAMPLE_TRILINEAR && InterpCode != SAMPLE_CUBIC_BSPLINE) return (1);
+  if (!src->ischunked) return (1);
+
+  void (*rowfunc)(const MRI *, const MRI_BSPLINE *, int, const float *, const float *, const float *,
+                  const int *, const int *, const int *, const char *, int, float *);
+  switch (src->type) {
+    case MRI_UCHAR: rowfunc = mriVol2VolTiledRow<unsigned char>;  break;
+    case MRI_SHORT: rowfunc = mriVol2VolTiledRow<short>;          break;
+    case MRI_USHRT: rowfunc = mriVol2VolTiledRow<unsigned short>; break;
+    case MRI_INT:   rowfunc = mriVol2VolTiledRow<int>;            break;
+    case MRI_LONG:  rowfunc = mriVol2VolTiledRow<long>;           break;
+    case MRI_FLOAT: rowfunc = mriVol2VolTiledRow<float>;          break;
+    default:
+      return (1);
+  }
+
+  const int width = targ->width, nframes = src->nframes;
+  const int nrowtiles = (targ->height + VOL2VOL_TILE_ROWS - 1) / VOL2VOL_TILE_ROWS;
+  const int ntiles = nrowtiles * targ->depth;
+  const bool directstore = (targ->type == MRI_FLOAT && targ->ischunked);
+  float M[3][4];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 4; j++) M[i][j] = Vt2s->rptr[i + 1][j + 1];
+
+  int show_progress_thread = 0;
+#ifdef HAVE_OPENMP
+  if (omp_get_max_threads() > 1) show_progress_thread = omp_get_max_threads() - 1;  // avoid master thread
+#endif
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) shared(show_progress_thread, targ, bspline, src, M, InterpCode, nintfunc, rowfunc)
+#endif
+  for (int tile = 0; tile < ntiles; tile++) {
+    ROMP_PFLB_begin
+
+    const int st = tile / nrowtiles;
+    const int rt0 = (tile % nrowtiles) * VOL2VOL_TILE_ROWS;
+    const int rt1 = MIN(rt0 + VOL2VOL_TILE_ROWS, targ->height);
+
+    std::vector<float> fcs(width), frs(width), fss(width), vals((size_t)width * nframes);
+    std::vector<int> ics(width), irs(width), iss(width);
+    std::vector<char> inside(width);
+
+    for (int rt = rt0; rt < rt1; rt++) {
+      /* CRS in source corresponding to this row of the target */
+      const float crt = M[0][1] * rt, cst = M[0][2] * st;
+      const float rrt = M[1][1] * rt, rst = M[1][2] * st;
+      const float srt = M[2][1] * rt, sst = M[2][2] * st;
+      for (int ct = 0; ct < width; ct++) {
+        fcs[ct] = M[0][0] * ct + crt + cst + M[0][3];
+        frs[ct] = M[1][0] * ct + rrt + rst + M[1][3];
+        fss[ct] = M[2][0] * ct + srt + sst + M[2][3];
+      }
+      for (int ct = 0; ct < width; ct++) {
+        ics[ct] = nintfunc(fcs[ct]);
+        irs[ct] = nintfunc(frs[ct]);
+        iss[ct] = nintfunc(fss[ct]);
+        inside[ct] = (ics[ct] >= 0 && ics[ct] < src->width && irs[ct] >= 0 && irs[ct] < src->height &&
+                      iss[ct] >= 0 && iss[ct] < src->depth);
+      }
+
+      rowfunc(src, bspline, InterpCode, &fcs[0], &frs[0], &fss[0], &ics[0], &irs[0], &iss[0], &inside[0], width, &vals[0]);
+
+      /* Assign output volume values, voxels that do not map into the source are left alone */
+      for (int f = 0; f < nframes; f++) {
+        if (directstore) {
+          float *const out = (float *)targ->chunk + rt * targ->vox_per_row + st * targ->vox_per_slice + f * targ->vox_per_vol;
+          for (int ct = 0; ct < width; ct++)
+            if (inside[ct]) out[ct] = vals[(size_t)ct * nframes + f];
+        }
+        else {
+          for (int ct = 0; ct < width; ct++)
+            if (inside[ct]) MRIsetVoxVal(targ, ct, rt, st, f, vals[(size_t)ct * nframes + f]);
+        }
+      }
+    }
+
+#ifdef HAVE_OPENMP
+    if (omp_get_thread_num() == show_progress_thread) exec_progress_callback(tile, ntiles, 0, 1);
+#else
+    exec_progress_callback(tile, ntiles, 0, 1);
+#endif
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  return (0);
+}
+
+
 /*---------------------------------------------------------------
   MRIvol2Vol() - samples the values of one volume into that of
   another. Handles multiple frames. Can do nearest-neighbor,
@@ -850,94 +1025,96 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
 
   if (InterpCode == SAMPLE_CUBIC_BSPLINE) bspline = MRItoBSpline(src, NULL, 3);
 
+  if (mriVol2VolTiled(src, targ, Vt2s, InterpCode, bspline, nintfunc) != 0) {
 #ifdef HAVE_OPENMP
-  if (omp_get_max_threads() == 1)
-    show_progress_thread = 0;
-  else
-    show_progress_thread = omp_get_max_threads() - 1;  // avoid master thread
+    if (omp_get_max_threads() == 1)
+      show_progress_thread = 0;
+    else
+      show_progress_thread = omp_get_max_threads() - 1;  // avoid master thread
 
-  for (tid = 0; tid < _MAX_FS_THREADS; tid++) {
-    valvects[tid] = (float *)calloc(sizeof(float), src->nframes);
-  }
+    for (tid = 0; tid < _MAX_FS_THREADS; tid++) {
+      valvects[tid] = (float *)calloc(sizeof(float), src->nframes);
+    }
 #else
-  show_progress_thread = 0;
-  valvects[0] = (float *)calloc(sizeof(float), src->nframes);
+    show_progress_thread = 0;
+    valvects[0] = (float *)calloc(sizeof(float), src->nframes);
 #endif
 
-  ROMP_PF_begin
+    ROMP_PF_begin
 #ifdef HAVE_OPENMP
-  #pragma omp parallel for if_ROMP(assume_reproducible) shared(show_progress_thread, targ, bspline, src, Vt2s, InterpCode)
+    #pragma omp parallel for if_ROMP(assume_reproducible) shared(show_progress_thread, targ, bspline, src, Vt2s, InterpCode)
 #endif
-  for (ct = 0; ct < targ->width; ct++) {
-    ROMP_PFLB_begin
-    
-    int rt, st, f;
-    int ics, irs, iss;
-    float fcs, frs, fss, *valvect;
-    double rval;
+    for (ct = 0; ct < targ->width; ct++) {
+      ROMP_PFLB_begin
+      
+      int rt, st, f;
+      int ics, irs, iss;
+      float fcs, frs, fss, *valvect;
+      double rval;
 
 #ifdef HAVE_OPENMP
-    int tid = omp_get_thread_num();
-    valvect = valvects[tid];
+      int tid = omp_get_thread_num();
+      valvect = valvects[tid];
 #else
-    valvect = valvects[0];
+      valvect = valvects[0];
 #endif
 
-    for (rt = 0; rt < targ->height; rt++) {
-      for (st = 0; st < targ->depth; st++) {
-        /* Column in source corresponding to CRS in Target */
-        fcs = Vt2s->rptr[1][1] * ct + Vt2s->rptr[1][2] * rt + Vt2s->rptr[1][3] * st + Vt2s->rptr[1][4];
-        ics = nintfunc(fcs);
-        if (ics < 0 || ics >= src->width) continue;
-
-        /* Row in source corresponding to CRS in Target */
-        frs = Vt2s->rptr[2][1] * ct + Vt2s->rptr[2][2] * rt + Vt2s->rptr[2][3] * st + Vt2s->rptr[2][4];
-        irs = nintfunc(frs);
-        if (irs < 0 || irs >= src->height) continue;
-
-        /* Slice in source corresponding to CRS in Target */
-        fss = Vt2s->rptr[3][1] * ct + Vt2s->rptr[3][2] * rt + Vt2s->rptr[3][3] * st + Vt2s->rptr[3][4];
-        iss = nintfunc(fss);
-        if (iss < 0 || iss >= src->depth) continue;
-
-        /* Assign output volume values */
-        if (InterpCode == SAMPLE_TRILINEAR)
-          MRIsampleSeqVolume(src, fcs, frs, fss, valvect, 0, src->nframes - 1);
-        else {
-          for (f = 0; f < src->nframes; f++) {
-            switch (InterpCode) {
-              case SAMPLE_NEAREST:
-                valvect[f] = MRIgetVoxVal(src, ics, irs, iss, f);
-                break;
-              case SAMPLE_CUBIC_BSPLINE:
-                MRIsampleBSpline(bspline, fcs, frs, fss, f, &rval);
-                valvect[f] = rval;
-                break;
-              case SAMPLE_SINC: /* no multi-frame */
-                MRIsincSampleVolume(src, fcs, frs, fss, sinchw, &rval);
-                valvect[f] = rval;
-                break;
-              default:
-                printf("ERROR: MRIvol2vol: interpolation method %i unknown\n", InterpCode);
-                exit(1);
+      for (rt = 0; rt < targ->height; rt++) {
+        for (st = 0; st < targ->depth; st++) {
+          /* Column in source corresponding to CRS in Target */
+          fcs = Vt2s->rptr[1][1] * ct + Vt2s->rptr[1][2] * rt + Vt2s->rptr[1][3] * st + Vt2s->rptr[1][4];
+          ics = nintfunc(fcs);
+          if (ics < 0 || ics >= src->width) continue;
+
+          /* Row in source corresponding to CRS in Target */
+          frs = Vt2s->rptr[2][1] * ct + Vt2s->rptr[2][2] * rt + Vt2s->rptr[2][3] * st + Vt2s->rptr[2][4];
+          irs = nintfunc(frs);
+          if (irs < 0 || irs >= src->height) continue;
+
+          /* Slice in source corresponding to CRS in Target */
+          fss = Vt2s->rptr[3][1] * ct + Vt2s->rptr[3][2] * rt + Vt2s->rptr[3][3] * st + Vt2s->rptr[3][4];
+          iss = nintfunc(fss);
+          if (iss < 0 || iss >= src->depth) continue;
+
+          /* Assign output volume values */
+          if (InterpCode == SAMPLE_TRILINEAR)
+            MRIsampleSeqVolume(src, fcs, frs, fss, valvect, 0, src->nframes - 1);
+          else {
+            for (f = 0; f < src->nframes; f++) {
+              switch (InterpCode) {
+                case SAMPLE_NEAREST:
+                  valvect[f] = MRIgetVoxVal(src, ics, irs, iss, f);
+                  break;
+                case SAMPLE_CUBIC_BSPLINE:
+                  MRIsampleBSpline(bspline, fcs, frs, fss, f, &rval);
+                  valvect[f] = rval;
+                  break;
+                case SAMPLE_SINC: /* no multi-frame */
+                  MRIsincSampleVolume(src, fcs, frs, fss, sinchw, &rval);
+                  valvect[f] = rval;
+                  break;
+                default:
+                  printf("ERROR: MRIvol2vol: interpolation method %i unknown\n", InterpCode);
+                  exit(1);
+              }
             }
           }
-        }
 
-        for (f = 0; f < src->nframes; f++) MRIsetVoxVal(targ, ct, rt, st, f, valvect[f]);
+          for (f = 0; f < src->nframes; f++) MRIsetVoxVal(targ, ct, rt, st, f, valvect[f]);
 
-      } /* target col */
-    }   /* target row */
-    if (tid == show_progress_thread) exec_progress_callback(ct, targ->width, 0, 1);
-    ROMP_PFLB_end
-  } /* target slice */
-  ROMP_PF_end
-  
+        } /* target col */
+      }   /* target row */
+      if (tid == show_progress_thread) exec_progress_callback(ct, targ->width, 0, 1);
+      ROMP_PFLB_end
+    } /* target slice */
+    ROMP_PF_end
+    
 #ifdef HAVE_OPENMP
-  for (tid = 0; tid < _MAX_FS_THREADS; tid++) free(valvects[tid]);
+    for (tid = 0; tid < _MAX_FS_THREADS; tid++) free(valvects[tid]);
 #else
-  free(valvects[0]);
+    free(valvects[0]);
 #endif
+  }
 
 #ifdef VERBOSE_MODE
   int tSampleTime = tSample.milliseconds();
@@ -3187,6 +3364,104 @@ void MRIConvertSurfaceVertexCoordinates(MRIS* mris, MRI* vol)
 
 /*---------------------------------------------------------------*/
 
+/*---------------------------------------------------------------
+  vol2surfVSMpoint() - computes the point (and nearest voxel) in SrcVol
+  that vertex vtx samples in MRIvol2surfVSM(), including the projection
+  along the normal and the vsm shift. Returns 0 if the vertex does not
+  sample the volume (out of bounds or outside of the vsm mask).
+  ---------------------------------------------------------------*/
+static int vol2surfVSMpoint(const MRI *SrcVol,
+                            const AffineMatrix *ras2voxAffine,
+                            const MRI_SURFACE *TrgSurf,
+                            int vtx,
+                            const MRI *vsm,
+                            float ProjFrac,
+                            int ProjType,
+                            int pedir,
+                            float *pfcol, float *pfrow, float *pfslc,
+                            int *picol, int *pirow, int *pislc)
+{
+  AffineVector Scrs, Txyz;
+  int irow, icol, islc; /* integer row, col, slc in source */
+  int cvsm, rvsm;
+  float frow, fcol, fslc; /* float row, col, slc in source */
+  float shift;
+  double val;
+  float Tx, Ty, Tz;
+  const VERTEX *v = &TrgSurf->vertices[vtx];
+
+  if (ProjFrac != 0.0) {
+    if (ProjType == 0)
+      ProjNormDist(&Tx, &Ty, &Tz, TrgSurf, vtx, ProjFrac);
+    else
+      ProjNormFracThick(&Tx, &Ty, &Tz, TrgSurf, vtx, ProjFrac);
+  }
+  else {
+    Tx = v->x;
+    Ty = v->y;
+    Tz = v->z;
+  }
+
+  /* Load the Target xyz vector */
+  SetAffineVector(&Txyz, Tx, Ty, Tz);
+  /* Compute the corresponding Source col-row-slc vector */
+  AffineMV(&Scrs, ras2voxAffine, &Txyz);
+  GetAffineVector(&Scrs, &fcol, &frow, &fslc);
+
+  icol = nint(fcol);
+  irow = nint(frow);
+  islc = nint(fslc);
+
+  /* check that the point is in the bounds of the volume */
+  if (irow < 0 || irow >= SrcVol->height || icol < 0 || icol >= SrcVol->width || islc < 0 || islc >= SrcVol->depth)
+    return (0);
+
+  if (vsm) {
+    /* Compute the voxel shift (converts from vsm
+       space to mov space). This does a 3d interp to
+       get vsm, not sure if really want a 2d*/
+    // Dont sample outside the BO mask
+    cvsm = floor(fcol);
+    rvsm = floor(frow);
+    if (cvsm < 0 || cvsm + 1 >= vsm->width) return (0);
+    if (rvsm < 0 || rvsm + 1 >= vsm->height) return (0);
+    val = MRIgetVoxVal(vsm, cvsm, rvsm, islc, 0);
+    if (fabs(val) < FLT_MIN) return (0);
+    val = MRIgetVoxVal(vsm, cvsm + 1, rvsm, islc, 0);
+    if (fabs(val) < FLT_MIN) return (0);
+    val = MRIgetVoxVal(vsm, cvsm, rvsm + 1, islc, 0);
+    if (fabs(val) < FLT_MIN) return (0);
+    val = MRIgetVoxVal(vsm, cvsm + 1, rvsm + 1, islc, 0);
+    if (fabs(val) < FLT_MIN) return (0);
+    MRIsampleSeqVolume(vsm, fcol, frow, fslc, &shift, 0, 0);
+    if(shift == 0) return (0);
+    if(abs(pedir) == 1){
+      fcol += (shift*FSIGN(pedir));
+      icol =  nint(fcol);
+      if(icol < 0 || icol >= SrcVol->width) return (0);
+    }
+    if(abs(pedir) == 2){
+      frow += (shift*FSIGN(pedir));
+      irow =  nint(frow);
+      if(irow < 0 || irow >= SrcVol->height) return (0);
+    }
+    if(abs(pedir) == 3){
+      if(shift == 0) return (0);
+      fslc += (shift*FSIGN(pedir));
+      islc = nint(fslc);
+      if(islc < 0 || islc >= SrcVol->depth) return (0);
+    }
+  }
+
+  *pfcol = fcol;
+  *pfrow = frow;
+  *pfslc = fslc;
+  *picol = icol;
+  *pirow = irow;
+  *pislc = islc;
+  return (1);
+}
+
 MRI *MRIvol2surfVSM(const MRI *SrcVol,
                     const MATRIX *Rtk,
                     const MRI_SURFACE *TrgSurf,
@@ -3199,15 +3474,12 @@ MRI *MRIvol2surfVSM(const MRI *SrcVol,
                     MRI *TrgVol, int pedir)
 {
   MATRIX *ras2vox, *vox2ras;
-  AffineVector Scrs, Txyz;
   AffineMatrix ras2voxAffine;
   int irow, icol, islc; /* integer row, col, slc in source */
-  int cvsm, rvsm;
   float frow, fcol, fslc; /* float row, col, slc in source */
-  float srcval, *valvect, shift;
+  float srcval, *valvect;
   int frm, vtx, nhits, err;
-  double rval, val;
-  float Tx, Ty, Tz;
+  double rval;
   const VERTEX *v;
 
 #ifdef MRI2_TIMERS
@@ -3283,69 +3555,10 @@ MRI *MRIvol2surfVSM(const MRI *SrcVol,
       continue;
     }
 
-    if (ProjFrac != 0.0) {
-      if (ProjType == 0)
-        ProjNormDist(&Tx, &Ty, &Tz, TrgSurf, vtx, ProjFrac);
-      else
-        ProjNormFracThick(&Tx, &Ty, &Tz, TrgSurf, vtx, ProjFrac);
-    }
-    else {
-      Tx = v->x;
-      Ty = v->y;
-      Tz = v->z;
-    }
-
-    /* Load the Target xyz vector */
-    SetAffineVector(&Txyz, Tx, Ty, Tz);
-    /* Compute the corresponding Source col-row-slc vector */
-    AffineMV(&Scrs, &ras2voxAffine, &Txyz);
-    GetAffineVector(&Scrs, &fcol, &frow, &fslc);
-
-    icol = nint(fcol);
-    irow = nint(frow);
-    islc = nint(fslc);
-
-    /* check that the point is in the bounds of the volume */
-    if (irow < 0 || irow >= SrcVol->height || icol < 0 || icol >= SrcVol->width || islc < 0 || islc >= SrcVol->depth)
+    if (!vol2surfVSMpoint(SrcVol, &ras2voxAffine, TrgSurf, vtx, vsm, ProjFrac, ProjType, pedir,
+                          &fcol, &frow, &fslc, &icol, &irow, &islc))
       continue;
 
-    if (vsm) {
-      /* Compute the voxel shift (converts from vsm
-         space to mov space). This does a 3d interp to
-         get vsm, not sure if really want a 2d*/
-      // Dont sample outside the BO mask
-      cvsm = floor(fcol);
-      rvsm = floor(frow);
-      if (cvsm < 0 || cvsm + 1 >= vsm->width) continue;
-      if (rvsm < 0 || rvsm + 1 >= vsm->height) continue;
-      val = MRIgetVoxVal(vsm, cvsm, rvsm, islc, 0);
-      if (fabs(val) < FLT_MIN) continue;
-      val = MRIgetVoxVal(vsm, cvsm + 1, rvsm, islc, 0);
-      if (fabs(val) < FLT_MIN) continue;
-      val = MRIgetVoxVal(vsm, cvsm, rvsm + 1, islc, 0);
-      if (fabs(val) < FLT_MIN) continue;
-      val = MRIgetVoxVal(vsm, cvsm + 1, rvsm + 1, islc, 0);
-      if (fabs(val) < FLT_MIN) continue;
-      MRIsampleSeqVolume(vsm, fcol, frow, fslc, &shift, 0, 0);
-      if(shift == 0) continue;
-      if(abs(pedir) == 1){
-	fcol += (shift*FSIGN(pedir));
-	icol =  nint(fcol);
-	if(icol < 0 || icol >= SrcVol->width) continue;
-      }
-      if(abs(pedir) == 2){
-	frow += (shift*FSIGN(pedir));
-	irow =  nint(frow);
-	if(irow < 0 || irow >= SrcVol->height) continue;
-      }
-      if(abs(pedir) == 3){
-	if(shift == 0) continue;
-	fslc += (shift*FSIGN(pedir));
-	islc = nint(fslc);
-	if(islc < 0 || islc >= SrcVol->depth) continue;
-      }
-    }
-
 #if 0
     if (Gdiag_no == vtx)
     {
@@ -3404,6 +3617,480 @@ MRI *MRIvol2surfVSM(const MRI *SrcVol,
   return (TrgVol);
 }
 
+/*
+  Hash of everything besides the sizes and the projection parameters
+  that the sampling of vol2surfVSMpoint() depends on: the registration,
+  the vox2ras of the source, the vsm and the surface vertices (with the
+  thickness in curv when projecting by a fraction of it).
+*/
+static unsigned long vol2surfOpHash(const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                                    const MRI *vsm, int ProjType)
+{
+  FnvHash hash;
+  int r, c, s;
+  float f;
+
+  MATRIX *vox2ras = MRIxfmCRS2XYZtkreg(SrcVol);
+  for (r = 1; r <= 4; r++)
+    for (c = 1; c <= 4; c++) {
+      f = vox2ras->rptr[r][c];
+      hash.add(&f);
+      f = Rtk ? Rtk->rptr[r][c] : (r == c);
+      hash.add(&f);
+    }
+  MatrixFree(&vox2ras);
+
+  if (vsm) {
+    for (s = 0; s < vsm->depth; s++)
+      for (r = 0; r < vsm->height; r++)
+        for (c = 0; c < vsm->width; c++) {
+          f = MRIgetVoxVal(vsm, c, r, s, 0);
+          hash.add(&f);
+        }
+  }
+
+  for (int vtx = 0; vtx < TrgSurf->nvertices; vtx++) {
+    const VERTEX *v = &TrgSurf->vertices[vtx];
+    const float xyz[7] = {v->x, v->y, v->z, v->nx, v->ny, v->nz, ProjType == 0 ? 0 : v->curv};
+    hash.add((const unsigned char *)xyz, sizeof(xyz));
+    hash.add((const unsigned char *)&v->ripflag, sizeof(v->ripflag));
+  }
+  return (hash.value);
+}
+
+/*!
+\fn MRI_VOL2SURF_OP *MRIvol2surfBuildOp(const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                                    const MRI *vsm, int InterpMethod, const float *ProjFrac, int nProjFrac,
+                                    int ProjType, int pedir)
+\brief Computes the sampling of MRIvol2surfVSM() as a sparse operator with
+one layer per projection fraction. Each layer has one row per vertex with
+the source voxels and weights that it samples (one for nearest, eight
+for trilinear, in the same order as MRIsampleSeqVolume()). Only the
+geometry of SrcVol is used, so the operator can be applied to any volume
+of the same size. Only SAMPLE_NEAREST and SAMPLE_TRILINEAR can be
+represented; returns NULL otherwise. Other arguments are as for
+MRIvol2surfVSM() (with nskip=1).
+*/
+MRI_VOL2SURF_OP *MRIvol2surfBuildOp(const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                                    const MRI *vsm, int InterpMethod, const float *ProjFrac, int nProjFrac,
+                                    int ProjType, int pedir)
+{
+  MRI_VOL2SURF_OP *op;
+  MATRIX *ras2vox, *vox2ras;
+  AffineMatrix ras2voxAffine;
+  int irow, icol, islc, vtx, layer, row, nmax, k, err;
+  float frow, fcol, fslc;
+  const int width = SrcVol->width, height = SrcVol->height, depth = SrcVol->depth;
+
+  if (InterpMethod != SAMPLE_NEAREST && InterpMethod != SAMPLE_TRILINEAR) {
+    printf("ERROR: MRIvol2surfBuildOp: interpolation method %d not supported\n", InterpMethod);
+    return (NULL);
+  }
+  if (vsm) {
+    err = MRIdimMismatch(vsm, SrcVol, 0);
+    if (err) {
+      printf("ERROR: MRIvol2surfBuildOp: vsm dimension mismatch %d\n", err);
+      return (NULL);
+    }
+    if (abs(pedir) != 1 && abs(pedir) != 2 && abs(pedir) != 3) {
+      printf("ERROR: MRIvol2surfBuildOp: pedir=%d, must be +/-1, +/-2, +/-3\n", pedir);
+      return (NULL);
+    }
+  }
+
+  vox2ras = MRIxfmCRS2XYZtkreg(SrcVol);
+  ras2vox = MatrixInverse(vox2ras, NULL);
+  if (Rtk != NULL) MatrixMultiply(ras2vox, Rtk, ras2vox);
+  MatrixFree(&vox2ras);
+  SetAffineMatrix(&ras2voxAffine, ras2vox);
+  MatrixFree(&ras2vox);
+
+  nmax = nProjFrac * TrgSurf->nvertices * (InterpMethod == SAMPLE_TRILINEAR ? 8 : 1);
+  op = (MRI_VOL2SURF_OP *)calloc(1, sizeof(MRI_VOL2SURF_OP));
+  op->nvertices = TrgSurf->nvertices;
+  op->width = width;
+  op->height = height;
+  op->depth = depth;
+  op->InterpMethod = InterpMethod;
+  op->nlayers = nProjFrac;
+  op->ProjType = ProjType;
+  op->pedir = vsm ? pedir : 0;
+  op->ProjFrac = (float *)calloc(nProjFrac, sizeof(float));
+  for (layer = 0; layer < nProjFrac; layer++) op->ProjFrac[layer] = ProjFrac[layer];
+  op->hash = vol2surfOpHash(SrcVol, Rtk, TrgSurf, vsm, ProjType);
+  op->rowptr = (int *)calloc(nProjFrac * TrgSurf->nvertices + 1, sizeof(int));
+  op->col = (int *)calloc(nmax + 1, sizeof(int));
+  op->weight = (double *)calloc(nmax + 1, sizeof(double));
+  op->hitptr = (int *)calloc(nProjFrac + 1, sizeof(int));
+  op->hits = (int *)calloc(nProjFrac * TrgSurf->nvertices + 1, sizeof(int));
+  if (!op->rowptr || !op->col || !op->weight || !op->hitptr || !op->hits) {
+    printf("ERROR: MRIvol2surfBuildOp: could not alloc\n");
+    MRIvol2surfOpFree(&op);
+    return (NULL);
+  }
+
+  k = 0;
+  for (layer = 0; layer < nProjFrac; layer++) {
+    op->hitptr[layer + 1] = op->hitptr[layer];
+    for (vtx = 0; vtx < TrgSurf->nvertices; vtx++) {
+      row = layer * TrgSurf->nvertices + vtx;
+      op->rowptr[row] = k;
+      if (TrgSurf->vertices[vtx].ripflag) continue;
+      if (!vol2surfVSMpoint(SrcVol, &ras2voxAffine, TrgSurf, vtx, vsm, ProjFrac[layer], ProjType, pedir,
+                            &fcol, &frow, &fslc, &icol, &irow, &islc))
+        continue;
+
+      op->hits[op->hitptr[layer + 1]++] = icol + irow * width + islc * width * height;
+
+      if (InterpMethod == SAMPLE_NEAREST) {
+        op->col[k] = icol + irow * width + islc * width * height;
+        op->weight[k] = 1.0;
+        k++;
+        continue;
+      }
+
+      /* same clamping and weights as MRIsampleSeqVolume() */
+      double x = fcol, y = frow, z = fslc;
+      int xm, xp, ym, yp, zm, zp;
+      double xmd, ymd, zmd, xpd, ypd, zpd;
+      if (MRIindexNotInVolume(SrcVol, x, y, z) == 1) continue;
+      if (x >= width) x = width - 1.0;
+      if (y >= height) y = height - 1.0;
+      if (z >= depth) z = depth - 1.0;
+      if (x < 0.0) x = 0.0;
+      if (y < 0.0) y = 0.0;
+      if (z < 0.0) z = 0.0;
+      xm = MAX((int)x, 0);
+      xp = MIN(width - 1, xm + 1);
+      ym = MAX((int)y, 0);
+      yp = MIN(height - 1, ym + 1);
+      zm = MAX((int)z, 0);
+      zp = MIN(depth - 1, zm + 1);
+      xmd = x - (float)xm;
+      ymd = y - (float)ym;
+      zmd = z - (float)zm;
+      xpd = (1.0f - xmd);
+      ypd = (1.0f - ymd);
+      zpd = (1.0f - zmd);
+
+      const int cc[8] = {xm, xm, xm, xm, xp, xp, xp, xp};
+      const int rr[8] = {ym, ym, yp, yp, ym, ym, yp, yp};
+      const int ss[8] = {zm, zp, zm, zp, zm, zp, zm, zp};
+      const double ww[8] = {xpd * ypd * zpd, xpd * ypd * zmd, xpd * ymd * zpd, xpd * ymd * zmd,
+                            xmd * ypd * zpd, xmd * ypd * zmd, xmd * ymd * zpd, xmd * ymd * zmd};
+      for (int n = 0; n < 8; n++) {
+        op->col[k] = cc[n] + rr[n] * width + ss[n] * width * height;
+        op->weight[k] = ww[n];
+        k++;
+      }
+    }
+  }
+  op->rowptr[nProjFrac * TrgSurf->nvertices] = k;
+  op->nnz = k;
+
+  return (op);
+}
+
+/*!
+\fn MRI *MRIvol2surfOp(const MRI_VOL2SURF_OP *op, const MRI *SrcVol, int GetMax, MRI *TrgVol)
+\brief Applies an operator from MRIvol2surfBuildOp() or MRIvol2surfOpRead()
+to all frames of SrcVol. The layers are averaged (or the max is taken if
+GetMax), the same as running MRIvol2surfVSM() for each projection fraction
+and combining the results with MRIadd()/MRImultiplyConst() (MRImax()).
+Vertices are processed in parallel; for each vertex, the entries are
+gathered into all frames at once. If TrgVol is NULL, it is allocated.
+*/
+MRI *MRIvol2surfOp(const MRI_VOL2SURF_OP *op, const MRI *SrcVol, int GetMax, MRI *TrgVol)
+{
+  int vtx;
+  const int nframes = SrcVol->nframes;
+
+  if (SrcVol->width != op->width || SrcVol->height != op->height || SrcVol->depth != op->depth) {
+    printf("ERROR: MRIvol2surfOp: volume and operator dimension mismatch\n");
+    return (NULL);
+  }
+  if (TrgVol == NULL) {
+    TrgVol = MRIallocSequence(op->nvertices, 1, 1, MRI_FLOAT, nframes);
+    if (TrgVol == NULL) return (NULL);
+    MRIcopyHeader(SrcVol, TrgVol);
+  }
+  else if (TrgVol->width != op->nvertices || TrgVol->nframes != nframes || TrgVol->type != MRI_FLOAT) {
+    printf("ERROR: MRIvol2surfOp: output dimension mismatch\n");
+    return (NULL);
+  }
+  TrgVol->xsize = 1;
+  TrgVol->ysize = 1;
+  TrgVol->zsize = 1;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (vtx = 0; vtx < op->nvertices; vtx++) {
+    ROMP_PFLB_begin
+    std::vector<double> sum(nframes);
+    int layer, k, f, c, r, s;
+    for (layer = 0; layer < op->nlayers; layer++) {
+      const int row = layer * op->nvertices + vtx;
+      std::fill(sum.begin(), sum.end(), 0.0);
+      for (k = op->rowptr[row]; k < op->rowptr[row + 1]; k++) {
+        c = op->col[k] % op->width;
+        r = (op->col[k] / op->width) % op->height;
+        s = op->col[k] / (op->width * op->height);
+        if (SrcVol->type == MRI_FLOAT)
+          for (f = 0; f < nframes; f++) sum[f] += op->weight[k] * (double)MRIFseq_vox(SrcVol, c, r, s, f);
+        else
+          for (f = 0; f < nframes; f++) sum[f] += op->weight[k] * (double)MRIgetVoxVal(SrcVol, c, r, s, f);
+      }
+      for (f = 0; f < nframes; f++) {
+        const float val = sum[f];
+        if (layer == 0)
+          MRIFseq_vox(TrgVol, vtx, 0, 0, f) = val;
+        else if (GetMax)
+          MRIFseq_vox(TrgVol, vtx, 0, 0, f) = std::max(MRIFseq_vox(TrgVol, vtx, 0, 0, f), val);
+        else
+          MRIFseq_vox(TrgVol, vtx, 0, 0, f) += val;
+      }
+    }
+    if (!GetMax && op->nlayers > 1)
+      for (f = 0; f < nframes; f++)
+        MRIFseq_vox(TrgVol, vtx, 0, 0, f) = MRIFseq_vox(TrgVol, vtx, 0, 0, f) * (1.0 / op->nlayers);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  return (TrgVol);
+}
+
+/*!
+\fn int MRIvol2surfOpHits(const MRI_VOL2SURF_OP *op, int layer, MRI *SrcHitVol)
+\brief Sets SrcHitVol to the number of vertices that sample each source
+voxel in the given layer, as MRIvol2surfVSM() does for its SrcHitVol.
+*/
+int MRIvol2surfOpHits(const MRI_VOL2SURF_OP *op, int layer, MRI *SrcHitVol)
+{
+  int n, c, r, s;
+
+  if (layer < 0 || layer >= op->nlayers) {
+    printf("ERROR: MRIvol2surfOpHits: layer %d out of range\n", layer);
+    return (1);
+  }
+  MRIconst(SrcHitVol->width, SrcHitVol->height, SrcHitVol->depth, 1, 0, SrcHitVol);
+  for (n = op->hitptr[layer]; n < op->hitptr[layer + 1]; n++) {
+    c = op->hits[n] % op->width;
+    r = (op->hits[n] / op->width) % op->height;
+    s = op->hits[n] / (op->width * op->height);
+    MRIFseq_vox(SrcHitVol, c, r, s, 0)++;
+  }
+  return (0);
+}
+
+/*!
+\fn int MRIvol2surfOpMatch(const MRI_VOL2SURF_OP *op, const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                       const MRI *vsm, int InterpMethod, const float *ProjFrac, int nProjFrac,
+                       int ProjType, int pedir)
+\brief Returns 1 if op (eg, from MRIvol2surfOpRead()) is what
+MRIvol2surfBuildOp() would build from these arguments, or 0 after
+printing what differs. The registration, vsm and surface are compared
+by hash.
+*/
+int MRIvol2surfOpMatch(const MRI_VOL2SURF_OP *op, const MRI *SrcVol, const MATRIX *Rtk, const MRI_SURFACE *TrgSurf,
+                       const MRI *vsm, int InterpMethod, const float *ProjFrac, int nProjFrac,
+                       int ProjType, int pedir)
+{
+  if (op->nvertices != TrgSurf->nvertices) {
+    printf("operator has %d vertices, surface has %d\n", op->nvertices, TrgSurf->nvertices);
+    return (0);
+  }
+  if (op->width != SrcVol->width || op->height != SrcVol->height || op->depth != SrcVol->depth) {
+    printf("operator is for a %dx%dx%d volume, source is %dx%dx%d\n", op->width, op->height, op->depth,
+           SrcVol->width, SrcVol->height, SrcVol->depth);
+    return (0);
+  }
+  if (op->InterpMethod != InterpMethod) {
+    printf("operator interpolation %d, requested %d\n", op->InterpMethod, InterpMethod);
+    return (0);
+  }
+  if (op->ProjType != ProjType || op->pedir != (vsm ? pedir : 0)) {
+    printf("operator projection type %d pedir %d, requested %d %d\n", op->ProjType, op->pedir, ProjType,
+           vsm ? pedir : 0);
+    return (0);
+  }
+  if (op->nlayers != nProjFrac) {
+    printf("operator has %d projection fractions, requested %d\n", op->nlayers, nProjFrac);
+    return (0);
+  }
+  for (int layer = 0; layer < nProjFrac; layer++) {
+    if (op->ProjFrac[layer] != ProjFrac[layer]) {
+      printf("operator projection %d is %g, requested %g\n", layer, op->ProjFrac[layer], ProjFrac[layer]);
+      return (0);
+    }
+  }
+  if (op->hash != vol2surfOpHash(SrcVol, Rtk, TrgSurf, vsm, ProjType)) {
+    printf("operator was built for a different registration, volume geometry, vsm or surface\n");
+    return (0);
+  }
+  return (1);
+}
+
+#define MRI_VOL2SURF_OP_MAGIC 0x56325350  // "V2SP"
+#define MRI_VOL2SURF_OP_VERSION 2
+
+/*!
+\fn int MRIvol2surfOpWrite(const MRI_VOL2SURF_OP *op, const char *fname)
+\brief Saves the operator in a (big-endian) binary file so that it can be
+reused for other volumes with the same geometry and registration.
+The projection and a hash of the inputs are saved too, for
+MRIvol2surfOpMatch().
+*/
+int MRIvol2surfOpWrite(const MRI_VOL2SURF_OP *op, const char *fname)
+{
+  FILE *fp;
+  int n;
+  const int nrows = op->nlayers * op->nvertices;
+
+  fp = fopen(fname, "wb");
+  if (fp == NULL) {
+    printf("ERROR: MRIvol2surfOpWrite(): could not open %s\n", fname);
+    return (1);
+  }
+  fwriteInt(MRI_VOL2SURF_OP_MAGIC, fp);
+  fwriteInt(MRI_VOL2SURF_OP_VERSION, fp);
+  fwriteInt(op->nvertices, fp);
+  fwriteInt(op->width, fp);
+  fwriteInt(op->height, fp);
+  fwriteInt(op->depth, fp);
+  fwriteInt(op->InterpMethod, fp);
+  fwriteInt(op->nlayers, fp);
+  fwriteInt(op->nnz, fp);
+  fwriteInt(op->ProjType, fp);
+  fwriteInt(op->pedir, fp);
+  for (n = 0; n < op->nlayers; n++) fwriteFloat(op->ProjFrac[n], fp);
+  fwriteInt((int)(op->hash >> 32), fp);
+  fwriteInt((int)(op->hash & 0xffffffff), fp);
+  for (n = 0; n <= nrows; n++) fwriteInt(op->rowptr[n], fp);
+  for (n = 0; n < op->nnz; n++) fwriteInt(op->col[n], fp);
+  for (n = 0; n < op->nnz; n++) fwriteDouble(op->weight[n], fp);
+  for (n = 0; n <= op->nlayers; n++) fwriteInt(op->hitptr[n], fp);
+  for (n = 0; n < op->hitptr[op->nlayers]; n++) fwriteInt(op->hits[n], fp);
+  if (ferror(fp)) {
+    printf("ERROR: MRIvol2surfOpWrite(): writing %s\n", fname);
+    fclose(fp);
+    return (1);
+  }
+  fclose(fp);
+  return (0);
+}
+
+/*!
+\fn MRI_VOL2SURF_OP *MRIvol2surfOpRead(const char *fname)
+\brief Reads an operator saved with MRIvol2surfOpWrite(). Returns NULL
+if the file cannot be read or is not a valid operator.
+*/
+MRI_VOL2SURF_OP *MRIvol2surfOpRead(const char *fname)
+{
+  MRI_VOL2SURF_OP *op;
+  FILE *fp;
+  int n, version, nrows, nvox;
+
+  fp = fopen(fname, "rb");
+  if (fp == NULL) {
+    printf("ERROR: MRIvol2surfOpRead(): could not open %s\n", fname);
+    return (NULL);
+  }
+  if (freadInt(fp) != MRI_VOL2SURF_OP_MAGIC) {
+    printf("ERROR: MRIvol2surfOpRead(): %s is not a vol2surf operator\n", fname);
+    fclose(fp);
+    return (NULL);
+  }
+  version = freadInt(fp);
+  if (version != MRI_VOL2SURF_OP_VERSION) {
+    printf("ERROR: MRIvol2surfOpRead(): %s has unsupported version %d\n", fname, version);
+    fclose(fp);
+    return (NULL);
+  }
+
+  op = (MRI_VOL2SURF_OP *)calloc(1, sizeof(MRI_VOL2SURF_OP));
+  op->nvertices = freadInt(fp);
+  op->width = freadInt(fp);
+  op->height = freadInt(fp);
+  op->depth = freadInt(fp);
+  op->InterpMethod = freadInt(fp);
+  op->nlayers = freadInt(fp);
+  op->nnz = freadInt(fp);
+  if (op->nvertices < 0 || op->width < 1 || op->height < 1 || op->depth < 1 || op->nlayers < 1 || op->nnz < 0 ||
+      feof(fp)) {
+    printf("ERROR: MRIvol2surfOpRead(): %s has a bad header\n", fname);
+    free(op);
+    fclose(fp);
+    return (NULL);
+  }
+  op->ProjType = freadInt(fp);
+  op->pedir = freadInt(fp);
+  op->ProjFrac = (float *)calloc(op->nlayers, sizeof(float));
+  for (n = 0; n < op->nlayers; n++) op->ProjFrac[n] = freadFloat(fp);
+  op->hash = (unsigned long)(unsigned int)freadInt(fp) << 32;
+  op->hash |= (unsigned int)freadInt(fp);
+  nrows = op->nlayers * op->nvertices;
+  nvox = op->width * op->height * op->depth;
+  op->rowptr = (int *)calloc(nrows + 1, sizeof(int));
+  op->col = (int *)calloc(op->nnz + 1, sizeof(int));
+  op->weight = (double *)calloc(op->nnz + 1, sizeof(double));
+  op->hitptr = (int *)calloc(op->nlayers + 1, sizeof(int));
+  for (n = 0; n <= nrows; n++) op->rowptr[n] = freadInt(fp);
+  for (n = 0; n < op->nnz; n++) op->col[n] = freadInt(fp);
+  for (n = 0; n < op->nnz; n++) op->weight[n] = freadDouble(fp);
+  for (n = 0; n <= op->nlayers; n++) op->hitptr[n] = freadInt(fp);
+  if (ferror(fp) || feof(fp) || op->rowptr[0] != 0 || op->rowptr[nrows] != op->nnz || op->hitptr[0] != 0 ||
+      op->hitptr[op->nlayers] < 0 || op->hitptr[op->nlayers] > nrows) {
+    printf("ERROR: MRIvol2surfOpRead(): %s is truncated or corrupt\n", fname);
+    MRIvol2surfOpFree(&op);
+    fclose(fp);
+    return (NULL);
+  }
+  op->hits = (int *)calloc(op->hitptr[op->nlayers] + 1, sizeof(int));
+  for (n = 0; n < op->hitptr[op->nlayers]; n++) op->hits[n] = freadInt(fp);
+  if (ferror(fp) || feof(fp)) {
+    printf("ERROR: MRIvol2surfOpRead(): %s is truncated or corrupt\n", fname);
+    MRIvol2surfOpFree(&op);
+    fclose(fp);
+    return (NULL);
+  }
+  for (n = 0; n < op->nnz; n++) {
+    if (op->col[n] < 0 || op->col[n] >= nvox) {
+      printf("ERROR: MRIvol2surfOpRead(): %s has a bad voxel index\n", fname);
+      MRIvol2surfOpFree(&op);
+      fclose(fp);
+      return (NULL);
+    }
+  }
+  for (n = 0; n < op->hitptr[op->nlayers]; n++) {
+    if (op->hits[n] < 0 || op->hits[n] >= nvox) {
+      printf("ERROR: MRIvol2surfOpRead(): %s has a bad voxel index\n", fname);
+      MRIvol2surfOpFree(&op);
+      fclose(fp);
+      return (NULL);
+    }
+  }
+  fclose(fp);
+  return (op);
+}
+
+int MRIvol2surfOpFree(MRI_VOL2SURF_OP **pop)
+{
+  MRI_VOL2SURF_OP *op = *pop;
+  if (op == NULL) return (0);
+  free(op->rowptr);
+  free(op->col);
+  free(op->weight);
+  free(op->hitptr);
+  free(op->hits);
+  free(op->ProjFrac);
+  free(op);
+  *pop = NULL;
+  return (0);
+}
+
 int MRIvol2VolTkRegVSM(MRI *mov, MRI *targ, MATRIX *Rtkreg, int InterpCode, float param, MRI *vsm, int pedir)
 {
   MATRIX *vox2vox = NULL;
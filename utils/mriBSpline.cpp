@@ -2121,14 +2121,16 @@ extern int MRIsampleSeqBSpline(
   if (Height == 1) sdj = 0;
   if (Depth == 1) sdk = 0;
 
+  // the coefficients are always float, so read them directly
   for (f = firstframe; f <= lastframe; f++) {
     interpolated = 0.0;
     for (k = 0; k <= sdk; k++) {
       w2 = 0.0;
       for (j = 0; j <= sdj; j++) {
+        const float *row = &MRIFseq_vox(bspline->coeff, 0, yIndex[j], zIndex[k], f);
         w = 0.0;
         for (i = 0; i <= sdi; i++) {
-          w += xWeight[i] * MRIgetVoxVal(bspline->coeff, xIndex[i], yIndex[j], zIndex[k], f);
+          w += xWeight[i] * row[xIndex[i]];
         }
         w2 += yWeight[j] * w;
       }
@@ -20,7 +20,11 @@
  *
  */
 
+#include <algorithm>
+#include <vector>
+
 #include "fastmarching.h"
+#include "romp_support.h"
 
 MRI *MRIextractDistanceMap(MRI *mri_src, MRI *mri_dst, int label, float max_distance, int mode, MRI *mri_mask)
 {
@@ -114,3 +118,280 @@ MRI *MRIextractDistanceMap(MRI *mri_src, MRI *mri_dst, int label, float max_dist
 
   return mri_distance;
 }
+
+
+/*
+  Exact Euclidean distance transform
+
+  The fast marching front above solves the eikonal equation one label
+  at a time through a heap, which is O(N log N) and inherently serial.
+  When the distance is straight-line (no mask to march around), the
+  exact distance can instead be computed with three separable passes of
+  the lower envelope of parabolas (Felzenszwalb & Huttenlocher), each
+  O(N) and independent across rows, so they run in parallel.
+
+  The output follows the fast marching conventions: distances are in
+  voxels, measured from the label boundary so that voxels on either side
+  of it are at +/-0.5, positive outside, negative inside, and clamped
+  at max_distance.
+*/
+
+static const float EDT_INFINITY = 1e20f;
+
+typedef struct
+{
+  std::vector<float> f, z;
+  std::vector<int> v, nearest;
+} EDT_SCRATCH;
+
+// squared distance transform of n samples spaced stride apart, in place. Samples
+// that are EDT_INFINITY are not sites. If nearest is not NULL it carries the
+// index of the closest site along with the distance
+static void edtLine(float *d, int *nearest, int n, size_t stride, EDT_SCRATCH *s)
+{
+  int q, k, j;
+
+  s->f.resize(n);
+  s->z.resize(n);
+  s->v.resize(n);
+  if (nearest) s->nearest.resize(n);
+  for (q = 0; q < n; q++) {
+    s->f[q] = d[q * stride];
+    if (nearest) s->nearest[q] = nearest[q * stride];
+  }
+
+  // lower envelope of the parabolas rooted at the sites
+  k = -1;
+  for (q = 0; q < n; q++) {
+    if (s->f[q] >= EDT_INFINITY) continue;
+    float sq = 0;
+    while (k >= 0) {
+      int const r = s->v[k];
+      sq = ((s->f[q] + (float)q * q) - (s->f[r] + (float)r * r)) / (2.0f * (q - r));
+      if (sq <= s->z[k])
+        k--;
+      else
+        break;
+    }
+    k++;
+    s->v[k] = q;
+    s->z[k] = (k == 0) ? -EDT_INFINITY : sq;
+  }
+  if (k < 0) return;  // no sites on this line
+
+  for (j = 0, q = 0; q < n; q++) {
+    while (j < k && s->z[j + 1] < q) j++;
+    int const r = s->v[j];
+    d[q * stride] = (float)(q - r) * (q - r) + s->f[r];
+    if (nearest) nearest[q * stride] = s->nearest[r];
+  }
+}
+
+// squared distance from every voxel to the closest one with feature set. d must be
+// 0 at the features and EDT_INFINITY elsewhere, nearest (if not NULL) must hold
+// whatever should be propagated from each feature
+static void edtVolume(float *d, int *nearest, int width, int height, int depth)
+{
+  size_t const slice = (size_t)width * height;
+  int y, z;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (z = 0; z < depth; z++) {
+    ROMP_PFLB_begin
+    EDT_SCRATCH s;
+    int x, y;
+    for (y = 0; y < height; y++) {
+      size_t const i = z * slice + (size_t)y * width;
+      edtLine(d + i, nearest ? nearest + i : NULL, width, 1, &s);
+    }
+    for (x = 0; x < width; x++) {
+      size_t const i = z * slice + x;
+      edtLine(d + i, nearest ? nearest + i : NULL, height, width, &s);
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (y = 0; y < height; y++) {
+    ROMP_PFLB_begin
+    EDT_SCRATCH s;
+    int x;
+    for (x = 0; x < width; x++) {
+      size_t const i = (size_t)y * width + x;
+      edtLine(d + i, nearest ? nearest + i : NULL, depth, slice, &s);
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+// distance map of voxels with seg == label into frame of mri_dst. Only the bounding box
+// of the label grown by max_distance can have distances below the limit, so the
+// transform is restricted to that
+static void edtLabelDistance(
+    const std::vector<int> &seg, int label, float max_distance, int mode, MRI *mri_dst, int frame)
+{
+  int const width = mri_dst->width, height = mri_dst->height, depth = mri_dst->depth;
+  bool const do_outside = (mode == 1 || mode == 3 || mode == 4);
+  bool const do_inside = (mode == 2 || mode == 3 || mode == 4);
+  int x, y, z, x0 = width, y0 = height, z0 = depth, x1 = -1, y1 = -1, z1 = -1;
+
+  for (z = 0; z < depth; z++)
+    for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+        if (seg[(size_t)x + (size_t)width * (y + (size_t)height * z)] == label) {
+          x0 = MIN(x0, x);
+          y0 = MIN(y0, y);
+          z0 = MIN(z0, z);
+          x1 = MAX(x1, x);
+          y1 = MAX(y1, y);
+          z1 = MAX(z1, z);
+        }
+
+  // everything outside the box is outside the label and beyond max_distance
+  float const far_val = do_outside ? max_distance : 0;
+  for (z = 0; z < depth; z++)
+    for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++) MRIFseq_vox(mri_dst, x, y, z, frame) = far_val;
+  if (x1 < 0) return;
+
+  int const margin = (int)ceil(max_distance + 0.5) + 1;
+  x0 = MAX(x0 - margin, 0);
+  y0 = MAX(y0 - margin, 0);
+  z0 = MAX(z0 - margin, 0);
+  x1 = MIN(x1 + margin, width - 1);
+  y1 = MIN(y1 + margin, height - 1);
+  z1 = MIN(z1 + margin, depth - 1);
+  int const bw = x1 - x0 + 1, bh = y1 - y0 + 1, bd = z1 - z0 + 1;
+  size_t const nbox = (size_t)bw * bh * bd;
+
+  std::vector<float> d_out, d_in;
+  if (do_outside) d_out.resize(nbox);
+  if (do_inside) d_in.resize(nbox);
+  for (z = 0; z < bd; z++)
+    for (y = 0; y < bh; y++)
+      for (x = 0; x < bw; x++) {
+        size_t const i = (size_t)x + (size_t)bw * (y + (size_t)bh * z);
+        bool const in = seg[(size_t)(x + x0) + (size_t)width * ((y + y0) + (size_t)height * (z + z0))] == label;
+        if (do_outside) d_out[i] = in ? 0 : EDT_INFINITY;
+        if (do_inside) d_in[i] = in ? EDT_INFINITY : 0;
+      }
+  if (do_outside) edtVolume(&d_out[0], NULL, bw, bh, bd);
+  if (do_inside) edtVolume(&d_in[0], NULL, bw, bh, bd);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (z = 0; z < bd; z++) {
+    ROMP_PFLB_begin
+    int x, y;
+    for (y = 0; y < bh; y++)
+      for (x = 0; x < bw; x++) {
+        size_t const i = (size_t)x + (size_t)bw * (y + (size_t)bh * z);
+        bool const in = seg[(size_t)(x + x0) + (size_t)width * ((y + y0) + (size_t)height * (z + z0))] == label;
+        float val = 0;
+        if (in && do_inside)
+          val = -MIN(sqrt(d_in[i]) - 0.5f, max_distance);
+        else if (!in && do_outside)
+          val = MIN(sqrt(d_out[i]) - 0.5f, max_distance);
+        if (mode == 4) val = fabs(val);
+        MRIFseq_vox(mri_dst, x + x0, y + y0, z + z0, frame) = val;
+      }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+static void edtReadLabels(MRI *mri_src, std::vector<int> &seg)
+{
+  int const width = mri_src->width, height = mri_src->height, depth = mri_src->depth;
+  int z;
+
+  seg.resize((size_t)width * height * depth);
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (z = 0; z < depth; z++) {
+    ROMP_PFLB_begin
+    int x, y;
+    for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+        seg[(size_t)x + (size_t)width * (y + (size_t)height * z)] =
+            static_cast< int >(round(MRIgetVoxVal(mri_src, x, y, z, 0)));
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+MRI *MRIextractDistanceMapEDT(MRI *mri_src, MRI *mri_dst, int label, float max_distance, int mode, MRI *mri_mask)
+{
+  // distances constrained to a mask are geodesic, which needs the marching front
+  if (mri_mask) return (MRIextractDistanceMap(mri_src, mri_dst, label, max_distance, mode, mri_mask));
+
+  return (MRIextractDistanceMaps(mri_src, mri_dst, &label, 1, max_distance, mode, NULL));
+}
+
+MRI *MRIextractDistanceMaps(
+    MRI *mri_src, MRI *mri_dst, const int *labels, int nlabels, float max_distance, int mode, MRI **pmri_nearest)
+{
+  int const width = mri_src->width, height = mri_src->height, depth = mri_src->depth;
+  int n;
+
+  if (max_distance <= 0) {
+    max_distance = 2 * MAX(MAX(width, height), depth);
+  }
+
+  if (mri_dst == NULL) {
+    mri_dst = MRIallocSequence(width, height, depth, MRI_FLOAT, nlabels);
+    MRIcopyHeader(mri_src, mri_dst);
+  }
+  if (mri_dst->width != width || mri_dst->height != height || mri_dst->depth != depth ||
+      mri_dst->type != MRI_FLOAT || mri_dst->nframes < nlabels) {
+    fprintf(stderr,
+            "ERROR : MRIextractDistanceMaps: mri_dst must be %dx%dx%d MRI_FLOAT with %d frames\n",
+            width, height, depth, nlabels);
+    return (mri_dst);
+  }
+
+  std::vector<int> seg;
+  edtReadLabels(mri_src, seg);
+
+  for (n = 0; n < nlabels; n++) edtLabelDistance(seg, labels[n], max_distance, mode, mri_dst, n);
+
+  if (pmri_nearest) {
+    // one more transform from all the labels at once, carrying the label along
+    size_t const nvox = seg.size();
+    std::vector<float> d(nvox);
+    std::vector<int> nearest(nvox);
+    std::vector<int> sorted(labels, labels + nlabels);
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < nvox; i++) {
+      bool const in = std::binary_search(sorted.begin(), sorted.end(), seg[i]);
+      d[i] = in ? 0 : EDT_INFINITY;
+      nearest[i] = in ? seg[i] : -1;
+    }
+    edtVolume(&d[0], &nearest[0], width, height, depth);
+
+    MRI *mri_nearest = *pmri_nearest;
+    if (mri_nearest == NULL) {
+      mri_nearest = MRIalloc(width, height, depth, MRI_INT);
+      MRIcopyHeader(mri_src, mri_nearest);
+    }
+    for (int z = 0; z < depth; z++)
+      for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+          MRIsetVoxVal(mri_nearest, x, y, z, 0, nearest[(size_t)x + (size_t)width * (y + (size_t)height * z)]);
+    *pmri_nearest = mri_nearest;
+  }
+
+  return (mri_dst);
+}
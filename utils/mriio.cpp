@@ -26,6 +26,7 @@
 
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 #include <vector>
 
 #include <ctype.h>
@@ -148,6 +149,8 @@ static MRI *ximgRead(const char *fname, int read_volume);
 static MRI *nifti1Read(const char *fname, int read_volume);
 static int nifti1Write(MRI *mri, const char *fname);
 static MRI *niiRead(const char *fname, int read_volume);
+static MRI *niiReadFrames(const char *fname, int frame0, int nframes, int vox0, int nvox);
+static MRI *overlayFramesCrop(const char *fname, int frame0, int nframes, int vno0, int nvertices);
 static MRI *niiReadFromMriFsStruct(MRIFSSTRUCT *mrifsStruct);
 static int niiWrite(MRI *mri, const char *fname);
 static int itkMorphWrite(MRI *mri, const char *fname);
@@ -794,8 +797,17 @@ MRI *mri_read(const char *fname, int type, int volume_flag, int start_frame, int
   }
   else if (type == MRI_CURV_FILE)
     mri = MRISreadCurvAsMRI(fname_copy, volume_flag);
-  else if (type == GIFTI_FILE)
-    mri = MRISreadGiftiAsMRI(fname_copy, volume_flag);
+  else if (type == GIFTI_FILE) {
+    if (volume_flag && start_frame >= 0) {
+      // only decode the data arrays of the requested frames, and check
+      // those here since the frame selection below is skipped
+      mri = MRISreadGiftiFrames(fname_copy, start_frame, end_frame - start_frame + 1);
+      start_frame = -1;
+      if (mri && nan_inf_check(mri) != NO_ERROR) MRIfree(&mri);
+    }
+    else
+      mri = MRISreadGiftiAsMRI(fname_copy, volume_flag);
+  }
   else if (type == IMAGE_FILE) {
     I = ImageRead(fname_copy);
     mri = ImageToMRI(I);
@@ -1069,6 +1081,65 @@ MRI *MRIreadInfo(const char *fname)
 
 } /* end MRIreadInfo() */
 
+/*---------------------------------------------------------------
+  MRIreadOverlayFrames() - reads a sub-block of a surface overlay:
+  frames [frame0,frame0+nframes) of vertices [vno0,vno0+nvertices),
+  where a negative count means "up to the end". Vertices are
+  counted in column-major voxel order, so reshaped overlays (eg,
+  ico7) are handled. GIFTI and nifti (.nii, .nii.gz) files are read
+  without materializing the rest of the data; other formats are
+  read completely and cropped. Returns an MRI_FLOAT of size
+  nvertices x 1 x 1 x nframes.
+  ---------------------------------------------------------------*/
+MRI *MRIreadOverlayFrames(const char *fname, int frame0, int nframes, int vno0, int nvertices)
+{
+  MRI *mri;
+  int type = mri_identify(fname);
+  if (type == GIFTI_FILE)
+    mri = MRISreadGiftiFrames(fname, frame0, nframes, vno0, nvertices);
+  else if (type == NII_FILE)
+    mri = niiReadFrames(fname, frame0, nframes, vno0, nvertices);
+  else
+    mri = overlayFramesCrop(fname, frame0, nframes, vno0, nvertices);
+
+  // the same check mri_read() does on selected frames, on every path
+  if (mri && nan_inf_check(mri) != NO_ERROR) MRIfree(&mri);
+  return (mri);
+} /* end MRIreadOverlayFrames() */
+
+/*---------------------------------------------------------------
+  overlayFramesCrop() - MRIreadOverlayFrames() for the formats
+  without a range reader: reads the whole file and crops it.
+  ---------------------------------------------------------------*/
+static MRI *overlayFramesCrop(const char *fname, int frame0, int nframes, int vno0, int nvertices)
+{
+  MRI *full = MRIread(fname);
+  if (full == NULL) return (NULL);
+  int nvox = full->width * full->height * full->depth;
+  if (nframes < 0) nframes = full->nframes - frame0;
+  if (nvertices < 0) nvertices = nvox - vno0;
+  if (frame0 < 0 || nframes <= 0 || frame0 + nframes > full->nframes || vno0 < 0 || nvertices <= 0 ||
+      vno0 + nvertices > nvox) {
+    MRIfree(&full);
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIreadOverlayFrames(): frame/vertex range out of bounds for %s", fname));
+  }
+
+  MRI *mri = MRIallocSequence(nvertices, 1, 1, MRI_FLOAT, nframes);
+  mri->tr = full->tr;
+  for (int f = 0; f < nframes; f++) {
+    for (int v = 0; v < nvertices; v++) {
+      int n = vno0 + v;
+      int c = n % full->width;
+      int r = (n / full->width) % full->height;
+      int s = n / (full->width * full->height);
+      MRIFseq_vox(mri, v, 0, 0, f) = MRIgetVoxVal(full, c, r, s, frame0 + f);
+    }
+  }
+  MRIfree(&full);
+
+  return (mri);
+} /* end overlayFramesCrop() */
+
 /*---------------------------------------------------------------
   MRIreadHeader() - reads the MRI header of the given file name.
   If type is MRI_VOLUME_TYPE_UNKNOWN, then the type will be
@@ -8938,6 +9009,139 @@ static MRI *niiRead(const char *fname, int read_volume)
 
 } /* end niiRead() */
 
+/*------------------------------------------------------------------
+  niiReadFrames() - reads frames [frame0,frame0+nframes) of voxels
+  [vox0,vox0+nvox) (in column-major voxel order) from a .nii or
+  .nii.gz surface overlay, without reading the rest of the file.
+  Frames are contiguous on disk, so each frame is one forward seek
+  (which also works on compressed files) plus one read. Returns an
+  MRI_FLOAT of size nvox x 1 x 1 x nframes.
+  -----------------------------------------------------------------*/
+static MRI *niiReadFrames(const char *fname, int frame0, int nframes, int vox0, int nvox)
+{
+  struct nifti_1_header hdr;
+  int use_compression = (fname[strlen(fname) - 1] == 'z');
+
+  znzFile fp = znzopen(fname, "r", use_compression);
+  if (fp == NULL) {
+    errno = 0;
+    ErrorReturn(NULL, (ERROR_BADFILE, "niiReadFrames(): error opening file %s", fname));
+  }
+  if (znzread(&hdr, sizeof(hdr), 1, fp) != 1) {
+    znzclose(fp);
+    errno = 0;
+    ErrorReturn(NULL, (ERROR_BADFILE, "niiReadFrames(): error reading header from %s", fname));
+  }
+  int swapped_flag = FALSE;
+  if (hdr.dim[0] < 1 || hdr.dim[0] > 7) {
+    swapped_flag = TRUE;
+    swap_nifti_1_header(&hdr);
+  }
+  if (hdr.dim[0] < 1 || hdr.dim[0] > 5 || memcmp(hdr.magic, NII_MAGIC, 4) != 0) {
+    znzclose(fp);
+    ErrorReturn(NULL, (ERROR_BADFILE, "niiReadFrames(): %s is not a supported nifti file", fname));
+  }
+
+  int bytes_per_voxel = 0;
+  switch (hdr.datatype) {
+    case DT_UNSIGNED_CHAR:
+    case DT_INT8:
+      bytes_per_voxel = 1;
+      break;
+    case DT_SIGNED_SHORT:
+    case DT_UINT16:
+      bytes_per_voxel = 2;
+      break;
+    case DT_SIGNED_INT:
+    case DT_UINT32:
+    case DT_FLOAT:
+      bytes_per_voxel = 4;
+      break;
+    case DT_DOUBLE:
+      bytes_per_voxel = 8;
+      break;
+    default:
+      znzclose(fp);
+      ErrorReturn(NULL, (ERROR_UNSUPPORTED, "niiReadFrames(): unsupported datatype %d in %s", hdr.datatype, fname));
+  }
+  bool scaledata = (hdr.scl_slope != 0) && !((hdr.scl_slope == 1) && (hdr.scl_inter == 0));
+
+  // see niiRead() for dim[1] < 0
+  long ncols = (hdr.dim[1] > 0) ? hdr.dim[1] : hdr.glmin;
+  long nvoxels = ncols * hdr.dim[2] * hdr.dim[3];
+  int nframes_total = (hdr.dim[0] < 4 || hdr.dim[4] == 0) ? 1 : hdr.dim[4];
+  if (hdr.dim[0] > 4 && hdr.dim[5] > 0) nframes_total *= hdr.dim[5];
+
+  if (nframes < 0) nframes = nframes_total - frame0;
+  if (nvox < 0) nvox = nvoxels - vox0;
+  if (frame0 < 0 || nframes <= 0 || frame0 + nframes > nframes_total || vox0 < 0 || nvox <= 0 ||
+      vox0 + nvox > nvoxels) {
+    znzclose(fp);
+    ErrorReturn(NULL,
+                (ERROR_BADPARM,
+                 "niiReadFrames(): frames %d-%d, voxels %d-%d out of range (%d frames, %ld voxels) in %s",
+                 frame0,
+                 frame0 + nframes - 1,
+                 vox0,
+                 vox0 + nvox - 1,
+                 nframes_total,
+                 nvoxels,
+                 fname));
+  }
+
+  MRI *mri = MRIallocSequence(nvox, 1, 1, MRI_FLOAT, nframes);
+  if (mri == NULL) {
+    znzclose(fp);
+    return (NULL);
+  }
+  switch (XYZT_TO_TIME(hdr.xyzt_units)) {
+    case NIFTI_UNITS_SEC:
+      mri->tr = hdr.pixdim[4] * 1000.0;
+      break;
+    case NIFTI_UNITS_MSEC:
+      mri->tr = hdr.pixdim[4];
+      break;
+    case NIFTI_UNITS_USEC:
+      mri->tr = hdr.pixdim[4] * 0.001;
+      break;
+  }
+
+  std::vector<unsigned char> buf((size_t)nvox * bytes_per_voxel);
+  for (int t = 0; t < nframes; t++) {
+    // offsets increase monotonically, so znzseek only ever goes forward
+    long offset = (long)hdr.vox_offset + ((long)(frame0 + t) * nvoxels + vox0) * bytes_per_voxel;
+    if (znzseek(fp, offset, SEEK_SET) == -1 || znzread(buf.data(), bytes_per_voxel, nvox, fp) != (size_t)nvox) {
+      znzclose(fp);
+      MRIfree(&mri);
+      errno = 0;
+      ErrorReturn(NULL, (ERROR_BADFILE, "niiReadFrames(): error reading frame %d from %s", frame0 + t, fname));
+    }
+    if (swapped_flag && bytes_per_voxel > 1) {
+      for (size_t n = 0; n < buf.size(); n += bytes_per_voxel)
+        std::reverse(buf.begin() + n, buf.begin() + n + bytes_per_voxel);
+    }
+
+    float *dst = &MRIFseq_vox(mri, 0, 0, 0, t);
+    const void *src = buf.data();
+    for (int v = 0; v < nvox; v++) {
+      switch (hdr.datatype) {
+        case DT_UNSIGNED_CHAR: dst[v] = ((const unsigned char *)src)[v]; break;
+        case DT_INT8:          dst[v] = ((const signed char *)src)[v]; break;
+        case DT_SIGNED_SHORT:  dst[v] = ((const short *)src)[v]; break;
+        case DT_UINT16:        dst[v] = ((const unsigned short *)src)[v]; break;
+        case DT_SIGNED_INT:    dst[v] = ((const int *)src)[v]; break;
+        case DT_UINT32:        dst[v] = ((const unsigned int *)src)[v]; break;
+        case DT_FLOAT:         dst[v] = ((const float *)src)[v]; break;
+        case DT_DOUBLE:        dst[v] = ((const double *)src)[v]; break;
+      }
+      if (scaledata) dst[v] = hdr.scl_slope * dst[v] + hdr.scl_inter;
+    }
+  }
+  znzclose(fp);
+
+  return (mri);
+} /* end niiReadFrames() */
+
 
 
 /*------------------------------------------------------------------
@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <vector>
 
 #include "box.h"
 #include "ctrpoints.h"
@@ -42,6 +44,7 @@
 #include "numerics.h"
 #include "proto.h"
 #include "region.h"
+#include "romp_support.h"
 #include "talairachex.h"
 
 /*-----------------------------------------------------
@@ -2109,6 +2112,402 @@ MRI *MRIbuildVoronoiDiagram(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst)
   ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIbuildVoronoiDiagram: src type %d unsupported", mri_src->type));
 }
 
+/*-----------------------------------------------------
+  Multigrid soap bubble
+
+  The fixed point of the Jacobi iteration in mriSoapBubbleFloat is
+  the solution of a discrete Laplace equation: every unmarked voxel
+  equals the mean of its 3x3x3 neighborhood (indices clamped at the
+  edges), with the control points as Dirichlet constraints. Jacobi
+  needs O(n^2) sweeps to carry information across n voxels, so on
+  large or high resolution volumes a fixed niter is either too few to
+  converge or wastes time. MRIsoapBubbleMultigrid solves the same
+  equations with multigrid preconditioned conjugate gradients until
+  the largest residual falls below tol times the range of the control
+  point values.
+
+  Smoothing is Gauss-Seidel done in z-slabs: all even slices in
+  parallel, then all odd slices, which is safe because the stencil
+  only reaches one slice away. Coarser levels halve each dimension,
+  a coarse voxel is constrained if any of its children is, residuals
+  are averaged down and corrections are interpolated back up
+  trilinearly.
+  ------------------------------------------------------*/
+static int   soap_bubble_solver = SOAP_BUBBLE_JACOBI;
+static float soap_bubble_tol    = 1e-4;
+static int   soap_bubble_env_checked = 0;
+
+int MRIsetSoapBubbleSolver(int solver, float tol)
+{
+  int old = soap_bubble_solver;
+  soap_bubble_solver = solver;
+  soap_bubble_env_checked = 1;  // an explicit choice overrides the environment
+  if (tol > 0) soap_bubble_tol = tol;
+  return (old);
+}
+
+static int soapBubbleSolver(void)
+{
+  if (!soap_bubble_env_checked) {
+    char *cp = getenv("FS_SOAP_BUBBLE_TOL");
+    if (cp && atof(cp) > 0) soap_bubble_tol = atof(cp);
+    if (getenv("FS_SOAP_BUBBLE_MULTIGRID")) {
+      soap_bubble_solver = SOAP_BUBBLE_MULTIGRID;
+      printf("using multigrid soap bubble, tol = %g\n", soap_bubble_tol);
+    }
+    soap_bubble_env_checked = 1;
+  }
+  return (soap_bubble_solver);
+}
+
+typedef struct
+{
+  int nx, ny, nz;
+  std::vector<float> u, b, r;
+  std::vector<char> fixed;
+} SOAP_LEVEL;
+
+#define SOAP_INDEX(l, x, y, z) ((size_t)(x) + (size_t)(l)->nx * ((size_t)(y) + (size_t)(l)->ny * (size_t)(z)))
+
+// sum of the 3x3x3 neighborhood excluding the entries that clamp back onto (x,y,z), and their count
+static inline float soapNeighborSum(const SOAP_LEVEL *l, const float *u, int x, int y, int z, int *pnself)
+{
+  float sum = 0;
+  int nself = 0, xk, yk, zk;
+  if (x > 0 && y > 0 && z > 0 && x < l->nx - 1 && y < l->ny - 1 && z < l->nz - 1) {
+    size_t const sy = l->nx, sz = (size_t)l->nx * l->ny;
+    const float *p = u + SOAP_INDEX(l, x, y, z);
+    for (zk = -1; zk <= 1; zk++)
+      for (yk = -1; yk <= 1; yk++) {
+        const float *row = p + zk * (long)sz + yk * (long)sy;
+        sum += row[-1] + row[0] + row[1];
+      }
+    *pnself = 1;
+    return (sum - *p);
+  }
+  for (zk = -1; zk <= 1; zk++) {
+    int zi = MIN(MAX(z + zk, 0), l->nz - 1);
+    for (yk = -1; yk <= 1; yk++) {
+      int yi = MIN(MAX(y + yk, 0), l->ny - 1);
+      for (xk = -1; xk <= 1; xk++) {
+        int xi = MIN(MAX(x + xk, 0), l->nx - 1);
+        if (xi == x && yi == y && zi == z)
+          nself++;
+        else
+          sum += u[SOAP_INDEX(l, xi, yi, zi)];
+      }
+    }
+  }
+  *pnself = nself;
+  return (sum);
+}
+
+static void soapSmooth(SOAP_LEVEL *l, int nsweeps)
+{
+  int sweep, color;
+  for (sweep = 0; sweep < nsweeps; sweep++) {
+    for (color = 0; color < 2; color++) {
+      int z;
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+      for (z = color; z < l->nz; z += 2) {
+        ROMP_PFLB_begin
+        int x, y, nself;
+        for (y = 0; y < l->ny; y++) {
+          for (x = 0; x < l->nx; x++) {
+            size_t const i = SOAP_INDEX(l, x, y, z);
+            if (l->fixed[i]) continue;
+            float const sum = soapNeighborSum(l, &l->u[0], x, y, z, &nself);
+            if (nself < 27) l->u[i] = (sum + 27.0f * l->b[i]) / (27 - nself);
+          }
+        }
+        ROMP_PFLB_end
+      }
+      ROMP_PF_end
+    }
+  }
+}
+
+// r = b - A u, where A u = u - mean3x3x3(u), and 0 at constrained voxels. Returns max |r|
+static float soapResidual(const SOAP_LEVEL *l, const float *u, const float *b, float *r)
+{
+  float max_r = 0;
+  int z;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) reduction(max:max_r)
+#endif
+  for (z = 0; z < l->nz; z++) {
+    ROMP_PFLB_begin
+    int x, y, nself;
+    for (y = 0; y < l->ny; y++) {
+      for (x = 0; x < l->nx; x++) {
+        size_t const i = SOAP_INDEX(l, x, y, z);
+        if (l->fixed[i]) {
+          r[i] = 0;
+          continue;
+        }
+        float const sum = soapNeighborSum(l, u, x, y, z, &nself);
+        r[i] = (b ? b[i] : 0) - ((27 - nself) * u[i] - sum) / 27.0f;
+        if (fabs(r[i]) > max_r) max_r = fabs(r[i]);
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+  return (max_r);
+}
+
+static void soapRestrict(const SOAP_LEVEL *fine, SOAP_LEVEL *coarse)
+{
+  int z;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (z = 0; z < coarse->nz; z++) {
+    ROMP_PFLB_begin
+    int x, y, xk, yk, zk;
+    for (y = 0; y < coarse->ny; y++) {
+      for (x = 0; x < coarse->nx; x++) {
+        size_t const ic = SOAP_INDEX(coarse, x, y, z);
+        float sum = 0;
+        int num = 0;
+        char fixed = 0;
+        for (zk = 2 * z; zk <= MIN(2 * z + 1, fine->nz - 1); zk++)
+          for (yk = 2 * y; yk <= MIN(2 * y + 1, fine->ny - 1); yk++)
+            for (xk = 2 * x; xk <= MIN(2 * x + 1, fine->nx - 1); xk++) {
+              size_t const i = SOAP_INDEX(fine, xk, yk, zk);
+              fixed |= fine->fixed[i];
+              sum += fine->r[i];
+              num++;
+            }
+        // the operator at twice the spacing sees a 4x smaller right hand side
+        coarse->fixed[ic] = fixed;
+        coarse->b[ic] = fixed ? 0 : 4.0f * sum / num;
+        coarse->u[ic] = 0;
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+// cell centered trilinear interpolation of the coarse correction, added to the unconstrained fine voxels
+static void soapProlongAdd(const SOAP_LEVEL *coarse, SOAP_LEVEL *fine)
+{
+  int z;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (z = 0; z < fine->nz; z++) {
+    ROMP_PFLB_begin
+    int x, y, cx[2], cy[2], cz[2], i, j, k;
+    float wx[2], wy[2], wz[2];
+    cz[0] = z / 2;
+    cz[1] = MIN(MAX(cz[0] + ((z & 1) ? 1 : -1), 0), coarse->nz - 1);
+    wz[0] = 0.75f;
+    wz[1] = 0.25f;
+    for (y = 0; y < fine->ny; y++) {
+      cy[0] = y / 2;
+      cy[1] = MIN(MAX(cy[0] + ((y & 1) ? 1 : -1), 0), coarse->ny - 1);
+      wy[0] = 0.75f;
+      wy[1] = 0.25f;
+      for (x = 0; x < fine->nx; x++) {
+        size_t const ifine = SOAP_INDEX(fine, x, y, z);
+        if (fine->fixed[ifine]) continue;
+        cx[0] = x / 2;
+        cx[1] = MIN(MAX(cx[0] + ((x & 1) ? 1 : -1), 0), coarse->nx - 1);
+        wx[0] = 0.75f;
+        wx[1] = 0.25f;
+        float e = 0;
+        for (k = 0; k < 2; k++)
+          for (j = 0; j < 2; j++)
+            for (i = 0; i < 2; i++) e += wx[i] * wy[j] * wz[k] * coarse->u[SOAP_INDEX(coarse, cx[i], cy[j], cz[k])];
+        fine->u[ifine] += e;
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+static void soapVcycle(std::vector<SOAP_LEVEL> &levels, int level)
+{
+  SOAP_LEVEL *l = &levels[level];
+  if (level == (int)levels.size() - 1) {
+    soapSmooth(l, 50);
+    return;
+  }
+  soapSmooth(l, 2);
+  soapResidual(l, &l->u[0], &l->b[0], &l->r[0]);
+  soapRestrict(l, &levels[level + 1]);
+  soapVcycle(levels, level + 1);
+  soapProlongAdd(&levels[level + 1], l);
+  soapSmooth(l, 2);
+}
+
+// dot product over the unconstrained voxels, summed per slice so the result doesn't depend on the thread count
+static double soapDot(const SOAP_LEVEL *l, const float *a, const float *b)
+{
+  std::vector<double> slice_sum(l->nz);
+  int z;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (z = 0; z < l->nz; z++) {
+    ROMP_PFLB_begin
+    size_t const i0 = SOAP_INDEX(l, 0, 0, z), i1 = i0 + (size_t)l->nx * l->ny;
+    double sum = 0;
+    for (size_t i = i0; i < i1; i++) sum += (double)a[i] * b[i];
+    slice_sum[z] = sum;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+  double sum = 0;
+  for (z = 0; z < l->nz; z++) sum += slice_sum[z];
+  return (sum);
+}
+
+// z = V-cycle approximation of A^-1 r, returned in levels[0].u
+static void soapPrecondition(std::vector<SOAP_LEVEL> &levels, const std::vector<float> &r)
+{
+  SOAP_LEVEL *l = &levels[0];
+  std::copy(r.begin(), r.end(), l->b.begin());
+  std::fill(l->u.begin(), l->u.end(), 0.0f);
+  soapVcycle(levels, 0);
+}
+
+/*
+  Solve for u (values at constrained voxels are left alone) with
+  conjugate gradients preconditioned by one V-cycle. Isolated control
+  points make the coarse grid problems a poor match for the fine one,
+  so plain V-cycles stall; using them as a preconditioner keeps the
+  convergence rate independent of the control point layout. The
+  Polak-Ribiere form of beta tolerates the V-cycle not being exactly
+  symmetric.
+*/
+static int soapSolve(std::vector<SOAP_LEVEL> &levels, std::vector<float> &u, float max_residual, int max_iter, float *pres)
+{
+  SOAP_LEVEL *l = &levels[0];
+  size_t const nvox = u.size();
+  std::vector<float> r(nvox), r_old(nvox), p(nvox), q(nvox), &zv = l->u;
+  int iter;
+  // with no right hand side the residual is -A u
+  float res = soapResidual(l, &u[0], NULL, &r[0]);
+
+  soapPrecondition(levels, r);
+  p = zv;
+  double rz = soapDot(l, &r[0], &zv[0]);
+  for (iter = 0; iter < max_iter && res > max_residual; iter++) {
+    soapResidual(l, &p[0], NULL, &q[0]);  // q = -A p
+    double const pq = -soapDot(l, &p[0], &q[0]);
+    if (pq <= 0) break;
+    float const alpha = rz / pq;
+    r_old = r;
+    res = 0;
+    for (size_t i = 0; i < nvox; i++) {
+      u[i] += alpha * p[i];
+      r[i] += alpha * q[i];
+      res = MAX(res, (float)fabs(r[i]));
+    }
+    if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) printf("soap bubble iteration %d: max residual %g\n", iter + 1, res);
+    if (res <= max_residual) {
+      iter++;
+      break;
+    }
+    soapPrecondition(levels, r);
+    for (size_t i = 0; i < nvox; i++) r_old[i] = r[i] - r_old[i];
+    double const beta = soapDot(l, &zv[0], &r_old[0]) / rz;
+    rz = soapDot(l, &r[0], &zv[0]);
+    for (size_t i = 0; i < nvox; i++) p[i] = zv[i] + beta * p[i];
+  }
+  *pres = res;
+  return (iter);
+}
+
+MRI *MRIsoapBubbleMultigrid(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst, float tol)
+{
+  int const max_iter = 100;
+  int x, y, z, f, iter;
+  float res;
+
+  if (!mri_dst) mri_dst = MRIcopy(mri_src, NULL);
+  if (tol <= 0) tol = soap_bubble_tol;
+
+  // build the hierarchy, halving until the volume is only a few voxels across
+  std::vector<SOAP_LEVEL> levels(1);
+  levels[0].nx = mri_dst->width;
+  levels[0].ny = mri_dst->height;
+  levels[0].nz = mri_dst->depth;
+  while (MAX(levels.back().nx, MAX(levels.back().ny, levels.back().nz)) > 4) {
+    SOAP_LEVEL coarse;
+    coarse.nx = (levels.back().nx + 1) / 2;
+    coarse.ny = (levels.back().ny + 1) / 2;
+    coarse.nz = (levels.back().nz + 1) / 2;
+    levels.push_back(coarse);
+  }
+  for (size_t n = 0; n < levels.size(); n++) {
+    size_t const nvox = (size_t)levels[n].nx * levels[n].ny * levels[n].nz;
+    levels[n].u.resize(nvox);
+    levels[n].b.resize(nvox);
+    levels[n].r.resize(nvox);
+    levels[n].fixed.resize(nvox);
+  }
+
+  SOAP_LEVEL *fine = &levels[0];
+  int nfixed = 0;
+  for (z = 0; z < fine->nz; z++)
+    for (y = 0; y < fine->ny; y++)
+      for (x = 0; x < fine->nx; x++) {
+        char const fixed = (nint(MRIgetVoxVal(mri_ctrl, x, y, z, 0)) == CONTROL_MARKED);
+        fine->fixed[SOAP_INDEX(fine, x, y, z)] = fixed;
+        nfixed += fixed;
+      }
+  if (nfixed == 0) {
+    printf("WARNING: MRIsoapBubbleMultigrid: no control points, leaving volume unchanged\n");
+    return (mri_dst);
+  }
+
+  std::vector<float> u(fine->u.size());
+  for (f = 0; f < mri_dst->nframes; f++) {
+    float min_val = 0, max_val = 0;
+    int first = 1;
+    for (z = 0; z < fine->nz; z++)
+      for (y = 0; y < fine->ny; y++)
+        for (x = 0; x < fine->nx; x++) {
+          size_t const i = SOAP_INDEX(fine, x, y, z);
+          float const val = MRIgetVoxVal(mri_dst, x, y, z, f);
+          u[i] = val;
+          if (!fine->fixed[i]) continue;
+          if (first || val < min_val) min_val = val;
+          if (first || val > max_val) max_val = val;
+          first = 0;
+        }
+
+    iter = soapSolve(levels, u, tol * MAX(max_val - min_val, 1e-6), max_iter, &res);
+    if (Gdiag & DIAG_SHOW)
+      printf("multigrid soap bubble frame %d: %d iterations, max residual %g (%d levels)\n",
+             f, iter, res, (int)levels.size());
+
+    for (z = 0; z < fine->nz; z++)
+      for (y = 0; y < fine->ny; y++)
+        for (x = 0; x < fine->nx; x++) {
+          size_t const i = SOAP_INDEX(fine, x, y, z);
+          if (!fine->fixed[i]) MRIsetVoxVal(mri_dst, x, y, z, f, u[i]);
+        }
+  }
+
+  if (Gdiag & DIAG_WRITE && DIAG_VERBOSE_ON) {
+    MRIwrite(mri_dst, "soap.mgh");
+  }
+  return (mri_dst);
+}
+
 /*-----------------------------------------------------
   Parameters:
 
@@ -2124,6 +2523,9 @@ MRI *MRIsoapBubble(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst, int niter, float m
 
   if (niter == 0)
     return(MRIcopy(mri_src, mri_dst)) ;
+  if (soapBubbleSolver() == SOAP_BUBBLE_MULTIGRID) {
+    return (MRIsoapBubbleMultigrid(mri_src, mri_ctrl, mri_dst, soap_bubble_tol));
+  }
   if (mri_src->type == MRI_FLOAT) {
     return (mriSoapBubbleFloat(mri_src, mri_ctrl, mri_dst, niter, min_change));
   }
@@ -343,6 +343,26 @@ void mrisSetDist(MRIS* mris, int vno, float* dist, int newCapacity) {
   const int * pcCap = &v->dist_capacity; *(int*)pcCap = newCapacity;
 }
 
+bool mrisReattachDist(MRIS* mris, int vno, float const * expected, int capacity) {
+  // MRISfreeDistsButNotOrig only forgets v->dist, the values stay in dist_storage until something reallocs them.
+  // A caller that knows those values are still the right ones can put them back rather than recompute them.
+  //
+  VERTEX const * const v = &mris->vertices[vno];
+
+  if (v->dist) return (v->dist == expected) && (v->dist_capacity >= capacity);
+  if (!expected || mris->dist_storage[vno] != (void*)expected) return false;
+
+  bool const doOrig = false;
+  char const flag = (char)(1)<<doOrig;
+  mris->dist_alloced_flags |= flag;
+
+  float * const * pc = &v->dist;
+  *(float**)pc = (float*)mris->dist_storage[vno];
+
+  const int * pcCap = &v->dist_capacity; *(int*)pcCap = capacity;
+  return true;
+}
+
 static void growDistOrDistOrig(bool doOrig, MRIS *mris, int vno, int minimumCapacity)
 {
   VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
@@ -743,6 +763,8 @@ void MRISdtr(MRIS *mris) {
 
   freeAndNULL(mris->dist_storage);
   freeAndNULL(mris->dist_orig_storage);
+
+  MRISsetIncrementalMetricProperties(mris, false);
 }
 
 
@@ -4802,11 +4802,13 @@ int MRISrigidBodyAlignGlobal(
   static bool 
     once,
     use_old,
-    use_new;
+    use_new,
+    use_spharm;
 
   if (!once) { once = true;
     use_old = !!getenv("FREESURFER_MRISrigidBodyAlignGlobal_useOld");
     use_new = !!getenv("FREESURFER_MRISrigidBodyAlignGlobal_useNew") || !use_old ;
+    use_spharm = !!getenv("FREESURFER_MRISrigidBodyAlignGlobal_useSpharm");
   }
 
   double new_mina = 666.0, new_minb = 666.0, new_ming = 666.0, new_sse = 666.0;
@@ -4822,14 +4824,28 @@ int MRISrigidBodyAlignGlobal(
     //
     double ext_sse = 0.0;  
     //double ext_sse = (gMRISexternalSSE) ? (*gMRISexternalSSE)(mris, parms) : 0.0;
-    MRISrigidBodyAlignGlobal_findMinSSE(
-        &new_mina, &new_minb, &new_ming, &new_sse,
-        mris,
-        parms,
-        min_radians,
-        max_radians,
-        ext_sse,
-        nangles); 
+    if (use_spharm) {
+      // spherical harmonic correlation peaks, each refined by a local search at the finest scale
+      MRISrigidBodyAlignGlobal_findMinSSE_spharm(
+          &new_mina, &new_minb, &new_ming, &new_sse,
+          mris,
+          parms,
+          min_radians,
+          max_radians,
+          ext_sse,
+          nangles,
+          31,     // lmax
+          4);     // npeaks
+    } else {
+      MRISrigidBodyAlignGlobal_findMinSSE(
+          &new_mina, &new_minb, &new_ming, &new_sse,
+          mris,
+          parms,
+          min_radians,
+          max_radians,
+          ext_sse,
+          nangles); 
+    }
 
     parms->start_t += 1.0f;
     parms->t       += 1.0f;
@@ -1843,6 +1843,10 @@ int MRIScomputeMetricProperties(MRIS *mris)
     return NO_ERROR;
   }
 
+  // only recompute what depends on the vertices that moved since the last call
+  if (!mris->incrementalMP && !!getenv("FS_INCREMENTAL_MP")) MRISsetIncrementalMetricProperties(mris, true);
+  if (mris->incrementalMP && mrisComputeMetricPropertiesIncrementally(mris)) return NO_ERROR;
+
   static int debug_count = 0;
   count_MRIScomputeMetricProperties_calls++;
   if (count_MRIScomputeMetricProperties_calls == debug_count) {
@@ -1870,6 +1874,9 @@ int MRIScomputeMetricProperties(MRIS *mris)
 
   MRISMP_dtr(&mp);
 
+  if (useOldBehaviour) mrisInvalidateIncrementalMetricProperties(mris);
+  else                 mrisNoteFullMetricProperties(mris);
+
   return NO_ERROR;
 }
 
@@ -9464,6 +9471,196 @@ static void MRISaverageGradients_write(
   fprintf(stdout, "%s:%d finished writing %s\n",__FILE__, __LINE__, filename);
 }
 
+// Fusing the averaging passes
+//  Each pass reads all the data and writes all the data, and there are up to 1024 of them, each with its own fork and join.
+//  Instead the indices are partitioned into compact blocks grown breadth first, and each block is given the halo of indices
+//  within FUSED_PASSES neighbor steps of it.  A block copies its values and its halo's into small SoA buffers, does up to
+//  FUSED_PASSES passes there, each over one layer of halo fewer than the last, and writes back only its own values.
+//  The halo work is redundant, but the buffers stay in cache and the threads only meet once per FUSED_PASSES passes.
+//  The sums are done in the same order as the unfused passes, so the results are identical.
+//
+#define MRISaverageGradients_FUSED_BLOCK_SIZE  4096     // owned indices per block
+#define MRISaverageGradients_FUSED_PASSES      8        // passes per exchange, and depth of the halo
+#define MRISaverageGradients_FUSED_MIN_AVGS    32       // fewer are not worth building the halos
+
+typedef struct MRISaverageGradients_FusedBlock {
+  int              nOwned;
+  std::vector<int> global;      // local -> index, the owned ones first, then the halo in order of distance
+  std::vector<int> layerEnd;    // layerEnd[d] is the number of local indices within distance d of the block
+  std::vector<int> firstNeighbor, neighbors;  // local neighbors of the local indices within distance FUSED_PASSES-1
+  std::vector<float> inv_num;
+} MRISaverageGradients_FusedBlock;
+
+static void MRISaverageGradients_fused(
+  int                                   num_avgs,
+  int                                   size,
+  const MRISaverageGradients_Control*   controls,
+  const int*                            neighbors,
+  MRISaverageGradients_Data*            datas)
+{
+  int const depth = MRISaverageGradients_FUSED_PASSES;
+  typedef MRISaverageGradients_Control Control;
+  typedef MRISaverageGradients_FusedBlock Block;
+
+  // Grow the blocks breadth first, so they are compact patches whatever the order of the indices
+  //
+  std::vector<int> blockOf(size, -1), order;
+  std::vector<int> blockBegin;
+  order.reserve(size);
+  for (int seed = 0; seed < size; seed++) {
+    if (blockOf[seed] >= 0) continue;
+    int const block = blockBegin.size();
+    blockBegin.push_back(order.size());
+    blockOf[seed] = block;
+    order.push_back(seed);
+    size_t head = blockBegin.back();
+    while (head < order.size() && (int)(order.size() - blockBegin.back()) < MRISaverageGradients_FUSED_BLOCK_SIZE) {
+      Control const * const c = &controls[order[head++]];
+      for (int n = 0; n < c->numNeighbors; n++) {
+        int const index = neighbors[c->firstNeighbor + n];
+        if (blockOf[index] >= 0) continue;
+        blockOf[index] = block;
+        order.push_back(index);
+        if ((int)(order.size() - blockBegin.back()) == MRISaverageGradients_FUSED_BLOCK_SIZE) break;
+      }
+    }
+  }
+  int const nblocks = blockBegin.size();
+  blockBegin.push_back(size);
+
+  // Add the halos and make the local neighbor lists.  Each thread keeps one index -> local map, and
+  // resets only the entries its last block set, so the blocks cost in proportion to their halos
+  //
+  std::vector<Block> blocks(nblocks);
+  int nthreads = 1;
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  std::vector< std::vector<int> > localOfs(nthreads);
+  int bi;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic,1)
+#endif
+  for (bi = 0; bi < nblocks; bi++) {
+    ROMP_PFLB_begin
+    Block & b = blocks[bi];
+#ifdef HAVE_OPENMP
+    std::vector<int> & localOf = localOfs[omp_get_thread_num()];
+#else
+    std::vector<int> & localOf = localOfs[0];
+#endif
+    if (localOf.empty()) localOf.assign(size, -1);
+
+    b.nOwned = blockBegin[bi+1] - blockBegin[bi];
+    b.global.assign(order.begin() + blockBegin[bi], order.begin() + blockBegin[bi+1]);
+    for (int l = 0; l < b.nOwned; l++) localOf[b.global[l]] = l;
+    b.layerEnd.push_back(b.nOwned);
+
+    for (int d = 1; d <= depth; d++) {
+      int const lo = (d == 1) ? 0 : b.layerEnd[d-2], hi = b.layerEnd[d-1];
+      for (int l = lo; l < hi; l++) {
+        Control const * const c = &controls[b.global[l]];
+        for (int n = 0; n < c->numNeighbors; n++) {
+          int const index = neighbors[c->firstNeighbor + n];
+          if (localOf[index] >= 0) continue;
+          localOf[index] = b.global.size();
+          b.global.push_back(index);
+        }
+      }
+      b.layerEnd.push_back(b.global.size());
+    }
+
+    int const nComputed = b.layerEnd[depth-1];
+    b.firstNeighbor.resize(nComputed + 1);
+    b.inv_num.resize(nComputed);
+    for (int l = 0; l < nComputed; l++) {
+      Control const * const c = &controls[b.global[l]];
+      b.firstNeighbor[l] = b.neighbors.size();
+      for (int n = 0; n < c->numNeighbors; n++) b.neighbors.push_back(localOf[neighbors[c->firstNeighbor + n]]);
+      b.inv_num[l] = 1.0f/(c->numNeighbors + 1);
+    }
+    b.firstNeighbor[nComputed] = b.neighbors.size();
+
+    for (size_t l = 0; l < b.global.size(); l++) localOf[b.global[l]] = -1;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // SoA copies of the data, exchanged between the blocks once per FUSED_PASSES passes
+  //
+  std::vector<float> inp(3*(size_t)size), out(3*(size_t)size);
+  float *xi = &inp[0], *yi = xi + size, *zi = yi + size;
+  for (int index = 0; index < size; index++) {
+    xi[index] = datas[index].dx; yi[index] = datas[index].dy; zi[index] = datas[index].dz;
+  }
+
+  // Each thread reuses one pair of local buffers, big enough for any block
+  //
+  int maxLocal = 0;
+  for (bi = 0; bi < nblocks; bi++) maxLocal = std::max(maxLocal, blocks[bi].layerEnd[depth]);
+  std::vector< std::vector<float> > threadBufs(nthreads);
+
+  for (int done = 0; done < num_avgs; ) {
+    int const passes = std::min(depth, num_avgs - done);
+    float const *xs = &inp[0], *ys = xs + size, *zs = ys + size;
+    float       *xd = &out[0], *yd = xd + size, *zd = yd + size;
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic,1)
+#endif
+    for (bi = 0; bi < nblocks; bi++) {
+      ROMP_PFLB_begin
+      Block const & b = blocks[bi];
+      int const nLocal = b.layerEnd[passes];
+
+#ifdef HAVE_OPENMP
+      std::vector<float> & bufs = threadBufs[omp_get_thread_num()];
+#else
+      std::vector<float> & bufs = threadBufs[0];
+#endif
+      if (bufs.empty()) bufs.resize(6*(size_t)maxLocal);
+      float *xa = &bufs[0], *ya = xa + nLocal, *za = ya + nLocal;
+      float *xb = za + nLocal, *yb = xb + nLocal, *zb = yb + nLocal;
+      for (int l = 0; l < nLocal; l++) {
+        int const index = b.global[l];
+        xa[l] = xs[index]; ya[l] = ys[index]; za[l] = zs[index];
+      }
+
+      for (int p = 1; p <= passes; p++) {
+        int const nComputed = b.layerEnd[passes - p];
+        for (int l = 0; l < nComputed; l++) {
+          float dx = xa[l], dy = ya[l], dz = za[l];
+          for (int k = b.firstNeighbor[l]; k < b.firstNeighbor[l+1]; k++) {
+            int const ln = b.neighbors[k];
+            dx += xa[ln]; dy += ya[ln]; dz += za[ln];
+          }
+          float const inv_num = b.inv_num[l];
+          xb[l] = dx*inv_num; yb[l] = dy*inv_num; zb[l] = dz*inv_num;
+        }
+        std::swap(xa, xb); std::swap(ya, yb); std::swap(za, zb);
+      }
+
+      for (int l = 0; l < b.nOwned; l++) {
+        int const index = b.global[l];
+        xd[index] = xa[l]; yd[index] = ya[l]; zd[index] = za[l];
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    inp.swap(out);
+    done += passes;
+  }
+
+  xi = &inp[0]; yi = xi + size; zi = yi + size;
+  for (int index = 0; index < size; index++) {
+    datas[index].dx = xi[index]; datas[index].dy = yi[index]; datas[index].dz = zi[index];
+  }
+}
+
+
 int MRISaverageGradients(MRIS *mris, int num_avgs)
 {
   int i, vno;
@@ -9703,8 +9900,15 @@ int MRISaverageGradients(MRIS *mris, int num_avgs)
       }
 #undef chunksCapacity
 
+      // Many iterations are done by the fused kernel
+      int unfused_avgs = num_avgs;
+      if (num_avgs >= MRISaverageGradients_FUSED_MIN_AVGS) {
+        MRISaverageGradients_fused(num_avgs, index_to_vno_size, controls, neighbors, datas_inp);
+        unfused_avgs = 0;
+      }
+
       // Do all the iterations
-      for (i = 0 ; i < num_avgs ; i++) {
+      for (i = 0 ; i < unfused_avgs ; i++) {
         
         unsigned int chunksIndex;
         ROMP_PF_begin
@@ -0,0 +1,689 @@
+/*
+ * @file utilities operating on Original
+ *
+ */
+/*
+ * surfaces Author: Bruce Fischl, extracted from mrisurf.c by Bevin Brett
+ *
+ * $ Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+#include <algorithm>
+#include <vector>
+
+#include "mrisurf_metricProperties.h"
+#include "mrisurf_base.h"
+
+
+// Incremental MRIScomputeMetricProperties
+//
+// Late in mris_fix_topology and mris_place_surface only a small fraction of the vertices move between
+// calls to MRIScomputeMetricProperties, yet every call recomputes every face, every vertex normal and every
+// distance list.  When tracking is enabled the surface remembers the positions the last computation saw,
+// finds the vertices that have moved since, and recomputes only
+//
+//      the faces that use a moved vertex, and the normals and areas of the vertices of those faces
+//      the distance lists of the moved vertices, and the entries for the moved vertices in their neighbors' lists
+//      the totals, by removing the old contributions of the recomputed faces and edges and adding the new ones
+//
+// The results match what mrisurf_metricProperties_fast.h computes for the same positions, except for the
+// order in which the totals are summed.  To keep that rounding from accumulating, and to be safe against
+// code that changes the metric properties without moving any vertex, a full computation is still done
+//
+//      every FS_INCREMENTAL_MP_PERIOD calls (default 10)
+//      when more than FS_INCREMENTAL_MP_MAX_DIRTY of the vertices have moved (default 0.1)
+//      when the topology, ripflags, nsize, status, radius, or the fix_vertex_area or UnitizeNormalFace globals change
+//      when the distance lists are no longer the ones the last computation left behind
+//      when a moved vertex has a degenerate normal, since the full computation knows how to perturb it
+//
+// Enable with MRISsetIncrementalMetricProperties(mris, true), or for all surfaces with FS_INCREMENTAL_MP=1.
+// The FS_FASTER_MP and FREESURFER_OLD_MRIScomputeMetricProperties variants are never done incrementally.
+//
+struct MRIS_IncrementalMP {
+
+  bool valid;                           // the snapshot below describes the current metric properties
+  int  stepsSinceFull;
+  int  fullPeriod;
+  double maxDirtyFraction;
+
+  // what the last computation depended on
+  //
+  int         nvertices, nfaces;
+  int         nsize;
+  short       nsizeMaxClock;
+  MRIS_Status status;
+  double      radius;
+  int         fix_vertex_area;
+  int         unitizeNormalFace;
+
+  std::vector<float>        x, y, z;
+  std::vector<char>         v_ripflag;
+  std::vector<int>          vtotal;
+  std::vector<float const*> dist;
+  std::vector<int>          dist_capacity;
+  std::vector<char>         f_ripflag;
+
+  // what each face and edge contributed to the totals
+  //
+  std::vector<float> f_unsignedArea;    // before orientation, this is what MRIScomputeTriangleProperties sums
+  std::vector<float> f_orientedArea;    // after orientation
+  std::vector<float> f_negOrigArea;     // orig_area of the face if it was negative after orientation
+
+  double unsignedArea;
+  double posArea, negArea, negOrigArea;
+  double distSum, distSum2, distN;
+
+  float xlo, xhi, ylo, yhi, zlo, zhi;
+
+  // scratch, kept to avoid reallocating
+  //
+  std::vector<char> v_mark, f_mark;
+  std::vector<int>  dirty, faces, affected;
+  std::vector<int>  nbrEntries;         // pairs of (clean neighbor, index of the dirty vertex in its list)
+  std::vector<float> newNormals, newOrigAreas;
+};
+
+
+static int envInt(const char* name, int dflt) {
+  const char* s = getenv(name);
+  return s ? atoi(s) : dflt;
+}
+
+static double envDouble(const char* name, double dflt) {
+  const char* s = getenv(name);
+  return s ? atof(s) : dflt;
+}
+
+
+void MRISsetIncrementalMetricProperties(MRIS *mris, bool enabled)
+{
+  MRIS_IncrementalMP* imp = (MRIS_IncrementalMP*)mris->incrementalMP;
+
+  if (!enabled) {
+    delete imp;
+    mris->incrementalMP = NULL;
+    return;
+  }
+
+  if (imp) return;
+
+  imp = new MRIS_IncrementalMP();
+  imp->valid            = false;
+  imp->stepsSinceFull   = 0;
+  imp->fullPeriod       = std::max(1, envInt("FS_INCREMENTAL_MP_PERIOD", 10));
+  imp->maxDirtyFraction = envDouble("FS_INCREMENTAL_MP_MAX_DIRTY", 0.1);
+  mris->incrementalMP   = imp;
+}
+
+
+void mrisInvalidateIncrementalMetricProperties(MRIS *mris)
+{
+  MRIS_IncrementalMP* imp = (MRIS_IncrementalMP*)mris->incrementalMP;
+  if (imp) imp->valid = false;
+}
+
+
+static bool isOrientedStatus(MRIS_Status status) {
+  switch (status) {
+    case MRIS_RIGID_BODY:
+    case MRIS_PARAMETERIZED_SPHERE:
+    case MRIS_SPHERE:
+    case MRIS_ELLIPSOID:
+    case MRIS_SPHERICAL_PATCH:
+    case MRIS_PLANE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+static void noteFaceContribution(MRIS_IncrementalMP* imp, int fno, bool add) {
+  float const unsignedArea = imp->f_unsignedArea[fno];
+  float const orientedArea = imp->f_orientedArea[fno];
+  float const negOrigArea  = imp->f_negOrigArea [fno];
+  double const sign = add ? 1.0 : -1.0;
+
+  imp->unsignedArea += sign * unsignedArea;
+  if (orientedArea >= 0.0f) {
+    imp->posArea     += sign * orientedArea;
+  } else {
+    imp->negArea     += sign * -orientedArea;
+    imp->negOrigArea += sign * negOrigArea;
+  }
+}
+
+
+static void recordFace(MRIS_IncrementalMP* imp, MRIS* mris, int fno, float unsignedArea) {
+  FACE const * const face = &mris->faces[fno];
+  imp->f_unsignedArea[fno] = unsignedArea;
+  imp->f_orientedArea[fno] = face->area;
+  imp->f_negOrigArea [fno] = (face->area < 0.0f) ? getFaceOrigArea(mris, fno) : 0.0f;
+}
+
+
+void mrisNoteFullMetricProperties(MRIS *mris)
+{
+  MRIS_IncrementalMP* imp = (MRIS_IncrementalMP*)mris->incrementalMP;
+  if (!imp) return;
+
+  imp->valid              = true;
+  imp->stepsSinceFull     = 0;
+  imp->nvertices          = mris->nvertices;
+  imp->nfaces             = mris->nfaces;
+  imp->nsize              = mris->nsize;
+  imp->nsizeMaxClock      = mris->nsizeMaxClock;
+  imp->status             = mris->status;
+  imp->radius             = mris->radius;
+  imp->fix_vertex_area    = fix_vertex_area;
+  imp->unitizeNormalFace  = UnitizeNormalFace;
+
+  int const nvertices = mris->nvertices;
+  int const nfaces    = mris->nfaces;
+
+  imp->x            .resize(nvertices);
+  imp->y            .resize(nvertices);
+  imp->z            .resize(nvertices);
+  imp->v_ripflag    .resize(nvertices);
+  imp->vtotal       .resize(nvertices);
+  imp->dist         .resize(nvertices);
+  imp->dist_capacity.resize(nvertices);
+  imp->v_mark       .assign(nvertices, 0);
+
+  imp->f_ripflag     .resize(nfaces);
+  imp->f_unsignedArea.resize(nfaces);
+  imp->f_orientedArea.resize(nfaces);
+  imp->f_negOrigArea .resize(nfaces);
+  imp->f_mark        .assign(nfaces, 0);
+
+  imp->distSum = imp->distSum2 = imp->distN = 0.0;
+
+  int vno;
+  for (vno = 0; vno < nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v  = &mris->vertices         [vno];
+    imp->x            [vno] = v->x;
+    imp->y            [vno] = v->y;
+    imp->z            [vno] = v->z;
+    imp->v_ripflag    [vno] = v->ripflag;
+    imp->vtotal       [vno] = vt->vtotal;
+    imp->dist         [vno] = v->dist;
+    imp->dist_capacity[vno] = v->dist_capacity;
+
+    if (v->ripflag || !v->dist) continue;
+    int m;
+    for (m = 0; m < vt->vnum; m++) {
+      if (mris->vertices[vt->v[m]].ripflag) continue;
+      double d = v->dist[m];
+      imp->distSum  += d;
+      imp->distSum2 += d*d;
+      imp->distN    += 1;
+    }
+  }
+
+  imp->unsignedArea = imp->posArea = imp->negArea = imp->negOrigArea = 0.0;
+
+  int fno;
+  for (fno = 0; fno < nfaces; fno++) {
+    FACE const * const face = &mris->faces[fno];
+    imp->f_ripflag[fno] = face->ripflag;
+    if (face->ripflag) {
+      imp->f_unsignedArea[fno] = imp->f_orientedArea[fno] = imp->f_negOrigArea[fno] = 0.0f;
+      continue;
+    }
+    recordFace(imp, mris, fno, fabs(face->area));
+    noteFaceContribution(imp, fno, true);
+  }
+
+  imp->xlo = mris->xlo; imp->xhi = mris->xhi;
+  imp->ylo = mris->ylo; imp->yhi = mris->yhi;
+  imp->zlo = mris->zlo; imp->zhi = mris->zhi;
+}
+
+
+// Decide whether the incremental path can be used, without changing anything.
+// Fills in imp->dirty and imp->nbrEntries.
+//
+static bool findDirtyVertices(MRIS_IncrementalMP* imp, MRIS* mris)
+{
+  if (!imp->valid)                                  return false;
+  if (imp->stepsSinceFull + 1 >= imp->fullPeriod)   return false;
+  if (imp->nvertices         != mris->nvertices
+   || imp->nfaces            != mris->nfaces
+   || imp->nsize             != mris->nsize
+   || imp->nsizeMaxClock     != mris->nsizeMaxClock
+   || imp->status            != mris->status
+   || imp->radius            != mris->radius
+   || imp->fix_vertex_area   != fix_vertex_area
+   || imp->unitizeNormalFace != UnitizeNormalFace
+   || mris->vtotalsMightBeTooBig)                   return false;
+
+  int const maxDirty = (int)(imp->maxDirtyFraction * mris->nvertices);
+
+  imp->dirty.clear();
+
+  int vno;
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v  = &mris->vertices         [vno];
+    if (v->ripflag   != imp->v_ripflag[vno]) return false;
+    if (vt->vtotal   != imp->vtotal   [vno]) return false;
+    if (v->ripflag) continue;
+    if (v->dist ? (v->dist != imp->dist[vno]) : (mris->dist_storage[vno] != (void*)imp->dist[vno])) return false;
+    if (!imp->dist[vno]) return false;
+    if (v->x != imp->x[vno] || v->y != imp->y[vno] || v->z != imp->z[vno]) {
+      if ((int)imp->dirty.size() >= maxDirty) return false;
+      imp->dirty.push_back(vno);
+    }
+  }
+
+  int fno;
+  for (fno = 0; fno < mris->nfaces; fno++) {
+    if (mris->faces[fno].ripflag != imp->f_ripflag[fno]) return false;
+  }
+
+  // Each clean neighbor of a moved vertex needs the entry for the moved vertex recomputed,
+  // which relies on the neighborhoods being symmetric
+  //
+  imp->nbrEntries.clear();
+  for (int const vno : imp->dirty) imp->v_mark[vno] = 1;
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < imp->dirty.size(); i++) {
+    int const vno = imp->dirty[i];
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    int n;
+    for (n = 0; n < vt->vtotal; n++) {
+      int const vnon = vt->v[n];
+      if (imp->v_mark[vnon] || mris->vertices[vnon].ripflag) continue;
+      VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vnon];
+      int m;
+      for (m = 0; m < vnt->vtotal; m++) if (vnt->v[m] == vno) break;
+      if (m == vnt->vtotal) { ok = false; break; }
+      imp->nbrEntries.push_back(vnon);
+      imp->nbrEntries.push_back(m);
+    }
+  }
+
+  for (int const vno : imp->dirty) imp->v_mark[vno] = 0;
+
+  return ok;
+}
+
+
+static float triangleArea(MRIS* mris, int fno, int n)
+{
+  FACE const * const f = &mris->faces[fno];
+
+  int const n0 = (n == 0) ? VERTICES_PER_FACE - 1 : n - 1;
+  int const n1 = (n == VERTICES_PER_FACE - 1) ? 0 : n + 1;
+
+  VERTEX const * const v0 = &mris->vertices[f->v[n0]];
+  VERTEX const * const v1 = &mris->vertices[f->v[n1]];
+  VERTEX const * const v2 = &mris->vertices[f->v[n ]];
+
+  float a[3], b[3];
+  a[0] = v2->x - v0->x; a[1] = v2->y - v0->y; a[2] = v2->z - v0->z;
+  b[0] = v1->x - v2->x; b[1] = v1->y - v2->y; b[2] = v1->z - v2->z;
+
+  float d1 = -b[1] * a[2] + a[1] * b[2];
+  float d2 =  b[0] * a[2] - a[0] * b[2];
+  float d3 = -b[0] * a[1] + a[0] * b[1];
+  return sqrt(d1 * d1 + d2 * d2 + d3 * d3) / 2;
+}
+
+
+// Same as MRIScomputeTriangleProperties followed by the orientation step of mrismp_OrientSurface, for one face
+//
+static float computeFaceProperties(MRIS* mris, int fno, VECTOR* v_a, VECTOR* v_b, VECTOR* v_n)
+{
+  FACE * const face = &mris->faces[fno];
+
+  VERTEX const
+    *v0 = &mris->vertices[face->v[0]],
+    *v1 = &mris->vertices[face->v[1]],
+    *v2 = &mris->vertices[face->v[2]];
+
+  VERTEX_EDGE(v_a, v0, v1);
+  VERTEX_EDGE(v_b, v0, v2);
+
+  V3_CROSS_PRODUCT(v_a, v_b, v_n);
+  float const area = V3_LEN(v_n) * 0.5f;
+  face->area = area;
+
+  V3_NORMALIZE(v_n, v_n);
+  float nx = V3_X(v_n), ny = V3_Y(v_n), nz = V3_Z(v_n);
+  VECTOR_LOAD(v_n, nx, ny, nz);
+
+  int ano;
+  for (ano = 0; ano < ANGLES_PER_TRIANGLE; ano++) {
+    VERTEX const *va, *vb, *vo;
+    switch (ano) {
+      default:
+      case 0: vo = v0; va = v2; vb = v1; break;
+      case 1: vo = v1; va = v0; vb = v2; break;
+      case 2: vo = v2; va = v1; vb = v0; break;
+    }
+    VERTEX_EDGE(v_a, vo, va);
+    VERTEX_EDGE(v_b, vo, vb);
+    float cross = VectorTripleProduct(v_b, v_a, v_n);
+    float dot   = V3_DOT(v_a, v_b);
+    face->angle[ano] = fastApproxAtan2f(cross, dot);
+  }
+
+  bool flip = false;
+  switch (mris->status) {
+    case MRIS_RIGID_BODY:
+    case MRIS_PARAMETERIZED_SPHERE:
+    case MRIS_SPHERE:
+    case MRIS_ELLIPSOID:
+    case MRIS_SPHERICAL_PATCH: {
+      float const xc = v0->x + v1->x + v2->x;
+      float const yc = v0->y + v1->y + v2->y;
+      float const zc = v0->z + v1->z + v2->z;
+      flip = (xc * nx + yc * ny + zc * nz) < 0.0f;
+    } break;
+    case MRIS_PLANE:
+      flip = nz < 0.0f;
+      break;
+    default:
+      break;
+  }
+
+  if (flip) {
+    face->area *= -1.0f;
+    nx = -nx; ny = -ny; nz = -nz;
+    for (ano = 0; ano < ANGLES_PER_TRIANGLE; ano++) face->angle[ano] *= -1.0f;
+  }
+
+  setFaceNorm(mris, fno, nx, ny, nz);
+
+  return area;
+}
+
+
+// Same as mrisComputeVertexDistancesWkr_extracted.h for one entry
+//
+static float vertexDistance(MRIS* mris, MRIS_Status_DistanceFormula formula, int vno, int vnon)
+{
+  VERTEX const * const v  = &mris->vertices[vno];
+  VERTEX const * const vn = &mris->vertices[vnon];
+
+  if (formula == MRIS_Status_DistanceFormula_0) {
+    float xd = v->x - vn->x;
+    float yd = v->y - vn->y;
+    float zd = v->z - vn->z;
+    float d = xd * xd + yd * yd + zd * zd;
+    return sqrt(d);
+  }
+
+  if (vn->ripflag) return 0.0f;
+
+  XYZ   n, nn;
+  float length, nlength;
+  XYZ_NORMALIZED_LOAD(&n,  &length,  v ->x, v ->y, v ->z);
+  XYZ_NORMALIZED_LOAD(&nn, &nlength, vn->x, vn->y, vn->z);
+  if (FZERO(nlength)) return 0.0f;
+
+  float angle = fabs(XYZApproxAngle_knownLength(&n, vn->x, vn->y, vn->z, nlength));
+  return angle * length;
+}
+
+
+bool mrisComputeMetricPropertiesIncrementally(MRIS *mris)
+{
+  MRIS_IncrementalMP* imp = (MRIS_IncrementalMP*)mris->incrementalMP;
+  if (!imp || !findDirtyVertices(imp, mris)) return false;
+
+  // The faces using a moved vertex, and the vertices whose normals and areas depend on them
+  //
+  imp->faces.clear();
+  imp->affected.clear();
+
+  for (int const vno : imp->dirty) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    int n;
+    for (n = 0; n < vt->num; n++) {
+      int const fno = vt->f[n];
+      if (imp->f_mark[fno]) continue;
+      imp->f_mark[fno] = 1;
+      imp->faces.push_back(fno);
+      FACE const * const face = &mris->faces[fno];
+      int i;
+      for (i = 0; i < VERTICES_PER_FACE; i++) {
+        int const vno2 = face->v[i];
+        if (imp->v_mark[vno2]) continue;
+        imp->v_mark[vno2] = 1;
+        imp->affected.push_back(vno2);
+      }
+    }
+    if (!imp->v_mark[vno]) {
+      imp->v_mark[vno] = 1;
+      imp->affected.push_back(vno);
+    }
+  }
+
+  for (int const fno : imp->faces)    imp->f_mark[fno] = 0;
+  for (int const vno : imp->affected) imp->v_mark[vno] = 0;
+
+  // Vertex normals first, because a degenerate one needs the full computation's perturbation
+  // and nothing must have been changed yet if that is what happens
+  //
+  imp->newNormals  .resize(3*imp->affected.size());
+  imp->newOrigAreas.resize(  imp->affected.size());
+
+  size_t i;
+  for (i = 0; i < imp->affected.size(); i++) {
+    int const vno = imp->affected[i];
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v  = &mris->vertices         [vno];
+    if (v->ripflag) continue;
+
+    float snorm[3] = {0,0,0};
+    float area = 0;
+    int count = 0;
+    int n;
+    for (n = 0; n < vt->num; n++) {
+      int const fno = vt->f[n];
+      if (mris->faces[fno].ripflag) continue;
+      count++;
+      float norm[3];
+      mrisNormalFace(mris, fno, (int)vt->n[n], norm);
+      snorm[0] += norm[0];
+      snorm[1] += norm[1];
+      snorm[2] += norm[2];
+      area += triangleArea(mris, fno, (int)vt->n[n]);
+    }
+
+    if (count && !(mrisNormalize(snorm) > 0.0)) return false;
+
+    imp->newNormals[3*i+0] = snorm[0];
+    imp->newNormals[3*i+1] = snorm[1];
+    imp->newNormals[3*i+2] = snorm[2];
+    imp->newOrigAreas[i]   = fix_vertex_area ? area / 3.0 : area / 2.0;
+  }
+
+  // The distance lists were only forgotten, so put them back
+  //
+  int vno;
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    if (mris->vertices[vno].ripflag) continue;
+    if (!mrisReattachDist(mris, vno, imp->dist[vno], imp->dist_capacity[vno])) {
+      imp->valid = false;
+      return false;
+    }
+  }
+
+  // Faces
+  //
+  VECTOR* v_a = VectorAlloc(3, MATRIX_REAL);
+  VECTOR* v_b = VectorAlloc(3, MATRIX_REAL);
+  VECTOR* v_n = VectorAlloc(3, MATRIX_REAL);
+
+  for (int const fno : imp->faces) {
+    if (mris->faces[fno].ripflag) continue;
+    noteFaceContribution(imp, fno, false);
+    float const unsignedArea = computeFaceProperties(mris, fno, v_a, v_b, v_n);
+    recordFace(imp, mris, fno, unsignedArea);
+    noteFaceContribution(imp, fno, true);
+  }
+
+  VectorFree(&v_a);
+  VectorFree(&v_b);
+  VectorFree(&v_n);
+
+  // Vertices
+  //
+  for (i = 0; i < imp->affected.size(); i++) {
+    int const vno = imp->affected[i];
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX                * const v  = &mris->vertices         [vno];
+    if (v->ripflag) continue;
+
+    v->nx = imp->newNormals[3*i+0];
+    v->ny = imp->newNormals[3*i+1];
+    v->nz = imp->newNormals[3*i+2];
+    if (v->origarea < 0) v->origarea = imp->newOrigAreas[i];
+
+    float area = 0.0f;
+    int n;
+    if (mris->status == MRIS_PLANE) {
+      if (v->nz < 0) {
+        v->nz *= -1.0f;
+        v->neg = 1;
+      } else {
+        v->neg = 0;
+      }
+      for (n = 0; n < vt->num; n++) area += mris->faces[vt->f[n]].area;
+    } else {
+      for (n = 0; n < vt->num; n++) {
+        FACE const * const face = &mris->faces[vt->f[n]];
+        if (face->ripflag == 0) area += fabs(face->area);
+      }
+    }
+    if (fix_vertex_area)
+      area /= 3.0;
+    else
+      area /= 2.0;
+    v->area = area;
+  }
+
+  // Distances
+  //
+  MRIS_Status_DistanceFormula const formula = MRIS_Status_distanceFormula(mris->status);
+
+  for (int const vno : imp->dirty) imp->v_mark[vno] = 1;
+
+  for (int const vno : imp->dirty) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v  = &mris->vertices         [vno];
+    int n;
+    for (n = 0; n < vt->vtotal; n++) {
+      int const vnon = vt->v[n];
+      bool const counted = (n < vt->vnum) && !mris->vertices[vnon].ripflag;
+      double const d_old = v->dist[n];
+      double const d_new = v->dist[n] = vertexDistance(mris, formula, vno, vnon);
+      if (counted) {
+        imp->distSum  += d_new - d_old;
+        imp->distSum2 += d_new*d_new - d_old*d_old;
+      }
+    }
+  }
+
+  for (i = 0; i < imp->nbrEntries.size(); i += 2) {
+    int const vnon = imp->nbrEntries[i];
+    int const m    = imp->nbrEntries[i+1];
+    VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vnon];
+    VERTEX          const * const vn  = &mris->vertices         [vnon];
+    bool const counted = (m < vnt->vnum);                     // the moved vertex is never ripped
+    double const d_old = vn->dist[m];
+    double const d_new = vn->dist[m] = vertexDistance(mris, formula, vnon, vnt->v[m]);
+    if (counted) {
+      imp->distSum  += d_new - d_old;
+      imp->distSum2 += d_new*d_new - d_old*d_old;
+    }
+  }
+
+  for (int const vno : imp->dirty) imp->v_mark[vno] = 0;
+
+  mris->dist_nsize = mris->nsize;
+
+  // Bounding box, which only needs a rescan if a moved vertex used to be on it
+  //
+  bool rescan = false;
+  for (int const vno : imp->dirty) {
+    float const x = imp->x[vno], y = imp->y[vno], z = imp->z[vno];
+    if (x == imp->xlo || x == imp->xhi || y == imp->ylo || y == imp->yhi || z == imp->zlo || z == imp->zhi) {
+      rescan = true;
+      break;
+    }
+  }
+  if (rescan) {
+    imp->xhi = imp->yhi = imp->zhi = -10000;
+    imp->xlo = imp->ylo = imp->zlo =  10000;
+    for (vno = 0; vno < mris->nvertices; vno++) {
+      VERTEX const * const v = &mris->vertices[vno];
+      if (v->x > imp->xhi) imp->xhi = v->x;
+      if (v->x < imp->xlo) imp->xlo = v->x;
+      if (v->y > imp->yhi) imp->yhi = v->y;
+      if (v->y < imp->ylo) imp->ylo = v->y;
+      if (v->z > imp->zhi) imp->zhi = v->z;
+      if (v->z < imp->zlo) imp->zlo = v->z;
+    }
+  } else {
+    for (int const vno : imp->dirty) {
+      VERTEX const * const v = &mris->vertices[vno];
+      if (v->x > imp->xhi) imp->xhi = v->x;
+      if (v->x < imp->xlo) imp->xlo = v->x;
+      if (v->y > imp->yhi) imp->yhi = v->y;
+      if (v->y < imp->ylo) imp->ylo = v->y;
+      if (v->z > imp->zhi) imp->zhi = v->z;
+      if (v->z < imp->zlo) imp->zlo = v->z;
+    }
+  }
+  mris->xlo = imp->xlo; mris->xhi = imp->xhi;
+  mris->ylo = imp->ylo; mris->yhi = imp->yhi;
+  mris->zlo = imp->zlo; mris->zhi = imp->zhi;
+  mris->xctr = 0.5f * (float)((double)imp->xlo + (double)imp->xhi);
+  mris->yctr = 0.5f * (float)((double)imp->ylo + (double)imp->yhi);
+  mris->zctr = 0.5f * (float)((double)imp->zlo + (double)imp->zhi);
+
+  // Totals
+  //
+  mris->total_area      = (float)imp->unsignedArea;
+  mris->avg_vertex_area = mris->total_area / mris->nvertices;
+
+  double const N   = imp->distN;
+  double const Avg = imp->distSum / N;
+  mris->std_vertex_dist = sqrt(N * (imp->distSum2 / N - Avg * Avg) / (N - 1));
+  mrisSetAvgInterVertexDist(mris, Avg);
+
+  if (isOrientedStatus(mris->status)) {
+    mris->total_area    = (float)imp->posArea;
+    mris->neg_area      = (float)imp->negArea;
+    mris->neg_orig_area = (float)imp->negOrigArea;
+  }
+  if (mris->status == MRIS_PARAMETERIZED_SPHERE || mris->status == MRIS_RIGID_BODY || mris->status == MRIS_SPHERE) {
+    mris->total_area = M_PI * mris->radius * mris->radius * 4.0;
+  }
+
+  // What this computation saw
+  //
+  for (int const vno : imp->dirty) {
+    VERTEX const * const v = &mris->vertices[vno];
+    imp->x[vno] = v->x;
+    imp->y[vno] = v->y;
+    imp->z[vno] = v->z;
+  }
+  imp->stepsSinceFull++;
+
+  return true;
+}
@@ -64,6 +64,7 @@
 #include "bfileio.h"
 #include "corio.h"
 #include "diag.h"
+#include "fio.h"
 #include "label.h"
 #include "matrix.h"
 #include "mri.h"
@@ -859,7 +860,10 @@ MRI *vol2surf_linear(MRI *SrcVol,
                   int ReverseMapFlag, int DoJac, int UseHash)
 \brief Applies one or more surface registrations with or without jacobian correction.
 This should be used as a replacement for surf2surf_nnfr and surf2surf_nnfr_jac
-(it gives identical results).
+(it gives identical results). The mapping is built as a sparse operator
+(see MRISapplyRegBuildOp()) which is then applied to the input; when the same
+registration is applied to many inputs, build (or read) the operator once and
+call MRISapplyRegOp() directly.
 \param MRI *SrcSurfVals - Inputs
 \param MRIS **SurfReg - array of surface reg pairs, src1-trg1:src2-trg2:... where
 trg1 and src2 are from the same anatomy.
@@ -870,15 +874,65 @@ trg1 and src2 are from the same anatomy.
 */
 MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
 {
-  MRI *TrgSurfVals = NULL;
+  MRIS_APPLYREG_OP *op;
+  MRI *TrgSurfVals;
+
+  /* check dimension consistency */
+  if (SrcSurfVals->width != SurfReg[0]->nvertices) {
+    printf("MRISapplyReg: Vals and Reg dimension mismatch\n");
+    printf("nVals = %d, nReg %d\n", SrcSurfVals->width, SurfReg[0]->nvertices);
+    return (NULL);
+  }
+
+  op = MRISapplyRegBuildOp(SurfReg, nsurfs, ReverseMapFlag, DoJac, UseHash);
+  if (op == NULL) return (NULL);
+  TrgSurfVals = MRISapplyRegOp(op, SrcSurfVals, NULL);
+  MRISapplyRegOpFree(&op);
+  return (TrgSurfVals);
+}
+
+/*
+  Hash of the vertex coordinates and ripflags of the registration
+  surfaces, which are all the mapping depends on besides the flags.
+*/
+static unsigned long applyRegOpHash(MRI_SURFACE **SurfReg, int nsurfs)
+{
+  FnvHash hash;
+  hash.add(&nsurfs);
+  for (int n = 0; n < nsurfs; n++) {
+    hash.add(&SurfReg[n]->nvertices);
+    for (int vtx = 0; vtx < SurfReg[n]->nvertices; vtx++) {
+      const VERTEX *v = &SurfReg[n]->vertices[vtx];
+      const float xyz[3] = {v->x, v->y, v->z};
+      hash.add((const unsigned char *)xyz, sizeof(xyz));
+      hash.add((const unsigned char *)&v->ripflag, sizeof(v->ripflag));
+    }
+  }
+  return (hash.value);
+}
+
+/*!
+\fn MRIS_APPLYREG_OP *MRISapplyRegBuildOp(MRI_SURFACE **SurfReg, int nsurfs,
+                  int ReverseMapFlag, int DoJac, int UseHash)
+\brief Computes the mapping of MRISapplyReg() as a sparse (CSR) operator
+with one row per target vertex. Each row holds the source vertices that
+map into the target vertex, the forward hit first followed by the reverse
+hits in source vertex order, together with a divisor for each entry
+(the number of times the source vertex was sampled when DoJac, otherwise 1)
+and a divisor for the row (the number of hits on the target when !DoJac,
+otherwise 1). Applying it reproduces MRISapplyReg() exactly.
+Arguments are the same as for MRISapplyReg().
+*/
+MRIS_APPLYREG_OP *MRISapplyRegBuildOp(MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
+{
+  MRIS_APPLYREG_OP *op;
   MRI_SURFACE *SrcSurfReg, *TrgSurfReg;
-  int svtx = 0, tvtx, tvtxN, svtxN = 0, f, n, nrevhits, nSrcLost;
-  int npairs, kS, kT, nhits;
-  // int nunmapped;
+  int svtx = 0, tvtx, tvtxN, svtxN = 0, n, nrevhits, nSrcLost;
+  int npairs, kS, kT, nhits, k;
   VERTEX *v;
   float dmin;
   MHT **Hash = NULL;
-  MRI *SrcHits, *TrgHits;
+  int *SrcHits, *TrgHits, *fwdsrc, *fwddiv, *revsrc, *revtrg, *rowfill;
 
   npairs = nsurfs / 2;
   printf("MRISapplyReg(): nsurfs = %d, revmap=%d, jac=%d,  hash=%d\n", nsurfs, ReverseMapFlag, DoJac, UseHash);
@@ -888,11 +942,6 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
   TrgSurfReg = SurfReg[nsurfs - 1];
 
   /* check dimension consistency */
-  if (SrcSurfVals->width != SrcSurfReg->nvertices) {
-    printf("MRISapplyReg: Vals and Reg dimension mismatch\n");
-    printf("nVals = %d, nReg %d\n", SrcSurfVals->width, SrcSurfReg->nvertices);
-    return (NULL);
-  }
   for (n = 0; n < npairs - 1; n++) {
     kS = 2 * n + 1;
     kT = kS + 1;
@@ -903,20 +952,22 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
     }
   }
 
-  /* allocate a "volume" to hold the output */
-  TrgSurfVals = MRIallocSequence(TrgSurfReg->nvertices, 1, 1, MRI_FLOAT, SrcSurfVals->nframes);
-  if (TrgSurfVals == NULL) return (NULL);
-  MRIcopyHeader(SrcSurfVals, TrgSurfVals);
-
   /* number of source vertices mapped to each target vertex */
-  TrgHits = MRIallocSequence(TrgSurfReg->nvertices, 1, 1, MRI_FLOAT, 1);
-  if (TrgHits == NULL) return (NULL);
-  MRIcopyHeader(SrcSurfVals, TrgHits);
-
+  TrgHits = (int *)calloc(TrgSurfReg->nvertices, sizeof(int));
   /* number of target vertices mapped to by each source vertex */
-  SrcHits = MRIallocSequence(SrcSurfReg->nvertices, 1, 1, MRI_FLOAT, 1);
-  if (SrcHits == NULL) return (NULL);
-  MRIcopyHeader(SrcSurfVals, SrcHits);
+  SrcHits = (int *)calloc(SrcSurfReg->nvertices, sizeof(int));
+  /* forward map (source vertex or -1) and its divisor for each target vertex */
+  fwdsrc = (int *)calloc(TrgSurfReg->nvertices, sizeof(int));
+  fwddiv = (int *)calloc(TrgSurfReg->nvertices, sizeof(int));
+  /* reverse hits, in source vertex order */
+  revsrc = (int *)calloc(SrcSurfReg->nvertices, sizeof(int));
+  revtrg = (int *)calloc(SrcSurfReg->nvertices, sizeof(int));
+  if (!TrgHits || !SrcHits || !fwdsrc || !fwddiv || !revsrc || !revtrg) {
+    printf("ERROR: MRISapplyRegBuildOp(): could not alloc\n");
+    free(TrgHits); free(SrcHits); free(fwdsrc); free(fwddiv); free(revsrc); free(revtrg);
+    return (NULL);
+  }
+  for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) fwdsrc[tvtx] = -1;
 
   if (UseHash) {
     printf("MRISapplyReg: building hash tables (res=16).\n");
@@ -945,8 +996,8 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
         tvtxN = svtx;
       }
       /* update the number of hits and distance */
-      MRIFseq_vox((SrcHits), svtx, 0, 0, 0)++;
-      MRIFseq_vox((TrgHits), tvtx, 0, 0, 0)++;
+      SrcHits[svtx]++;
+      TrgHits[tvtx]++;
     }
   }
 
@@ -969,7 +1020,6 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
   /* Go through the forwad loop (finding closest srcvtx to each trgvtx).
   This maps each target vertex to a source vertex */
   printf("MRISapplyReg: Forward Loop (%d)\n", TrgSurfReg->nvertices);
-  // nunmapped = 0;
   for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
     if(TrgSurfReg->vertices[tvtx].ripflag) continue;
     if (!UseHash) {
@@ -1037,16 +1087,15 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
 
     if (!DoJac) {
       /* update the number of hits */
-      MRIFseq_vox(SrcHits, svtx, 0, 0, 0)++;
-      MRIFseq_vox(TrgHits, tvtx, 0, 0, 0)++;
+      SrcHits[svtx]++;
+      TrgHits[tvtx]++;
       nhits = 1;
     }
     else
-      nhits = MRIgetVoxVal(SrcHits, svtx, 0, 0, 0);
+      nhits = SrcHits[svtx];
 
-    /* accumulate mapped values for each frame */
-    for (f = 0; f < SrcSurfVals->nframes; f++)
-      MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) += (MRIFseq_vox(SrcSurfVals, svtx, 0, 0, f) / nhits);
+    fwdsrc[tvtx] = svtx;
+    fwddiv[tvtx] = nhits;
   }
   if(stvpairfp) fclose(stvpairfp);
 
@@ -1054,12 +1103,11 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
   Go through the reverse loop (finding closest trgvtx to each srcvtx
   unmapped by the forward loop). This assures that each source vertex
   is represented in the map */
+  nrevhits = 0;
   if (ReverseMapFlag) {
     printf("MRISapplyReg: Reverse Loop (%d)\n", SrcSurfReg->nvertices);
-    nrevhits = 0;
     for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++) {
-      if (MRIFseq_vox((SrcHits), svtx, 0, 0, 0) != 0) continue;
-      nrevhits++;
+      if (SrcHits[svtx] != 0) continue;
 
       // Compute the target vertex that corresponds to this source vertex
       svtxN = svtx;
@@ -1078,43 +1126,273 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
       }
 
       /* update the number of hits */
-      MRIFseq_vox((SrcHits), svtx, 0, 0, 0)++;
-      MRIFseq_vox((TrgHits), tvtx, 0, 0, 0)++;
-      /* accumulate mapped values for each frame */
-      for (f = 0; f < SrcSurfVals->nframes; f++)
-        MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) += MRIFseq_vox(SrcSurfVals, svtx, 0, 0, f);
+      SrcHits[svtx]++;
+      TrgHits[tvtx]++;
+      revsrc[nrevhits] = svtx;
+      revtrg[nrevhits] = tvtx;
+      nrevhits++;
     }
     printf("  Reverse Loop had %d hits\n", nrevhits);
   }
 
   /*---------------------------------------------------------------
-  Finally, divide the value at each target vertex by the number
-  of source vertices mapping into it */
-  if (!DoJac) {
-    printf("MRISapplyReg: Dividing by number of hits (%d)\n", TrgSurfReg->nvertices);
-    for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
-      n = MRIFseq_vox((TrgHits), tvtx, 0, 0, 0);
-      if (n > 1) {
-        for (f = 0; f < SrcSurfVals->nframes; f++) MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) /= n;
-      }
-    }
+  Assemble the rows. The forward hit goes first and the reverse hits
+  follow in source vertex order, which is the order in which they were
+  accumulated above, so the sums come out bit-for-bit the same. */
+  op = (MRIS_APPLYREG_OP *)calloc(1, sizeof(MRIS_APPLYREG_OP));
+  op->nsrc = SrcSurfReg->nvertices;
+  op->ntrg = TrgSurfReg->nvertices;
+  op->ReverseMapFlag = ReverseMapFlag;
+  op->DoJac = DoJac;
+  op->hash = applyRegOpHash(SurfReg, nsurfs);
+  op->rowptr = (int *)calloc(op->ntrg + 1, sizeof(int));
+  op->rowdiv = (float *)calloc(op->ntrg, sizeof(float));
+  for (tvtx = 0; tvtx < op->ntrg; tvtx++) {
+    if (fwdsrc[tvtx] >= 0) op->rowptr[tvtx + 1]++;
+    // Finally, divide the value at each target vertex by the number
+    // of source vertices mapping into it
+    op->rowdiv[tvtx] = 1;
+    if (!DoJac && TrgHits[tvtx] > 1) op->rowdiv[tvtx] = TrgHits[tvtx];
+  }
+  for (k = 0; k < nrevhits; k++) op->rowptr[revtrg[k] + 1]++;
+  for (tvtx = 0; tvtx < op->ntrg; tvtx++) op->rowptr[tvtx + 1] += op->rowptr[tvtx];
+  op->nnz = op->rowptr[op->ntrg];
+  op->col = (int *)calloc(op->nnz + 1, sizeof(int));
+  op->div = (float *)calloc(op->nnz + 1, sizeof(float));
+  rowfill = (int *)calloc(op->ntrg, sizeof(int));
+  for (tvtx = 0; tvtx < op->ntrg; tvtx++) {
+    rowfill[tvtx] = op->rowptr[tvtx];
+    if (fwdsrc[tvtx] < 0) continue;
+    op->col[rowfill[tvtx]] = fwdsrc[tvtx];
+    op->div[rowfill[tvtx]] = fwddiv[tvtx];
+    rowfill[tvtx]++;
+  }
+  for (k = 0; k < nrevhits; k++) {
+    tvtx = revtrg[k];
+    op->col[rowfill[tvtx]] = revsrc[k];
+    op->div[rowfill[tvtx]] = 1;
+    rowfill[tvtx]++;
   }
 
   /* Count lost sources */
   nSrcLost = 0;
-  for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++) {
-    n = MRIFseq_vox((SrcHits), svtx, 0, 0, 0);
-    if (n == 0) nSrcLost++;
-  }
+  for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++)
+    if (SrcHits[svtx] == 0) nSrcLost++;
   printf("MRISapplyReg: nSrcLost = %d\n", nSrcLost);
 
-  MRIfree(&SrcHits);
-  MRIfree(&TrgHits);
-  if (UseHash)
+  free(rowfill);
+  free(TrgHits);
+  free(SrcHits);
+  free(fwdsrc);
+  free(fwddiv);
+  free(revsrc);
+  free(revtrg);
+  if (UseHash) {
     for (n = 0; n < nsurfs; n++) MHTfree(&Hash[n]);
+    free(Hash);
+  }
+  return (op);
+}
+
+/*!
+\fn MRI *MRISapplyRegOp(MRIS_APPLYREG_OP *op, MRI *SrcSurfVals, MRI *TrgSurfVals)
+\brief Applies an operator from MRISapplyRegBuildOp() or MRISapplyRegOpRead()
+to all frames of SrcSurfVals (sparse matrix times dense block). Target
+vertices are processed in parallel. If TrgSurfVals is NULL, it is allocated.
+*/
+MRI *MRISapplyRegOp(MRIS_APPLYREG_OP *op, MRI *SrcSurfVals, MRI *TrgSurfVals)
+{
+  int tvtx;
+
+  if (SrcSurfVals->width != op->nsrc) {
+    printf("MRISapplyRegOp: Vals and operator dimension mismatch\n");
+    printf("nVals = %d, nOp %d\n", SrcSurfVals->width, op->nsrc);
+    return (NULL);
+  }
+  if (TrgSurfVals == NULL) {
+    TrgSurfVals = MRIallocSequence(op->ntrg, 1, 1, MRI_FLOAT, SrcSurfVals->nframes);
+    if (TrgSurfVals == NULL) return (NULL);
+    MRIcopyHeader(SrcSurfVals, TrgSurfVals);
+  }
+  else if (TrgSurfVals->width != op->ntrg || TrgSurfVals->nframes != SrcSurfVals->nframes ||
+           TrgSurfVals->type != MRI_FLOAT) {
+    printf("MRISapplyRegOp: output dimension mismatch\n");
+    return (NULL);
+  }
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (tvtx = 0; tvtx < op->ntrg; tvtx++) {
+    ROMP_PFLB_begin
+    int f, k;
+    for (f = 0; f < SrcSurfVals->nframes; f++) {
+      float sum = 0;
+      if (SrcSurfVals->type == MRI_FLOAT)
+        for (k = op->rowptr[tvtx]; k < op->rowptr[tvtx + 1]; k++)
+          sum += (MRIFseq_vox(SrcSurfVals, op->col[k], 0, 0, f) / op->div[k]);
+      else
+        for (k = op->rowptr[tvtx]; k < op->rowptr[tvtx + 1]; k++)
+          sum += (MRIgetVoxVal(SrcSurfVals, op->col[k], 0, 0, f) / op->div[k]);
+      if (op->rowdiv[tvtx] > 1) sum /= op->rowdiv[tvtx];
+      MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) = sum;
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
   return (TrgSurfVals);
 }
 
+/*!
+\fn int MRISapplyRegOpMatch(MRIS_APPLYREG_OP *op, MRI_SURFACE **SurfReg, int nsurfs,
+                        int ReverseMapFlag, int DoJac)
+\brief Returns 1 if op (eg, from MRISapplyRegOpRead()) is what
+MRISapplyRegBuildOp() would build from these arguments, or 0 after
+printing what differs. The surfaces are compared by a hash of their
+coordinates.
+*/
+int MRISapplyRegOpMatch(MRIS_APPLYREG_OP *op, MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac)
+{
+  if (op->nsrc != SurfReg[0]->nvertices || op->ntrg != SurfReg[nsurfs - 1]->nvertices) {
+    printf("operator maps %d to %d vertices, surfaces have %d and %d\n", op->nsrc, op->ntrg,
+           SurfReg[0]->nvertices, SurfReg[nsurfs - 1]->nvertices);
+    return (0);
+  }
+  if (op->ReverseMapFlag != ReverseMapFlag || op->DoJac != DoJac) {
+    printf("operator has revmap=%d jac=%d, requested %d %d\n", op->ReverseMapFlag, op->DoJac, ReverseMapFlag, DoJac);
+    return (0);
+  }
+  if (op->hash != applyRegOpHash(SurfReg, nsurfs)) {
+    printf("operator was built from different registration surfaces\n");
+    return (0);
+  }
+  return (1);
+}
+
+#define MRIS_APPLYREG_OP_MAGIC 0x52524f50  // "RROP"
+#define MRIS_APPLYREG_OP_VERSION 2
+
+/*!
+\fn int MRISapplyRegOpWrite(MRIS_APPLYREG_OP *op, const char *fname)
+\brief Saves the operator in a (big-endian) binary file so that it can be
+reused for other inputs with the same registration. A hash of the
+registration surfaces is saved too, for MRISapplyRegOpMatch().
+*/
+int MRISapplyRegOpWrite(MRIS_APPLYREG_OP *op, const char *fname)
+{
+  FILE *fp;
+  int n;
+
+  fp = fopen(fname, "wb");
+  if (fp == NULL) {
+    printf("ERROR: MRISapplyRegOpWrite(): could not open %s\n", fname);
+    return (1);
+  }
+  fwriteInt(MRIS_APPLYREG_OP_MAGIC, fp);
+  fwriteInt(MRIS_APPLYREG_OP_VERSION, fp);
+  fwriteInt(op->nsrc, fp);
+  fwriteInt(op->ntrg, fp);
+  fwriteInt(op->nnz, fp);
+  fwriteInt(op->ReverseMapFlag, fp);
+  fwriteInt(op->DoJac, fp);
+  fwriteInt((int)(op->hash >> 32), fp);
+  fwriteInt((int)(op->hash & 0xffffffff), fp);
+  for (n = 0; n <= op->ntrg; n++) fwriteInt(op->rowptr[n], fp);
+  for (n = 0; n < op->ntrg; n++) fwriteFloat(op->rowdiv[n], fp);
+  for (n = 0; n < op->nnz; n++) fwriteInt(op->col[n], fp);
+  for (n = 0; n < op->nnz; n++) fwriteFloat(op->div[n], fp);
+  if (ferror(fp)) {
+    printf("ERROR: MRISapplyRegOpWrite(): writing %s\n", fname);
+    fclose(fp);
+    return (1);
+  }
+  fclose(fp);
+  return (0);
+}
+
+/*!
+\fn MRIS_APPLYREG_OP *MRISapplyRegOpRead(const char *fname)
+\brief Reads an operator saved with MRISapplyRegOpWrite(). Returns NULL
+if the file cannot be read or is not a valid operator.
+*/
+MRIS_APPLYREG_OP *MRISapplyRegOpRead(const char *fname)
+{
+  MRIS_APPLYREG_OP *op;
+  FILE *fp;
+  int n, version;
+
+  fp = fopen(fname, "rb");
+  if (fp == NULL) {
+    printf("ERROR: MRISapplyRegOpRead(): could not open %s\n", fname);
+    return (NULL);
+  }
+  if (freadInt(fp) != MRIS_APPLYREG_OP_MAGIC) {
+    printf("ERROR: MRISapplyRegOpRead(): %s is not a surface reg operator\n", fname);
+    fclose(fp);
+    return (NULL);
+  }
+  version = freadInt(fp);
+  if (version != MRIS_APPLYREG_OP_VERSION) {
+    printf("ERROR: MRISapplyRegOpRead(): %s has unsupported version %d\n", fname, version);
+    fclose(fp);
+    return (NULL);
+  }
+
+  op = (MRIS_APPLYREG_OP *)calloc(1, sizeof(MRIS_APPLYREG_OP));
+  op->nsrc = freadInt(fp);
+  op->ntrg = freadInt(fp);
+  op->nnz = freadInt(fp);
+  op->ReverseMapFlag = freadInt(fp);
+  op->DoJac = freadInt(fp);
+  op->hash = (unsigned long)(unsigned int)freadInt(fp) << 32;
+  op->hash |= (unsigned int)freadInt(fp);
+  if (op->nsrc < 0 || op->ntrg < 0 || op->nnz < 0 || feof(fp)) {
+    printf("ERROR: MRISapplyRegOpRead(): %s has a bad header\n", fname);
+    free(op);
+    fclose(fp);
+    return (NULL);
+  }
+  op->rowptr = (int *)calloc(op->ntrg + 1, sizeof(int));
+  op->rowdiv = (float *)calloc(op->ntrg, sizeof(float));
+  op->col = (int *)calloc(op->nnz + 1, sizeof(int));
+  op->div = (float *)calloc(op->nnz + 1, sizeof(float));
+  for (n = 0; n <= op->ntrg; n++) op->rowptr[n] = freadInt(fp);
+  for (n = 0; n < op->ntrg; n++) op->rowdiv[n] = freadFloat(fp);
+  for (n = 0; n < op->nnz; n++) op->col[n] = freadInt(fp);
+  for (n = 0; n < op->nnz; n++) op->div[n] = freadFloat(fp);
+  if (ferror(fp) || feof(fp) || op->rowptr[0] != 0 || op->rowptr[op->ntrg] != op->nnz) {
+    printf("ERROR: MRISapplyRegOpRead(): %s is truncated or corrupt\n", fname);
+    MRISapplyRegOpFree(&op);
+    fclose(fp);
+    return (NULL);
+  }
+  for (n = 0; n < op->nnz; n++) {
+    if (op->col[n] < 0 || op->col[n] >= op->nsrc) {
+      printf("ERROR: MRISapplyRegOpRead(): %s has a bad vertex index\n", fname);
+      MRISapplyRegOpFree(&op);
+      fclose(fp);
+      return (NULL);
+    }
+  }
+  fclose(fp);
+  return (op);
+}
+
+int MRISapplyRegOpFree(MRIS_APPLYREG_OP **pop)
+{
+  MRIS_APPLYREG_OP *op = *pop;
+  if (op == NULL) return (0);
+  free(op->rowptr);
+  free(op->rowdiv);
+  free(op->col);
+  free(op->div);
+  free(op);
+  *pop = NULL;
+  return (0);
+}
+
 /*----------------------------------------------------------------
   MRI *surf2surf_nnfr() - NOTE: use MRISapplyReg instead!
 
@@ -0,0 +1,305 @@
+/**
+ * @brief multi-threaded shortest paths over a surface edge graph
+ *
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "surfsssp.h"
+#include "error.h"
+#include "romp_support.h"
+
+SSSP_GRAPH *SSSPgraphAlloc(int nnodes, int nedges)
+{
+  SSSP_GRAPH *graph = (SSSP_GRAPH *)calloc(1, sizeof(SSSP_GRAPH));
+  graph->nnodes = nnodes;
+  graph->rowptr = (int *)calloc(nnodes + 1, sizeof(int));
+  graph->col = (int *)calloc(nedges > 0 ? nedges : 1, sizeof(int));
+  graph->cost = (float *)calloc(nedges > 0 ? nedges : 1, sizeof(float));
+  return (graph);
+}
+
+int SSSPgraphFree(SSSP_GRAPH **pgraph)
+{
+  SSSP_GRAPH *graph = *pgraph;
+  if (graph == NULL) return (0);
+  free(graph->rowptr);
+  free(graph->col);
+  free(graph->cost);
+  free(graph);
+  *pgraph = NULL;
+  return (0);
+}
+
+/*!
+  \fn SSSP_GRAPH *SSSPgraphFromSurf(MRI_SURFACE *surf, SSSP_EDGE_COST costfunc, void *parms)
+  \brief Graph of the vertex 1-neighbors. The cost of each edge is
+  costfunc(vno, vno_nbr, parms), or the length of the edge if costfunc
+  is NULL. costfunc is called serially, once per directed edge, so it
+  need not be thread safe. Ripped vertices are kept, since callers
+  such as mris_pmake use ripflag to mark the sources.
+*/
+SSSP_GRAPH *SSSPgraphFromSurf(MRI_SURFACE *surf, SSSP_EDGE_COST costfunc, void *parms)
+{
+  int nedges = 0;
+  for (int vno = 0; vno < surf->nvertices; vno++) nedges += surf->vertices_topology[vno].vnum;
+
+  SSSP_GRAPH *graph = SSSPgraphAlloc(surf->nvertices, nedges);
+  int k = 0;
+  for (int vno = 0; vno < surf->nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &surf->vertices_topology[vno];
+    VERTEX const * const v = &surf->vertices[vno];
+    graph->rowptr[vno] = k;
+    for (int n = 0; n < vt->vnum; n++) {
+      int const vno_nbr = vt->v[n];
+      graph->col[k] = vno_nbr;
+      if (costfunc)
+        graph->cost[k] = costfunc(vno, vno_nbr, parms);
+      else {
+        VERTEX const * const vn = &surf->vertices[vno_nbr];
+        graph->cost[k] = sqrt(SQR(v->x - vn->x) + SQR(v->y - vn->y) + SQR(v->z - vn->z));
+      }
+      k++;
+    }
+  }
+  graph->rowptr[surf->nvertices] = k;
+  return (graph);
+}
+
+typedef struct
+{
+  int node, from;
+  float dist;
+} SSSP_REQUEST;
+
+/*
+  Relax the edges of the listed nodes, the light ones (cost <= delta)
+  or the heavy ones. The threads only read dist and pred and collect
+  the improvements; they are applied serially afterwards, in thread
+  order, which leaves the same result whatever the order.
+*/
+static void ssspRelax(const SSSP_GRAPH *graph, const std::vector<int> &list, bool light, float delta, float maxcost,
+                      const float *dist, const int *pred, std::vector<std::vector<SSSP_REQUEST> > &requests)
+{
+  int i;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(static)
+#endif
+  for (i = 0; i < (int)list.size(); i++) {
+    ROMP_PFLB_begin
+#ifdef HAVE_OPENMP
+    std::vector<SSSP_REQUEST> &mine = requests[omp_get_thread_num()];
+#else
+    std::vector<SSSP_REQUEST> &mine = requests[0];
+#endif
+    int const u = list[i];
+    float const du = dist[u];
+    for (int e = graph->rowptr[u]; e < graph->rowptr[u + 1]; e++) {
+      float const w = graph->cost[e];
+      if ((w <= delta) != light) continue;
+      float const nd = du + w;
+      if (nd > maxcost) continue;
+      int const v = graph->col[e];
+      if (nd < dist[v] || (pred && nd == dist[v] && w > 0 && u < pred[v])) {
+        SSSP_REQUEST r = {v, u, nd};
+        mine.push_back(r);
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+/*
+  Apply the improvements collected by ssspRelax() and file the improved
+  nodes in the bucket of their new cost. Ties go to the lowest numbered
+  predecessor, over edges of non-zero cost only so that the
+  predecessors cannot form a cycle.
+*/
+static void ssspApply(std::vector<std::vector<SSSP_REQUEST> > &requests, float delta, float *dist, int *pred,
+                      std::vector<std::vector<int> > &buckets)
+{
+  for (size_t t = 0; t < requests.size(); t++) {
+    for (size_t i = 0; i < requests[t].size(); i++) {
+      SSSP_REQUEST const &r = requests[t][i];
+      if (r.dist < dist[r.node]) {
+        dist[r.node] = r.dist;
+        if (pred) pred[r.node] = r.from;
+        size_t const nb = (size_t)(r.dist / delta);
+        if (nb >= buckets.size()) buckets.resize(nb + 1);
+        buckets[nb].push_back(r.node);
+      }
+      else if (pred && r.dist == dist[r.node] && r.dist > dist[r.from] && r.from < pred[r.node])
+        pred[r.node] = r.from;
+    }
+    requests[t].clear();
+  }
+}
+
+/*!
+  \fn int SSSPsolve(const SSSP_GRAPH *graph, const int *sources, int nsources, float maxcost, float *dist, int *pred)
+  \brief Cost from the nearest source to every node, by delta-stepping
+  with delta the mean edge cost. Paths costing more than maxcost are
+  not followed (maxcost <= 0 for no limit). Nodes not reached get
+  SSSP_UNREACHED. If pred is not NULL it gets the previous node on the
+  path, or -1 for the sources and the nodes not reached. Returns the
+  number of nodes reached.
+*/
+int SSSPsolve(const SSSP_GRAPH *graph, const int *sources, int nsources, float maxcost, float *dist, int *pred)
+{
+  int const nnodes = graph->nnodes;
+  if (maxcost <= 0) maxcost = SSSP_UNREACHED;
+
+  for (int n = 0; n < nnodes; n++) dist[n] = SSSP_UNREACHED;
+  if (pred)
+    for (int n = 0; n < nnodes; n++) pred[n] = -1;
+
+  int const nedges = graph->rowptr[nnodes];
+  double sum = 0;
+  for (int e = 0; e < nedges; e++) sum += graph->cost[e];
+  float delta = nedges > 0 ? sum / nedges : 1;
+  if (delta <= 0) delta = 1;
+
+  std::vector<std::vector<int> > buckets(1);
+  for (int i = 0; i < nsources; i++) {
+    dist[sources[i]] = 0;
+    buckets[0].push_back(sources[i]);
+  }
+
+  int nthreads = 1;
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  std::vector<std::vector<SSSP_REQUEST> > requests(nthreads);
+  std::vector<int> frontier, settled;
+  std::vector<int> inFrontier(nnodes, -1), inSettled(nnodes, -1);
+  int phase = 0, round = 0;
+
+  for (size_t b = 0; b < buckets.size(); b++) {
+    while (!buckets[b].empty()) {
+      while (!buckets[b].empty()) {
+        // nodes whose cost still falls in this bucket, once each
+        frontier.clear();
+        for (size_t i = 0; i < buckets[b].size(); i++) {
+          int const n = buckets[b][i];
+          if ((size_t)(dist[n] / delta) != b || inFrontier[n] == phase) continue;
+          inFrontier[n] = phase;
+          frontier.push_back(n);
+          if (inSettled[n] != round) {
+            inSettled[n] = round;
+            settled.push_back(n);
+          }
+        }
+        buckets[b].clear();
+        phase++;
+
+        ssspRelax(graph, frontier, true, delta, maxcost, dist, pred, requests);
+        ssspApply(requests, delta, dist, pred, buckets);
+      }
+
+      // the costs in this bucket are final, so the heavy edges need
+      // relaxing once; the loop only repeats if rounding puts one of
+      // the results back in this bucket
+      ssspRelax(graph, settled, false, delta, maxcost, dist, pred, requests);
+      ssspApply(requests, delta, dist, pred, buckets);
+      settled.clear();
+      round++;
+    }
+  }
+
+  int nreached = 0;
+  for (int n = 0; n < nnodes; n++)
+    if (dist[n] != SSSP_UNREACHED) nreached++;
+
+  return (nreached);
+}
+
+/*!
+  \fn int SSSPsolveEach(const SSSP_GRAPH *graph, const int *sources, int nsources, float maxcost, SSSP_VISIT visit, void *parms)
+  \brief A separate search from each source, out to maxcost (<= 0 for no
+  limit), with the sources shared among the threads. Each thread keeps
+  its own cost array and resets only what it touched, so a search costs
+  in proportion to its neighborhood rather than to the surface. The
+  result of each search is passed to visit(). Returns 0.
+*/
+int SSSPsolveEach(const SSSP_GRAPH *graph, const int *sources, int nsources, float maxcost,
+                  SSSP_VISIT visit, void *parms)
+{
+  typedef std::pair<float, int> Entry;
+  int const nnodes = graph->nnodes;
+  if (maxcost <= 0) maxcost = SSSP_UNREACHED;
+
+  int nthreads = 1;
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  std::vector<std::vector<float> > dists(nthreads);
+
+  int nth;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 16)
+#endif
+  for (nth = 0; nth < nsources; nth++) {
+    ROMP_PFLB_begin
+#ifdef HAVE_OPENMP
+    std::vector<float> &dist = dists[omp_get_thread_num()];
+#else
+    std::vector<float> &dist = dists[0];
+#endif
+    if (dist.empty()) dist.assign(nnodes, SSSP_UNREACHED);
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+    std::vector<int> node, touched;
+    std::vector<float> cost;
+
+    int const source = sources[nth];
+    dist[source] = 0;
+    touched.push_back(source);
+    heap.push(Entry(0, source));
+    while (!heap.empty()) {
+      Entry const top = heap.top();
+      heap.pop();
+      int const u = top.second;
+      if (top.first > dist[u]) continue;
+      node.push_back(u);
+      cost.push_back(top.first);
+      for (int e = graph->rowptr[u]; e < graph->rowptr[u + 1]; e++) {
+        float const nd = top.first + graph->cost[e];
+        int const v = graph->col[e];
+        if (nd > maxcost || nd >= dist[v]) continue;
+        if (dist[v] == SSSP_UNREACHED) touched.push_back(v);
+        dist[v] = nd;
+        heap.push(Entry(nd, v));
+      }
+    }
+
+    visit(nth, source, node.size(), node.size() ? &node[0] : NULL, cost.size() ? &cost[0] : NULL, parms);
+
+    for (size_t i = 0; i < touched.size(); i++) dist[touched[i]] = SSSP_UNREACHED;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  return (0);
+}
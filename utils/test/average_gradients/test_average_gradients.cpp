@@ -0,0 +1,81 @@
+//
+// equivalence check for the fused averaging passes in MRISaverageGradients()
+// (mrisurf_metricProperties.cpp), which are used from 32 passes up. On an
+// icosahedron big enough to be split into several blocks, with a ripped cap,
+// averaging the gradient num_avgs times in one call must give, bit for bit,
+// what num_avgs calls of one unfused pass each give, for a multiple of the
+// passes per exchange, for a number that is not, and for the largest number
+// the deformation code uses.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "error.h"
+#include "icosahedron.h"
+#include "mrisurf.h"
+
+const char *Progname = "test_average_gradients";
+
+static void setGradients(MRIS *mris)
+{
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    v->dx = sin(0.37 * vno) + 0.01 * v->x;
+    v->dy = cos(0.11 * vno) - 0.02 * v->z;
+    v->dz = (vno % 13) - 6.0;
+    // a ripped cap, so some vertices keep their values and some lose neighbors
+    v->ripflag = (v->z > 0.9 * mris->radius);
+  }
+}
+
+static int compareAveraging(int num_avgs)
+{
+  MRIS *fused = ic10242_make_surface(0, 0);
+  MRIS *unfused = ic10242_make_surface(0, 0);
+  setGradients(fused);
+  setGradients(unfused);
+
+  MRISaverageGradients(fused, num_avgs);
+  for (int n = 0; n < num_avgs; n++) MRISaverageGradients(unfused, 1);
+
+  int nerrors = 0, nchanged = 0;
+  for (int vno = 0; vno < fused->nvertices; vno++) {
+    VERTEX const *vf = &fused->vertices[vno], *vu = &unfused->vertices[vno];
+    if (vf->dx != vu->dx || vf->dy != vu->dy || vf->dz != vu->dz) {
+      if (nerrors++ < 5)
+        std::cerr << num_avgs << " passes: vertex " << vno << " fused (" << vf->dx << ", " << vf->dy << ", " << vf->dz
+                  << "), unfused (" << vu->dx << ", " << vu->dy << ", " << vu->dz << ")" << std::endl;
+    }
+    if (vf->dz != (vno % 13) - 6.0) nchanged++;
+  }
+  if (nchanged == 0) {
+    std::cerr << num_avgs << " passes: nothing was averaged" << std::endl;
+    nerrors++;
+  }
+  if (nerrors) std::cerr << num_avgs << " passes: " << nerrors << " vertices differ" << std::endl;
+
+  MRISfree(&fused);
+  MRISfree(&unfused);
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  // without OpenMP the fast smoother would be used instead
+  setenv("USE_FAST_SURF_SMOOTHER", "0", 1);
+
+  int nerrors = 0;
+  nerrors += compareAveraging(32);
+  nerrors += compareAveraging(37);
+  nerrors += compareAveraging(1024);
+
+  if (nerrors) {
+    std::cerr << "ERROR: the fused averaging differs from the unfused passes" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
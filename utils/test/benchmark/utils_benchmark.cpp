@@ -0,0 +1,415 @@
+//
+// Benchmarks for the core kernels of the utils library. All inputs are
+// synthetic and built in memory (volumes of a given size and type,
+// icosahedral spheres, a random GCA-like atlas), so no test data or network
+// is needed. Results are written as JSON, eg for tracking nightly runs:
+//
+//   utils_benchmark --size 128 --type float --ico 6 --repeat 5 --json out.json
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "diag.h"
+#include "macros.h"
+#include "mri.h"
+#include "mri2.h"
+#include "mrisurf.h"
+#include "mrishash.h"
+#include "icosahedron.h"
+#include "gca.h"
+#include "transform.h"
+#include "matrix.h"
+#include "label.h"
+#include "timer.h"
+#include "version.h"
+#include "romp_support.h"
+
+const char *Progname = "utils_benchmark";
+
+struct Result {
+  std::string name, params;
+  std::vector<double> msec;
+};
+
+static int size = 128, type = MRI_FLOAT, icoorder = 6, repeat = 3, nthreads = 1;
+static const char *jsonfile = NULL, *only = NULL, *tmpdir = NULL;
+static std::vector<Result> results;
+
+static void print_usage(void)
+{
+  printf("USAGE: %s [options]\n\n", Progname);
+  printf("   --size N      : volumes are N^3 voxels (default %d)\n", size);
+  printf("   --type t      : volume type, uchar, short, int or float (default float)\n");
+  printf("   --ico order   : icosahedral sphere order 0-7 (default %d)\n", icoorder);
+  printf("   --repeat R    : time each kernel R times (default %d)\n", repeat);
+  printf("   --threads n   : number of OpenMP threads (default %d)\n", nthreads);
+  printf("   --only name   : only run kernels whose name contains name\n");
+  printf("   --tmpdir dir  : directory for the mgh/mgz files (default $TMPDIR or /tmp)\n");
+  printf("   --json file   : write the results to file as JSON (default stdout)\n");
+  printf("\n");
+}
+
+static bool selected(const char *name) { return only == NULL || strstr(name, only) != NULL; }
+
+// times fn() repeat times; setup() is run (untimed) before each repetition
+template <class Setup, class Fn>
+static void bench(const char *name, const std::string &params, Setup setup, Fn fn)
+{
+  if (!selected(name)) return;
+  Result r;
+  r.name = name;
+  r.params = params;
+  for (int n = 0; n < repeat; n++) {
+    setup();
+    Timer timer;
+    fn();
+    r.msec.push_back(timer.nanoseconds() / 1.0e6);
+  }
+  std::vector<double> sorted = r.msec;
+  std::sort(sorted.begin(), sorted.end());
+  fprintf(stderr, "%-34s %-28s min %10.3f  median %10.3f msec\n", name, params.c_str(), sorted[0],
+          sorted[sorted.size() / 2]);
+  results.push_back(r);
+}
+
+template <class Fn>
+static void bench(const char *name, const std::string &params, Fn fn)
+{
+  bench(name, params, [] {}, fn);
+}
+
+static MRI *makeVolume(int width, int height, int depth, int mritype, int nframes)
+{
+  MRI *mri = MRIallocSequence(width, height, depth, mritype, nframes);
+  for (int f = 0; f < nframes; f++)
+    for (int z = 0; z < depth; z++)
+      for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+          MRIsetVoxVal(mri, x, y, z, f, (float)(rand() % 200) + (mritype == MRI_FLOAT ? drand48() : 0));
+  return (mri);
+}
+
+static MRIS *makeIco(int order)
+{
+  switch (order) {
+    case 0: return (ic12_make_surface(0, 0));
+    case 1: return (ic42_make_surface(0, 0));
+    case 2: return (ic162_make_surface(0, 0));
+    case 3: return (ic642_make_surface(0, 0));
+    case 4: return (ic2562_make_surface(0, 0));
+    case 5: return (ic10242_make_surface(0, 0));
+    case 6: return (ic40962_make_surface(0, 0));
+    default: return (ic163842_make_surface(0, 0));
+  }
+}
+
+static std::string sizeParams(int n, const char *extra = "")
+{
+  char tmp[STRLEN];
+  sprintf(tmp, "%dx%dx%d %s%s", n, n, n, type == MRI_UCHAR ? "uchar" : type == MRI_SHORT ? "short" :
+          type == MRI_INT ? "int" : "float", extra);
+  return (tmp);
+}
+
+/*---------------------------------------------------------------*/
+static void benchVolumes(void)
+{
+  MRI *src = makeVolume(size, size, size, type, 1);
+  MRI *dst = NULL;
+
+  // 1d gaussian along each axis
+  float kernel[7];
+  float ksum = 0;
+  for (int i = 0; i < 7; i++) ksum += (kernel[i] = exp(-(i - 3) * (i - 3) / 4.0));
+  for (int i = 0; i < 7; i++) kernel[i] /= ksum;
+  const int axes[3] = {MRI_WIDTH, MRI_HEIGHT, MRI_DEPTH};
+  const char *axisname[3] = {" width", " height", " depth"};
+  for (int a = 0; a < 3; a++)
+    bench("MRIconvolve1d", sizeParams(size, axisname[a]), [&] {
+      dst = MRIconvolve1d(src, dst, kernel, 7, axes[a], 0, 0);
+    });
+  if (dst) MRIfree(&dst);
+
+  // small rotation and shift
+  MRI *targ = MRIallocSequence(size, size, size, MRI_FLOAT, 1);
+  MATRIX *Vt2s = MatrixIdentity(4, NULL);
+  const double c = cos(0.1), s = sin(0.1);
+  *MATRIX_RELT(Vt2s, 1, 1) = c;
+  *MATRIX_RELT(Vt2s, 1, 2) = -s;
+  *MATRIX_RELT(Vt2s, 2, 1) = s;
+  *MATRIX_RELT(Vt2s, 2, 2) = c;
+  *MATRIX_RELT(Vt2s, 1, 4) = 0.3;
+  *MATRIX_RELT(Vt2s, 2, 4) = -0.7;
+  *MATRIX_RELT(Vt2s, 3, 4) = 1.1;
+  bench("MRIvol2Vol", sizeParams(size, " nearest"), [&] { MRIvol2Vol(src, targ, Vt2s, SAMPLE_NEAREST, 0); });
+  bench("MRIvol2Vol", sizeParams(size, " trilinear"), [&] { MRIvol2Vol(src, targ, Vt2s, SAMPLE_TRILINEAR, 0); });
+  MatrixFree(&Vt2s);
+  MRIfree(&targ);
+
+  // segmentation with 64 blocky labels
+  const int nsegs = 64;
+  MRI *seg = MRIalloc(size, size, size, MRI_INT);
+  for (int z = 0; z < size; z++)
+    for (int y = 0; y < size; y++)
+      for (int x = 0; x < size; x++)
+        MRIsetVoxVal(seg, x, y, z, 0, 1 + ((x / 16) + 4 * (y / 16) + 16 * (z / 16)) % nsegs);
+  bench("MRIsegStats", sizeParams(size, " 64 segs"), [&] {
+    float min, max, range, mean, std;
+    for (int segid = 1; segid <= nsegs; segid++) MRIsegStats(seg, segid, src, 0, &min, &max, &range, &mean, &std);
+  });
+  bench("MRIsegIdList", sizeParams(size), [&] {
+    int nlist;
+    int *list = MRIsegIdList(seg, &nlist, 0);
+    free(list);
+  });
+  MRIfree(&seg);
+
+  // file i/o
+  std::string base = std::string(tmpdir) + "/utils_benchmark." + std::to_string((long)getpid());
+  const char *exts[2] = {".mgh", ".mgz"};
+  for (int e = 0; e < 2; e++) {
+    std::string fname = base + exts[e];
+    bench("mghWrite", sizeParams(size, exts[e]), [&] { mghWrite(src, fname.c_str()); });
+    bench("mghRead", sizeParams(size, exts[e]), [&] {
+      MRI *mri = mghRead(fname.c_str());
+      if (mri) MRIfree(&mri);
+    });
+    unlink(fname.c_str());
+  }
+
+  MRIfree(&src);
+}
+
+/*---------------------------------------------------------------*/
+static void benchSurfaces(void)
+{
+  MRIS *mris = makeIco(icoorder);
+  char params[STRLEN];
+  sprintf(params, "ic%d %d vertices", icoorder, mris->nvertices);
+
+  // the ico surfaces are unit spheres, make them brain sized
+  MRISscaleBrain(mris, mris, 100);
+
+  bench("MRIScomputeMetricProperties", params, [&] { MRIScomputeMetricProperties(mris); });
+
+  MRI *vals = makeVolume(mris->nvertices, 1, 1, MRI_FLOAT, 10);
+  MRI *smoothed = NULL;
+  bench("MRISsmoothMRI", std::string(params) + " 10 frames 10 steps",
+        [&] { smoothed = MRISsmoothMRI(mris, vals, 10, NULL, smoothed); });
+  if (smoothed) MRIfree(&smoothed);
+  MRIfree(&vals);
+
+  // closest vertex to random points near the sphere
+  const int npoints = 100000;
+  std::vector<float> pts(3 * npoints);
+  for (int n = 0; n < npoints; n++) {
+    double x = drand48() - 0.5, y = drand48() - 0.5, z = drand48() - 0.5;
+    const double r = (95 + 10 * drand48()) / sqrt(x * x + y * y + z * z + 1e-12);
+    pts[3 * n] = x * r;
+    pts[3 * n + 1] = y * r;
+    pts[3 * n + 2] = z * r;
+  }
+  MRIS_HASH_TABLE *mht = NULL;
+  bench("MHTcreateVertexTable_Resolution", params, [&] {
+    if (mht) MHTfree(&mht);
+    mht = MHTcreateVertexTable_Resolution(mris, CURRENT_VERTICES, 2.0);
+  });
+  if (mht == NULL) mht = MHTcreateVertexTable_Resolution(mris, CURRENT_VERTICES, 2.0);
+  bench("MHTfindClosestVertex", std::string(params) + " 100000 points", [&] {
+    float dist;
+    for (int n = 0; n < npoints; n++) MHTfindClosestVertexNoXYZ(mht, mris, pts[3 * n], pts[3 * n + 1], pts[3 * n + 2], &dist);
+  });
+  MHTfree(&mht);
+
+  // a polar cap label, dilated and eroded
+  LABEL *cap = LabelAlloc(mris->nvertices, NULL, "cap");
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const *v = &mris->vertices[vno];
+    if (v->z < 50) continue;
+    LV *lv = &cap->lv[cap->n_points++];
+    lv->vno = vno;
+    lv->x = v->x;
+    lv->y = v->y;
+    lv->z = v->z;
+  }
+  LABEL *area = NULL;
+  bench("LabelDilate/LabelErode", std::string(params) + " 4 steps",
+        [&] {
+          if (area) LabelFree(&area);
+          area = LabelCopy(cap, NULL);
+        },
+        [&] {
+          LabelDilate(area, mris, 4, CURRENT_VERTICES);
+          LabelErode(area, mris, 4);
+        });
+  if (area) LabelFree(&area);
+  LabelFree(&cap);
+
+  MRISfree(&mris);
+}
+
+/*---------------------------------------------------------------*/
+static void benchAtlas(void)
+{
+  const int nlabels = 20, nsamples = 20000;
+  GCA *gca = GCAalloc(1, 2.0, 4.0, size, size, size, GCA_NO_FLAGS);
+
+  // random priors at each prior location
+  for (int x = 0; x < gca->prior_width; x++)
+    for (int y = 0; y < gca->prior_height; y++)
+      for (int z = 0; z < gca->prior_depth; z++) {
+        GCA_PRIOR *gcap = &gca->priors[x][y][z];
+        gcap->nlabels = MIN(gcap->max_labels, 3);
+        for (int n = 0; n < gcap->nlabels; n++) {
+          gcap->labels[n] = 1 + rand() % nlabels;
+          gcap->priors[n] = 1.0 / gcap->nlabels;
+        }
+      }
+
+  // samples at random prior locations with random label densities
+  GCA_SAMPLE *gcas = (GCA_SAMPLE *)calloc(nsamples, sizeof(GCA_SAMPLE));
+  for (int i = 0; i < nsamples; i++) {
+    gcas[i].xp = rand() % gca->prior_width;
+    gcas[i].yp = rand() % gca->prior_height;
+    gcas[i].zp = rand() % gca->prior_depth;
+    gcas[i].label = 1 + rand() % nlabels;
+    gcas_setPrior(gcas[i], 0.05 + 0.9 * drand48());
+    gcas[i].means = (float *)calloc(1, sizeof(float));
+    gcas[i].covars = (float *)calloc(1, sizeof(float));
+    gcas[i].means[0] = rand() % 200;
+    gcas[i].covars[0] = 25 + rand() % 100;
+  }
+
+  MRI *inputs = makeVolume(size, size, size, type, 1);
+  TRANSFORM *transform = TransformAlloc(LINEAR_VOX_TO_VOX, inputs);
+  char params[STRLEN];
+  sprintf(params, " %d samples", nsamples);
+  bench("GCAcomputeLogSampleProbability", sizeParams(size, params),
+        [&] { GCAcomputeLogSampleProbability(gca, gcas, inputs, transform, nsamples, DEFAULT_CLAMP); });
+
+  TransformFree(&transform);
+  MRIfree(&inputs);
+  for (int i = 0; i < nsamples; i++) {
+    free(gcas[i].means);
+    free(gcas[i].covars);
+  }
+  free(gcas);
+  GCAfree(&gca);
+}
+
+/*---------------------------------------------------------------*/
+static void benchMatrices(void)
+{
+  const int rows = 20 * size, cols = 2 * size;
+  MATRIX *m = MatrixAlloc(rows, cols, MATRIX_REAL);
+  for (int r = 1; r <= rows; r++)
+    for (int c = 1; c <= cols; c++) *MATRIX_RELT(m, r, c) = drand48();
+  MATRIX *mtm = NULL;
+  char params[STRLEN];
+  sprintf(params, "%dx%d", rows, cols);
+  bench("MatrixMtM", params, [&] { mtm = MatrixMtM(m, mtm); });
+  MatrixFree(&mtm);
+  MatrixFree(&m);
+}
+
+/*---------------------------------------------------------------*/
+static void writeJson(FILE *fp)
+{
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"program\": \"%s\",\n", Progname);
+  fprintf(fp, "  \"version\": \"%s\",\n", getVersion().c_str());
+  fprintf(fp, "  \"threads\": %d,\n", nthreads);
+  fprintf(fp, "  \"repeat\": %d,\n", repeat);
+  fprintf(fp, "  \"results\": [\n");
+  for (unsigned int n = 0; n < results.size(); n++) {
+    const Result &r = results[n];
+    std::vector<double> sorted = r.msec;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0;
+    for (double t : sorted) mean += t;
+    mean /= sorted.size();
+    fprintf(fp, "    {\"name\": \"%s\", \"params\": \"%s\", \"min_ms\": %.4f, \"median_ms\": %.4f, "
+            "\"mean_ms\": %.4f, \"max_ms\": %.4f, \"ms\": [",
+            r.name.c_str(), r.params.c_str(), sorted[0], sorted[sorted.size() / 2], mean, sorted.back());
+    for (unsigned int k = 0; k < r.msec.size(); k++) fprintf(fp, "%s%.4f", k ? ", " : "", r.msec[k]);
+    fprintf(fp, "]}%s\n", n + 1 < results.size() ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++) {
+    const bool more = i + 1 < argc;
+    if (!strcmp(argv[i], "--help")) {
+      print_usage();
+      exit(0);
+    }
+    else if (!strcmp(argv[i], "--size") && more) size = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--ico") && more) icoorder = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--repeat") && more) repeat = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && more) nthreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--only") && more) only = argv[++i];
+    else if (!strcmp(argv[i], "--tmpdir") && more) tmpdir = argv[++i];
+    else if (!strcmp(argv[i], "--json") && more) jsonfile = argv[++i];
+    else if (!strcmp(argv[i], "--type") && more) {
+      i++;
+      if (!strcmp(argv[i], "uchar")) type = MRI_UCHAR;
+      else if (!strcmp(argv[i], "short")) type = MRI_SHORT;
+      else if (!strcmp(argv[i], "int")) type = MRI_INT;
+      else if (!strcmp(argv[i], "float")) type = MRI_FLOAT;
+      else {
+        printf("ERROR: unknown type %s\n", argv[i]);
+        exit(1);
+      }
+    }
+    else {
+      printf("ERROR: unknown or incomplete option %s\n", argv[i]);
+      print_usage();
+      exit(1);
+    }
+  }
+  if (size < 16 || icoorder < 0 || icoorder > 7 || repeat < 1 || nthreads < 1) {
+    printf("ERROR: need --size >= 16, --ico 0-7, --repeat >= 1 and --threads >= 1\n");
+    exit(1);
+  }
+  if (tmpdir == NULL) tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL) tmpdir = "/tmp";
+
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(nthreads);
+#endif
+
+  // same inputs on every run
+  srand(1234);
+  srand48(1234);
+
+  benchVolumes();
+  benchSurfaces();
+  benchAtlas();
+  benchMatrices();
+
+  if (jsonfile) {
+    FILE *fp = fopen(jsonfile, "w");
+    if (fp == NULL) {
+      printf("ERROR: could not open %s\n", jsonfile);
+      exit(1);
+    }
+    writeJson(fp);
+    fclose(fp);
+  }
+  else
+    writeJson(stdout);
+
+  exit(0);
+}
@@ -0,0 +1,135 @@
+//
+// consistency check for the reentrant cluster labeling (clusterlabel.h).
+// Random maps are clustered with clustGetClusters()/sclustMapSurfClusters()
+// and with clustLabelGraph(), which must find the same clusters, also when
+// many threads label against the same graph at once.
+//
+
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "clusterlabel.h"
+#include "error.h"
+#include "icosahedron.h"
+#include "romp_support.h"
+#include "surfcluster.h"
+#include "volcluster.h"
+
+const char *Progname = "test_clusterlabel";
+
+// cluster sizes sorted, for comparing clusterings with different numbering
+static std::vector<double> sortedSizes(const CLUSTER_WORKSPACE *work)
+{
+  std::vector<double> sizes;
+  for (int k = 0; k < work->nclusters; k++) sizes.push_back(work->clusters[k].size);
+  std::sort(sizes.begin(), sizes.end());
+  return (sizes);
+}
+
+static int compareSizes(const char *what, std::vector<double> ref, const std::vector<double> &sizes)
+{
+  std::sort(ref.begin(), ref.end());
+  if (ref.size() != sizes.size()) {
+    std::cerr << what << ": " << ref.size() << " clusters, clustLabelGraph found " << sizes.size() << std::endl;
+    return (1);
+  }
+  for (unsigned int k = 0; k < ref.size(); k++)
+    if (fabs(ref[k] - sizes[k]) > 1e-4 * (1 + ref[k])) {
+      std::cerr << what << ": cluster size " << ref[k] << " vs " << sizes[k] << std::endl;
+      return (1);
+    }
+  return (0);
+}
+
+int main(int argc, char *argv[])
+{
+  int nerrors = 0;
+  srand48(1234);
+
+  // volume with a mask, 6-connectivity and a minimum cluster volume
+  MRI *vol = MRIallocSequence(40, 36, 30, MRI_FLOAT, 1);
+  MRI *mask = MRIalloc(40, 36, 30, MRI_UCHAR);
+  vol->xsize = 1.5;
+  vol->zsize = 2;
+  for (int s = 0; s < vol->depth; s++)
+    for (int r = 0; r < vol->height; r++)
+      for (int c = 0; c < vol->width; c++) {
+        MRIsetVoxVal(vol, c, r, s, 0, 4 * drand48() - 2);
+        MRIsetVoxVal(mask, c, r, s, 0, drand48() < 0.9);
+      }
+
+  CLUSTER_GRAPH *vgraph = clustGraphFromVolume(vol, mask, 0);
+  CLUSTER_WORKSPACE *work = clustWorkspaceAlloc(vgraph);
+  std::vector<float> val(vgraph->nnodes);
+  clustGraphValues(vgraph, vol, 0, &val[0]);
+  for (int thsign = -1; thsign <= 1; thsign++) {
+    int nclusters;
+    VOLCLUSTER **vclist = clustGetClusters(vol, 0, 1.0, -1, thsign, 4.0, mask, &nclusters, NULL);
+    std::vector<double> ref;
+    for (int k = 0; k < nclusters; k++) ref.push_back(vclist[k]->nmembers * vclist[k]->voxsize);
+    clustFreeClusterList(&vclist, nclusters);
+    clustLabelGraph(vgraph, &val[0], 1.0, -1, thsign, 4.0, work);
+    nerrors += compareSizes("volume", ref, sortedSizes(work));
+  }
+  clustWorkspaceFree(&work);
+
+  // surface
+  MRIS *surf = ic2562_make_surface(0, 0);
+  MRISscaleBrain(surf, surf, 100);
+  MRIScomputeMetricProperties(surf);
+  MRI *map = MRIallocSequence(surf->nvertices, 1, 1, MRI_FLOAT, 1);
+  for (int vno = 0; vno < surf->nvertices; vno++) {
+    float v = 4 * drand48() - 2;
+    MRIsetVoxVal(map, vno, 0, 0, 0, v);
+    surf->vertices[vno].val = v;
+  }
+  CLUSTER_GRAPH *sgraph = clustGraphFromSurf(surf);
+  std::vector<float> sval(sgraph->nnodes);
+  clustGraphValues(sgraph, map, 0, &sval[0]);
+  std::vector<double> sref;
+  {
+    int nclusters;
+    SCS *scs = sclustMapSurfClusters(surf, 1.0, -1, 0, 0, &nclusters, NULL, NULL);
+    for (int k = 0; k < nclusters; k++) sref.push_back(scs[k].area);
+    free(scs);
+  }
+  work = clustWorkspaceAlloc(sgraph);
+  clustLabelGraph(sgraph, &sval[0], 1.0, -1, 0, 0, work);
+  nerrors += compareSizes("surface", sref, sortedSizes(work));
+  std::vector<double> ssizes = sortedSizes(work);
+  clustWorkspaceFree(&work);
+
+  // concurrent labeling with one workspace per thread
+  int nthreaderrors = 0;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) reduction(+ : nthreaderrors)
+#endif
+  for (int n = 0; n < 32; n++) {
+    ROMP_PFLB_begin
+    CLUSTER_WORKSPACE *w = clustWorkspaceAlloc(sgraph);
+    clustLabelGraph(sgraph, &sval[0], 1.0, -1, 0, 0, w);
+    if (sortedSizes(w) != ssizes) nthreaderrors++;
+    clustWorkspaceFree(&w);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+  nerrors += nthreaderrors;
+
+  clustGraphFree(&vgraph);
+  clustGraphFree(&sgraph);
+  MRIfree(&vol);
+  MRIfree(&mask);
+  MRIfree(&map);
+  MRISfree(&surf);
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " mismatches between clustLabelGraph and the reference clustering" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
@@ -0,0 +1,89 @@
+//
+// consistency check for the exact distance transform in mri_fastmarching.cpp.
+// On a synthetic volume holding a ball and a box, MRIextractDistanceMapEDT()
+// must agree with the fast marching MRIextractDistanceMap() in every mode,
+// within the error of the marching front, which overestimates the distance
+// off the grid axes.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "error.h"
+#include "fastmarching.h"
+#include "mri.h"
+
+const char *Progname = "test_fastmarching";
+
+#define WIDTH        48
+#define MAX_DISTANCE 8.0f
+
+// the marching front overestimates by a few percent of the distance, and a
+// voxel next to the boundary can be off by up to half a voxel
+#define DIFF_ABS     0.6f
+#define DIFF_REL     0.1f
+#define MEAN_DIFF    0.35f
+
+static MRI *makeLabels(int label)
+{
+  MRI *mri = MRIalloc(WIDTH, WIDTH, WIDTH, MRI_UCHAR);
+  for (int z = 0; z < WIDTH; z++)
+    for (int y = 0; y < WIDTH; y++)
+      for (int x = 0; x < WIDTH; x++) {
+        bool const ball = (x - 14) * (x - 14) + (y - 16) * (y - 16) + (z - 20) * (z - 20) <= 81;
+        bool const box = x >= 28 && x <= 37 && y >= 24 && y <= 39 && z >= 12 && z <= 33;
+        MRIsetVoxVal(mri, x, y, z, 0, ball || box ? label : 0);
+      }
+  return (mri);
+}
+
+static int compareModes(MRI *mri_labels, int label, int mode)
+{
+  MRI *mri_fm = MRIextractDistanceMap(mri_labels, NULL, label, MAX_DISTANCE, mode, NULL);
+  MRI *mri_edt = MRIextractDistanceMapEDT(mri_labels, NULL, label, MAX_DISTANCE, mode, NULL);
+
+  int nerrors = 0, nvox = 0;
+  double sum = 0, max_diff = 0;
+  for (int z = 0; z < WIDTH; z++)
+    for (int y = 0; y < WIDTH; y++)
+      for (int x = 0; x < WIDTH; x++) {
+        float const fm = MRIgetVoxVal(mri_fm, x, y, z, 0);
+        float const edt = MRIgetVoxVal(mri_edt, x, y, z, 0);
+        // both are clamped at the limit, the marching front a little sooner
+        if (fabs(edt) >= MAX_DISTANCE - 1 || (fm == 0 && edt == 0)) continue;
+        double const diff = fabs(fm - edt);
+        if (diff > DIFF_ABS + DIFF_REL * fabs(edt) || fm * edt < 0) nerrors++;
+        sum += diff;
+        max_diff = MAX(max_diff, diff);
+        nvox++;
+      }
+  double const mean_diff = nvox ? sum / nvox : 0;
+  std::cout << "mode " << mode << ": " << nvox << " voxels, mean difference " << mean_diff
+            << ", max difference " << max_diff << std::endl;
+  if (nvox == 0 || mean_diff > MEAN_DIFF) nerrors++;
+  if (nerrors) std::cerr << "mode " << mode << ": " << nerrors << " voxels differ" << std::endl;
+
+  MRIfree(&mri_fm);
+  MRIfree(&mri_edt);
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  int const label = 17;
+  MRI *mri_labels = makeLabels(label);
+
+  int nerrors = 0;
+  for (int mode = 1; mode <= 4; mode++) nerrors += compareModes(mri_labels, label, mode);
+
+  MRIfree(&mri_labels);
+
+  if (nerrors) {
+    std::cerr << "ERROR: the exact distances differ from fast marching" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
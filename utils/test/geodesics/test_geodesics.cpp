@@ -0,0 +1,134 @@
+//
+// neighborhood check for computeGeodesics() (geodesics.h) on an icosahedral
+// sphere. Every vertex within the limit over the edges must be listed, once,
+// at no more than its distance over the edges and no less than the straight
+// line, the lists must agree both ways, nothing beyond the limit may be
+// listed, and the result must not depend on the number of threads.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <vector>
+
+#include "error.h"
+#include "geodesics.h"
+#include "icosahedron.h"
+#include "mrisurf.h"
+#include "romp_support.h"
+#include "surfsssp.h"
+
+const char *Progname = "test_geodesics";
+
+#define SURF_FNAME "./test_geodesics_surf"
+#define DIST_TOL 1e-3
+
+static float findDist(const Geodesics *g, int vno)
+{
+  for (int n = 0; n < g->vnum; n++)
+    if (g->v[n] == vno) return (g->dist[n]);
+  return (-1);
+}
+
+static int checkNeighborhoods(MRIS *surf, const Geodesics *geo, float maxdist)
+{
+  int const nvertices = surf->nvertices;
+  SSSP_GRAPH *graph = SSSPgraphFromSurf(surf, NULL, NULL);
+  std::vector<float> edgedist(nvertices);
+  std::vector<int> seen(nvertices, -1);
+  int nerrors = 0, nmore = 0;
+
+  for (int k = 0; k < nvertices; k++) {
+    Geodesics const *g = &geo[k];
+    VERTEX const *vk = &surf->vertices[k];
+    SSSPsolve(graph, &k, 1, maxdist, &edgedist[0], NULL);
+
+    for (int n = 0; n < g->vnum; n++) {
+      int const vno = g->v[n];
+      float const d = g->dist[n];
+      if (vno < 0 || vno >= nvertices || vno == k || seen[vno] == k) {
+        nerrors++;
+        continue;
+      }
+      seen[vno] = k;
+      VERTEX const *v = &surf->vertices[vno];
+      float const chord = sqrt(SQR(vk->x - v->x) + SQR(vk->y - v->y) + SQR(vk->z - v->z));
+      if (d > maxdist || d < chord - DIST_TOL) nerrors++;
+      if (edgedist[vno] != SSSP_UNREACHED && d > edgedist[vno] + DIST_TOL) nerrors++;
+      if (edgedist[vno] == SSSP_UNREACHED || d < edgedist[vno] - DIST_TOL) nmore++;
+      if (d <= maxdist - DIST_TOL && fabs(findDist(&geo[vno], k) - d) > DIST_TOL * (1 + d)) nerrors++;
+    }
+    for (int vno = 0; vno < nvertices; vno++)
+      if (vno != k && edgedist[vno] <= maxdist - DIST_TOL && seen[vno] != k) nerrors++;
+  }
+  SSSPgraphFree(&graph);
+
+  // the line-of-sight paths cut across the faces, so some must be shorter than over the edges
+  if (nmore == 0) {
+    std::cerr << "no geodesic is shorter than the path over the edges" << std::endl;
+    nerrors++;
+  }
+  if (nerrors) std::cerr << nerrors << " bad neighbors" << std::endl;
+  return (nerrors);
+}
+
+static int sameGeodesics(const Geodesics *geo1, const Geodesics *geo2, int nvertices)
+{
+  int nerrors = 0;
+  for (int k = 0; k < nvertices; k++) {
+    if (geo1[k].vnum != geo2[k].vnum) {
+      nerrors++;
+      continue;
+    }
+    for (int n = 0; n < geo1[k].vnum; n++)
+      if (geo1[k].v[n] != geo2[k].v[n] || geo1[k].dist[n] != geo2[k].dist[n]) {
+        nerrors++;
+        break;
+      }
+  }
+  if (nerrors) std::cerr << nerrors << " vertices differ between one thread and many" << std::endl;
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  // read back as the tools would get it, with the vertex distances
+  MRIS *ico = ic2562_make_surface(0, 0);
+  MRISwrite(ico, SURF_FNAME);
+  MRISfree(&ico);
+  MRIS *surf = MRISread(SURF_FNAME);
+  if (!surf) exit(1);
+
+  double sum = 0;
+  int nedges = 0;
+  for (int vno = 0; vno < surf->nvertices; vno++) {
+    VERTEX_TOPOLOGY const *vt = &surf->vertices_topology[vno];
+    for (int n = 0; n < vt->vnum; n++) sum += surf->vertices[vno].dist[n];
+    nedges += vt->vnum;
+  }
+  float const maxdist = 4 * sum / nedges;
+
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(1);
+#endif
+  Geodesics *geo1 = computeGeodesics(surf, maxdist);
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(omp_get_num_procs() > 1 ? omp_get_num_procs() : 4);
+#endif
+  Geodesics *geoN = computeGeodesics(surf, maxdist);
+
+  int nerrors = checkNeighborhoods(surf, geo1, maxdist);
+  nerrors += sameGeodesics(geo1, geoN, surf->nvertices);
+
+  free(geo1);
+  free(geoN);
+  MRISfree(&surf);
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " errors in the geodesic neighborhoods" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
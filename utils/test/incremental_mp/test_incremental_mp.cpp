@@ -0,0 +1,136 @@
+//
+// equivalence check for the incremental MRIScomputeMetricProperties in
+// utils/mrisurf_metricProperties_incremental.cpp. Two copies of a surface have
+// the same few vertices moved, step after step. One is updated incrementally,
+// the other by the full computation, and the faces, vertex normals, areas,
+// distance lists and totals must agree, on a surface and on a sphere.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "error.h"
+#include "icosahedron.h"
+#include "mrisurf.h"
+#include "mrisurf_metricProperties.h"
+
+const char *Progname = "test_incremental_mp";
+
+#define SURF_FNAME "./test_incremental_mp_surf"
+#define NSTEPS     6
+#define NMOVED     25
+
+// the per-element values are computed the same way, the totals are summed in another order
+#define ELT_TOL    1e-5
+#define TOTAL_TOL  1e-4
+
+static int differ(double a, double b, double tol) { return (fabs(a - b) > tol * (1 + fabs(b))); }
+
+static int compareSurfaces(const char *what, MRIS *inc, MRIS *full)
+{
+  int nerrors = 0;
+
+  for (int fno = 0; fno < full->nfaces; fno++) {
+    FACE const *fi = &inc->faces[fno], *ff = &full->faces[fno];
+    FaceNormCacheEntry const *ni = getFaceNorm(inc, fno), *nf = getFaceNorm(full, fno);
+    int bad = differ(fi->area, ff->area, ELT_TOL) || differ(ni->nx, nf->nx, ELT_TOL) ||
+              differ(ni->ny, nf->ny, ELT_TOL) || differ(ni->nz, nf->nz, ELT_TOL);
+    for (int n = 0; n < ANGLES_PER_TRIANGLE; n++) bad |= differ(fi->angle[n], ff->angle[n], ELT_TOL);
+    if (bad) nerrors++;
+  }
+
+  for (int vno = 0; vno < full->nvertices; vno++) {
+    VERTEX const *vi = &inc->vertices[vno], *vf = &full->vertices[vno];
+    VERTEX_TOPOLOGY const *vt = &full->vertices_topology[vno];
+    int bad = differ(vi->nx, vf->nx, ELT_TOL) || differ(vi->ny, vf->ny, ELT_TOL) || differ(vi->nz, vf->nz, ELT_TOL) ||
+              differ(vi->area, vf->area, ELT_TOL) || differ(vi->origarea, vf->origarea, ELT_TOL);
+    if (!vi->dist || !vf->dist)
+      bad = 1;
+    else
+      for (int n = 0; n < vt->vtotal; n++) bad |= differ(vi->dist[n], vf->dist[n], ELT_TOL);
+    if (bad) nerrors++;
+  }
+
+  if (differ(inc->total_area, full->total_area, TOTAL_TOL) || differ(inc->neg_area, full->neg_area, TOTAL_TOL) ||
+      differ(inc->avg_vertex_area, full->avg_vertex_area, TOTAL_TOL) ||
+      differ(inc->avg_vertex_dist, full->avg_vertex_dist, TOTAL_TOL) ||
+      differ(inc->std_vertex_dist, full->std_vertex_dist, TOTAL_TOL) || inc->xlo != full->xlo ||
+      inc->xhi != full->xhi || inc->ylo != full->ylo || inc->yhi != full->yhi || inc->zlo != full->zlo ||
+      inc->zhi != full->zhi) {
+    std::cerr << what << ": totals differ, total_area " << inc->total_area << " vs " << full->total_area
+              << ", avg_vertex_dist " << inc->avg_vertex_dist << " vs " << full->avg_vertex_dist
+              << ", std_vertex_dist " << inc->std_vertex_dist << " vs " << full->std_vertex_dist << std::endl;
+    nerrors++;
+  }
+
+  if (nerrors) std::cerr << what << ": " << nerrors << " faces, vertices or totals differ" << std::endl;
+  return (nerrors);
+}
+
+static int checkMoves(const char *what, MRIS_Status status)
+{
+  MRIS *inc = MRISread(SURF_FNAME);
+  MRIS *full = MRISread(SURF_FNAME);
+  if (!inc || !full) exit(1);
+  inc->status = full->status = status;
+
+  // the 2-neighborhoods, so the moved vertices are also in lists beyond their neighbors'
+  MRISsetNeighborhoodSizeAndDist(inc, 2);
+  MRISsetNeighborhoodSizeAndDist(full, 2);
+
+  MRISsetIncrementalMetricProperties(inc, true);
+  MRIScomputeMetricProperties(inc);
+  MRIScomputeMetricProperties(full);
+
+  int vno_xhi = 0;
+  for (int vno = 1; vno < full->nvertices; vno++)
+    if (full->vertices[vno].x > full->vertices[vno_xhi].x) vno_xhi = vno;
+
+  int nerrors = 0;
+  for (int step = 1; step <= NSTEPS; step++) {
+    // the same few vertices moved in both, and the extreme one in x pushed out so the bounding box changes
+    for (int k = 0; k < NMOVED; k++) {
+      int const vno = (k == 0) ? vno_xhi : (step * 97 + k * 131) % full->nvertices;
+      VERTEX const *v = &full->vertices[vno];
+      float const dx = (k == 0) ? 0.5 : 0.3 * sin(step + k);
+      float const dy = 0.3 * cos(2 * step + k), dz = 0.2 * sin(3 * step - k);
+      MRISsetXYZ(inc, vno, v->x + dx, v->y + dy, v->z + dz);
+      MRISsetXYZ(full, vno, v->x + dx, v->y + dy, v->z + dz);
+    }
+
+    if (!mrisComputeMetricPropertiesIncrementally(inc)) {
+      std::cerr << what << ": step " << step << " was not done incrementally" << std::endl;
+      nerrors++;
+      MRIScomputeMetricProperties(inc);
+    }
+    MRIScomputeMetricProperties(full);
+    nerrors += compareSurfaces(what, inc, full);
+  }
+
+  MRISfree(&inc);
+  MRISfree(&full);
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  // no periodic full computation during the test
+  setenv("FS_INCREMENTAL_MP_PERIOD", "1000", 1);
+
+  MRIS *ico = ic2562_make_surface(0, 0);
+  MRISwrite(ico, SURF_FNAME);
+  MRISfree(&ico);
+
+  int nerrors = checkMoves("surface", MRIS_SURFACE);
+  nerrors += checkMoves("sphere", MRIS_SPHERE);
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " differences between the incremental and the full metric properties"
+              << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
@@ -0,0 +1,147 @@
+//
+// micro-benchmark and consistency check for the LABEL index (LabelBuildIndex)
+// in utils/label.cpp. Builds a synthetic 200k point label and times the
+// lookups with and without the index, which must give identical answers.
+//
+
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+#include "error.h"
+#include "label.h"
+#include "macros.h"
+#include "mri.h"
+#include "mrisurf.h"
+#include "timer.h"
+
+const char *Progname = "test_label_index";
+
+#define NPOINTS 200000
+
+// every 10th point repeats an earlier vertex, and every 7th point is a
+// volume point (no vertex) whose coords may repeat too
+static LABEL *makeLabel(void)
+{
+  LABEL *area = LabelAlloc(NPOINTS, NULL, "synthetic");
+  srand(1234);
+  for (int n = 0; n < NPOINTS; n++) {
+    LV *lv = &area->lv[n];
+    lv->vno = (n % 10 == 9) ? rand() % n : 3 * n;
+    if (n % 7 == 0) lv->vno = -1;
+    lv->xv = rand() % 64;
+    lv->yv = rand() % 64;
+    lv->zv = rand() % 64;
+    lv->x = (n % 7 == 0 && n % 3 == 0) ? lv->xv : lv->xv + 0.001 * (n % 997);
+    lv->y = lv->yv;
+    lv->z = lv->zv;
+    lv->deleted = 0;
+  }
+  area->n_points = NPOINTS;
+  return (area);
+}
+
+int main(int argc, char *argv[])
+{
+  int nerrors = 0;
+  int const nlookups = 20000;
+  Timer timer;
+
+  LABEL *linear = makeLabel();
+  LABEL *indexed = makeLabel();
+
+  // LabelHasVertex
+  std::vector<int> vnos(nlookups);
+  for (int i = 0; i < nlookups; i++) vnos[i] = rand() % (3 * NPOINTS);
+
+  timer.reset();
+  std::vector<int> found_linear(nlookups);
+  for (int i = 0; i < nlookups; i++) found_linear[i] = LabelHasVertex(vnos[i], linear);
+  long t_linear = timer.milliseconds();
+
+  timer.reset();
+  LabelBuildIndex(indexed);
+  long t_build = timer.milliseconds();
+  timer.reset();
+  for (int i = 0; i < nlookups; i++)
+    if (LabelHasVertex(vnos[i], indexed) != found_linear[i]) nerrors++;
+  long t_indexed = timer.milliseconds();
+  std::cout << "LabelHasVertex x " << nlookups << ": linear " << t_linear << " msec, indexed " << t_indexed
+            << " msec (+" << t_build << " msec to build)" << std::endl;
+
+  // LabelRemoveDuplicates is hashed either way, check it against the pairwise definition on a subset
+  LABEL *small = LabelAlloc(5000, NULL, "small");
+  small->n_points = 5000;
+  memmove(small->lv, linear->lv, small->n_points * sizeof(LV));
+  LabelRemoveDuplicates(small);
+  for (int n1 = 0; n1 < small->n_points; n1++) {
+    int dup = 0;
+    for (int n2 = 0; n2 < n1 && !dup; n2++) {
+      LV *lv1 = &small->lv[n2], *lv2 = &small->lv[n1];
+      if (lv1->deleted) continue;
+      if (lv1->vno >= 0)
+        dup = (lv1->vno == lv2->vno);
+      else if (lv2->vno < 0)
+        dup = FEQUAL(lv1->x, lv2->x) && FEQUAL(lv1->y, lv2->y) && FEQUAL(lv1->z, lv2->z);
+    }
+    if (dup != small->lv[n1].deleted) nerrors++;
+  }
+  LabelFree(&small);
+
+  timer.reset();
+  LabelRemoveDuplicates(indexed);
+  std::cout << "LabelRemoveDuplicates on " << NPOINTS << " points: " << timer.milliseconds() << " msec" << std::endl;
+
+  // LabelDeleteVoxel
+  memmove(linear->lv, indexed->lv, NPOINTS * sizeof(LV));
+  timer.reset();
+  std::vector<int> ndeleted(nlookups);
+  for (int i = 0; i < nlookups; i++) ndeleted[i] = LabelDeleteVoxel(linear, i % 64, (i / 64) % 64, i % 61, NULL, NULL);
+  t_linear = timer.milliseconds();
+  timer.reset();
+  for (int i = 0; i < nlookups; i++)
+    if (LabelDeleteVoxel(indexed, i % 64, (i / 64) % 64, i % 61, NULL, NULL) != ndeleted[i]) nerrors++;
+  t_indexed = timer.milliseconds();
+  for (int n = 0; n < NPOINTS; n++)
+    if (linear->lv[n].deleted != indexed->lv[n].deleted) nerrors++;
+  std::cout << "LabelDeleteVoxel x " << nlookups << ": linear " << t_linear << " msec, indexed " << t_indexed
+            << " msec" << std::endl;
+
+  // points appended after the index was built must be found
+  LabelRealloc(indexed, NPOINTS + 1);
+  indexed->lv[NPOINTS].vno = 3 * NPOINTS + 1;
+  indexed->n_points++;
+  if (LabelHasVertex(3 * NPOINTS + 1, indexed) != NPOINTS) nerrors++;
+
+  // LabelInit recomputes the voxel coords, which the index must not keep
+  MRI *mri = MRIalloc(64, 64, 64, MRI_UCHAR);
+  LABEL *init = LabelAlloc(10, NULL, "init");
+  init->coords = LABEL_COORDS_SCANNER_RAS;
+  for (int n = 0; n < 10; n++) {
+    LV *lv = &init->lv[init->n_points++];
+    lv->vno = -1;
+    lv->x = 3 * n - 10;
+    lv->y = 5 - n;
+    lv->z = n;
+    lv->xv = lv->yv = lv->zv = 0;
+  }
+  LabelBuildIndex(init);
+  LabelInit(init, mri, NULL, CURRENT_VERTICES);
+  LV const *lv = &init->lv[3];
+  if (lv->xv == 0 && lv->yv == 0 && lv->zv == 0) nerrors++;
+  LabelDeleteVoxel(init, lv->xv, lv->yv, lv->zv, NULL, NULL);
+  if (!lv->deleted) nerrors++;
+  LabelFree(&init);
+  MRIfree(&mri);
+
+  LabelFree(&linear);
+  LabelFree(&indexed);
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " mismatches between indexed and linear label lookups" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
@@ -0,0 +1,89 @@
+//
+// check of the NaN/Inf test on the overlay frame readers in mriio.cpp. An
+// overlay with a NaN in one vertex of its second frame is written as GIFTI,
+// nifti and mgh. Reading the GIFTI file with a '#frame' suffix, and reading
+// any of them with MRIreadOverlayFrames(), must fail when the requested
+// frames and vertices hold the NaN, and give the values when they do not.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "error.h"
+#include "mri.h"
+
+const char *Progname = "test_overlay_frames";
+
+#define OVERLAY_NVERTICES 100
+#define NFRAMES           3
+#define NAN_VNO           17
+#define NAN_FRAME         1
+
+static float value(int vno, int frame) { return (vno + 0.25f * frame); }
+
+// expects the vertices [vno0,vno0+nvertices) of the frames [frame0,frame0+nframes)
+static int checkValues(const char *what, MRI *mri, int frame0, int nframes, int vno0, int nvertices)
+{
+  if (!mri) {
+    std::cerr << what << ": could not be read" << std::endl;
+    return (1);
+  }
+  int nerrors = 0;
+  if (mri->width != nvertices || mri->nframes != nframes) {
+    std::cerr << what << ": " << mri->width << " vertices, " << mri->nframes << " frames" << std::endl;
+    nerrors++;
+  }
+  else
+    for (int f = 0; f < nframes; f++)
+      for (int v = 0; v < nvertices; v++)
+        if (MRIgetVoxVal(mri, v, 0, 0, f) != value(vno0 + v, frame0 + f)) nerrors++;
+  if (nerrors) std::cerr << what << ": wrong values" << std::endl;
+  MRIfree(&mri);
+  return (nerrors);
+}
+
+static int checkRejected(const char *what, MRI *mri)
+{
+  if (!mri) return (0);
+  std::cerr << what << ": the NaN was not caught" << std::endl;
+  MRIfree(&mri);
+  return (1);
+}
+
+int main(int argc, char *argv[])
+{
+  MRI *overlay = MRIallocSequence(OVERLAY_NVERTICES, 1, 1, MRI_FLOAT, NFRAMES);
+  for (int f = 0; f < NFRAMES; f++)
+    for (int vno = 0; vno < OVERLAY_NVERTICES; vno++) MRIsetVoxVal(overlay, vno, 0, 0, f, value(vno, f));
+  MRIsetVoxVal(overlay, NAN_VNO, 0, 0, NAN_FRAME, NAN);
+
+  const char *fnames[] = {"test_overlay_frames.gii", "test_overlay_frames.nii", "test_overlay_frames.mgh"};
+  int nerrors = 0;
+  for (int n = 0; n < 3; n++) {
+    if (MRIwrite(overlay, fnames[n]) != NO_ERROR) {
+      std::cerr << "ERROR: could not write " << fnames[n] << std::endl;
+      exit(1);
+    }
+    std::cout << fnames[n] << std::endl;
+    nerrors += checkValues("first frame", MRIreadOverlayFrames(fnames[n], 0, 1, 0, -1), 0, 1, 0, OVERLAY_NVERTICES);
+    nerrors += checkRejected("second frame", MRIreadOverlayFrames(fnames[n], NAN_FRAME, 1, 0, -1));
+    nerrors += checkRejected("all frames", MRIreadOverlayFrames(fnames[n], 0, -1, 0, -1));
+    // the NaN is outside of these vertices
+    nerrors += checkValues("vertices 20-29", MRIreadOverlayFrames(fnames[n], 0, -1, 20, 10), 0, NFRAMES, 20, 10);
+  }
+
+  // mri_read() with a frame suffix, which uses the GIFTI range reader
+  nerrors += checkValues("gii#0", MRIread("test_overlay_frames.gii#0"), 0, 1, 0, OVERLAY_NVERTICES);
+  nerrors += checkRejected("gii#1", MRIread("test_overlay_frames.gii#1"));
+
+  MRIfree(&overlay);
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " errors reading the overlay frames" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
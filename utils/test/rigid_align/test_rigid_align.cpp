@@ -0,0 +1,134 @@
+//
+// consistency check for MRISrigidBodyAlignGlobal_findMinSSE_spharm() in
+// MRISrigidBodyAlignGlobal.cpp. The template is the parameterized curvature
+// of an icosahedron and the subject is the same surface rotated. The
+// spherical harmonic search must find the rotation the grid search finds,
+// with an sse no worse, and with fewer sse evaluations, which are counted
+// through gMRISexternalSSE.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "MRISrigidBodyAlignGlobal.h"
+#include "error.h"
+#include "icosahedron.h"
+#include "mrisurf.h"
+
+const char *Progname = "test_rigid_align";
+
+// the arguments hiam_register and mrisurf_integrate.cpp use
+#define MIN_DEGREES 0.5f
+#define MAX_DEGREES 32.0f
+#define NANGLES     8
+
+// two grid cells apart at most
+#define ROTATION_TOL RADIANS(2 * MIN_DEGREES)
+#define SSE_TOL      1e-3
+
+static int nevaluations = 0;
+
+static double countEvaluation(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
+{
+  nevaluations++;
+  return (0.0);
+}
+
+// a few smooth bumps of either sign, placed with no symmetry
+static void setCurvature(MRIS *mris)
+{
+  static float const bumps[][4] = {
+      {0.8f, 0.1f, 0.59f, 1.0f}, {-0.3f, 0.9f, 0.3f, -0.7f}, {-0.5f, -0.6f, 0.62f, 0.5f}, {0.2f, -0.4f, -0.89f, -1.2f}};
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    double const r = sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
+    double curv = 0;
+    for (unsigned int n = 0; n < sizeof(bumps) / sizeof(bumps[0]); n++) {
+      double const norm = sqrt(SQR(bumps[n][0]) + SQR(bumps[n][1]) + SQR(bumps[n][2]));
+      double const cosAngle = (v->x * bumps[n][0] + v->y * bumps[n][1] + v->z * bumps[n][2]) / (r * norm);
+      curv += bumps[n][3] * exp(-(1 - cosAngle) / 0.08);
+    }
+    v->curv = curv;
+  }
+}
+
+// largest distance between the vertices of the subject rotated each way
+static double rotationDifference(MRIS *mris, double a1, double b1, double g1, double a2, double b2, double g2)
+{
+  MRIS *r1 = MRISrotate(mris, NULL, a1, b1, g1);
+  MRIS *r2 = MRISrotate(mris, NULL, a2, b2, g2);
+  double maxdist = 0;
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const *v1 = &r1->vertices[vno], *v2 = &r2->vertices[vno];
+    maxdist = MAX(maxdist, sqrt(SQR(v1->x - v2->x) + SQR(v1->y - v2->y) + SQR(v1->z - v2->z)));
+  }
+  MRISfree(&r1);
+  MRISfree(&r2);
+  return (maxdist / mris->radius);
+}
+
+int main(int argc, char *argv[])
+{
+  MRIS *mris = ic2562_make_surface(0, 0);
+  setCurvature(mris);
+
+  // mean in frame 0, variance in frame 1
+  MRI_SP *mrisp = MRISPalloc(1, 2);
+  MRIStoParameterization(mris, mrisp, 1, 0);
+  for (int u = 0; u < U_DIM(mrisp); u++)
+    for (int v = 0; v < V_DIM(mrisp); v++) *IMAGEFseq_pix(mrisp->Ip, u, v, 1) = 1.0f;
+
+  MRISrotate(mris, mris, RADIANS(10), RADIANS(-6), RADIANS(14));
+
+  INTEGRATION_PARMS parms;
+  parms.mrisp_template = mrisp;
+  parms.frame_no = 0;
+  parms.abs_norm = 1;
+  gMRISexternalSSE = countEvaluation;
+
+  double grid_a, grid_b, grid_g, grid_sse;
+  nevaluations = 0;
+  MRISrigidBodyAlignGlobal_findMinSSE(&grid_a, &grid_b, &grid_g, &grid_sse, mris, &parms, RADIANS(MIN_DEGREES),
+                                      RADIANS(MAX_DEGREES), 0.0, NANGLES);
+  int const grid_evaluations = nevaluations;
+
+  double spharm_a, spharm_b, spharm_g, spharm_sse;
+  nevaluations = 0;
+  MRISrigidBodyAlignGlobal_findMinSSE_spharm(&spharm_a, &spharm_b, &spharm_g, &spharm_sse, mris, &parms,
+                                             RADIANS(MIN_DEGREES), RADIANS(MAX_DEGREES), 0.0, NANGLES, 31, 4);
+  int const spharm_evaluations = nevaluations;
+
+  std::cout << "grid: (" << DEGREES(grid_a) << ", " << DEGREES(grid_b) << ", " << DEGREES(grid_g) << ") sse "
+            << grid_sse << ", " << grid_evaluations << " evaluations" << std::endl;
+  std::cout << "spharm: (" << DEGREES(spharm_a) << ", " << DEGREES(spharm_b) << ", " << DEGREES(spharm_g) << ") sse "
+            << spharm_sse << ", " << spharm_evaluations << " evaluations" << std::endl;
+
+  int nerrors = 0;
+  double const diff = rotationDifference(mris, grid_a, grid_b, grid_g, spharm_a, spharm_b, spharm_g);
+  if (diff > ROTATION_TOL) {
+    std::cerr << "the rotations differ by " << DEGREES(diff) << " degrees" << std::endl;
+    nerrors++;
+  }
+  if (spharm_sse > grid_sse * (1 + SSE_TOL)) {
+    std::cerr << "the spharm sse " << spharm_sse << " is worse than the grid sse " << grid_sse << std::endl;
+    nerrors++;
+  }
+  if (spharm_evaluations >= grid_evaluations) {
+    std::cerr << "the spharm search evaluated the sse " << spharm_evaluations << " times, the grid search "
+              << grid_evaluations << " times" << std::endl;
+    nerrors++;
+  }
+
+  gMRISexternalSSE = NULL;
+  MRISPfree(&mrisp);
+  MRISfree(&mris);
+
+  if (nerrors) {
+    std::cerr << "ERROR: the spherical harmonic search does not match the grid search" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
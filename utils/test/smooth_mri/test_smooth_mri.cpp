@@ -0,0 +1,92 @@
+//
+// equivalence check for MRISsmoothMRIFastMultiFrame() in mrisurf_mri.cpp.
+// A multi-frame overlay on an icosahedron, stored reshaped to more than one
+// row and slice, and an inclusive mask of the same number of voxels but
+// stored as one row, must be smoothed to the values MRISsmoothMRIFast()
+// gives, bit for bit, with and without the mask.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "error.h"
+#include "icosahedron.h"
+#include "mri.h"
+#include "mrisurf.h"
+
+const char *Progname = "test_smooth_mri";
+
+#define NFRAMES 70
+#define NSTEPS  5
+
+static int compareSmoothing(const char *what, MRIS *surf, MRI *src, MRI *mask)
+{
+  MRI *fast = MRISsmoothMRIFast(surf, src, NSTEPS, mask, NULL);
+  MRI *mf = MRISsmoothMRIFastMultiFrame(surf, src, NSTEPS, mask, NULL);
+  if (!fast || !mf) {
+    std::cerr << what << ": no output" << std::endl;
+    return (1);
+  }
+
+  int nerrors = 0, nzero = 0;
+  for (int f = 0; f < src->nframes; f++)
+    for (int s = 0; s < src->depth; s++)
+      for (int r = 0; r < src->height; r++)
+        for (int c = 0; c < src->width; c++) {
+          float const vfast = MRIgetVoxVal(fast, c, r, s, f), vmf = MRIgetVoxVal(mf, c, r, s, f);
+          if (vfast != vmf) {
+            if (nerrors++ < 5)
+              std::cerr << what << ": " << c << " " << r << " " << s << " " << f << " fast " << vfast
+                        << ", multi-frame " << vmf << std::endl;
+          }
+          if (vfast == 0) nzero++;
+        }
+  // the masked-out vertices are zeroed, and only those
+  if (mask && nzero == 0) {
+    std::cerr << what << ": the mask was not applied" << std::endl;
+    nerrors++;
+  }
+  if (nerrors) std::cerr << what << ": " << nerrors << " values differ" << std::endl;
+
+  MRIfree(&fast);
+  MRIfree(&mf);
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  MRIS *surf = ic642_make_surface(0, 0);
+  int const nvertices = surf->nvertices;
+
+  // 642 = 107 x 3 x 2, filled in the order mri_reshape() uses
+  MRI *src = MRIallocSequence(107, 3, 2, MRI_FLOAT, NFRAMES);
+  MRI *mask = MRIalloc(nvertices, 1, 1, MRI_FLOAT);
+  if (src->width * src->height * src->depth != nvertices) {
+    std::cerr << "ERROR: " << nvertices << " vertices do not fit the overlay" << std::endl;
+    exit(1);
+  }
+  for (int vno = 0; vno < nvertices; vno++) {
+    VERTEX const *v = &surf->vertices[vno];
+    int const c = vno % src->width, r = (vno / src->width) % src->height, s = vno / (src->width * src->height);
+    for (int f = 0; f < NFRAMES; f++)
+      MRIsetVoxVal(src, c, r, s, f, sin(0.05 * v->x * (f + 1)) + cos(0.07 * v->y) + 0.01 * v->z * f);
+    // a cap and a band out of the mask, so its position matters
+    MRIsetVoxVal(mask, vno, 0, 0, 0, (v->z > 0.7 * surf->radius || fabs(v->x) < 0.1 * surf->radius) ? 0 : 1);
+  }
+
+  int nerrors = compareSmoothing("no mask", surf, src, NULL);
+  nerrors += compareSmoothing("mask", surf, src, mask);
+
+  MRIfree(&src);
+  MRIfree(&mask);
+  MRISfree(&surf);
+
+  if (nerrors) {
+    std::cerr << "ERROR: MRISsmoothMRIFastMultiFrame differs from MRISsmoothMRIFast" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
@@ -0,0 +1,8 @@
+#!/usr/bin/env bash
+source "$(dirname $0)/../../../test.sh"
+
+# lh.surf is the surface of the MRIScomputeBorderValues test
+for threads in 1 8; do
+    export OMP_NUM_THREADS=$threads
+    test_command test_surfsssp lh.surf
+done
@@ -0,0 +1,215 @@
+//
+// consistency check for the shortest path engine (surfsssp.h). The costs
+// SSSPsolve() and SSSPsolveEach() find over the edge graph of a surface,
+// from several sources and bounded by a maximum cost, must be those of a
+// serial Dijkstra, and the predecessors must be the lowest numbered of
+// the shortest ones, with one thread and with many.
+//
+
+#include <math.h>
+
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "icosahedron.h"
+#include "mrisurf.h"
+#include "romp_support.h"
+#include "surfsssp.h"
+
+const char *Progname = "test_surfsssp";
+
+// serial Dijkstra, the reference
+static std::vector<float> dijkstra(const SSSP_GRAPH *graph, const std::vector<int> &sources, float maxcost)
+{
+  typedef std::pair<float, int> Entry;
+  std::vector<float> dist(graph->nnodes, SSSP_UNREACHED);
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+  for (unsigned int i = 0; i < sources.size(); i++) {
+    dist[sources[i]] = 0;
+    heap.push(Entry(0, sources[i]));
+  }
+  while (!heap.empty()) {
+    Entry const top = heap.top();
+    heap.pop();
+    int const u = top.second;
+    if (top.first > dist[u]) continue;
+    for (int e = graph->rowptr[u]; e < graph->rowptr[u + 1]; e++) {
+      float const nd = top.first + graph->cost[e];
+      int const v = graph->col[e];
+      if (maxcost > 0 && nd > maxcost) continue;
+      if (nd < dist[v]) {
+        dist[v] = nd;
+        heap.push(Entry(nd, v));
+      }
+    }
+  }
+  return (dist);
+}
+
+static int checkSolve(const char *what, const SSSP_GRAPH *graph, const std::vector<int> &sources, float maxcost)
+{
+  int const nnodes = graph->nnodes;
+  std::vector<float> dist(nnodes);
+  std::vector<int> pred(nnodes);
+  int const nreached = SSSPsolve(graph, &sources[0], sources.size(), maxcost, &dist[0], &pred[0]);
+  std::vector<float> const ref = dijkstra(graph, sources, maxcost);
+
+  int nerrors = 0, nref = 0;
+  for (int v = 0; v < nnodes; v++) {
+    if (ref[v] != SSSP_UNREACHED) nref++;
+    if (dist[v] != ref[v]) nerrors++;
+  }
+  if (nreached != nref) nerrors++;
+  if (nerrors) {
+    std::cerr << what << ": " << nerrors << " costs differ from Dijkstra" << std::endl;
+    return (nerrors);
+  }
+
+  // the lowest numbered predecessor over an edge that adds to the cost, and whether
+  // a zero cost edge also gives the cost, in which case any shortest one will do
+  std::vector<int> lowest(nnodes, -1);
+  std::vector<char> zeroTie(nnodes, 0), isSource(nnodes, 0);
+  for (unsigned int i = 0; i < sources.size(); i++) isSource[sources[i]] = 1;
+  for (int u = 0; u < nnodes; u++) {
+    if (dist[u] == SSSP_UNREACHED) continue;
+    for (int e = graph->rowptr[u]; e < graph->rowptr[u + 1]; e++) {
+      int const v = graph->col[e];
+      if (isSource[v] || dist[u] + graph->cost[e] != dist[v]) continue;
+      if (dist[v] > dist[u]) {
+        if (lowest[v] < 0 || u < lowest[v]) lowest[v] = u;
+      }
+      else
+        zeroTie[v] = 1;
+    }
+  }
+  for (int v = 0; v < nnodes; v++) {
+    int const p = pred[v];
+    if (isSource[v] || dist[v] == SSSP_UNREACHED) {
+      if (p != -1) nerrors++;
+      continue;
+    }
+    if (p < 0 || p >= nnodes) {
+      nerrors++;
+      continue;
+    }
+    bool shortest = false;
+    for (int e = graph->rowptr[p]; e < graph->rowptr[p + 1]; e++)
+      if (graph->col[e] == v && dist[p] + graph->cost[e] == dist[v]) shortest = true;
+    if (!shortest || (!zeroTie[v] && p != lowest[v])) nerrors++;
+  }
+
+  // and the paths lead back to a source
+  for (int v = 0; v < nnodes; v++) {
+    int n = v, nsteps = 0;
+    while (pred[n] >= 0 && nsteps <= nnodes) {
+      n = pred[n];
+      nsteps++;
+    }
+    if (dist[v] != SSSP_UNREACHED && !isSource[n]) nerrors++;
+  }
+  if (nerrors) std::cerr << what << ": " << nerrors << " bad predecessors" << std::endl;
+  return (nerrors);
+}
+
+typedef struct
+{
+  std::vector<std::vector<int> > node;
+  std::vector<std::vector<float> > cost;
+} EACH_RESULTS;
+
+static void keepResults(int nth, int source, int nreached, const int *node, const float *cost, void *parms)
+{
+  EACH_RESULTS *results = (EACH_RESULTS *)parms;
+  results->node[nth].assign(node, node + nreached);
+  results->cost[nth].assign(cost, cost + nreached);
+}
+
+static int checkSolveEach(const char *what, const SSSP_GRAPH *graph, const std::vector<int> &sources, float maxcost)
+{
+  EACH_RESULTS results;
+  results.node.resize(sources.size());
+  results.cost.resize(sources.size());
+  SSSPsolveEach(graph, &sources[0], sources.size(), maxcost, keepResults, &results);
+
+  int nerrors = 0;
+  for (unsigned int nth = 0; nth < sources.size(); nth++) {
+    std::vector<float> const ref = dijkstra(graph, std::vector<int>(1, sources[nth]), maxcost);
+    std::vector<int> const &node = results.node[nth];
+    std::vector<float> const &cost = results.cost[nth];
+    int nref = 0;
+    for (int v = 0; v < graph->nnodes; v++)
+      if (ref[v] != SSSP_UNREACHED) nref++;
+    if ((int)node.size() != nref || node.empty() || node[0] != sources[nth]) {
+      nerrors++;
+      continue;
+    }
+    for (unsigned int i = 0; i < node.size(); i++)
+      if (cost[i] != ref[node[i]] || (i > 0 && cost[i] < cost[i - 1])) {
+        nerrors++;
+        break;
+      }
+  }
+  if (nerrors) std::cerr << what << ": " << nerrors << " searches differ from Dijkstra" << std::endl;
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  MRIS *surf;
+  if (argc > 1) {
+    surf = MRISread(argv[1]);
+    if (!surf) exit(1);
+  }
+  else {
+    // an icosahedron with a bumpy radius, so the edges are of many lengths
+    surf = ic2562_make_surface(0, 0);
+    for (int vno = 0; vno < surf->nvertices; vno++) {
+      VERTEX const *v = &surf->vertices[vno];
+      float const r = 1 + 0.2 * sin(0.1 * v->x) * cos(0.13 * v->y + 0.07 * v->z);
+      MRISsetXYZ(surf, vno, r * v->x, r * v->y, r * v->z);
+    }
+  }
+
+  SSSP_GRAPH *graph = SSSPgraphFromSurf(surf, NULL, NULL);
+  int const nedges = graph->rowptr[graph->nnodes];
+  double sum = 0;
+  for (int e = 0; e < nedges; e++) sum += graph->cost[e];
+  float const meanlen = sum / nedges;
+  std::cout << surf->nvertices << " vertices, mean edge length " << meanlen << std::endl;
+
+  std::vector<int> few, many;
+  for (int vno = 0; vno < surf->nvertices; vno += surf->nvertices / 5) few.push_back(vno);
+  for (int vno = 3; vno < surf->nvertices; vno += 37) many.push_back(vno);
+
+  // one thread, then many
+  std::vector<int> nthreads(1, 1);
+#ifdef HAVE_OPENMP
+  nthreads.push_back(omp_get_max_threads() > 1 ? omp_get_max_threads() : 4);
+#endif
+
+  int nerrors = 0;
+  for (unsigned int i = 0; i < nthreads.size(); i++) {
+#ifdef HAVE_OPENMP
+    omp_set_num_threads(nthreads[i]);
+#endif
+    std::cout << nthreads[i] << " threads" << std::endl;
+    nerrors += checkSolve("one source", graph, std::vector<int>(1, few[1]), 0);
+    nerrors += checkSolve("multi-source", graph, few, 0);
+    nerrors += checkSolve("bounded multi-source", graph, few, 8 * meanlen);
+    nerrors += checkSolveEach("bounded each", graph, many, 5 * meanlen);
+  }
+
+  SSSPgraphFree(&graph);
+  MRISfree(&surf);
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " mismatches between the SSSP engine and Dijkstra" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
@@ -0,0 +1,191 @@
+//
+// consistency check for TFCE::computeUnionFind() (tfce.h). On a small
+// volume and on an icosahedron with known clusters, some isolated, some
+// joined at a lower threshold, some negative and some masked out, the union
+// find sweep must give the map computeRecluster() gives, for each sign, and an
+// isolated block of constant value must get its TFCE score worked out by hand.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "error.h"
+#include "icosahedron.h"
+#include "mri.h"
+#include "mrisurf.h"
+#include "tfce.h"
+
+const char *Progname = "test_tfce";
+
+// the two sum the thresholds in another order
+#define TFCE_TOL 1e-4
+
+#define BLOCK_VAL 3.05f
+
+static int differ(double a, double b) { return (fabs(a - b) > TFCE_TOL * (1 + fabs(b))); }
+
+static void setThresholds(TFCE &tfce, int thsign)
+{
+  tfce.thsign = thsign;
+  tfce.hmin = 0.1;
+  tfce.hmax = 4.1;
+  tfce.nh = 41;
+  tfce.hlistUniform();
+}
+
+static int compareMaps(const char *what, TFCE &tfce, MRI *map)
+{
+  MRI *uf = tfce.computeUnionFind(map);
+  MRI *rc = tfce.computeRecluster(map);
+  if (!uf || !rc) {
+    std::cerr << what << ": no map" << std::endl;
+    return (1);
+  }
+
+  int nerrors = 0, nonzero = 0;
+  for (int s = 0; s < map->depth; s++)
+    for (int r = 0; r < map->height; r++)
+      for (int c = 0; c < map->width; c++) {
+        double const vuf = MRIgetVoxVal(uf, c, r, s, 0), vrc = MRIgetVoxVal(rc, c, r, s, 0);
+        if (differ(vuf, vrc)) {
+          if (nerrors++ < 5)
+            std::cerr << what << ": " << c << " " << r << " " << s << " union find " << vuf << ", recluster " << vrc
+                      << std::endl;
+        }
+        if (vrc != 0) nonzero++;
+      }
+  if (nonzero == 0) {
+    std::cerr << what << ": empty map" << std::endl;
+    nerrors++;
+  }
+  if (nerrors) std::cerr << what << ": " << nerrors << " values differ" << std::endl;
+
+  MRIfree(&uf);
+  MRIfree(&rc);
+  return (nerrors);
+}
+
+// the TFCE score of a cluster of csize that stays whole from its value down, by the trapezoid rule
+static double expectedScore(const TFCE &tfce, double csize, float val)
+{
+  double sum = 0;
+  for (int n = 0; n < tfce.nh; n++) {
+    float const h = tfce.hlist[n];
+    if (val < h) continue;
+    double coef = 0;
+    if (n > 0) coef += (tfce.hlist[n] - tfce.hlist[n - 1]) / 2;
+    if (n < tfce.nh - 1) coef += (tfce.hlist[n + 1] - tfce.hlist[n]) / 2;
+    sum += coef * (float)(pow(csize, tfce.E) * pow(tfce.hlist[n], tfce.H));
+  }
+  return (sum);
+}
+
+static int checkVolume(void)
+{
+  MRI *map = MRIalloc(20, 20, 6, MRI_FLOAT);
+  MRI *mask = MRIalloc(20, 20, 6, MRI_FLOAT);
+  MRIvalueFill(mask, 1);
+
+  // an isolated 3x3x2 block
+  for (int s = 1; s <= 2; s++)
+    for (int r = 2; r <= 4; r++)
+      for (int c = 2; c <= 4; c++) MRIsetVoxVal(map, c, r, s, 0, BLOCK_VAL);
+  // two peaks joined by a low bridge
+  for (int s = 0; s < 4; s++)
+    for (int r = 10; r < 16; r++)
+      for (int c = 2; c < 18; c++) {
+        float const dl = fabs(c - 5.0) + fabs(r - 12.5) + fabs(s - 1.5);
+        float const dr = fabs(c - 14.0) + fabs(r - 12.5) + fabs(s - 1.5);
+        MRIsetVoxVal(map, c, r, s, 0, 0.65 + 3.3 / (1 + MIN(dl, dr)));
+      }
+  // a negative block, a single voxel, and a block that is masked out
+  for (int r = 2; r <= 6; r++)
+    for (int c = 10; c <= 13; c++) MRIsetVoxVal(map, c, r, 3, 0, -2.55);
+  MRIsetVoxVal(map, 17, 3, 1, 0, 1.77);
+  for (int r = 2; r <= 4; r++)
+    for (int c = 15; c <= 16; c++) {
+      MRIsetVoxVal(map, c, r, 4, 0, 2.35);
+      MRIsetVoxVal(mask, c, r, 4, 0, 0);
+    }
+
+  int nerrors = 0;
+  TFCE tfce;
+  tfce.mask = mask;
+  for (int thsign = -1; thsign <= 1; thsign++) {
+    setThresholds(tfce, thsign);
+    nerrors += compareMaps(thsign == 0 ? "volume, abs" : (thsign > 0 ? "volume, pos" : "volume, neg"), tfce, map);
+  }
+
+  setThresholds(tfce, 1);
+  MRI *uf = tfce.computeUnionFind(map);
+  double const expected = expectedScore(tfce, 18 * map->xsize * map->ysize * map->zsize, BLOCK_VAL);
+  int nbad = 0;
+  for (int s = 1; s <= 2; s++)
+    for (int r = 2; r <= 4; r++)
+      for (int c = 2; c <= 4; c++)
+        if (differ(MRIgetVoxVal(uf, c, r, s, 0), expected)) nbad++;
+  if (nbad) std::cerr << "volume: the block scores " << MRIgetVoxVal(uf, 3, 3, 1, 0) << ", not " << expected << std::endl;
+  if (MRIgetVoxVal(uf, 15, 3, 4, 0) != 0) {
+    std::cerr << "volume: the masked block scores " << MRIgetVoxVal(uf, 15, 3, 4, 0) << std::endl;
+    nbad++;
+  }
+  nerrors += nbad;
+  MRIfree(&uf);
+
+  MRIfree(&map);
+  MRIfree(&mask);
+  return (nerrors);
+}
+
+static int checkSurface(void)
+{
+  MRIS *surf = ic642_make_surface(0, 0);
+  MRI *map = MRIalloc(surf->nvertices, 1, 1, MRI_FLOAT);
+  MRI *mask = MRIalloc(surf->nvertices, 1, 1, MRI_FLOAT);
+  MRIvalueFill(mask, 1);
+
+  for (int vno = 0; vno < surf->nvertices; vno++) {
+    VERTEX const *v = &surf->vertices[vno];
+    float val = 0;
+    if (v->z > 0.8 * surf->radius)  // a cap, higher in the middle
+      val = 1.05 + 3 * (v->z / surf->radius - 0.8) / 0.2;
+    else if (v->z < -0.85 * surf->radius)  // a negative cap
+      val = -2.55;
+    else if (fabs(v->z) < 0.15 * surf->radius && v->x > 0)  // half a band, with two peaks
+      val = 0.65 + 2.5 * fabs(v->y) / surf->radius;
+    else if (v->x < -0.9 * surf->radius) {  // masked out
+      val = 2.35;
+      MRIsetVoxVal(mask, vno, 0, 0, 0, 0);
+    }
+    MRIsetVoxVal(map, vno, 0, 0, 0, val);
+  }
+
+  int nerrors = 0;
+  TFCE tfce;
+  tfce.surf = surf;
+  tfce.mask = mask;
+  for (int thsign = -1; thsign <= 1; thsign++) {
+    setThresholds(tfce, thsign);
+    nerrors += compareMaps(thsign == 0 ? "surface, abs" : (thsign > 0 ? "surface, pos" : "surface, neg"), tfce, map);
+  }
+
+  MRIfree(&map);
+  MRIfree(&mask);
+  MRISfree(&surf);
+  return (nerrors);
+}
+
+int main(int argc, char *argv[])
+{
+  int nerrors = checkVolume();
+  nerrors += checkSurface();
+
+  if (nerrors) {
+    std::cerr << "ERROR: " << nerrors << " differences between computeUnionFind and computeRecluster" << std::endl;
+    exit(1);
+  }
+  std::cout << "passed" << std::endl;
+  exit(0);
+}
@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <float.h>
+#include <algorithm>
 #include "error.h"
 #include "diag.h"
 #include "surfcluster.h"
@@ -227,15 +228,179 @@ int TFCE::hlistAuto(MRI *map)
 
 /*!
   \func MRI *TFCE::compute(MRI *map)
-  \brief Computes the TFCE map
+  \brief Computes the TFCE map, by default with computeUnionFind()
 */
 MRI *TFCE::compute(MRI *map)
+{
+  if(unionfind) return(computeUnionFind(map));
+  return(computeRecluster(map));
+}
+
+/*!
+  \func MRI *TFCE::computeUnionFind(MRI *map)
+  \brief Computes the TFCE map in a single sweep over the thresholds.
+  The vertices/voxels are sorted by value once and added to a union-find
+  forest going from the highest threshold down, so each threshold only
+  costs the merges it causes plus a pass over the current clusters. The
+  root of each cluster carries the TFCE sum accumulated so far; when a
+  root is merged into another it keeps its sum relative to the new root,
+  so the score of a member is the sum along its path to the root. Gives
+  the same map as computeRecluster() (same inclusion rule, 6-connected
+  voxels or 1-neighbor vertices, cluster area or volume) and does not
+  modify surf.
+*/
+MRI *TFCE::computeUnionFind(MRI *map)
+{
+  if(debug) printf("Entering TFCE::computeUnionFind() hlist.size()=%d\n",(int)hlist.size());
+  if(hlist.size()==0 || (int)hlist.size() < nh){
+    printf("ERROR: TFCE::computeUnionFind(): hlist has not been set up\n");
+    return(NULL);
+  }
+  const int ncols = map->width, nrows = map->height, nslices = map->depth;
+  const int nvox = ncols*nrows*nslices;
+  if(surf && nvox != surf->nvertices){
+    printf("ERROR: TFCE::computeUnionFind(): map has %d vertices, surf has %d\n",nvox,surf->nvertices);
+    return(NULL);
+  }
+
+  // Signed values of the vertices/voxels that can be clustered, as seen by
+  // clustValueInRange(). Masked vertices are set to 0 as in
+  // computeRecluster(); masked voxels are excluded by clustGetClusters().
+  std::vector<float> sval(nvox);
+  std::vector<int> order;
+  order.reserve(nvox);
+  for(int s = 0; s < nslices; s++){
+    for(int r = 0; r < nrows; r++){
+      for(int c = 0; c < ncols; c++){
+        int i = c + ncols*(r + nrows*s);
+        float v = MRIgetVoxVal(map,c,r,s,0);
+        if(mask){
+          int m = MRIgetVoxVal(mask,c,r,s,0);
+          if(surf && m < 0.5) v = 0;
+          if(!surf && m == 0) continue;
+        }
+        if(thsign ==  0) v = fabs(v);
+        if(thsign == -1) v = -v;
+        sval[i] = v;
+        order.push_back(i);
+      }
+    }
+  }
+  std::sort(order.begin(), order.end(), [&sval](int a, int b){
+    return(sval[a] > sval[b] || (sval[a] == sval[b] && a < b));
+  });
+
+  // The trapezoidal integral over h is a weighted sum of the per-threshold
+  // maps, so the thresholds can be visited in any order
+  std::vector<double> hcoef(nh,0.0);
+  std::vector<int> horder(nh);
+  for(int nthh=0; nthh < nh-1; nthh++){
+    double hd = hlist[nthh+1]-hlist[nthh];
+    hcoef[nthh]   += hd/2;
+    hcoef[nthh+1] += hd/2;
+  }
+  for(int nthh=0; nthh < nh; nthh++) horder[nthh] = nthh;
+  std::sort(horder.begin(), horder.end(), [this](int a, int b){
+    return((float)hlist[a] > (float)hlist[b]);
+  });
+
+  // Cluster size per member: vertex area (mm2) or 1 voxel
+  double areascale = 1, voxsize = map->xsize * map->ysize * map->zsize;
+  if(surf && surf->group_avg_surface_area > 0 && !surf->group_avg_vtxarea_loaded)
+    areascale = surf->group_avg_surface_area/surf->total_area;
+
+  std::vector<int> parent(nvox,-1), roots, path;
+  std::vector<double> acc(nvox,0.0), size(nvox,0.0);
+  auto find = [&parent,&acc,&path](int i){
+    int root = i;
+    while(parent[root] != root) root = parent[root];
+    path.clear();
+    for(int j = i; parent[j] != root && j != root; j = parent[j]) path.push_back(j);
+    for(int n = (int)path.size()-1; n >= 0; n--){
+      acc[path[n]] += acc[parent[path[n]]];
+      parent[path[n]] = root;
+    }
+    return(root);
+  };
+  auto unite = [&](int i, int j){
+    int ri = find(i), rj = find(j);
+    if(ri == rj) return;
+    if(size[ri] < size[rj]) std::swap(ri,rj);
+    parent[rj] = ri;
+    acc[rj] -= acc[ri];
+    size[ri] += size[rj];
+  };
+
+  int nadded = 0, ncand = order.size();
+  for(int k=0; k < nh; k++){
+    int nthh = horder[k];
+    float h = hlist[nthh];
+    while(nadded < ncand && sval[order[nadded]] >= h){
+      int i = order[nadded++];
+      parent[i] = i;
+      if(surf) size[i] = surf->group_avg_vtxarea_loaded ? surf->vertices[i].group_avg_area : surf->vertices[i].area;
+      else     size[i] = 1;
+      roots.push_back(i);
+      if(surf){
+        VERTEX_TOPOLOGY const * const vt = &surf->vertices_topology[i];
+        for(int n=0; n < vt->vnum; n++)
+          if(parent[vt->v[n]] >= 0) unite(i,vt->v[n]);
+      }
+      else {
+        int c = i % ncols, r = (i/ncols) % nrows, s = i/(ncols*nrows);
+        if(c > 0         && parent[i-1] >= 0) unite(i,i-1);
+        if(c < ncols-1   && parent[i+1] >= 0) unite(i,i+1);
+        if(r > 0         && parent[i-ncols] >= 0) unite(i,i-ncols);
+        if(r < nrows-1   && parent[i+ncols] >= 0) unite(i,i+ncols);
+        if(s > 0         && parent[i-ncols*nrows] >= 0) unite(i,i-ncols*nrows);
+        if(s < nslices-1 && parent[i+ncols*nrows] >= 0) unite(i,i+ncols*nrows);
+      }
+    }
+    // Add this threshold's term to every cluster, dropping merged roots
+    double powhH = pow(hlist[nthh],H);
+    int nroots = 0;
+    for(int i : roots){
+      if(parent[i] != i) continue;
+      roots[nroots++] = i;
+      double csize;
+      if(surf) csize = (float)((float)size[i]*areascale);
+      else     csize = size[i]*voxsize;
+      float v = pow(csize,E)*powhH; // stored as float by computeRecluster()
+      acc[i] += hcoef[nthh]*v;
+    }
+    roots.resize(nroots);
+    if(debug) printf("%2d h=%g, nc=%d nhits=%d\n",nthh,hlist[nthh],nroots,nadded);
+  }
+
+  MRI *tfcemap = MRIallocSequence(ncols,nrows,nslices,MRI_FLOAT,1);
+  MRIcopyHeader(map, tfcemap);
+  MRIcopyPulseParameters(map, tfcemap);
+  for(int n=0; n < nadded; n++){
+    int i = order[n];
+    int root = find(i);
+    double vsum = acc[i];
+    if(i != root) vsum += acc[root];
+    int c = i % ncols, r = (i/ncols) % nrows, s = i/(ncols*nrows);
+    if(mask && MRIgetVoxVal(mask,c,r,s,0) < 0.5) continue;
+    MRIsetVoxVal(tfcemap,c,r,s,0, vsum);
+    if(debug && c == vnodebug) printf("  nh=%d final tfce stat c=%d %g\n",nh,c,vsum);
+  }
+
+  return(tfcemap);
+}
+
+/*!
+  \func MRI *TFCE::computeRecluster(MRI *map)
+  \brief Computes the TFCE map by clustering the whole map again at
+  each threshold. Kept as the reference for computeUnionFind().
+*/
+MRI *TFCE::computeRecluster(MRI *map)
 {
   MRI *tfcemap = NULL;
 
-  if(debug) printf("Entering TFCE::compute() hlist.size()=%d\n",(int)hlist.size());
+  if(debug) printf("Entering TFCE::computeRecluster() hlist.size()=%d\n",(int)hlist.size());
   if(hlist.size()==0){
-    printf("ERROR: TFCE::compute(): hlist has not been set up\n");
+    printf("ERROR: TFCE::computeRecluster(): hlist has not been set up\n");
     return(NULL);
   }
   
@@ -265,7 +430,7 @@ MRI *TFCE::compute(MRI *map)
   MRIcopyHeader(map, tfcemaps);
   MRIcopyPulseParameters(map, tfcemaps);
 
-  if(debug) printf("Entering TFCE::compute() hlist.size()=%d\n",(int)hlist.size());
+  if(debug) printf("Entering TFCE::computeRecluster() hlist.size()=%d\n",(int)hlist.size());
   // Cannot be parallized here because MapSurfClust is not thread safe
   for(int nthh=0; nthh < nh; nthh++){
     double h = hlist[nthh];
@@ -2036,6 +2036,7 @@ namespace Representations {
 		addProp(t_PMRI,						"mri_sras2vox",					"volume that the above matrix is for");
 		addProp(t_pVoid,					"mht")->setNoHash();
 		addProp(t_pVoid,					"temps")->setNoHash();
+		addProp(t_pVoid,					"incrementalMP",				"dirty vertex tracking for MRIScomputeMetricProperties")->setNoHash();
 
 			addPropList("LIST_OF_MRIS_ELTS");
 			addPropListSublist("LIST_OF_MRIS_ELTS_1");